@@ -0,0 +1,1484 @@
+#include "ExpressionArchive.h"
+#include "ExpressionCache.h"
+#include "ExpressionHolder.h"
+#include "ExpressionParser.h"
+#include "ExpressionProfile.h"
+#include "ExpressionStream.h"
+#include "JitExpression.h"
+#include "RuleFileLoader.h"
+#include "RuleGraph.h"
+#include "RuleSet.h"
+#include "StaticExpression.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+   Measures parsing and evaluation across a range of generated expressions, writing the results
+   as JSON so they can be compared between builds. Every expression and value comes from a seeded
+   generator, so two runs with the same seed measure exactly the same work.
+
+   Usage: ExpressionParserBenchmark [--seed <n>] [--quick] [--output <file>]
+
+   Benchmarks that can check their results against evaluating the expression directly record it
+   in "agrees", and the run exits with 1 if any of them disagree.
+*/
+
+namespace
+{
+   using Clock = std::chrono::steady_clock;
+
+   struct Options
+   {
+      uint32_t m_seed = 1;
+      bool m_quick = false;
+      std::string m_outputPath;
+   };
+
+   // The shape of the generated expressions.
+   struct ExpressionShape
+   {
+      int m_terms;
+      int m_depth;
+      double m_andRatio;
+   };
+
+   // Values are drawn from the same range as the comparison constants so every branch gets taken.
+   constexpr int ValueRange = 1000;
+
+   // Results are summed into here so the optimiser can't throw away the work being timed.
+   std::atomic<uint64_t> g_sink = 0;
+
+   class ExpressionGenerator
+   {
+   public:
+      explicit ExpressionGenerator(uint32_t seed)
+         : m_random(seed)
+         , m_fieldCount(0)
+      {}
+
+      // With a field count, every comparison reads one of the fields "f0", "f1"... picked at random.
+      std::string Generate(const ExpressionShape& shape, int fieldCount = 0)
+      {
+         m_fieldCount = fieldCount;
+         return GenerateGroup(shape.m_terms, shape.m_depth, shape.m_andRatio);
+      }
+
+      std::vector<int> GenerateValues(size_t count)
+      {
+         std::uniform_int_distribution<int> distribution(-ValueRange, ValueRange);
+         std::vector<int> values(count);
+         for (int& value : values)
+         {
+            value = distribution(m_random);
+         }
+         return values;
+      }
+
+      // Values bunched around a single point, the way real data rarely spreads evenly over a range.
+      std::vector<int> GenerateSkewedValues(size_t count)
+      {
+         std::normal_distribution<double> distribution(std::uniform_int_distribution<int>(-ValueRange, ValueRange)(m_random), ValueRange / 20.0);
+         std::vector<int> values(count);
+         for (int& value : values)
+         {
+            value = std::clamp((int)distribution(m_random), -ValueRange, ValueRange);
+         }
+         return values;
+      }
+
+      // A random walk taking steps of up to maxStep either way, the way a sensor reading drifts.
+      std::vector<int> GenerateWalkValues(size_t count, int maxStep)
+      {
+         std::uniform_int_distribution<int> step(-maxStep, maxStep);
+         std::vector<int> values(count);
+         int value = std::uniform_int_distribution<int>(-ValueRange, ValueRange)(m_random);
+         for (int& walked : values)
+         {
+            value = std::clamp(value + step(m_random), -ValueRange, ValueRange);
+            walked = value;
+         }
+         return values;
+      }
+
+      // Values drawn from a pool of distinctCount values, heavily skewed towards the start of the pool
+      // so a few values make up most of the stream, the way ids or status codes repeat.
+      std::vector<int> GenerateRepeatedValues(size_t count, size_t distinctCount)
+      {
+         const std::vector<int> pool = GenerateValues(distinctCount);
+         std::uniform_real_distribution<double> distribution(0.0, 1.0);
+         std::vector<int> values(count);
+         for (int& value : values)
+         {
+            const double position = distribution(m_random);
+            value = pool[std::min((size_t)(position * position * position * distinctCount), distinctCount - 1)];
+         }
+         return values;
+      }
+
+      // Distinct values in [-spread, spread], sorted.
+      std::vector<int> GenerateMembers(int count, int spread)
+      {
+         std::uniform_int_distribution<int> distribution(-spread, spread);
+         std::vector<int> members;
+         while ((int)members.size() < count)
+         {
+            members.push_back(distribution(m_random));
+            std::sort(members.begin(), members.end());
+            members.erase(std::unique(members.begin(), members.end()), members.end());
+         }
+         return members;
+      }
+
+      // Values in [-spread, spread] with about half of them picked from the members, so checking
+      // them against a set of those members passes often enough for both outcomes to matter.
+      std::vector<int> GenerateValuesAmong(const std::vector<int>& members, int spread, size_t count)
+      {
+         std::uniform_int_distribution<int> distribution(-spread, spread);
+         std::uniform_int_distribution<size_t> member(0, members.size() - 1);
+         std::vector<int> values(count);
+         for (size_t i = 0; i < count; ++i)
+         {
+            values[i] = i % 2 == 0 ? members[member(m_random)] : distribution(m_random);
+         }
+         return values;
+      }
+
+   private:
+      // A chain of terms, with one of them replaced by a braced group when there is depth left.
+      std::string GenerateGroup(int terms, int depth, double andRatio)
+      {
+         int bracedTerms = 0;
+         int bracedAt = -1;
+         if (depth > 0 && terms >= 2)
+         {
+            bracedTerms = std::uniform_int_distribution<int>(2, std::max(2, terms - 1))(m_random);
+            bracedTerms = std::min(bracedTerms, terms);
+         }
+
+         // The braced group takes the place of that many terms in the chain
+         const int chainLength = terms - std::max(bracedTerms - 1, 0);
+         if (bracedTerms > 0)
+         {
+            bracedAt = std::uniform_int_distribution<int>(0, chainLength - 1)(m_random);
+         }
+
+         std::string expression;
+         for (int i = 0; i < chainLength; ++i)
+         {
+            if (i > 0)
+            {
+               expression += std::bernoulli_distribution(andRatio)(m_random) ? " and " : " or ";
+            }
+            expression += i == bracedAt ? "(" + GenerateGroup(bracedTerms, depth - 1, andRatio) + ")" : GenerateComparison();
+         }
+         return expression;
+      }
+
+      std::string GenerateComparison()
+      {
+         static const char* const s_operators[] = { "<", "<=", "=", "!=", ">=", ">" };
+         const int operatorIndex = std::uniform_int_distribution<int>(0, 5)(m_random);
+         const int value = std::uniform_int_distribution<int>(-ValueRange, ValueRange)(m_random);
+         const std::string comparison = s_operators[operatorIndex] + std::to_string(value);
+         if (m_fieldCount == 0)
+         {
+            return comparison;
+         }
+         return "f" + std::to_string(std::uniform_int_distribution<int>(0, m_fieldCount - 1)(m_random)) + comparison;
+      }
+
+   private:
+      std::mt19937 m_random;
+      int m_fieldCount;
+   };
+
+   // Run the function until at least the minimum time has passed, returning nanoseconds per call.
+   // The function does count operations per call.
+   template <typename Function>
+   double Measure(double minimumSeconds, size_t operationsPerCall, Function&& function)
+   {
+      size_t calls = 0;
+      const Clock::time_point start = Clock::now();
+      Clock::duration elapsed;
+      do
+      {
+         function();
+         ++calls;
+         elapsed = Clock::now() - start;
+      } while (std::chrono::duration<double>(elapsed).count() < minimumSeconds);
+
+      return std::chrono::duration<double, std::nano>(elapsed).count() / (double)(calls * operationsPerCall);
+   }
+
+   class JsonWriter
+   {
+   public:
+      void BeginResult(const std::string& benchmark)
+      {
+         m_stream << (m_resultCount++ > 0 ? ",\n" : "\n") << "    { \"benchmark\": \"" << benchmark << "\"";
+      }
+
+      void Field(const char* pName, double value) { m_stream << ", \"" << pName << "\": " << value; }
+      void Field(const char* pName, const std::string& value) { m_stream << ", \"" << pName << "\": \"" << value << "\""; }
+
+      // Record whether a benchmark's results matched evaluating the expression directly. Any that
+      // didn't fail the whole run once every benchmark has finished.
+      void Agrees(bool isAgreeing)
+      {
+         Field("agrees", isAgreeing ? 1 : 0);
+         m_isAgreeing = m_isAgreeing && isAgreeing;
+      }
+
+      bool IsAgreeing() const { return m_isAgreeing; }
+
+      void Shape(const ExpressionShape& shape)
+      {
+         Field("terms", shape.m_terms);
+         Field("depth", shape.m_depth);
+         Field("andRatio", shape.m_andRatio);
+      }
+
+      void EndResult() { m_stream << " }"; }
+
+      std::string Finish(uint32_t seed) const
+      {
+         std::ostringstream document;
+         document << "{\n  \"seed\": " << seed << ",\n  \"hardwareThreads\": " << std::thread::hardware_concurrency()
+                  << ",\n  \"results\": [" << m_stream.str() << "\n  ]\n}\n";
+         return document.str();
+      }
+
+   private:
+      std::ostringstream m_stream;
+      size_t m_resultCount = 0;
+      bool m_isAgreeing = true;
+   };
+
+   // Parse a pool of expressions of the same shape, clearing the parser between each.
+   void BenchmarkParse(JsonWriter& json, ExpressionGenerator& generator, const ExpressionShape& shape, double minimumSeconds)
+   {
+      std::vector<std::string> expressions;
+      for (int i = 0; i < 64; ++i)
+      {
+         expressions.push_back(generator.Generate(shape));
+      }
+
+      ExpressionParser parser;
+      size_t allocations = 0;
+      size_t parses = 0;
+      const double nsPerParse = Measure(minimumSeconds, expressions.size(), [&]()
+      {
+         for (const std::string& expression : expressions)
+         {
+            parser.Clear();
+            parser.Parse(expression);
+            allocations += parser.GetParseAllocationCount();
+            ++parses;
+         }
+      });
+
+      json.BeginResult("parse");
+      json.Shape(shape);
+      json.Field("nsPerParse", nsPerParse);
+      json.Field("allocationsPerParse", (double)allocations / (double)parses);
+      json.EndResult();
+   }
+
+   // Evaluate single values in each mode, along with whole spans of values at once.
+   void BenchmarkEvaluate(JsonWriter& json, ExpressionGenerator& generator, const ExpressionShape& shape, double minimumSeconds)
+   {
+      ExpressionParser parser;
+      if (parser.Parse(generator.Generate(shape)) != ExpressionParser::ParseResult::OK)
+      {
+         std::cerr << "Generated expression failed to parse: " << parser.GetErrorMessage() << std::endl;
+         return;
+      }
+
+      const std::vector<int> values = generator.GenerateValues(4096);
+      auto evaluateSingle = [&](const char* pMode)
+      {
+         const CompiledExpression& expression = parser.GetCompiledExpression();
+         const double nsPerEvaluate = Measure(minimumSeconds, values.size(), [&]()
+         {
+            uint64_t passed = 0;
+            for (int value : values)
+            {
+               passed += expression.Evaluate(value);
+            }
+            g_sink += passed;
+         });
+
+         json.BeginResult("evaluate");
+         json.Shape(shape);
+         json.Field("mode", std::string(pMode));
+         json.Field("intervals", (double)expression.GetIntervals().size());
+         json.Field("nsPerEvaluate", nsPerEvaluate);
+         json.EndResult();
+      };
+
+      evaluateSingle("program");
+      parser.SetEvaluationMode(ExpressionParser::EvaluationMode::Intervals);
+      evaluateSingle("intervals");
+      parser.SetDomain(-ValueRange, ValueRange);
+      evaluateSingle("domain");
+      parser.ClearDomain();
+      parser.SetEvaluationMode(ExpressionParser::EvaluationMode::Program);
+
+      ExpressionProfile profile(parser.GetCompiledExpression());
+      const double nsPerProfiledEvaluate = Measure(minimumSeconds, values.size(), [&]()
+      {
+         uint64_t passed = 0;
+         for (int value : values)
+         {
+            passed += parser.GetCompiledExpression().Evaluate(value, profile);
+         }
+         g_sink += passed;
+      });
+
+      json.BeginResult("evaluateProfiled");
+      json.Shape(shape);
+      json.Field("nsPerEvaluate", nsPerProfiledEvaluate);
+      json.EndResult();
+
+      std::vector<uint8_t> results(values.size());
+      const double nsPerValue = Measure(minimumSeconds, values.size(), [&]()
+      {
+         parser.Evaluate(values, results);
+         g_sink += results[0];
+      });
+
+      json.BeginResult("evaluateBatch");
+      json.Shape(shape);
+      json.Field("nsPerValue", nsPerValue);
+      json.EndResult();
+   }
+
+   // Evaluate skewed values before and after reordering the expression on a sample of them.
+   void BenchmarkOptimize(JsonWriter& json, ExpressionGenerator& generator, const ExpressionShape& shape, double minimumSeconds)
+   {
+      ExpressionParser parser;
+      if (parser.Parse(generator.Generate(shape)) != ExpressionParser::ParseResult::OK)
+      {
+         std::cerr << "Generated expression failed to parse: " << parser.GetErrorMessage() << std::endl;
+         return;
+      }
+
+      const std::vector<int> values = generator.GenerateSkewedValues(4096);
+      auto evaluate = [&]()
+      {
+         return Measure(minimumSeconds, values.size(), [&]()
+         {
+            uint64_t passed = 0;
+            for (int value : values)
+            {
+               passed += parser.Evaluate(value);
+            }
+            g_sink += passed;
+         });
+      };
+
+      const double nsBefore = evaluate();
+      parser.Optimize(std::span<const int>(values).first(256));
+      const double nsAfter = evaluate();
+
+      json.BeginResult("optimize");
+      json.Shape(shape);
+      json.Field("nsPerEvaluateBefore", nsBefore);
+      json.Field("nsPerEvaluateAfter", nsAfter);
+      json.EndResult();
+   }
+
+   // Simplify a pool of expressions, counting the comparisons removed and checking every value still
+   // gets the same result, then evaluate one of them before and after.
+   void BenchmarkSimplify(JsonWriter& json, ExpressionGenerator& generator, const ExpressionShape& shape, double minimumSeconds)
+   {
+      std::vector<std::string> expressions;
+      for (int i = 0; i < 64; ++i)
+      {
+         expressions.push_back(generator.Generate(shape));
+      }
+
+      const std::vector<int> values = generator.GenerateValues(4096);
+      ExpressionParser parser;
+      ExpressionParser simplified;
+      size_t instructionsBefore = 0;
+      size_t instructionsAfter = 0;
+      bool isAgreeing = true;
+      for (const std::string& expression : expressions)
+      {
+         parser.Clear();
+         simplified.Clear();
+         if (parser.Parse(expression) != ExpressionParser::ParseResult::OK || simplified.Parse(expression) != ExpressionParser::ParseResult::OK)
+         {
+            std::cerr << "Generated expression failed to parse: " << parser.GetErrorMessage() << std::endl;
+            return;
+         }
+
+         simplified.Simplify();
+         instructionsBefore += parser.GetCompiledExpression().GetInstructions().size();
+         instructionsAfter += simplified.GetCompiledExpression().GetInstructions().size();
+         for (int value : values)
+         {
+            isAgreeing = isAgreeing && parser.Evaluate(value) == simplified.Evaluate(value);
+         }
+      }
+      if (isAgreeing == false)
+      {
+         std::cerr << "Simplified results differ from Evaluate" << std::endl;
+      }
+
+      const double nsPerSimplify = Measure(minimumSeconds, expressions.size(), [&]()
+      {
+         for (const std::string& expression : expressions)
+         {
+            simplified.Clear();
+            simplified.Parse(expression);
+            simplified.Simplify();
+         }
+      });
+
+      auto measureEach = [&](const ExpressionParser& expression)
+      {
+         return Measure(minimumSeconds, values.size(), [&]()
+         {
+            uint64_t passed = 0;
+            for (int value : values)
+            {
+               passed += expression.Evaluate(value);
+            }
+            g_sink += passed;
+         });
+      };
+
+      json.BeginResult("simplify");
+      json.Shape(shape);
+      json.Agrees(isAgreeing);
+      json.Field("instructionsBefore", (double)instructionsBefore / (double)expressions.size());
+      json.Field("instructionsAfter", (double)instructionsAfter / (double)expressions.size());
+      json.Field("nsPerParseAndSimplify", nsPerSimplify);
+      json.Field("nsPerEvaluateBefore", measureEach(parser));
+      json.Field("nsPerEvaluateAfter", measureEach(simplified));
+      json.EndResult();
+   }
+
+   // The expression compiled to native code against the parser evaluating it, checking the two
+   // agree on every value along the way.
+   void BenchmarkJit(JsonWriter& json, ExpressionGenerator& generator, const ExpressionShape& shape, double minimumSeconds)
+   {
+      ExpressionParser parser;
+      if (parser.Parse(generator.Generate(shape)) != ExpressionParser::ParseResult::OK)
+      {
+         std::cerr << "Generated expression failed to parse: " << parser.GetErrorMessage() << std::endl;
+         return;
+      }
+
+      const JitExpression jit(parser.GetCompiledExpression());
+      const std::vector<int> values = generator.GenerateValues(4096);
+      std::vector<uint8_t> results(values.size());
+      std::vector<uint8_t> jitResults(values.size());
+      parser.Evaluate(values, results);
+      jit.Evaluate(values, jitResults);
+
+      bool isAgreeing = results == jitResults;
+      for (size_t i = 0; i < values.size(); ++i)
+      {
+         isAgreeing = isAgreeing && jit.Evaluate(values[i]) == (results[i] != 0);
+      }
+      if (isAgreeing == false)
+      {
+         std::cerr << "JIT results differ from Evaluate" << std::endl;
+      }
+
+      auto measureEach = [&](const auto& expression)
+      {
+         return Measure(minimumSeconds, values.size(), [&]()
+         {
+            uint64_t passed = 0;
+            for (int value : values)
+            {
+               passed += expression.Evaluate(value);
+            }
+            g_sink += passed;
+         });
+      };
+
+      auto measureBatch = [&](const auto& expression)
+      {
+         return Measure(minimumSeconds, values.size(), [&]()
+         {
+            expression.Evaluate(values, results);
+            g_sink += results[0];
+         });
+      };
+
+      json.BeginResult("jit");
+      json.Shape(shape);
+      json.Field("native", jit.IsNative() ? 1 : 0);
+      json.Agrees(isAgreeing);
+      json.Field("codeBytes", (double)jit.GetCodeSize());
+      json.Field("nsPerEvaluate", measureEach(parser));
+      json.Field("nsPerJitEvaluate", measureEach(jit));
+      json.Field("nsPerBatchValue", measureBatch(parser));
+      json.Field("nsPerJitBatchValue", measureBatch(jit));
+      json.EndResult();
+   }
+
+   // Evaluate the same expression and values through a parser of each value type.
+   template <typename Parser>
+   void BenchmarkValueType(JsonWriter& json, const char* pTypeName, const std::string& expression, const std::vector<int>& intValues, double minimumSeconds)
+   {
+      using T = typename Parser::ValueType;
+
+      Parser parser;
+      if (parser.Parse(expression) != ExpressionParser::ParseResult::OK)
+      {
+         std::cerr << "Generated expression failed to parse: " << parser.GetErrorMessage() << std::endl;
+         return;
+      }
+
+      const std::vector<T> values(intValues.begin(), intValues.end());
+      const double nsPerEvaluate = Measure(minimumSeconds, values.size(), [&]()
+      {
+         uint64_t passed = 0;
+         for (T value : values)
+         {
+            passed += parser.Evaluate(value);
+         }
+         g_sink += passed;
+      });
+
+      std::vector<uint8_t> results(values.size());
+      const double nsPerValue = Measure(minimumSeconds, values.size(), [&]()
+      {
+         parser.Evaluate(values, results);
+         g_sink += results[0];
+      });
+
+      json.BeginResult("valueType");
+      json.Field("type", std::string(pTypeName));
+      json.Field("nsPerEvaluate", nsPerEvaluate);
+      json.Field("nsPerBatchValue", nsPerValue);
+      json.EndResult();
+   }
+
+   void BenchmarkValueTypes(JsonWriter& json, ExpressionGenerator& generator, const ExpressionShape& shape, double minimumSeconds)
+   {
+      const std::string expression = generator.Generate(shape);
+      const std::vector<int> values = generator.GenerateValues(4096);
+      BenchmarkValueType<ExpressionParser>(json, "int32", expression, values, minimumSeconds);
+      BenchmarkValueType<Int64ExpressionParser>(json, "int64", expression, values, minimumSeconds);
+      BenchmarkValueType<FloatExpressionParser>(json, "float", expression, values, minimumSeconds);
+      BenchmarkValueType<DoubleExpressionParser>(json, "double", expression, values, minimumSeconds);
+   }
+
+   // Evaluate one shared compiled expression from an increasing number of threads. Nothing
+   // mutable is shared, so throughput should scale with the thread count up to the core count.
+   void BenchmarkThreadScaling(JsonWriter& json, ExpressionGenerator& generator, const ExpressionShape& shape, double minimumSeconds)
+   {
+      ExpressionParser parser;
+      parser.Parse(generator.Generate(shape));
+      const CompiledExpression& expression = parser.GetCompiledExpression();
+      const std::vector<int> values = generator.GenerateValues(4096);
+
+      const unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+      double singleThreadRate = 0.0;
+      for (unsigned threadCount = 1; ; threadCount = std::min(threadCount * 2, maxThreads))
+      {
+         std::atomic<bool> start = false;
+         std::atomic<uint64_t> evaluations = 0;
+         std::vector<std::thread> threads;
+         for (unsigned i = 0; i < threadCount; ++i)
+         {
+            threads.emplace_back([&]()
+            {
+               while (start == false) {}
+
+               uint64_t passed = 0;
+               uint64_t evaluated = 0;
+               const Clock::time_point threadStart = Clock::now();
+               while (std::chrono::duration<double>(Clock::now() - threadStart).count() < minimumSeconds)
+               {
+                  for (int value : values)
+                  {
+                     passed += expression.Evaluate(value);
+                  }
+                  evaluated += values.size();
+               }
+               evaluations += evaluated;
+               g_sink += passed;
+            });
+         }
+
+         const Clock::time_point begin = Clock::now();
+         start = true;
+         for (std::thread& thread : threads)
+         {
+            thread.join();
+         }
+         const double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+         const double rate = (double)evaluations / seconds;
+         if (threadCount == 1)
+         {
+            singleThreadRate = rate;
+         }
+
+         json.BeginResult("threadScaling");
+         json.Shape(shape);
+         json.Field("threads", threadCount);
+         json.Field("evaluationsPerSecond", rate);
+         json.Field("speedup", rate / singleThreadRate);
+         json.EndResult();
+
+         if (threadCount == maxThreads)
+         {
+            break;
+         }
+      }
+   }
+
+   // Match values against many rules with the RuleSet index, compared to evaluating every rule.
+   void BenchmarkRuleSet(JsonWriter& json, ExpressionGenerator& generator, int ruleCount, double minimumSeconds)
+   {
+      const ExpressionShape shape = { 4, 1, 0.5 };
+      std::vector<CompiledExpression> rules;
+      RuleSet ruleSet;
+      for (int i = 0; i < ruleCount; ++i)
+      {
+         ExpressionParser parser;
+         parser.Parse(generator.Generate(shape));
+         rules.push_back(parser.GetCompiledExpression());
+         ruleSet.Add((RuleSet::RuleId)i, rules.back());
+      }
+      ruleSet.Build();
+
+      const std::vector<int> values = generator.GenerateValues(1024);
+      std::vector<RuleSet::RuleId> matches;
+      const double nsPerMatch = Measure(minimumSeconds, values.size(), [&]()
+      {
+         for (int value : values)
+         {
+            g_sink += ruleSet.Match(value, matches);
+         }
+      });
+
+      const double nsPerEvaluateAll = Measure(minimumSeconds, values.size(), [&]()
+      {
+         for (int value : values)
+         {
+            matches.clear();
+            for (size_t i = 0; i < rules.size(); ++i)
+            {
+               if (rules[i].Evaluate(value))
+               {
+                  matches.push_back((RuleSet::RuleId)i);
+               }
+            }
+            g_sink += matches.size();
+         }
+      });
+
+      json.BeginResult("ruleSet");
+      json.Shape(shape);
+      json.Field("rules", ruleCount);
+      json.Field("nsPerMatch", nsPerMatch);
+      json.Field("nsPerEvaluateAll", nsPerEvaluateAll);
+      json.EndResult();
+   }
+
+   // Rules built from a small pool of braced guards and a larger pool of bodies, so sub-expressions
+   // are shared the way they are across real rule sets. Every rule is evaluated over a batch of values
+   // through the graph, against evaluating each rule's compiled expression on its own.
+   void BenchmarkRuleGraph(JsonWriter& json, ExpressionGenerator& generator, int ruleCount, double minimumSeconds)
+   {
+      const ExpressionShape shape = { 4, 1, 0.5 };
+      std::vector<std::string> guards;
+      for (int i = 0; i < 16; ++i)
+      {
+         guards.push_back("(" + generator.Generate(shape) + ")");
+      }
+      std::vector<std::string> bodies;
+      for (int i = 0; i < std::max(ruleCount / 4, 1); ++i)
+      {
+         bodies.push_back("(" + generator.Generate(shape) + ")");
+      }
+
+      RuleGraph graph;
+      std::vector<CompiledExpression> rules;
+      for (int i = 0; i < ruleCount; ++i)
+      {
+         const std::string rule = guards[(size_t)i % guards.size()] + (i % 3 == 0 ? " or " : " and ") + bodies[(size_t)i * 7 % bodies.size()];
+         ExpressionParser parser;
+         if (parser.Parse(rule) != ExpressionParser::ParseResult::OK || graph.Add((RuleGraph::RuleId)i, rule) != ExpressionParser::ParseResult::OK)
+         {
+            std::cerr << "Generated expression failed to parse: " << parser.GetErrorMessage() << std::endl;
+            return;
+         }
+         rules.push_back(parser.GetCompiledExpression());
+      }
+
+      const std::vector<int> values = generator.GenerateValues(1024);
+      std::vector<uint8_t> graphResults(values.size() * rules.size());
+      std::vector<uint8_t> results(values.size() * rules.size());
+      auto evaluateEach = [&]()
+      {
+         for (size_t i = 0; i < rules.size(); ++i)
+         {
+            rules[i].Evaluate(values, std::span<uint8_t>(results).subspan(i * values.size(), values.size()));
+         }
+      };
+
+      graph.Evaluate(values, graphResults);
+      evaluateEach();
+      const bool isAgreeing = graphResults == results;
+      if (isAgreeing == false)
+      {
+         std::cerr << "Rule graph results differ from Evaluate" << std::endl;
+      }
+
+      const double nsPerGraphValue = Measure(minimumSeconds, values.size(), [&]()
+      {
+         graph.Evaluate(values, graphResults);
+         g_sink += graphResults[0];
+      });
+
+      const double nsPerEachValue = Measure(minimumSeconds, values.size(), [&]()
+      {
+         evaluateEach();
+         g_sink += results[0];
+      });
+
+      json.BeginResult("ruleGraph");
+      json.Field("rules", ruleCount);
+      json.Agrees(isAgreeing);
+      json.Field("nodes", (double)graph.GetNodeCount());
+      json.Field("unsharedNodes", (double)graph.GetUnsharedNodeCount());
+      json.Field("nsPerValue", nsPerGraphValue);
+      json.Field("nsPerValueEachRule", nsPerEachValue);
+      json.EndResult();
+   }
+
+   // Starting up from rule strings, parsing each one and building a rule set, against starting up
+   // from the same rules written to an archive, which only has to be mapped and validated.
+   void BenchmarkArchive(JsonWriter& json, ExpressionGenerator& generator, int ruleCount, double minimumSeconds)
+   {
+      const ExpressionShape shape = { 4, 1, 0.5 };
+      std::vector<std::string> rules;
+      for (int i = 0; i < ruleCount; ++i)
+      {
+         rules.push_back(generator.Generate(shape));
+      }
+
+      const double nsPerParsedRule = Measure(minimumSeconds, rules.size(), [&]()
+      {
+         RuleSet ruleSet;
+         ExpressionParser parser;
+         for (size_t i = 0; i < rules.size(); ++i)
+         {
+            parser.Clear();
+            parser.Parse(rules[i]);
+            ruleSet.Add((RuleSet::RuleId)i, parser.GetCompiledExpression());
+         }
+         ruleSet.Build();
+         g_sink += ruleSet.GetRuleCount();
+      });
+
+      ExpressionArchiveWriter writer;
+      for (size_t i = 0; i < rules.size(); ++i)
+      {
+         writer.Add((RuleSet::RuleId)i, rules[i]);
+      }
+      const std::string path = (std::filesystem::temp_directory_path() / "ExpressionParserBenchmark.expa").string();
+      if (writer.WriteToFile(path) == false)
+      {
+         std::cerr << "Failed to write the archive to " << path << std::endl;
+         return;
+      }
+
+      auto measureLoad = [&](bool verifyChecksum)
+      {
+         return Measure(minimumSeconds, rules.size(), [&]()
+         {
+            ExpressionArchive archive;
+            archive.Load(path, verifyChecksum);
+            g_sink += archive.GetRuleCount();
+         });
+      };
+      const double nsPerLoadedRule = measureLoad(true);
+      const double nsPerUncheckedRule = measureLoad(false);
+
+      ExpressionArchive archive;
+      const ExpressionArchive::LoadResult result = archive.Load(path);
+      if (result != ExpressionArchive::LoadResult::OK)
+      {
+         std::cerr << "Failed to load the archive: " << ExpressionArchive::GetLoadResultMessage(result) << std::endl;
+         return;
+      }
+
+      const std::vector<int> values = generator.GenerateValues(1024);
+      std::vector<RuleSet::RuleId> matches;
+      const double nsPerMatch = Measure(minimumSeconds, values.size(), [&]()
+      {
+         for (int value : values)
+         {
+            g_sink += archive.Match(value, matches);
+         }
+      });
+
+      json.BeginResult("archive");
+      json.Shape(shape);
+      json.Field("rules", ruleCount);
+      json.Field("archiveBytes", (double)std::filesystem::file_size(path));
+      json.Field("nsPerParsedRule", nsPerParsedRule);
+      json.Field("nsPerLoadedRule", nsPerLoadedRule);
+      json.Field("nsPerUncheckedRule", nsPerUncheckedRule);
+      json.Field("nsPerMatch", nsPerMatch);
+      json.EndResult();
+
+      archive.Close();
+      std::filesystem::remove(path);
+   }
+
+   // Loading a file of rules, one per line, with an increasing number of threads parsing them.
+   void BenchmarkBulkLoad(JsonWriter& json, ExpressionGenerator& generator, int ruleCount, double minimumSeconds)
+   {
+      const ExpressionShape shape = { 4, 1, 0.5 };
+      const std::string path = (std::filesystem::temp_directory_path() / "ExpressionParserBenchmark.rules").string();
+      {
+         std::ofstream file(path, std::ios::binary | std::ios::trunc);
+         for (int i = 0; i < ruleCount; ++i)
+         {
+            file << generator.Generate(shape) << '\n';
+         }
+      }
+
+      const unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+      for (unsigned threadCount = 1; ; threadCount = std::min(threadCount * 2, maxThreads))
+      {
+         RuleFileLoader loader(threadCount);
+         const double nsPerRule = Measure(minimumSeconds, (size_t)ruleCount, [&]()
+         {
+            loader.LoadFile(path);
+            g_sink += loader.GetRuleSet().GetRuleCount();
+         });
+
+         json.BeginResult("bulkLoad");
+         json.Shape(shape);
+         json.Field("rules", ruleCount);
+         json.Field("threads", threadCount);
+         json.Field("nsPerRule", nsPerRule);
+         json.EndResult();
+
+         if (threadCount == maxThreads)
+         {
+            break;
+         }
+      }
+
+      std::filesystem::remove(path);
+   }
+
+   // A literal compiled at compile time against the same literal parsed at runtime.
+   void BenchmarkStatic(JsonWriter& json, ExpressionGenerator& generator, double minimumSeconds)
+   {
+      static constexpr const char s_expression[] = ">10 and (<50 or >100) and !=75 or =-5";
+      constexpr auto staticExpression = ExpressionParser::Compile(s_expression);
+
+      ExpressionParser parser;
+      parser.Parse(s_expression);
+      const std::vector<int> values = generator.GenerateValues(4096);
+
+      const double nsPerStatic = Measure(minimumSeconds, values.size(), [&]()
+      {
+         uint64_t passed = 0;
+         for (int value : values)
+         {
+            passed += staticExpression.Evaluate(value);
+         }
+         g_sink += passed;
+      });
+
+      const double nsPerParsed = Measure(minimumSeconds, values.size(), [&]()
+      {
+         uint64_t passed = 0;
+         for (int value : values)
+         {
+            passed += parser.Evaluate(value);
+         }
+         g_sink += passed;
+      });
+
+      json.BeginResult("staticExpression");
+      json.Field("expression", std::string(s_expression));
+      json.Field("nsPerStaticEvaluate", nsPerStatic);
+      json.Field("nsPerParsedEvaluate", nsPerParsed);
+      json.EndResult();
+   }
+
+   // A multi-field expression over rows stored as columns, evaluated a row at a time against filtering
+   // whole columns into a selection bitmap.
+   void BenchmarkColumns(JsonWriter& json, ExpressionGenerator& generator, const ExpressionShape& shape, int fieldCount, double minimumSeconds)
+   {
+      ExpressionParser parser;
+      for (int field = 0; field < fieldCount; ++field)
+      {
+         parser.BindField("f" + std::to_string(field), (uint16_t)field);
+      }
+      if (parser.Parse(generator.Generate(shape, fieldCount)) != ExpressionParser::ParseResult::OK)
+      {
+         std::cerr << "Generated expression failed to parse: " << parser.GetErrorMessage() << std::endl;
+         return;
+      }
+
+      constexpr size_t RowCount = 65536;
+      std::vector<std::vector<int>> columnValues;
+      std::vector<std::span<const int>> columns;
+      for (int field = 0; field < fieldCount; ++field)
+      {
+         columnValues.push_back(generator.GenerateValues(RowCount));
+      }
+      for (const std::vector<int>& values : columnValues)
+      {
+         columns.push_back(values);
+      }
+
+      std::vector<int> row(fieldCount);
+      const double nsPerRow = Measure(minimumSeconds, RowCount, [&]()
+      {
+         uint64_t passed = 0;
+         for (size_t i = 0; i < RowCount; ++i)
+         {
+            for (int field = 0; field < fieldCount; ++field)
+            {
+               row[field] = columnValues[field][i];
+            }
+            passed += parser.EvaluateRow(row);
+         }
+         g_sink += passed;
+      });
+
+      std::vector<uint64_t> selection(RowCount / 64);
+      const double nsPerColumnRow = Measure(minimumSeconds, RowCount, [&]()
+      {
+         parser.Evaluate(columns, selection);
+         g_sink += selection[0];
+      });
+
+      uint64_t selected = 0;
+      for (uint64_t word : selection)
+      {
+         selected += std::popcount(word);
+      }
+
+      json.BeginResult("columns");
+      json.Shape(shape);
+      json.Field("fields", fieldCount);
+      json.Field("selectivity", (double)selected / RowCount);
+      json.Field("nsPerRowEvaluate", nsPerRow);
+      json.Field("nsPerColumnarRow", nsPerColumnRow);
+      json.EndResult();
+   }
+
+   // A drifting stream of values fed through an ExpressionStream, which only looks at the expression
+   // when a value leaves the run giving the current result, against evaluating every value and
+   // comparing it with the last result.
+   void BenchmarkStream(JsonWriter& json, ExpressionGenerator& generator, const ExpressionShape& shape, int maxStep, double minimumSeconds)
+   {
+      ExpressionParser parser;
+      if (parser.Parse(generator.Generate(shape)) != ExpressionParser::ParseResult::OK)
+      {
+         std::cerr << "Generated expression failed to parse: " << parser.GetErrorMessage() << std::endl;
+         return;
+      }
+
+      const std::vector<int> values = generator.GenerateWalkValues(65536, maxStep);
+      ExpressionStream stream(parser.GetCompiledExpression());
+      std::vector<ExpressionStream::Transition> transitions;
+
+      // Replay the transitions against evaluating every value
+      stream.Update(values, transitions);
+      const uint64_t lookups = stream.GetLookupCount();
+      bool isAgreeing = true;
+      size_t transition = 0;
+      bool passes = false;
+      for (size_t i = 0; i < values.size(); ++i)
+      {
+         if (transition < transitions.size() && transitions[transition].m_sample == i)
+         {
+            passes = transitions[transition++].m_passes;
+         }
+         isAgreeing = isAgreeing && passes == parser.Evaluate(values[i]);
+      }
+      if (isAgreeing == false || transition != transitions.size())
+      {
+         isAgreeing = false;
+         std::cerr << "Stream transitions differ from Evaluate" << std::endl;
+      }
+
+      const double nsPerStream = Measure(minimumSeconds, values.size(), [&]()
+      {
+         stream.Reset();
+         transitions.clear();
+         g_sink += stream.Update(values, transitions);
+      });
+
+      const double nsPerEvaluate = Measure(minimumSeconds, values.size(), [&]()
+      {
+         uint64_t changes = 0;
+         bool last = false;
+         for (size_t i = 0; i < values.size(); ++i)
+         {
+            const bool result = parser.Evaluate(values[i]);
+            changes += i == 0 || result != last;
+            last = result;
+         }
+         g_sink += changes;
+      });
+
+      json.BeginResult("stream");
+      json.Shape(shape);
+      json.Field("maxStep", maxStep);
+      json.Agrees(isAgreeing);
+      json.Field("transitionRate", (double)transitions.size() / values.size());
+      json.Field("lookupRate", (double)lookups / values.size());
+      json.Field("nsPerStreamSample", nsPerStream);
+      json.Field("nsPerEvaluateSample", nsPerEvaluate);
+      json.EndResult();
+   }
+
+   // Skewed values evaluated through a direct mapped cache against evaluating every one of them. The
+   // cache is also checked to follow the parser on to a different expression.
+   void BenchmarkCache(JsonWriter& json, ExpressionGenerator& generator, const ExpressionShape& shape, size_t distinctCount, size_t entryCount, double minimumSeconds)
+   {
+      ExpressionParser parser;
+      if (parser.Parse(generator.Generate(shape)) != ExpressionParser::ParseResult::OK)
+      {
+         std::cerr << "Generated expression failed to parse: " << parser.GetErrorMessage() << std::endl;
+         return;
+      }
+
+      const std::vector<int> values = generator.GenerateRepeatedValues(65536, distinctCount);
+      ExpressionCache cache(parser.GetCompiledExpression(), entryCount);
+
+      auto agrees = [&]()
+      {
+         bool isAgreeing = true;
+         for (const int value : values)
+         {
+            isAgreeing = isAgreeing && cache.Evaluate(value) == parser.Evaluate(value);
+         }
+         return isAgreeing;
+      };
+
+      bool isAgreeing = agrees();
+      if (parser.Parse(generator.Generate(shape)) == ExpressionParser::ParseResult::OK)
+      {
+         isAgreeing = isAgreeing && agrees();
+      }
+      if (isAgreeing == false)
+      {
+         std::cerr << "Cached results differ from Evaluate" << std::endl;
+      }
+
+      cache.Clear();
+      cache.ResetCounters();
+      for (const int value : values)
+      {
+         g_sink += cache.Evaluate(value);
+      }
+      const double hitRate = (double)cache.GetHitCount() / values.size();
+
+      const double nsPerCached = Measure(minimumSeconds, values.size(), [&]()
+      {
+         uint64_t passed = 0;
+         for (const int value : values)
+         {
+            passed += cache.Evaluate(value);
+         }
+         g_sink += passed;
+      });
+
+      const double nsPerEvaluate = Measure(minimumSeconds, values.size(), [&]()
+      {
+         uint64_t passed = 0;
+         for (const int value : values)
+         {
+            passed += parser.Evaluate(value);
+         }
+         g_sink += passed;
+      });
+
+      json.BeginResult("cache");
+      json.Shape(shape);
+      json.Field("distinctValues", distinctCount);
+      json.Field("entries", cache.GetEntryCount());
+      json.Agrees(isAgreeing);
+      json.Field("hitRate", hitRate);
+      json.Field("nsPerCachedValue", nsPerCached);
+      json.Field("nsPerEvaluateValue", nsPerEvaluate);
+      json.EndResult();
+   }
+
+   // Evaluating through a holder's reader against evaluating the parser's expression directly, with
+   // the rule left alone and while another thread reloads it every millisecond. Every batch must
+   // match one of the two versions being swapped between as a whole, never a mix of them.
+   void BenchmarkHolder(JsonWriter& json, ExpressionGenerator& generator, const ExpressionShape& shape, double minimumSeconds)
+   {
+      const std::string expressions[2] = { generator.Generate(shape), generator.Generate(shape) };
+      ExpressionParser parsers[2];
+      ExpressionHolder holder;
+      for (int i = 0; i < 2; ++i)
+      {
+         if (parsers[i].Parse(expressions[i]) != ExpressionParser::ParseResult::OK)
+         {
+            std::cerr << "Generated expression failed to parse: " << parsers[i].GetErrorMessage() << std::endl;
+            return;
+         }
+      }
+      holder.Publish(expressions[0]);
+      std::optional<ExpressionHolder::Reader> reader = holder.CreateReader();
+
+      const std::vector<int> values = generator.GenerateValues(4096);
+      std::vector<uint8_t> expected[2] = { std::vector<uint8_t>(values.size()), std::vector<uint8_t>(values.size()) };
+      parsers[0].Evaluate(values, expected[0]);
+      parsers[1].Evaluate(values, expected[1]);
+
+      auto evaluateEach = [&](auto&& evaluate)
+      {
+         uint64_t passed = 0;
+         for (const int value : values)
+         {
+            passed += evaluate(value);
+         }
+         g_sink += passed;
+      };
+
+      const double nsPerDirect = Measure(minimumSeconds, values.size(), [&]()
+      {
+         evaluateEach([&parsers](int value) { return parsers[0].Evaluate(value); });
+      });
+
+      const double nsPerReader = Measure(minimumSeconds, values.size(), [&]()
+      {
+         evaluateEach([&reader](int value) { return reader->Evaluate(value); });
+      });
+
+      std::atomic<bool> isReloading = true;
+      uint64_t reloads = 0;
+      std::thread reloader([&]()
+      {
+         while (isReloading)
+         {
+            holder.Publish(expressions[++reloads % 2]);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         }
+      });
+
+      const double nsPerReloading = Measure(minimumSeconds, values.size(), [&]()
+      {
+         evaluateEach([&reader](int value) { return reader->Evaluate(value); });
+      });
+
+      bool isAgreeing = true;
+      std::vector<uint8_t> results(values.size());
+      for (int i = 0; i < 64; ++i)
+      {
+         reader->Evaluate(values, results);
+         isAgreeing = isAgreeing && (results == expected[0] || results == expected[1]);
+      }
+
+      isReloading = false;
+      reloader.join();
+      if (isAgreeing == false)
+      {
+         std::cerr << "Holder results match neither published expression" << std::endl;
+      }
+
+      json.BeginResult("holder");
+      json.Shape(shape);
+      json.Agrees(isAgreeing);
+      json.Field("reloads", (double)reloads);
+      json.Field("nsPerDirectValue", nsPerDirect);
+      json.Field("nsPerReaderValue", nsPerReader);
+      json.Field("nsPerReloadingValue", nsPerReloading);
+      json.EndResult();
+   }
+
+   // Sorted values swept into runs of the same result against evaluating them as a batch, along with
+   // unsorted values evaluated by sorting them first. Random chains of comparisons mostly collapse
+   // to a single interval, so the expression is an "in{...}" of short ranges spread out enough to
+   // keep rangeCount intervals, with about half the values landing in one. The number of runs then
+   // grows with the number of boundaries, up to the number of values.
+   void BenchmarkSorted(JsonWriter& json, ExpressionGenerator& generator, int rangeCount, double minimumSeconds)
+   {
+      constexpr int RangeLength = 3;
+      const int spread = rangeCount * 8;
+      const std::vector<int> members = generator.GenerateMembers(rangeCount, spread);
+      std::string set = "in{";
+      for (size_t i = 0; i < members.size(); ++i)
+      {
+         set += (i > 0 ? ", " : "") + std::to_string(members[i]) + ".." + std::to_string(members[i] + RangeLength);
+      }
+      set += "}";
+
+      ExpressionParser parser;
+      if (parser.Parse(set) != ExpressionParser::ParseResult::OK)
+      {
+         std::cerr << "Generated set failed to parse: " << parser.GetErrorMessage() << std::endl;
+         return;
+      }
+
+      const std::vector<int> values = generator.GenerateValuesAmong(members, spread, 65536);
+      std::vector<int> sortedValues = values;
+      std::sort(sortedValues.begin(), sortedValues.end());
+
+      // Expand the runs back out to compare against the batch results
+      std::vector<ExpressionParser::ResultRun> runs;
+      std::vector<uint8_t> results(values.size());
+      std::vector<uint8_t> sweptResults(values.size());
+      parser.EvaluateSorted(sortedValues, runs);
+      parser.Evaluate(sortedValues, results);
+      for (const ExpressionParser::ResultRun& run : runs)
+      {
+         std::fill_n(sweptResults.begin() + run.m_first, run.m_count, run.m_passes ? 1 : 0);
+      }
+      bool isAgreeing = sweptResults == results;
+      parser.EvaluateBySorting(values, sweptResults);
+      parser.Evaluate(values, results);
+      isAgreeing = isAgreeing && sweptResults == results;
+      if (isAgreeing == false)
+      {
+         std::cerr << "Sorted evaluation results differ from Evaluate" << std::endl;
+      }
+
+      const double nsPerSweptValue = Measure(minimumSeconds, values.size(), [&]()
+      {
+         runs.clear();
+         g_sink += parser.EvaluateSorted(sortedValues, runs);
+      });
+
+      const double nsPerBatchValue = Measure(minimumSeconds, values.size(), [&]()
+      {
+         parser.Evaluate(sortedValues, results);
+         g_sink += results[0];
+      });
+
+      const double nsPerSortingValue = Measure(minimumSeconds, values.size(), [&]()
+      {
+         parser.EvaluateBySorting(values, sweptResults);
+         g_sink += sweptResults[0];
+      });
+
+      json.BeginResult("sorted");
+      json.Field("ranges", (double)members.size());
+      json.Agrees(isAgreeing);
+      json.Field("intervals", (double)parser.GetIntervals().size());
+      json.Field("boundaries", (double)parser.GetIntervals().size() * 2);
+      json.Field("runs", (double)runs.size());
+      json.Field("nsPerSweptValue", nsPerSweptValue);
+      json.Field("nsPerBatchValue", nsPerBatchValue);
+      json.Field("nsPerSortingValue", nsPerSortingValue);
+      json.EndResult();
+   }
+
+   // Compare "in{...}" against the same members written out as a chain of "=" comparisons joined
+   // by "or", or ranges as "(>=a and <=b)" groups. The spread decides which lookup the set gets for
+   // batches: close members make a bitmap, lone members too spread out for one a hash table, and
+   // spread out ranges stay sorted.
+   void BenchmarkSet(JsonWriter& json, ExpressionGenerator& generator, const char* pLayout, int memberCount, int spread, int rangeLength, double minimumSeconds)
+   {
+      const std::vector<int> members = generator.GenerateMembers(memberCount, spread);
+      std::string set = "in{";
+      std::string chain;
+      for (size_t i = 0; i < members.size(); ++i)
+      {
+         const std::string value = std::to_string(members[i]);
+         const std::string last = std::to_string(members[i] + rangeLength);
+         set += (i > 0 ? ", " : "") + (rangeLength > 0 ? value + ".." + last : value);
+         chain += (i > 0 ? " or " : "") + (rangeLength > 0 ? "(>=" + value + " and <=" + last + ")" : "=" + value);
+      }
+      set += "}";
+
+      ExpressionParser setParser;
+      ExpressionParser chainParser;
+      if (setParser.Parse(set) != ExpressionParser::ParseResult::OK || chainParser.Parse(chain) != ExpressionParser::ParseResult::OK)
+      {
+         std::cerr << "Generated set failed to parse: " << setParser.GetErrorMessage() << chainParser.GetErrorMessage() << std::endl;
+         return;
+      }
+
+      const std::vector<int> values = generator.GenerateValuesAmong(members, spread, 65536);
+      std::vector<uint8_t> setResults(values.size());
+      std::vector<uint8_t> chainResults(values.size());
+      setParser.Evaluate(values, setResults);
+      chainParser.Evaluate(values, chainResults);
+      bool isAgreeing = setResults == chainResults;
+      for (size_t i = 0; i < values.size() && isAgreeing; ++i)
+      {
+         isAgreeing = setParser.Evaluate(values[i]) == (chainResults[i] != 0);
+      }
+      if (isAgreeing == false)
+      {
+         std::cerr << "Set results differ from the equivalent comparisons" << std::endl;
+      }
+
+      auto measureSingle = [&](const ExpressionParser& parser)
+      {
+         return Measure(minimumSeconds, values.size(), [&]()
+         {
+            uint64_t passed = 0;
+            for (int value : values)
+            {
+               passed += parser.Evaluate(value) ? 1 : 0;
+            }
+            g_sink += passed;
+         });
+      };
+
+      auto measureBatch = [&](const ExpressionParser& parser)
+      {
+         return Measure(minimumSeconds, values.size(), [&]()
+         {
+            parser.Evaluate(values, setResults);
+            g_sink += setResults[0];
+         });
+      };
+
+      json.BeginResult("set");
+      json.Field("layout", pLayout);
+      json.Field("members", (double)members.size());
+      json.Agrees(isAgreeing);
+      json.Field("nsPerSetValue", measureSingle(setParser));
+      json.Field("nsPerChainValue", measureSingle(chainParser));
+      json.Field("nsPerSetBatchValue", measureBatch(setParser));
+      json.Field("nsPerChainBatchValue", measureBatch(chainParser));
+      json.EndResult();
+   }
+
+   bool ReadOptions(int argc, char** argv, Options& options)
+   {
+      for (int i = 1; i < argc; ++i)
+      {
+         if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+         {
+            options.m_seed = (uint32_t)std::stoul(argv[++i]);
+         }
+         else if (std::strcmp(argv[i], "--quick") == 0)
+         {
+            options.m_quick = true;
+         }
+         else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+         {
+            options.m_outputPath = argv[++i];
+         }
+         else
+         {
+            std::cerr << "Usage: " << argv[0] << " [--seed <n>] [--quick] [--output <file>]" << std::endl;
+            return false;
+         }
+      }
+      return true;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   Options options;
+   if (ReadOptions(argc, argv, options) == false)
+   {
+      return 1;
+   }
+
+   const double minimumSeconds = options.m_quick ? 0.01 : 0.2;
+   ExpressionGenerator generator(options.m_seed);
+   JsonWriter json;
+
+   // Term count scaling with a fixed shape, then depth and and/or mix at a fixed term count
+   std::vector<ExpressionShape> shapes;
+   for (int terms : { 1, 4, 16, 64, 256 })
+   {
+      shapes.push_back({ terms, 2, 0.5 });
+   }
+   for (int depth : { 0, 4, 8 })
+   {
+      shapes.push_back({ 32, depth, 0.5 });
+   }
+   for (double andRatio : { 0.0, 0.25, 0.75, 1.0 })
+   {
+      shapes.push_back({ 32, 2, andRatio });
+   }
+
+   for (const ExpressionShape& shape : shapes)
+   {
+      BenchmarkParse(json, generator, shape, minimumSeconds);
+      BenchmarkEvaluate(json, generator, shape, minimumSeconds);
+      BenchmarkOptimize(json, generator, shape, minimumSeconds);
+      BenchmarkSimplify(json, generator, shape, minimumSeconds);
+      BenchmarkJit(json, generator, shape, minimumSeconds);
+   }
+
+   BenchmarkValueTypes(json, generator, { 16, 2, 0.5 }, minimumSeconds);
+   BenchmarkThreadScaling(json, generator, { 16, 2, 0.5 }, minimumSeconds);
+   for (int ruleCount : { 100, 1000, 10000 })
+   {
+      BenchmarkRuleSet(json, generator, ruleCount, minimumSeconds);
+      BenchmarkArchive(json, generator, ruleCount, minimumSeconds);
+      BenchmarkRuleGraph(json, generator, ruleCount, minimumSeconds);
+   }
+   BenchmarkBulkLoad(json, generator, 100000, minimumSeconds);
+   BenchmarkStatic(json, generator, minimumSeconds);
+   for (double andRatio : { 0.25, 0.75 })
+   {
+      BenchmarkColumns(json, generator, { 16, 2, andRatio }, 4, minimumSeconds);
+   }
+   for (int maxStep : { 1, 10, 100 })
+   {
+      BenchmarkStream(json, generator, { 4, 1, 0.5 }, maxStep, minimumSeconds);
+   }
+   for (int rangeCount : { 1, 16, 256, 4096, 16384 })
+   {
+      BenchmarkSorted(json, generator, rangeCount, minimumSeconds);
+   }
+   for (size_t distinctCount : { 256, 4096, 65536 })
+   {
+      BenchmarkCache(json, generator, { 256, 2, 0.5 }, distinctCount, 1024, minimumSeconds);
+   }
+   BenchmarkHolder(json, generator, { 64, 2, 0.5 }, minimumSeconds);
+   for (int memberCount : { 16, 256 })
+   {
+      BenchmarkSet(json, generator, "bitmap", memberCount, memberCount * 4, 0, minimumSeconds);
+      BenchmarkSet(json, generator, "hash", memberCount, 1000000000, 0, minimumSeconds);
+      BenchmarkSet(json, generator, "sorted", memberCount, 1000000000, 10, minimumSeconds);
+   }
+
+   const std::string document = json.Finish(options.m_seed);
+   if (options.m_outputPath.empty())
+   {
+      std::cout << document;
+   }
+   else
+   {
+      std::ofstream(options.m_outputPath) << document;
+   }
+
+   if (json.IsAgreeing() == false)
+   {
+      std::cerr << "Some results differ from Evaluate, see \"agrees\" in the output" << std::endl;
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,170 @@
+#include "CompiledExpression.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+
+
+namespace
+{
+   // Below this many intervals a linear scan beats a binary search.
+   constexpr size_t LinearScanLimit = 8;
+
+   // Parsers on any thread may be compiling at once, so versions are handed out atomically.
+   std::atomic<uint64_t> s_nextVersion = 1;
+
+   uint64_t NextVersion()
+   {
+      return s_nextVersion.fetch_add(1, std::memory_order_relaxed);
+   }
+}
+
+
+/****************************************
+   Compiled Expression
+****************************************/
+
+template <ExpressionValueType T>
+BasicCompiledExpression<T>::BasicCompiledExpression()
+   : m_entry(Instruction::JumpToFalse)
+   , m_batchStackDepth(0)
+   , m_filterDepth(0)
+   , m_fieldCount(0)
+   , m_evaluationMode(EvaluationMode::Program)
+   , m_domainMin(0)
+   , m_domainRange(0)
+   , m_version(NextVersion())
+{}
+
+template <ExpressionValueType T>
+bool BasicCompiledExpression<T>::EvaluateRow(std::span<const T> row) const
+{
+   assert(row.size() >= m_fieldCount);
+   return EvaluateProgramRow(m_instructions, m_entry, row);
+}
+
+template <ExpressionValueType T>
+bool BasicCompiledExpression<T>::EvaluateProgram(std::span<const Instruction> program, uint32_t entry, T value)
+{
+   const Instruction* pProgram = program.data();
+   uint32_t at = entry;
+   while (at < Instruction::JumpToFalse)
+   {
+      const Instruction& instruction = pProgram[at];
+      at = Compare(instruction.m_operation, instruction.m_value, value) ? instruction.m_onTrue : instruction.m_onFalse;
+   }
+
+   return at == Instruction::JumpToTrue;
+}
+
+template <ExpressionValueType T>
+bool BasicCompiledExpression<T>::EvaluateProgramRow(std::span<const Instruction> program, uint32_t entry, std::span<const T> row)
+{
+   const Instruction* pProgram = program.data();
+   uint32_t at = entry;
+   while (at < Instruction::JumpToFalse)
+   {
+      const Instruction& instruction = pProgram[at];
+      at = Compare(instruction.m_operation, instruction.m_value, row[instruction.m_field]) ? instruction.m_onTrue : instruction.m_onFalse;
+   }
+
+   return at == Instruction::JumpToTrue;
+}
+
+template <ExpressionValueType T>
+bool BasicCompiledExpression<T>::EvaluateIntervals(std::span<const Interval> intervals, T value)
+{
+   const Interval* pIntervals = intervals.data();
+   size_t count = intervals.size();
+   if (count <= LinearScanLimit)
+   {
+      for (size_t i = 0; i < count; ++i)
+      {
+         if (value <= pIntervals[i].m_max)
+         {
+            return value >= pIntervals[i].m_min;
+         }
+      }
+      return false;
+   }
+
+   // Find the last interval starting at or before the value. The loop always runs the same number
+   // of times for a given count, and the compiler turns the select into a conditional move.
+   while (count > 1)
+   {
+      const size_t half = count / 2;
+      pIntervals = pIntervals[half].m_min <= value ? pIntervals + half : pIntervals;
+      count -= half;
+   }
+   return pIntervals->m_min <= value && value <= pIntervals->m_max;
+}
+
+template <ExpressionValueType T>
+bool BasicCompiledExpression<T>::PassesAll(T min, T max) const
+{
+   // The whole range has to sit inside a single interval, as there is a gap between each of them
+   auto it = std::upper_bound(m_intervals.begin(), m_intervals.end(), min,
+      [](T value, const Interval& interval) { return value < interval.m_min; });
+   return it != m_intervals.begin() && (it - 1)->m_max >= max;
+}
+
+template <ExpressionValueType T>
+bool BasicCompiledExpression<T>::PassesAny(T min, T max) const
+{
+   // Find the first interval that doesn't end before the range, then check it starts within it
+   auto it = std::lower_bound(m_intervals.begin(), m_intervals.end(), min,
+      [](const Interval& interval, T value) { return interval.m_max < value; });
+   return it != m_intervals.end() && it->m_min <= max;
+}
+
+template <ExpressionValueType T>
+void BasicCompiledExpression<T>::BuildDomain(T min, uint32_t range) requires std::integral<T>
+{
+   m_domainMin = min;
+   m_domainRange = range;
+
+   // Every interval already describes a run of passing values, so fill whole words at a time
+   // rather than setting one bit per value.
+   const uint64_t bitCount = (uint64_t)m_domainRange + 1;
+   m_domainBits.assign((size_t)((bitCount + 63) / 64), 0);
+
+   using Unsigned = std::make_unsigned_t<T>;
+   const T domainMax = (T)((Unsigned)m_domainMin + m_domainRange);
+   for (const Interval& interval : m_intervals)
+   {
+      if (interval.m_max < m_domainMin || interval.m_min > domainMax)
+      {
+         continue;
+      }
+
+      const uint64_t first = (Unsigned)((Unsigned)std::max(interval.m_min, m_domainMin) - (Unsigned)m_domainMin);
+      const uint64_t last = (Unsigned)((Unsigned)std::min(interval.m_max, domainMax) - (Unsigned)m_domainMin);
+      const size_t firstWord = (size_t)(first >> 6);
+      const size_t lastWord = (size_t)(last >> 6);
+      const uint64_t firstMask = ~0ull << (first & 63);
+      const uint64_t lastMask = ~0ull >> (63 - (last & 63));
+
+      if (firstWord == lastWord)
+      {
+         m_domainBits[firstWord] |= firstMask & lastMask;
+         continue;
+      }
+
+      m_domainBits[firstWord] |= firstMask;
+      std::fill(m_domainBits.begin() + firstWord + 1, m_domainBits.begin() + lastWord, ~0ull);
+      m_domainBits[lastWord] |= lastMask;
+   }
+}
+
+template <ExpressionValueType T>
+void BasicCompiledExpression<T>::ClearDomain()
+{
+   m_domainMin = 0;
+   m_domainRange = 0;
+   m_domainBits.clear();
+   m_domainBits.shrink_to_fit();
+}
+
+#define INSTANTIATE(T) template class BasicCompiledExpression<T>;
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,423 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+class ExpressionProfile;
+
+// The value types expressions can be parsed and evaluated for. Everything defined outside of the
+// headers is explicitly instantiated for each of these, eg: EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#define EXPRESSION_VALUE_TYPES(X) X(int32_t) X(int64_t) X(float) X(double)
+
+template <typename T>
+concept ExpressionValueType = std::same_as<T, int32_t> || std::same_as<T, int64_t> || std::same_as<T, float> || std::same_as<T, double>;
+
+template <ExpressionValueType T>
+class BasicExpressionParser;
+
+// The parts of a compiled expression that are the same whatever type of value it evaluates.
+class CompiledExpressionBase
+{
+public:
+   // The comparison an expression performs, combined where needed (eg: LessThan | EqualTo for "<=").
+   enum OperatorFlags
+   {
+      LessThan = 1 << 0,
+      GreaterThan = 1 << 1,
+      EqualTo = 1 << 2,
+      NotEqualTo = 1 << 3,
+   };
+
+   // How Evaluate() checks a single value.
+   enum class EvaluationMode : uint8_t
+   {
+      // Run the compiled instruction program, short circuiting through the expression.
+      Program,
+      // Search the sorted intervals of passing values. The cost only depends on how many
+      // intervals there are, not how the expression was written.
+      Intervals,
+   };
+
+   // Where a comparison was read from in the expression string.
+   struct SourceRange
+   {
+      uint32_t m_at;
+      uint32_t m_length;
+   };
+
+   // A run of consecutive values sharing the same result, starting at index m_first.
+   struct ResultRun
+   {
+      size_t m_first;
+      size_t m_count;
+      bool m_passes;
+   };
+};
+
+// A compiled expression is the result of a successful BasicExpressionParser::Parse, holding everything
+// needed to evaluate values and nothing from the parse itself. It is never modified once built and
+// evaluating it touches no reference counts or other shared state, so a single instance can be
+// evaluated from any number of threads at once. Copy it out of the parser to keep it around.
+// Every comparison works on T directly, so nothing is converted or dispatched on the way through.
+template <ExpressionValueType T>
+class BasicCompiledExpression : public CompiledExpressionBase
+{
+public:
+   using ValueType = T;
+
+   // An inclusive range of values, used to describe every value an expression passes. For floating
+   // point values the ends are the nearest representable values, eg: "<1" ends just below 1.
+   struct Interval
+   {
+      T m_min;
+      T m_max;
+   };
+
+   // Instructions are the flattened form of the expression and are what Evaluate() actually runs.
+   // Each one holds a single comparison along with where to go next depending on its result, so
+   // the and/or short circuiting is baked into the jump targets rather than worked out at runtime.
+   // Every jump goes forwards.
+   struct Instruction
+   {
+      // Jump targets at or above JumpToFalse end the evaluation rather than index an instruction.
+      static constexpr uint32_t JumpToFalse = 0xFFFFFFFE;
+      static constexpr uint32_t JumpToTrue = 0xFFFFFFFF;
+
+      uint8_t m_operation;
+      uint16_t m_field;
+      T m_value;
+      uint32_t m_onTrue;
+      uint32_t m_onFalse;
+   };
+
+   // Batch operations are a postfix form of the expression used to evaluate many values at once.
+   // Comparisons push a mask of results for a block of values, AND/OR ops pop the top two masks and
+   // push them combined. Nothing short circuits here, instead each comparison runs over every
+   // value in the block so it can be vectorised.
+   struct BatchOp
+   {
+      enum Type : uint8_t
+      {
+         Compare,
+         And,
+         Or,
+         False,
+         True,
+         Set,
+      };
+
+      uint8_t m_type;
+      uint8_t m_operation;
+      T m_value;
+
+      // For sets, the index of the set, with the operation being EqualTo for "in" or NotEqualTo
+      // for "notin".
+      uint32_t m_set;
+   };
+
+   // Filter ops are a prefix form of the expression used to filter columns of rows. Each AND/OR
+   // group is followed by its children and knows where they end, so a group can stop as soon as
+   // no rows are left undecided and skip straight past the rest of its children.
+   struct FilterOp
+   {
+      enum Type : uint8_t
+      {
+         Compare,
+         And,
+         Or,
+         False,
+         True,
+         Set,
+      };
+
+      uint8_t m_type;
+      uint8_t m_operation;
+      uint16_t m_field;
+
+      // For groups, the index just past the group's last child.
+      uint32_t m_end;
+      T m_value;
+
+      // For sets, the index of the set, the same as for batch operations.
+      uint32_t m_set;
+   };
+
+   // The members of an "in{...}" or "notin{...}" set, held in whichever form suits how densely
+   // they are packed so checking a value costs the same however many members there are. Sets
+   // packed closely enough are a bitmap with a bit per value, sets of lone integers are a perfect
+   // hash table, and anything else keeps its members as sorted intervals searched without
+   // branching. Only integers can be a bitmap or hash table.
+   class Set
+   {
+   public:
+      enum class Kind : uint8_t
+      {
+         Sorted,
+         Bitmap,
+         Hash,
+      };
+
+      // An empty set, containing nothing.
+      Set();
+
+      // Build a set from sorted, non overlapping intervals with a gap between each.
+      explicit Set(std::span<const Interval> members);
+
+      bool Contains(T value) const
+      {
+         if constexpr (std::is_integral_v<T>)
+         {
+            using Unsigned = std::make_unsigned_t<T>;
+            if (m_kind == Kind::Bitmap)
+            {
+               const uint64_t bit = (Unsigned)((Unsigned)value - (Unsigned)m_bitmapMin);
+               return bit <= m_bitmapRange && ((m_words[(size_t)(bit >> 6)] >> (bit & 63)) & 1) != 0;
+            }
+            if (m_kind == Kind::Hash)
+            {
+               return m_slots[GetSlot(value)] == value;
+            }
+         }
+         return ContainsSorted(value);
+      }
+
+      // Write 1 to the mask for every value in the set and 0 otherwise, or the other way around if
+      // the set is negated.
+      void Evaluate(const T* pValues, uint8_t* pMask, size_t count, bool isNegated) const;
+
+      Kind GetKind() const { return m_kind; }
+      std::span<const Interval> GetMembers() const { return m_members; }
+
+      // The number of bytes used to look values up.
+      size_t GetMemoryCost() const;
+
+   private:
+      // Searching halves the intervals left each step by picking a side with a conditional move
+      // rather than a branch, finishing on the last interval starting at or before the value.
+      bool ContainsSorted(T value) const
+      {
+         if (m_members.empty())
+         {
+            return false;
+         }
+
+         const Interval* pBase = m_members.data();
+         for (size_t count = m_members.size(); count > 1; count -= count / 2)
+         {
+            pBase = pBase[count / 2].m_min <= value ? pBase + count / 2 : pBase;
+         }
+         return pBase->m_min <= value && value <= pBase->m_max;
+      }
+
+      // The first hash picks a bucket and the second a slot, which the bucket's displacement then
+      // moves to wherever its members were found room.
+      size_t GetSlot(T value) const requires std::integral<T>
+      {
+         using Unsigned = std::make_unsigned_t<T>;
+         const uint64_t key = (Unsigned)value;
+         const size_t bucket = (size_t)((key * m_bucketMultiplier) >> m_bucketShift);
+         return (size_t)((key * m_slotMultiplier) >> m_slotShift) ^ m_displacements[bucket];
+      }
+
+      // Try to build a perfect hash table for the lone values, returning false if none was found.
+      bool BuildHash() requires std::integral<T>;
+
+   private:
+      Kind m_kind;
+      std::vector<Interval> m_members;
+
+      // Bitmaps hold a bit for every value in the inclusive range from m_bitmapMin.
+      T m_bitmapMin;
+      uint64_t m_bitmapRange;
+      std::vector<uint64_t> m_words;
+
+      // Hash tables hold one member per slot, with every empty slot holding a member that belongs
+      // to a different slot so a lookup never matches it.
+      std::vector<T> m_slots;
+      std::vector<uint32_t> m_displacements;
+      uint64_t m_bucketMultiplier;
+      uint64_t m_slotMultiplier;
+      uint32_t m_bucketShift;
+      uint32_t m_slotShift;
+   };
+
+   // An empty expression, which fails every value.
+   BasicCompiledExpression();
+
+   // Evaluate a value against the expression. Every field reads the same value, so this is only
+   // really meaningful for expressions comparing a single field.
+   bool Evaluate(T value) const
+   {
+      if constexpr (std::is_integral_v<T>)
+      {
+         if (IsInDomain(value))
+         {
+            return EvaluateDomain(value);
+         }
+      }
+      return EvaluateOutsideDomain(value);
+   }
+
+   // Evaluate a value by running the instruction program, counting what each comparison does into
+   // the profile. This always runs the program whatever the evaluation mode, as that is what the
+   // counts describe. The profile must have been created from this expression. Evaluate(value)
+   // never counts anything, so there is no cost unless this is called.
+   bool Evaluate(T value, ExpressionProfile& profile) const;
+
+   // Evaluate every value in the span, writing 1 to the matching result if it passes and 0 if
+   // not. Comparisons run over whole blocks of values, using SSE2/AVX2 for 32 bit integers where
+   // the CPU supports it. The results span must be at least as large as the values span.
+   void Evaluate(std::span<const T> values, std::span<uint8_t> results) const;
+
+   // Evaluate a single row, with each field reading its column of the row. The row must have a
+   // column for every field the expression compares, see GetFieldCount().
+   bool EvaluateRow(std::span<const T> row) const;
+
+   // Evaluate a block of rows stored as one contiguous column per field, setting the bit for
+   // every passing row in selection and clearing it for every failing row, with row i being bit
+   // i % 64 of word i / 64. Rows are only compared while they can still change the result, so
+   // the rows passed on to each term of an AND group are only those passing every term before it.
+   // There must be a column for every field the expression compares, all holding the same number
+   // of rows, and selection must have room for a bit per row.
+   void Evaluate(std::span<const std::span<const T>> columns, std::span<uint64_t> selection) const;
+
+   // Evaluate values sorted in ascending order, appending a run for every stretch of consecutive
+   // values with the same result. The values are swept along with the intervals in a single pass,
+   // each run ending where a galloping search finds the next value past its boundary, so the cost
+   // grows with the number of runs rather than the number of values. Any NaN must come after every
+   // other value, where sorting with NaN placed last leaves them. Neighbouring runs never share a
+   // result. Returns the number of runs appended.
+   size_t EvaluateSorted(std::span<const T> values, std::vector<ResultRun>& runs) const;
+
+   // Evaluate values in any order by sorting a copy of them, sweeping it with EvaluateSorted() and
+   // scattering the results back, writing 1 to the matching result if it passes and 0 if not. This
+   // allocates, so is only worth it for expressions with many comparisons, or when the same values
+   // go through many expressions and the sort can be done once outside. The results span must be
+   // at least as large as the values span.
+   void EvaluateBySorting(std::span<const T> values, std::span<uint8_t> results) const;
+
+   // The number of columns a row needs, one more than the highest field the expression compares.
+   uint32_t GetFieldCount() const { return m_fieldCount; }
+
+   EvaluationMode GetEvaluationMode() const { return m_evaluationMode; }
+
+   // The sorted, non overlapping intervals of every value the expression passes. Adjacent
+   // intervals are always merged, so there is a gap of at least one failing value between each.
+   std::span<const Interval> GetIntervals() const { return m_intervals; }
+
+   // Check if every value, or any value, in the inclusive range passes without evaluating them.
+   bool PassesAll(T min, T max) const;
+   bool PassesAny(T min, T max) const;
+
+   // The number of bytes used by the domain bitmap, or 0 if there is no domain.
+   size_t GetDomainMemoryCost() const { return m_domainBits.size() * sizeof(uint64_t); }
+
+   // The instruction program along with the index of the instruction to start from, which may
+   // instead be a JumpToTrue/JumpToFalse target if the expression always has the same result.
+   std::span<const Instruction> GetInstructions() const { return m_instructions; }
+   uint32_t GetEntry() const { return m_entry; }
+
+   // Where in the expression string each instruction's comparison came from.
+   std::span<const SourceRange> GetSourceRanges() const { return m_sourceRanges; }
+
+   // Identifies this compile of the expression. Every expression compiled or cleared is given a new
+   // version while copies keep the one they were copied from, so anything holding on to results can
+   // tell when the expression it took them from has been replaced, eg: by parsing another string.
+   uint64_t GetVersion() const { return m_version; }
+
+   // What Evaluate() and EvaluateRow() run, for programs and intervals kept outside of a compiled
+   // expression, eg: in an ExpressionArchive. They must be laid out just as GetInstructions() and
+   // GetIntervals() return them.
+   static bool EvaluateProgram(std::span<const Instruction> program, uint32_t entry, T value);
+   static bool EvaluateProgramRow(std::span<const Instruction> program, uint32_t entry, std::span<const T> row);
+   static bool EvaluateIntervals(std::span<const Interval> intervals, T value);
+
+private:
+   template <ExpressionValueType>
+   friend class BasicExpressionParser;
+
+   static bool Compare(int operation, T constant, T value)
+   {
+      switch (operation)
+      {
+         case (int)LessThan:                       return value < constant;
+         case (int)LessThan | (int)EqualTo:        return value <= constant;
+         case (int)EqualTo:                        return value == constant;
+         case (int)NotEqualTo:                     return value != constant;
+         case (int)GreaterThan | (int)EqualTo:     return value >= constant;
+         case (int)GreaterThan:                    return value > constant;
+         default:                                  return false;
+      }
+   }
+
+   bool EvaluateProgram(T value) const { return EvaluateProgram(m_instructions, m_entry, value); }
+   bool EvaluateIntervals(T value) const { return EvaluateIntervals(m_intervals, value); }
+
+   // Evaluate a batch of values against the intervals alone, for expressions that only compare a
+   // single field.
+   void EvaluateIntervals(std::span<const T> values, std::span<uint8_t> results) const;
+   bool EvaluateOutsideDomain(T value) const
+   {
+      // NaN falls outside of every interval but still passes "!=", so it always runs the program.
+      // A value only compares unequal to itself when it is NaN.
+      return m_evaluationMode == EvaluationMode::Intervals && value == value ? EvaluateIntervals(value) : EvaluateProgram(value);
+   }
+
+   // Filter the rows of a block through the op at the given index along with any children it has,
+   // returning the index of the op following on from it. Only rows set in pActive are compared,
+   // with those passing written to pPassed, which may be the same selection as pActive. OR groups
+   // take their selections from pScratch, and every comparison uses pMask for a block of results.
+   uint32_t FilterBlock(uint32_t at, const T* const* pColumns, size_t rowCount, const uint64_t* pActive, uint64_t* pPassed, uint64_t* pScratch, uint8_t* pMask) const;
+
+   // Materialise the intervals as a bitmap over the inclusive range starting at min. Only integers
+   // have a domain, there are far too many floating point values in any useful range.
+   void BuildDomain(T min, uint32_t range) requires std::integral<T>;
+   void ClearDomain();
+
+   // Check if the value is inside the domain bitmap, treating the whole range as unsigned avoids
+   // having to check against both ends.
+   bool IsInDomain(T value) const requires std::integral<T>
+   {
+      using Unsigned = std::make_unsigned_t<T>;
+      return m_domainBits.empty() == false && (Unsigned)((Unsigned)value - (Unsigned)m_domainMin) <= m_domainRange;
+   }
+
+   bool EvaluateDomain(T value) const requires std::integral<T>
+   {
+      using Unsigned = std::make_unsigned_t<T>;
+      const uint32_t bit = (uint32_t)((Unsigned)value - (Unsigned)m_domainMin);
+      return (m_domainBits[bit >> 6] >> (bit & 63)) & 1;
+   }
+
+private:
+   std::vector<Instruction> m_instructions;
+   std::vector<SourceRange> m_sourceRanges;
+   uint32_t m_entry;
+
+   std::vector<BatchOp> m_batchProgram;
+   uint32_t m_batchStackDepth;
+
+   std::vector<FilterOp> m_filterProgram;
+   uint32_t m_filterDepth;
+   uint32_t m_fieldCount;
+
+   std::vector<Interval> m_intervals;
+   EvaluationMode m_evaluationMode;
+
+   std::vector<Set> m_sets;
+
+   T m_domainMin;
+   uint32_t m_domainRange;
+   std::vector<uint64_t> m_domainBits;
+
+   uint64_t m_version;
+};
+
+using CompiledExpression = BasicCompiledExpression<int32_t>;
+using Int64CompiledExpression = BasicCompiledExpression<int64_t>;
+using FloatCompiledExpression = BasicCompiledExpression<float>;
+using DoubleCompiledExpression = BasicCompiledExpression<double>;
@@ -0,0 +1,555 @@
+#include "CompiledExpression.h"
+#include "ExpressionKernels.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define EXPRESSION_PARSER_X64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(EXPRESSION_PARSER_X64) && (defined(__GNUC__) || defined(__clang__))
+#define EXPRESSION_PARSER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define EXPRESSION_PARSER_TARGET_AVX2
+#endif
+
+
+namespace
+{
+   // Values are evaluated a block at a time so the masks for every level of the expression
+   // stay in the L1 cache.
+   constexpr size_t BatchBlockSize = 1024;
+
+   // Filter selections hold a bit per row, so a block of rows fits in this many words.
+   constexpr size_t BlockWords = BatchBlockSize / 64;
+
+   // Expressions of a single field passing no more than this many intervals are evaluated in
+   // batches against the intervals themselves, which is a couple of compares per interval however
+   // many terms were written to get there.
+   constexpr size_t BatchIntervalLimit = 4;
+
+   // Once fewer than 1 in this many rows of a block are still active, comparing each active row on
+   // its own beats running the compare kernel over the whole block and throwing most of it away.
+   constexpr size_t SparseRowDivisor = 16;
+
+   using ExpressionKernels::CompareKernel;
+
+   template <typename T, typename Comparison>
+   void CompareEach(const T* pValues, uint8_t* pMask, size_t count, Comparison comparison)
+   {
+      for (size_t i = 0; i < count; ++i)
+      {
+         pMask[i] = comparison(pValues[i]) ? 1 : 0;
+      }
+   }
+
+   // Picking the comparison once per block leaves a branch free loop per operator, which the
+   // compiler can vectorise for whatever type it is given.
+   template <typename T>
+   void CompareBlockScalar(int operation, T constant, const T* pValues, uint8_t* pMask, size_t count)
+   {
+      switch (operation)
+      {
+         case (int)CompiledExpressionBase::LessThan:                                           CompareEach(pValues, pMask, count, [constant](T value) { return value < constant; }); break;
+         case (int)CompiledExpressionBase::LessThan | (int)CompiledExpressionBase::EqualTo:    CompareEach(pValues, pMask, count, [constant](T value) { return value <= constant; }); break;
+         case (int)CompiledExpressionBase::EqualTo:                                            CompareEach(pValues, pMask, count, [constant](T value) { return value == constant; }); break;
+         case (int)CompiledExpressionBase::NotEqualTo:                                         CompareEach(pValues, pMask, count, [constant](T value) { return value != constant; }); break;
+         case (int)CompiledExpressionBase::GreaterThan | (int)CompiledExpressionBase::EqualTo: CompareEach(pValues, pMask, count, [constant](T value) { return value >= constant; }); break;
+         case (int)CompiledExpressionBase::GreaterThan:                                        CompareEach(pValues, pMask, count, [constant](T value) { return value > constant; }); break;
+         default:                                                                              std::memset(pMask, 0, count); break;
+      }
+   }
+
+#ifdef EXPRESSION_PARSER_X64
+   // Every comparison is built from a single greater than or equality test, optionally swapping the
+   // operands and/or inverting the result. eg: "<=" is "not >", "!=" is "not =".
+   struct SimdComparison
+   {
+      bool m_isValid;
+      bool m_isEqualTest;
+      bool m_swapOperands;
+      bool m_invert;
+   };
+
+   SimdComparison GetSimdComparison(int operation)
+   {
+      switch (operation)
+      {
+         case (int)CompiledExpressionBase::LessThan:                                           return { true, false, true, false };   // c > v
+         case (int)CompiledExpressionBase::LessThan | (int)CompiledExpressionBase::EqualTo:    return { true, false, false, true };   // !(v > c)
+         case (int)CompiledExpressionBase::EqualTo:                                            return { true, true, false, false };   // v == c
+         case (int)CompiledExpressionBase::NotEqualTo:                                         return { true, true, false, true };    // !(v == c)
+         case (int)CompiledExpressionBase::GreaterThan | (int)CompiledExpressionBase::EqualTo: return { true, false, true, true };    // !(c > v)
+         case (int)CompiledExpressionBase::GreaterThan:                                        return { true, false, false, false };  // v > c
+         default:                                                                              return { false, false, false, false };
+      }
+   }
+
+   void CompareBlockSse2(int operation, int constant, const int* pValues, uint8_t* pMask, size_t count)
+   {
+      const SimdComparison comparison = GetSimdComparison(operation);
+      if (comparison.m_isValid == false)
+      {
+         std::memset(pMask, 0, count);
+         return;
+      }
+
+      const __m128i constants = _mm_set1_epi32(constant);
+      const __m128i invert = comparison.m_invert ? _mm_set1_epi32(-1) : _mm_setzero_si128();
+      const __m128i ones = _mm_set1_epi8(1);
+
+      auto compare = [&](const int* pFrom)
+      {
+         const __m128i values = _mm_loadu_si128((const __m128i*)pFrom);
+         __m128i result;
+         if (comparison.m_isEqualTest)
+         {
+            result = _mm_cmpeq_epi32(values, constants);
+         }
+         else
+         {
+            result = comparison.m_swapOperands ? _mm_cmpgt_epi32(constants, values) : _mm_cmpgt_epi32(values, constants);
+         }
+         return _mm_xor_si128(result, invert);
+      };
+
+      // 16 values at a time, narrowing the 32 bit lane masks down to bytes
+      size_t i = 0;
+      for (; i + 16 <= count; i += 16)
+      {
+         const __m128i low = _mm_packs_epi32(compare(pValues + i), compare(pValues + i + 4));
+         const __m128i high = _mm_packs_epi32(compare(pValues + i + 8), compare(pValues + i + 12));
+         _mm_storeu_si128((__m128i*)(pMask + i), _mm_and_si128(_mm_packs_epi16(low, high), ones));
+      }
+
+      CompareBlockScalar(operation, constant, pValues + i, pMask + i, count - i);
+   }
+
+   EXPRESSION_PARSER_TARGET_AVX2
+   void CompareBlockAvx2(int operation, int constant, const int* pValues, uint8_t* pMask, size_t count)
+   {
+      const SimdComparison comparison = GetSimdComparison(operation);
+      if (comparison.m_isValid == false)
+      {
+         std::memset(pMask, 0, count);
+         return;
+      }
+
+      const __m256i constants = _mm256_set1_epi32(constant);
+      const __m256i invert = comparison.m_invert ? _mm256_set1_epi32(-1) : _mm256_setzero_si256();
+      const __m256i ones = _mm256_set1_epi8(1);
+
+      // Packing works within each 128 bit half, this puts the 4 byte groups back in order afterwards
+      const __m256i packedOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+      auto compare = [&](const int* pFrom) EXPRESSION_PARSER_TARGET_AVX2
+      {
+         const __m256i values = _mm256_loadu_si256((const __m256i*)pFrom);
+         __m256i result;
+         if (comparison.m_isEqualTest)
+         {
+            result = _mm256_cmpeq_epi32(values, constants);
+         }
+         else
+         {
+            result = comparison.m_swapOperands ? _mm256_cmpgt_epi32(constants, values) : _mm256_cmpgt_epi32(values, constants);
+         }
+         return _mm256_xor_si256(result, invert);
+      };
+
+      // 32 values at a time, narrowing the 32 bit lane masks down to bytes
+      size_t i = 0;
+      for (; i + 32 <= count; i += 32)
+      {
+         const __m256i low = _mm256_packs_epi32(compare(pValues + i), compare(pValues + i + 8));
+         const __m256i high = _mm256_packs_epi32(compare(pValues + i + 16), compare(pValues + i + 24));
+         const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packs_epi16(low, high), packedOrder);
+         _mm256_storeu_si256((__m256i*)(pMask + i), _mm256_and_si256(packed, ones));
+      }
+
+      CompareBlockSse2(operation, constant, pValues + i, pMask + i, count - i);
+   }
+
+   bool CpuSupportsAvx2()
+   {
+#if defined(_MSC_VER)
+      int cpuInfo[4];
+      __cpuid(cpuInfo, 0);
+      if (cpuInfo[0] < 7)
+      {
+         return false;
+      }
+
+      // AVX2 also needs the OS to be saving the YMM registers (OSXSAVE + XCR0 bits 1 and 2)
+      __cpuid(cpuInfo, 1);
+      const bool hasOsxsave = (cpuInfo[2] & (1 << 27)) != 0;
+      const bool hasAvx = (cpuInfo[2] & (1 << 28)) != 0;
+      if (hasOsxsave == false || hasAvx == false || (_xgetbv(0) & 0x6) != 0x6)
+      {
+         return false;
+      }
+
+      __cpuidex(cpuInfo, 7, 0);
+      return (cpuInfo[1] & (1 << 5)) != 0;
+#else
+      return __builtin_cpu_supports("avx2");
+#endif
+   }
+#endif
+
+   // Picks the widest compare kernel the CPU supports. SSE2 is part of x86-64 so it only needs
+   // checking for AVX2. Only 32 bit integers have hand written kernels, anything else gets the
+   // scalar kernel and whatever the compiler makes of it.
+   template <typename T>
+   CompareKernel<T> SelectCompareKernel()
+   {
+#ifdef EXPRESSION_PARSER_X64
+      if constexpr (std::is_same_v<T, int32_t>)
+      {
+         return CpuSupportsAvx2() ? &CompareBlockAvx2 : &CompareBlockSse2;
+      }
+#endif
+      return &CompareBlockScalar<T>;
+   }
+
+   // Pack 64 mask bytes, each holding 0 or 1, into a word with a bit per byte.
+   uint64_t PackMaskWord(const uint8_t* pMask)
+   {
+      uint64_t bits = 0;
+#ifdef EXPRESSION_PARSER_X64
+      // Shifting the 1 up to the top of each byte lets movemask gather 16 of them at once
+      for (size_t i = 0; i < 4; ++i)
+      {
+         const __m128i bytes = _mm_loadu_si128((const __m128i*)(pMask + i * 16));
+         bits |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_slli_epi16(bytes, 7)) << (i * 16);
+      }
+#else
+      for (size_t i = 0; i < 64; ++i)
+      {
+         bits |= (uint64_t)pMask[i] << i;
+      }
+#endif
+      return bits;
+   }
+
+   bool IsEmpty(const uint64_t* pBits, size_t wordCount)
+   {
+      return std::all_of(pBits, pBits + wordCount, [](uint64_t word) { return word == 0; });
+   }
+
+   // Masks only ever hold 0 or 1, so the byte-wise combine is left for the compiler to vectorise.
+   void CombineBlock(bool isOrLogic, uint8_t* pInOut, const uint8_t* pOther, size_t count)
+   {
+      if (isOrLogic)
+      {
+         for (size_t i = 0; i < count; ++i) { pInOut[i] |= pOther[i]; }
+      }
+      else
+      {
+         for (size_t i = 0; i < count; ++i) { pInOut[i] &= pOther[i]; }
+      }
+   }
+}
+
+
+/****************************************
+   Expression Kernels
+****************************************/
+
+template <typename T>
+ExpressionKernels::CompareKernel<T> ExpressionKernels::GetCompareKernel()
+{
+   static const CompareKernel<T> compareKernel = SelectCompareKernel<T>();
+   return compareKernel;
+}
+
+
+/****************************************
+   Compiled Expression
+****************************************/
+
+template <ExpressionValueType T>
+void BasicCompiledExpression<T>::Evaluate(std::span<const T> values, std::span<uint8_t> results) const
+{
+   assert(results.size() >= values.size());
+
+   const CompareKernel<T> compareKernel = ExpressionKernels::GetCompareKernel<T>();
+
+   if constexpr (std::is_integral_v<T>)
+   {
+      if (m_domainBits.empty() == false)
+      {
+         // With a domain bitmap each value is a gather of its bit, only values outside of the
+         // domain need evaluating properly.
+         for (size_t i = 0; i < values.size(); ++i)
+         {
+            results[i] = IsInDomain(values[i]) ? EvaluateDomain(values[i]) : EvaluateOutsideDomain(values[i]);
+         }
+         return;
+      }
+   }
+
+   if (m_batchProgram.empty())
+   {
+      std::fill_n(results.begin(), values.size(), (uint8_t)0);
+      return;
+   }
+
+   if (m_fieldCount <= 1 && m_intervals.size() <= BatchIntervalLimit)
+   {
+      EvaluateIntervals(values, results);
+      return;
+   }
+
+   // The bottom of the mask stack is the results themselves, so the final mask never needs
+   // copying. The rest of it is kept per thread, so only the first batch of a thread allocates.
+   thread_local std::vector<uint8_t> scratch;
+   scratch.resize(std::max(scratch.size(), (size_t)(m_batchStackDepth - 1) * BatchBlockSize));
+
+   for (size_t blockStart = 0; blockStart < values.size(); blockStart += BatchBlockSize)
+   {
+      const size_t count = std::min(BatchBlockSize, values.size() - blockStart);
+      const T* pValues = values.data() + blockStart;
+      auto getMask = [&](size_t depth)
+      {
+         return depth == 0 ? results.data() + blockStart : scratch.data() + (depth - 1) * BatchBlockSize;
+      };
+
+      size_t depth = 0;
+      for (const BatchOp& op : m_batchProgram)
+      {
+         switch (op.m_type)
+         {
+            case BatchOp::Compare:
+               compareKernel(op.m_operation, op.m_value, pValues, getMask(depth++), count);
+               break;
+
+            case BatchOp::False:
+               std::memset(getMask(depth++), 0, count);
+               break;
+
+            case BatchOp::True:
+               std::memset(getMask(depth++), 1, count);
+               break;
+
+            case BatchOp::Set:
+               m_sets[op.m_set].Evaluate(pValues, getMask(depth++), count, op.m_operation == (int)NotEqualTo);
+               break;
+
+            case BatchOp::And:
+            case BatchOp::Or:
+               --depth;
+               CombineBlock(op.m_type == BatchOp::Or, getMask(depth - 1), getMask(depth), count);
+               break;
+         }
+      }
+      assert(depth == 1);
+   }
+}
+
+template <ExpressionValueType T>
+void BasicCompiledExpression<T>::EvaluateIntervals(std::span<const T> values, std::span<uint8_t> results) const
+{
+   // NaN falls outside of every interval, but can still pass "!=", so it takes the result the
+   // program gives it. Masking that in keeps the loops free of branches for the compiler to vectorise.
+   uint8_t nanResult = 0;
+   if constexpr (std::is_floating_point_v<T>)
+   {
+      nanResult = EvaluateProgram(std::numeric_limits<T>::quiet_NaN()) ? 1 : 0;
+   }
+
+   std::fill_n(results.begin(), values.size(), (uint8_t)0);
+   for (const Interval& interval : m_intervals)
+   {
+      const T min = interval.m_min;
+      const T max = interval.m_max;
+      for (size_t i = 0; i < values.size(); ++i)
+      {
+         results[i] |= (uint8_t)((values[i] >= min) & (values[i] <= max));
+      }
+   }
+
+   if constexpr (std::is_floating_point_v<T>)
+   {
+      for (size_t i = 0; i < values.size(); ++i)
+      {
+         results[i] |= (uint8_t)(values[i] != values[i]) & nanResult;
+      }
+   }
+}
+
+template <ExpressionValueType T>
+void BasicCompiledExpression<T>::Evaluate(std::span<const std::span<const T>> columns, std::span<uint64_t> selection) const
+{
+   assert(columns.size() >= m_fieldCount);
+   const size_t rowCount = columns.empty() ? 0 : columns[0].size();
+   assert(std::all_of(columns.begin(), columns.end(), [rowCount](std::span<const T> column) { return column.size() == rowCount; }));
+   assert(selection.size() * 64 >= rowCount);
+
+   const size_t selectionWords = (rowCount + 63) / 64;
+   if (m_filterProgram.empty())
+   {
+      std::fill_n(selection.begin(), selectionWords, 0ull);
+      return;
+   }
+
+   // Every OR group needs two selections of its own while its terms are filtered
+   std::vector<uint64_t> scratch(m_filterDepth * 2 * BlockWords);
+   std::vector<uint8_t> mask(BatchBlockSize);
+   std::vector<const T*> blockColumns(columns.size());
+
+   for (size_t blockStart = 0; blockStart < rowCount; blockStart += BatchBlockSize)
+   {
+      const size_t count = std::min(BatchBlockSize, rowCount - blockStart);
+      for (size_t i = 0; i < columns.size(); ++i)
+      {
+         blockColumns[i] = columns[i].data() + blockStart;
+      }
+
+      // Every row of the block starts out active, the selection is then narrowed down in place
+      uint64_t* pSelection = selection.data() + blockStart / 64;
+      const size_t wordCount = (count + 63) / 64;
+      std::fill_n(pSelection, wordCount, ~0ull);
+      if (count % 64 != 0)
+      {
+         pSelection[wordCount - 1] = (1ull << (count % 64)) - 1;
+      }
+
+      FilterBlock(0, blockColumns.data(), count, pSelection, pSelection, scratch.data(), mask.data());
+   }
+}
+
+template <ExpressionValueType T>
+uint32_t BasicCompiledExpression<T>::FilterBlock(uint32_t at, const T* const* pColumns, size_t rowCount, const uint64_t* pActive, uint64_t* pPassed, uint64_t* pScratch, uint8_t* pMask) const
+{
+   const FilterOp& op = m_filterProgram[at];
+   const size_t wordCount = (rowCount + 63) / 64;
+   switch (op.m_type)
+   {
+      case FilterOp::Compare:
+      {
+         const T* pValues = pColumns[op.m_field];
+         size_t activeCount = 0;
+         for (size_t i = 0; i < wordCount; ++i)
+         {
+            activeCount += (size_t)std::popcount(pActive[i]);
+         }
+
+         if (activeCount * SparseRowDivisor < rowCount)
+         {
+            // Walk the set bits of each word, so only active rows are ever read
+            for (size_t i = 0; i < wordCount; ++i)
+            {
+               uint64_t passed = 0;
+               for (uint64_t active = pActive[i]; active != 0; active &= active - 1)
+               {
+                  const int bit = std::countr_zero(active);
+                  passed |= (uint64_t)Compare(op.m_operation, op.m_value, pValues[i * 64 + bit]) << bit;
+               }
+               pPassed[i] = passed;
+            }
+            return at + 1;
+         }
+
+         // Each word is read before it is written, so this is fine when pActive and pPassed are the same
+         ExpressionKernels::GetCompareKernel<T>()(op.m_operation, op.m_value, pValues, pMask, rowCount);
+         for (size_t i = 0; i < wordCount; ++i)
+         {
+            pPassed[i] = PackMaskWord(pMask + i * 64) & pActive[i];
+         }
+         return at + 1;
+      }
+
+      case FilterOp::Set:
+      {
+         const Set& set = m_sets[op.m_set];
+         const bool isNegated = op.m_operation == (int)NotEqualTo;
+         const T* pValues = pColumns[op.m_field];
+         size_t activeCount = 0;
+         for (size_t i = 0; i < wordCount; ++i)
+         {
+            activeCount += (size_t)std::popcount(pActive[i]);
+         }
+
+         // The same as comparisons, only checking the active rows once there are few enough
+         if (activeCount * SparseRowDivisor < rowCount)
+         {
+            for (size_t i = 0; i < wordCount; ++i)
+            {
+               uint64_t passed = 0;
+               for (uint64_t active = pActive[i]; active != 0; active &= active - 1)
+               {
+                  const int bit = std::countr_zero(active);
+                  passed |= (uint64_t)(set.Contains(pValues[i * 64 + bit]) != isNegated) << bit;
+               }
+               pPassed[i] = passed;
+            }
+            return at + 1;
+         }
+
+         set.Evaluate(pValues, pMask, rowCount, isNegated);
+         for (size_t i = 0; i < wordCount; ++i)
+         {
+            pPassed[i] = PackMaskWord(pMask + i * 64) & pActive[i];
+         }
+         return at + 1;
+      }
+
+      case FilterOp::False:
+         std::fill_n(pPassed, wordCount, 0ull);
+         return at + 1;
+
+      case FilterOp::True:
+         std::copy_n(pActive, wordCount, pPassed);
+         return at + 1;
+
+      case FilterOp::And:
+      {
+         // Each term is only given the rows passing every term before it, stopping once none are left
+         std::copy_n(pActive, wordCount, pPassed);
+         for (uint32_t child = at + 1; child < op.m_end && IsEmpty(pPassed, wordCount) == false; )
+         {
+            child = FilterBlock(child, pColumns, rowCount, pPassed, pPassed, pScratch, pMask);
+         }
+         return op.m_end;
+      }
+
+      case FilterOp::Or:
+      {
+         // Each term is only given the rows failing every term before it, stopping once none are left.
+         // The active rows are copied out first as pPassed may be the same selection.
+         uint64_t* pRemaining = pScratch;
+         uint64_t* pChildPassed = pScratch + BlockWords;
+         std::copy_n(pActive, wordCount, pRemaining);
+         std::fill_n(pPassed, wordCount, 0ull);
+         for (uint32_t child = at + 1; child < op.m_end && IsEmpty(pRemaining, wordCount) == false; )
+         {
+            child = FilterBlock(child, pColumns, rowCount, pRemaining, pChildPassed, pScratch + 2 * BlockWords, pMask);
+            for (size_t i = 0; i < wordCount; ++i)
+            {
+               pPassed[i] |= pChildPassed[i];
+               pRemaining[i] &= ~pChildPassed[i];
+            }
+         }
+         return op.m_end;
+      }
+   }
+
+   assert(false);
+   return op.m_end;
+}
+
+#define INSTANTIATE(T) \
+   template ExpressionKernels::CompareKernel<T> ExpressionKernels::GetCompareKernel<T>(); \
+   template void BasicCompiledExpression<T>::Evaluate(std::span<const T>, std::span<uint8_t>) const; \
+   template void BasicCompiledExpression<T>::Evaluate(std::span<const std::span<const T>>, std::span<uint64_t>) const;
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,246 @@
+#include "CompiledExpression.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+
+namespace
+{
+   // A bitmap is used whenever it is no bigger than this, or than a few times the sorted intervals.
+   constexpr size_t SmallBitmapBytes = 512;
+   constexpr size_t BitmapToSortedRatio = 4;
+
+   // Below this many members a sorted search takes no more steps than hashing does.
+   constexpr size_t HashMinimumMembers = 8;
+
+   // Hash tables have the first power of two at least twice the member count as slots, and a
+   // bucket for every two to four members. A few pairs of multipliers are tried before giving up.
+   constexpr size_t HashMembersPerBucket = 2;
+   constexpr int HashAttempts = 8;
+
+   // Multipliers for the hash are drawn from a fixed sequence, so a set always builds the same way.
+   uint64_t NextMultiplier(uint64_t& state)
+   {
+      uint64_t value = (state += 0x9E3779B97F4A7C15ull);
+      value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+      value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+      return (value ^ (value >> 31)) | 1;
+   }
+}
+
+
+/****************************************
+   Compiled Set
+****************************************/
+
+template <ExpressionValueType T>
+BasicCompiledExpression<T>::Set::Set()
+   : m_kind(Kind::Sorted)
+   , m_bitmapMin(0)
+   , m_bitmapRange(0)
+   , m_bucketMultiplier(0)
+   , m_slotMultiplier(0)
+   , m_bucketShift(0)
+   , m_slotShift(0)
+{}
+
+template <ExpressionValueType T>
+BasicCompiledExpression<T>::Set::Set(std::span<const Interval> members)
+   : Set()
+{
+   m_members.assign(members.begin(), members.end());
+   if constexpr (std::is_integral_v<T>)
+   {
+      if (m_members.empty())
+      {
+         return;
+      }
+
+      using Unsigned = std::make_unsigned_t<T>;
+      const uint64_t range = (Unsigned)((Unsigned)m_members.back().m_max - (Unsigned)m_members.front().m_min);
+      const uint64_t bitmapBytes = range / 8 + 8;
+      if (range < std::numeric_limits<uint32_t>::max() && bitmapBytes <= std::max<uint64_t>(SmallBitmapBytes, m_members.size() * sizeof(Interval) * BitmapToSortedRatio))
+      {
+         m_kind = Kind::Bitmap;
+         m_bitmapMin = m_members.front().m_min;
+         m_bitmapRange = range;
+         m_words.assign((size_t)(range / 64 + 1), 0);
+         for (const Interval& member : m_members)
+         {
+            const uint64_t first = (Unsigned)((Unsigned)member.m_min - (Unsigned)m_bitmapMin);
+            const uint64_t last = (Unsigned)((Unsigned)member.m_max - (Unsigned)m_bitmapMin);
+            for (uint64_t bit = first; bit <= last; ++bit)
+            {
+               m_words[(size_t)(bit >> 6)] |= 1ull << (bit & 63);
+            }
+         }
+         return;
+      }
+
+      const bool isLoneValues = std::all_of(m_members.begin(), m_members.end(), [](const Interval& member) { return member.m_min == member.m_max; });
+      if (isLoneValues && m_members.size() >= HashMinimumMembers && BuildHash())
+      {
+         m_kind = Kind::Hash;
+      }
+   }
+}
+
+template <ExpressionValueType T>
+bool BasicCompiledExpression<T>::Set::BuildHash() requires std::integral<T>
+{
+   using Unsigned = std::make_unsigned_t<T>;
+   const size_t size = std::bit_ceil(m_members.size() * 2);
+   const size_t bucketCount = std::max<size_t>(2, std::bit_ceil(m_members.size() / HashMembersPerBucket));
+   m_bucketShift = 64 - (uint32_t)std::countr_zero(bucketCount);
+   m_slotShift = 64 - (uint32_t)std::countr_zero(size);
+
+   uint64_t state = 0;
+   std::vector<std::vector<uint64_t>> buckets(bucketCount);
+   std::vector<uint32_t> order(bucketCount);
+   std::vector<uint8_t> isUsed;
+   for (int attempt = 0; attempt < HashAttempts; ++attempt)
+   {
+      m_bucketMultiplier = NextMultiplier(state);
+      m_slotMultiplier = NextMultiplier(state);
+      for (std::vector<uint64_t>& bucket : buckets)
+      {
+         bucket.clear();
+      }
+      for (const Interval& member : m_members)
+      {
+         const uint64_t key = (Unsigned)member.m_min;
+         buckets[(size_t)((key * m_bucketMultiplier) >> m_bucketShift)].push_back(key);
+      }
+
+      // The fullest buckets are the hardest to place, so they go first while most slots are free
+      for (uint32_t i = 0; i < bucketCount; ++i)
+      {
+         order[i] = i;
+      }
+      std::stable_sort(order.begin(), order.end(), [&buckets](uint32_t left, uint32_t right) { return buckets[left].size() > buckets[right].size(); });
+
+      isUsed.assign(size, 0);
+      m_displacements.assign(bucketCount, 0);
+      bool isPerfect = true;
+      for (size_t i = 0; i < bucketCount && isPerfect && buckets[order[i]].empty() == false; ++i)
+      {
+         const std::vector<uint64_t>& bucket = buckets[order[i]];
+         isPerfect = false;
+         for (size_t displacement = 0; displacement < size && isPerfect == false; ++displacement)
+         {
+            // Keys sharing a bucket can't share a slot hash either, as the displacement moves them together
+            size_t placed = 0;
+            for (; placed < bucket.size(); ++placed)
+            {
+               const size_t slot = (size_t)((bucket[placed] * m_slotMultiplier) >> m_slotShift) ^ displacement;
+               if (isUsed[slot] != 0)
+               {
+                  break;
+               }
+               isUsed[slot] = 1;
+            }
+
+            if (placed == bucket.size())
+            {
+               m_displacements[order[i]] = (uint32_t)displacement;
+               isPerfect = true;
+               break;
+            }
+
+            for (size_t j = 0; j < placed; ++j)
+            {
+               isUsed[(size_t)((bucket[j] * m_slotMultiplier) >> m_slotShift) ^ displacement] = 0;
+            }
+         }
+      }
+
+      if (isPerfect == false)
+      {
+         continue;
+      }
+
+      // Empty slots hold the first member, which belongs in a slot of its own, so no value landing
+      // in an empty slot can ever match
+      m_slots.assign(size, m_members[0].m_min);
+      for (const Interval& member : m_members)
+      {
+         m_slots[GetSlot(member.m_min)] = member.m_min;
+      }
+      return true;
+   }
+
+   m_slots.clear();
+   m_displacements.clear();
+   m_bucketMultiplier = 0;
+   m_slotMultiplier = 0;
+   m_bucketShift = 0;
+   m_slotShift = 0;
+   return false;
+}
+
+template <ExpressionValueType T>
+void BasicCompiledExpression<T>::Set::Evaluate(const T* pValues, uint8_t* pMask, size_t count, bool isNegated) const
+{
+   // Picking the lookup once keeps it out of the loop. Everything the lookups read is copied to
+   // locals first, as writing the mask could otherwise change any of it as far as the compiler knows.
+   const uint8_t inSet = isNegated ? 0 : 1;
+   auto evaluateEach = [&](auto contains)
+   {
+      for (size_t i = 0; i < count; ++i)
+      {
+         pMask[i] = contains(pValues[i]) ? inSet : (uint8_t)(1 - inSet);
+      }
+   };
+
+   if constexpr (std::is_integral_v<T>)
+   {
+      using Unsigned = std::make_unsigned_t<T>;
+      switch (m_kind)
+      {
+         case Kind::Bitmap:
+         {
+            const uint64_t* pWords = m_words.data();
+            const Unsigned min = (Unsigned)m_bitmapMin;
+            const uint64_t range = m_bitmapRange;
+            evaluateEach([pWords, min, range](T value)
+            {
+               const uint64_t bit = (Unsigned)((Unsigned)value - min);
+               return bit <= range && ((pWords[(size_t)(bit >> 6)] >> (bit & 63)) & 1) != 0;
+            });
+            return;
+         }
+
+         case Kind::Hash:
+         {
+            const T* pSlots = m_slots.data();
+            const uint32_t* pDisplacements = m_displacements.data();
+            const uint64_t bucketMultiplier = m_bucketMultiplier;
+            const uint64_t slotMultiplier = m_slotMultiplier;
+            const uint32_t bucketShift = m_bucketShift;
+            const uint32_t slotShift = m_slotShift;
+            evaluateEach([=](T value)
+            {
+               const uint64_t key = (Unsigned)value;
+               const size_t bucket = (size_t)((key * bucketMultiplier) >> bucketShift);
+               return pSlots[(size_t)((key * slotMultiplier) >> slotShift) ^ pDisplacements[bucket]] == value;
+            });
+            return;
+         }
+
+         case Kind::Sorted:
+            break;
+      }
+   }
+   evaluateEach([this](T value) { return ContainsSorted(value); });
+}
+
+template <ExpressionValueType T>
+size_t BasicCompiledExpression<T>::Set::GetMemoryCost() const
+{
+   return m_members.size() * sizeof(Interval) + m_words.size() * sizeof(uint64_t) + m_slots.size() * sizeof(T) + m_displacements.size() * sizeof(uint32_t);
+}
+
+#define INSTANTIATE(T) template class BasicCompiledExpression<T>::Set;
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
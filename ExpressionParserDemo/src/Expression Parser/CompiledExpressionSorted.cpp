@@ -0,0 +1,138 @@
+#include "CompiledExpression.h"
+#include "ExpressionIntervals.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace ExpressionIntervals;
+
+
+namespace
+{
+   // Find the end of the run starting at first, being the index of the first value above max. The
+   // value at first must be in the run. Stepping out in doubling strides from the start of the run
+   // finds its end in time proportional to the log of its length, however many values follow it.
+   // NaN compares false against everything, so any trailing NaN is treated as being past the end.
+   template <typename T>
+   size_t FindRunEnd(std::span<const T> values, size_t first, T max)
+   {
+      size_t low = first + 1;
+      size_t stride = 1;
+      while (low + stride - 1 < values.size() && values[low + stride - 1] <= max)
+      {
+         low += stride;
+         stride *= 2;
+      }
+
+      const size_t high = std::min(low + stride - 1, values.size());
+      return (size_t)(std::partition_point(values.begin() + low, values.begin() + high, [max](T value) { return value <= max; }) - values.begin());
+   }
+}
+
+
+/****************************************
+   Compiled Expression
+****************************************/
+
+template <ExpressionValueType T>
+size_t BasicCompiledExpression<T>::EvaluateSorted(std::span<const T> values, std::vector<ResultRun>& runs) const
+{
+   const size_t initialCount = runs.size();
+   auto addRun = [&runs, initialCount](size_t first, size_t count, bool passes)
+   {
+      // Only NaN can follow a run with another of the same result, as passing and failing runs
+      // otherwise alternate
+      if (runs.size() > initialCount && runs.back().m_passes == passes)
+      {
+         runs.back().m_count += count;
+      }
+      else
+      {
+         runs.push_back({ first, count, passes });
+      }
+   };
+
+   size_t interval = 0;
+   size_t at = 0;
+   while (at < values.size())
+   {
+      const T value = values[at];
+      if (value != value)
+      {
+         addRun(at, 1, EvaluateProgram(value));
+         ++at;
+         continue;
+      }
+
+      // The values only ever go up, so the intervals are only ever stepped forwards
+      while (interval < m_intervals.size() && m_intervals[interval].m_max < value)
+      {
+         ++interval;
+      }
+
+      // The run ends either with the interval holding the value, or with the gap before the next
+      const bool passes = interval < m_intervals.size() && m_intervals[interval].m_min <= value;
+      const T runMax = passes ? m_intervals[interval].m_max
+         : interval < m_intervals.size() ? Previous(m_intervals[interval].m_min) : MaxValue<T>;
+
+      const size_t end = FindRunEnd(values, at, runMax);
+      addRun(at, end - at, passes);
+      at = end;
+   }
+   return runs.size() - initialCount;
+}
+
+template <ExpressionValueType T>
+void BasicCompiledExpression<T>::EvaluateBySorting(std::span<const T> values, std::span<uint8_t> results) const
+{
+   assert(results.size() >= values.size());
+
+   // Each value is sorted along with its index, so the results can be scattered back through them
+   struct IndexedValue
+   {
+      T m_value;
+      size_t m_index;
+   };
+   std::vector<IndexedValue> order(values.size());
+   for (size_t i = 0; i < values.size(); ++i)
+   {
+      order[i] = { values[i], i };
+   }
+   std::sort(order.begin(), order.end(), [](const IndexedValue& a, const IndexedValue& b)
+   {
+      if constexpr (std::is_floating_point_v<T>)
+      {
+         // NaN goes after everything else, which is where EvaluateSorted() needs it
+         const bool isNaNA = a.m_value != a.m_value;
+         const bool isNaNB = b.m_value != b.m_value;
+         if (isNaNA || isNaNB)
+         {
+            return isNaNA == false && isNaNB;
+         }
+      }
+      return a.m_value < b.m_value;
+   });
+
+   std::vector<T> sorted(values.size());
+   for (size_t i = 0; i < order.size(); ++i)
+   {
+      sorted[i] = order[i].m_value;
+   }
+
+   std::vector<ResultRun> runs;
+   EvaluateSorted(sorted, runs);
+   for (const ResultRun& run : runs)
+   {
+      const uint8_t result = run.m_passes ? 1 : 0;
+      for (size_t i = run.m_first; i < run.m_first + run.m_count; ++i)
+      {
+         results[order[i].m_index] = result;
+      }
+   }
+}
+
+#define INSTANTIATE(T) \
+   template size_t BasicCompiledExpression<T>::EvaluateSorted(std::span<const T>, std::vector<ResultRun>&) const; \
+   template void BasicCompiledExpression<T>::EvaluateBySorting(std::span<const T>, std::span<uint8_t>) const;
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
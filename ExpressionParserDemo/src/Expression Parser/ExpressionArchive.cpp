@@ -0,0 +1,449 @@
+#include "ExpressionArchive.h"
+
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+
+namespace
+{
+   using Instruction = CompiledExpression::Instruction;
+   using Interval = CompiledExpression::Interval;
+
+   // "EXPA" when read as bytes.
+   constexpr uint32_t ArchiveMagic = 0x41505845;
+
+   // Every section starts on this alignment, which covers all of the records in them.
+   constexpr size_t SectionAlignment = 8;
+
+   // Section offsets and counts, and the indices in every record, are 32 bit. Keeping the whole
+   // archive within this size keeps all of them in range.
+   constexpr size_t MaxArchiveSize = std::numeric_limits<uint32_t>::max();
+
+   struct Section
+   {
+      uint32_t m_offset;
+      uint32_t m_count;
+   };
+
+   struct ArchiveHeader
+   {
+      uint32_t m_magic;
+      uint32_t m_version;
+
+      // Covers every byte after itself, up to the end of the archive.
+      uint64_t m_checksum;
+      uint64_t m_size;
+
+      Section m_records;
+      Section m_instructions;
+      Section m_intervals;
+
+      // The RuleSet index, see RuleSet for how it is laid out.
+      Section m_segmentStarts;
+      Section m_nodeOffsets;
+      Section m_nodeRules;
+      uint32_t m_ruleCount;
+      uint32_t m_reserved;
+   };
+
+   // Records are used straight from the archive, so their layout is the format.
+   static_assert(std::endian::native == std::endian::little, "Archives are little endian");
+   static_assert(sizeof(ArchiveHeader) == 80);
+   static_assert(sizeof(Instruction) == 16 && offsetof(Instruction, m_field) == 2 && offsetof(Instruction, m_value) == 4 && offsetof(Instruction, m_onTrue) == 8);
+   static_assert(sizeof(Interval) == 8);
+   static_assert(sizeof(RuleSet::RuleId) == 4);
+
+   constexpr size_t ChecksumEnd = offsetof(ArchiveHeader, m_checksum) + sizeof(uint64_t);
+
+   // FNV-1a taken a word at a time rather than a byte at a time. Every step is reversible, so any
+   // single changed word always changes the result, and it is quick enough to check on every load.
+   uint64_t ComputeChecksum(std::span<const uint8_t> data)
+   {
+      constexpr uint64_t Prime = 0x100000001B3ull;
+      uint64_t hash = 0xCBF29CE484222325ull;
+      size_t at = 0;
+      for (; at + sizeof(uint64_t) <= data.size(); at += sizeof(uint64_t))
+      {
+         uint64_t word;
+         std::memcpy(&word, data.data() + at, sizeof(word));
+         hash = (hash ^ word) * Prime;
+      }
+      for (; at < data.size(); ++at)
+      {
+         hash = (hash ^ data[at]) * Prime;
+      }
+      return hash;
+   }
+
+   size_t AlignSection(size_t offset)
+   {
+      return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+   }
+
+   // Get the records of a section, returning false if any of it falls outside of the archive.
+   template <typename Record>
+   bool GetSection(std::span<const uint8_t> data, const Section& section, std::span<const Record>& records)
+   {
+      if (section.m_offset % SectionAlignment != 0 || section.m_offset > data.size()
+         || section.m_count > (data.size() - section.m_offset) / sizeof(Record))
+      {
+         return false;
+      }
+
+      records = std::span<const Record>(reinterpret_cast<const Record*>(data.data() + section.m_offset), section.m_count);
+      return true;
+   }
+
+   template <typename Record>
+   void SetSection(std::vector<uint8_t>& archive, const Section& section, const std::vector<Record>& records)
+   {
+      if (records.empty() == false)
+      {
+         std::memcpy(archive.data() + section.m_offset, records.data(), records.size() * sizeof(Record));
+      }
+   }
+}
+
+
+/****************************************
+   Expression Archive Writer
+****************************************/
+
+ExpressionArchiveWriter::ParseResult ExpressionArchiveWriter::Add(RuleSet::RuleId id, std::string_view expression)
+{
+   m_parser.Clear();
+   const ParseResult result = m_parser.Parse(expression);
+   if (result == ParseResult::OK)
+   {
+      Add(id, m_parser.GetCompiledExpression());
+   }
+   return result;
+}
+
+void ExpressionArchiveWriter::Add(RuleSet::RuleId id, const CompiledExpression& expression)
+{
+   const std::span<const Instruction> instructions = expression.GetInstructions();
+   const std::span<const Interval> intervals = expression.GetIntervals();
+
+   // The indices can only wrap past an archive size Write() refuses to lay out
+   m_records.push_back({ id, expression.GetEntry(), (uint32_t)m_instructions.size(), (uint32_t)instructions.size(),
+      (uint32_t)m_intervals.size(), (uint32_t)intervals.size(), expression.GetFieldCount(), (uint32_t)expression.GetEvaluationMode() });
+
+   // Instructions have a byte of padding, copy each field over so it is always written as zero
+   for (const Instruction& instruction : instructions)
+   {
+      Instruction& copy = m_instructions.emplace_back();
+      std::memset(&copy, 0, sizeof(copy));
+      copy.m_operation = instruction.m_operation;
+      copy.m_field = instruction.m_field;
+      copy.m_value = instruction.m_value;
+      copy.m_onTrue = instruction.m_onTrue;
+      copy.m_onFalse = instruction.m_onFalse;
+   }
+   m_intervals.insert(m_intervals.end(), intervals.begin(), intervals.end());
+
+   m_ruleSet.Add(id, expression);
+}
+
+std::vector<uint8_t> ExpressionArchiveWriter::Write()
+{
+   m_ruleSet.Build();
+
+   ArchiveHeader header = {};
+   header.m_magic = ArchiveMagic;
+   header.m_version = ExpressionArchive::Version;
+   header.m_ruleCount = (uint32_t)m_ruleSet.GetRuleCount();
+
+   size_t size = sizeof(ArchiveHeader);
+   auto addSection = [&size](Section& section, size_t count, size_t recordSize)
+   {
+      size = AlignSection(size);
+      section = { (uint32_t)size, (uint32_t)count };
+      size += count * recordSize;
+   };
+   addSection(header.m_records, m_records.size(), sizeof(ExpressionRecord));
+   addSection(header.m_instructions, m_instructions.size(), sizeof(Instruction));
+   addSection(header.m_intervals, m_intervals.size(), sizeof(Interval));
+   addSection(header.m_segmentStarts, m_ruleSet.m_segmentStarts.size(), sizeof(int));
+   addSection(header.m_nodeOffsets, m_ruleSet.m_nodeOffsets.size(), sizeof(uint32_t));
+   addSection(header.m_nodeRules, m_ruleSet.m_nodeRules.size(), sizeof(RuleSet::RuleId));
+
+   if (AlignSection(size) > MaxArchiveSize)
+   {
+      return {};
+   }
+
+   std::vector<uint8_t> archive(AlignSection(size), 0);
+   header.m_size = archive.size();
+   SetSection(archive, header.m_records, m_records);
+   SetSection(archive, header.m_instructions, m_instructions);
+   SetSection(archive, header.m_intervals, m_intervals);
+   SetSection(archive, header.m_segmentStarts, m_ruleSet.m_segmentStarts);
+   SetSection(archive, header.m_nodeOffsets, m_ruleSet.m_nodeOffsets);
+   SetSection(archive, header.m_nodeRules, m_ruleSet.m_nodeRules);
+
+   std::memcpy(archive.data(), &header, sizeof(header));
+   header.m_checksum = ComputeChecksum(std::span<const uint8_t>(archive).subspan(ChecksumEnd));
+   std::memcpy(archive.data() + offsetof(ArchiveHeader, m_checksum), &header.m_checksum, sizeof(header.m_checksum));
+   return archive;
+}
+
+bool ExpressionArchiveWriter::WriteToFile(const std::string& path)
+{
+   const std::vector<uint8_t> archive = Write();
+   if (archive.empty())
+   {
+      return false;
+   }
+
+   std::ofstream file(path, std::ios::binary | std::ios::trunc);
+   file.write(reinterpret_cast<const char*>(archive.data()), (std::streamsize)archive.size());
+   return file.good();
+}
+
+void ExpressionArchiveWriter::Clear()
+{
+   m_parser.Clear();
+   m_ruleSet.Clear();
+   m_records.clear();
+   m_instructions.clear();
+   m_intervals.clear();
+}
+
+
+/****************************************
+   Expression Archive
+****************************************/
+
+ExpressionArchive::ExpressionArchive()
+   : m_ruleCount(0)
+{}
+
+ExpressionArchive::~ExpressionArchive()
+{
+   Close();
+}
+
+ExpressionArchive::LoadResult ExpressionArchive::Load(const std::string& path, bool verifyChecksum)
+{
+   Close();
+
+   if (m_file.Open(path) == false)
+   {
+      return LoadResult::FileError;
+   }
+   m_data = m_file.GetData();
+
+   const LoadResult result = Validate(verifyChecksum);
+   if (result != LoadResult::OK)
+   {
+      Close();
+   }
+   return result;
+}
+
+ExpressionArchive::LoadResult ExpressionArchive::Attach(std::span<const uint8_t> data, bool verifyChecksum)
+{
+   Close();
+
+   if (reinterpret_cast<uintptr_t>(data.data()) % SectionAlignment != 0)
+   {
+      return LoadResult::InvalidHeader;
+   }
+
+   m_data = data;
+   const LoadResult result = Validate(verifyChecksum);
+   if (result != LoadResult::OK)
+   {
+      Close();
+   }
+   return result;
+}
+
+void ExpressionArchive::Close()
+{
+   m_file.Close();
+   m_data = {};
+   m_records = {};
+   m_instructions = {};
+   m_intervals = {};
+   m_segmentStarts = {};
+   m_nodeOffsets = {};
+   m_nodeRules = {};
+   m_ruleCount = 0;
+}
+
+RuleSet::RuleId ExpressionArchive::GetId(size_t index) const
+{
+   return GetRecord(index).m_id;
+}
+
+bool ExpressionArchive::Evaluate(size_t index, int value) const
+{
+   const ExpressionRecord& record = GetRecord(index);
+   if (record.m_evaluationMode == (uint32_t)CompiledExpression::EvaluationMode::Intervals)
+   {
+      return CompiledExpression::EvaluateIntervals(GetIntervals(record), value);
+   }
+   return CompiledExpression::EvaluateProgram(GetInstructions(record), record.m_entry, value);
+}
+
+bool ExpressionArchive::EvaluateRow(size_t index, std::span<const int> row) const
+{
+   const ExpressionRecord& record = GetRecord(index);
+   assert(row.size() >= record.m_fieldCount);
+   return CompiledExpression::EvaluateProgramRow(GetInstructions(record), record.m_entry, row);
+}
+
+std::span<const CompiledExpression::Interval> ExpressionArchive::GetIntervals(size_t index) const
+{
+   return GetIntervals(GetRecord(index));
+}
+
+uint32_t ExpressionArchive::GetFieldCount(size_t index) const
+{
+   return GetRecord(index).m_fieldCount;
+}
+
+size_t ExpressionArchive::Match(int value, std::vector<RuleSet::RuleId>& matches) const
+{
+   if (IsLoaded() == false)
+   {
+      matches.clear();
+      return 0;
+   }
+   return RuleSet::Match(m_segmentStarts, m_nodeOffsets, m_nodeRules, value, matches);
+}
+
+std::string_view ExpressionArchive::GetLoadResultMessage(LoadResult result)
+{
+   switch (result)
+   {
+      case LoadResult::OK:                   return "OK";
+      case LoadResult::FileError:            return "The file couldn't be opened or mapped.";
+      case LoadResult::InvalidHeader:        return "The data doesn't start with an expression archive header.";
+      case LoadResult::UnsupportedVersion:   return "The archive was written by a different version.";
+      case LoadResult::ChecksumMismatch:     return "The archive's checksum doesn't match its contents.";
+      case LoadResult::InvalidData:          return "The archive's contents are inconsistent.";
+   }
+   return "Unknown load result.";
+}
+
+ExpressionArchive::LoadResult ExpressionArchive::Validate(bool verifyChecksum)
+{
+   if (m_data.size() < sizeof(ArchiveHeader))
+   {
+      return LoadResult::InvalidHeader;
+   }
+
+   ArchiveHeader header;
+   std::memcpy(&header, m_data.data(), sizeof(header));
+   if (header.m_magic != ArchiveMagic || header.m_size != m_data.size())
+   {
+      return LoadResult::InvalidHeader;
+   }
+   if (header.m_version != Version)
+   {
+      return LoadResult::UnsupportedVersion;
+   }
+   if (verifyChecksum && ComputeChecksum(m_data.subspan(ChecksumEnd)) != header.m_checksum)
+   {
+      return LoadResult::ChecksumMismatch;
+   }
+
+   if (GetSection(m_data, header.m_records, m_records) == false
+      || GetSection(m_data, header.m_instructions, m_instructions) == false
+      || GetSection(m_data, header.m_intervals, m_intervals) == false
+      || GetSection(m_data, header.m_segmentStarts, m_segmentStarts) == false
+      || GetSection(m_data, header.m_nodeOffsets, m_nodeOffsets) == false
+      || GetSection(m_data, header.m_nodeRules, m_nodeRules) == false)
+   {
+      return LoadResult::InvalidData;
+   }
+   m_ruleCount = header.m_ruleCount;
+
+   // Everything evaluating an expression has to stay inside of it, and every jump has to go
+   // forwards so the evaluation always ends
+   for (const ExpressionRecord& record : m_records)
+   {
+      if (record.m_firstInstruction > m_instructions.size() || record.m_instructionCount > m_instructions.size() - record.m_firstInstruction
+         || record.m_firstInterval > m_intervals.size() || record.m_intervalCount > m_intervals.size() - record.m_firstInterval
+         || record.m_evaluationMode > (uint32_t)CompiledExpression::EvaluationMode::Intervals)
+      {
+         return LoadResult::InvalidData;
+      }
+
+      if (record.m_entry < Instruction::JumpToFalse && record.m_entry >= record.m_instructionCount)
+      {
+         return LoadResult::InvalidData;
+      }
+
+      auto isValidJump = [&record](uint32_t target, uint32_t from)
+      {
+         return target >= Instruction::JumpToFalse || (target > from && target < record.m_instructionCount);
+      };
+
+      const std::span<const Instruction> instructions = GetInstructions(record);
+      for (uint32_t at = 0; at < instructions.size(); ++at)
+      {
+         const Instruction& instruction = instructions[at];
+         if (isValidJump(instruction.m_onTrue, at) == false || isValidJump(instruction.m_onFalse, at) == false || instruction.m_field >= record.m_fieldCount)
+         {
+            return LoadResult::InvalidData;
+         }
+      }
+
+      // The interval search relies on them being sorted with gaps between them
+      const std::span<const Interval> intervals = GetIntervals(record);
+      for (size_t i = 0; i < intervals.size(); ++i)
+      {
+         if (intervals[i].m_min > intervals[i].m_max || (i > 0 && intervals[i - 1].m_max >= intervals[i].m_min))
+         {
+            return LoadResult::InvalidData;
+         }
+      }
+   }
+
+   // Every value has to fall in a segment, and every node's rules have to be inside of the rules
+   if (m_segmentStarts.empty() || m_segmentStarts[0] != std::numeric_limits<int>::min()
+      || m_nodeOffsets.size() != m_segmentStarts.size() * 2 + 1 || m_nodeOffsets[0] != 0 || m_nodeOffsets.back() != m_nodeRules.size())
+   {
+      return LoadResult::InvalidData;
+   }
+   for (size_t i = 1; i < m_segmentStarts.size(); ++i)
+   {
+      if (m_segmentStarts[i - 1] >= m_segmentStarts[i])
+      {
+         return LoadResult::InvalidData;
+      }
+   }
+   for (size_t i = 1; i < m_nodeOffsets.size(); ++i)
+   {
+      if (m_nodeOffsets[i - 1] > m_nodeOffsets[i])
+      {
+         return LoadResult::InvalidData;
+      }
+   }
+
+   return LoadResult::OK;
+}
+
+const ExpressionArchive::ExpressionRecord& ExpressionArchive::GetRecord(size_t index) const
+{
+   assert(index < m_records.size());
+   return m_records[index];
+}
+
+std::span<const CompiledExpression::Instruction> ExpressionArchive::GetInstructions(const ExpressionRecord& record) const
+{
+   return m_instructions.subspan(record.m_firstInstruction, record.m_instructionCount);
+}
+
+std::span<const CompiledExpression::Interval> ExpressionArchive::GetIntervals(const ExpressionRecord& record) const
+{
+   return m_intervals.subspan(record.m_firstInterval, record.m_intervalCount);
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "ExpressionParser.h"
+#include "MappedFile.h"
+#include "RuleSet.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compiles expressions into a binary archive, which ExpressionArchive can then evaluate straight
+// from memory. Expressions are added with the id of the rule they belong to, and the archive also
+// holds a RuleSet index built over all of them.
+//
+// The archive starts with a versioned header followed by sections of fixed size records, every
+// reference between them being an offset or an index rather than a pointer. So the archive can be
+// mapped at any address and used as it is. A checksum over everything after the checksum itself
+// catches files that have been truncated or corrupted.
+class ExpressionArchiveWriter
+{
+public:
+   using ParseResult = ExpressionParser::ParseResult;
+
+   // Bind a field name for the expressions added after it, see ExpressionParser::BindField().
+   bool BindField(std::string_view name, uint16_t column) { return m_parser.BindField(name, column); }
+
+   // Parse the expression and add it to the archive. Nothing is added unless it parses, with the
+   // reason it failed being available from GetErrorMessage().
+   ParseResult Add(RuleSet::RuleId id, std::string_view expression);
+   void Add(RuleSet::RuleId id, const CompiledExpression& expression);
+
+   std::string GetErrorMessage() const { return m_parser.GetErrorMessage(); }
+
+   size_t GetExpressionCount() const { return m_records.size(); }
+
+   // Build the rule set index and lay out the whole archive. Every offset in an archive is 32 bit,
+   // so an archive over 4 GiB can't be written, with Write() returning nothing and WriteToFile()
+   // returning false without creating the file.
+   std::vector<uint8_t> Write();
+   bool WriteToFile(const std::string& path);
+
+   void Clear();
+
+private:
+   friend class ExpressionArchive;
+
+   // How each expression is stored in the archive. Its instructions and intervals are indices
+   // into the sections holding every expression's, with the jump targets of its instructions
+   // being relative to its first instruction the same as in a compiled expression.
+   struct ExpressionRecord
+   {
+      RuleSet::RuleId m_id;
+      uint32_t m_entry;
+      uint32_t m_firstInstruction;
+      uint32_t m_instructionCount;
+      uint32_t m_firstInterval;
+      uint32_t m_intervalCount;
+      uint32_t m_fieldCount;
+      uint32_t m_evaluationMode;
+   };
+
+private:
+   ExpressionParser m_parser;
+   RuleSet m_ruleSet;
+
+   std::vector<ExpressionRecord> m_records;
+   std::vector<CompiledExpression::Instruction> m_instructions;
+   std::vector<CompiledExpression::Interval> m_intervals;
+};
+
+// A loaded archive, evaluating the expressions in it without parsing or allocating anything for
+// them. An archive is read only once loaded, so it can be evaluated from any number of threads.
+class ExpressionArchive
+{
+public:
+   enum class LoadResult : uint8_t
+   {
+      OK = 0,
+
+      FileError,
+      InvalidHeader,
+      UnsupportedVersion,
+      ChecksumMismatch,
+      InvalidData
+   };
+
+   // The archive version written by ExpressionArchiveWriter, and the only version loaded.
+   static constexpr uint32_t Version = 1;
+
+   ExpressionArchive();
+   ~ExpressionArchive();
+
+   // A mapped archive is unmapped along with the instance.
+   ExpressionArchive(const ExpressionArchive&) = delete;
+   ExpressionArchive& operator=(const ExpressionArchive&) = delete;
+
+   // Map the file into memory and validate it, closing any archive already loaded. Nothing is
+   // copied out of the mapping, pages are only read in as the expressions using them are evaluated.
+   // Checking the checksum reads the whole file, everything else is checked either way.
+   LoadResult Load(const std::string& path, bool verifyChecksum = true);
+
+   // Validate and use an archive already in memory, which has to stay alive and unchanged for as
+   // long as it is being used. The data must be 8 byte aligned.
+   LoadResult Attach(std::span<const uint8_t> data, bool verifyChecksum = true);
+
+   void Close();
+
+   bool IsLoaded() const { return m_data.empty() == false; }
+
+   size_t GetExpressionCount() const { return m_records.size(); }
+   RuleSet::RuleId GetId(size_t index) const;
+
+   // Evaluate the expression at the index, the same as CompiledExpression::Evaluate() and
+   // CompiledExpression::EvaluateRow() for the expression it was written from.
+   bool Evaluate(size_t index, int value) const;
+   bool EvaluateRow(size_t index, std::span<const int> row) const;
+
+   std::span<const CompiledExpression::Interval> GetIntervals(size_t index) const;
+   uint32_t GetFieldCount(size_t index) const;
+
+   // Match a value against the rule set index, the same as RuleSet::Match() for a rule set with
+   // every expression in the archive added to it.
+   size_t Match(int value, std::vector<RuleSet::RuleId>& matches) const;
+   size_t GetRuleCount() const { return m_ruleCount; }
+
+   static std::string_view GetLoadResultMessage(LoadResult result);
+
+private:
+   using ExpressionRecord = ExpressionArchiveWriter::ExpressionRecord;
+
+   LoadResult Validate(bool verifyChecksum);
+
+   const ExpressionRecord& GetRecord(size_t index) const;
+   std::span<const CompiledExpression::Instruction> GetInstructions(const ExpressionRecord& record) const;
+   std::span<const CompiledExpression::Interval> GetIntervals(const ExpressionRecord& record) const;
+
+private:
+   std::span<const uint8_t> m_data;
+
+   // Holds the data when the archive was loaded from a file.
+   MappedFile m_file;
+
+   std::span<const ExpressionRecord> m_records;
+   std::span<const CompiledExpression::Instruction> m_instructions;
+   std::span<const CompiledExpression::Interval> m_intervals;
+   std::span<const int> m_segmentStarts;
+   std::span<const uint32_t> m_nodeOffsets;
+   std::span<const RuleSet::RuleId> m_nodeRules;
+   uint32_t m_ruleCount;
+};
@@ -0,0 +1,58 @@
+#include "ExpressionCache.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+/****************************************
+   Expression Cache
+****************************************/
+
+template <ExpressionValueType T>
+BasicExpressionCache<T>::BasicExpressionCache(const Compiled& expression, size_t entryCount)
+   : m_pExpression(&expression)
+   , m_version(expression.GetVersion())
+   , m_entries(std::bit_ceil(std::max<size_t>(entryCount, 2)))
+   , m_shift(64 - (uint32_t)std::countr_zero(m_entries.size()))
+   , m_hitCount(0)
+   , m_missCount(0)
+{
+   Clear();
+}
+
+template <ExpressionValueType T>
+void BasicExpressionCache<T>::Evaluate(std::span<const T> values, std::span<uint8_t> results)
+{
+   assert(results.size() >= values.size());
+   for (size_t i = 0; i < values.size(); ++i)
+   {
+      results[i] = Evaluate(values[i]) ? 1 : 0;
+   }
+}
+
+template <ExpressionValueType T>
+void BasicExpressionCache<T>::ResetCounters()
+{
+   m_hitCount = 0;
+   m_missCount = 0;
+}
+
+template <ExpressionValueType T>
+void BasicExpressionCache<T>::Clear()
+{
+   std::fill(m_entries.begin(), m_entries.end(), Entry{ 0, Entry::Empty });
+   m_version = m_pExpression->GetVersion();
+}
+
+template <ExpressionValueType T>
+bool BasicExpressionCache<T>::Miss(Entry& entry, Key key, T value)
+{
+   ++m_missCount;
+   const bool passes = m_pExpression->Evaluate(value);
+   entry = { key, passes ? Entry::Passes : Entry::Fails };
+   return passes;
+}
+
+#define INSTANTIATE(T) template class BasicExpressionCache<T>;
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
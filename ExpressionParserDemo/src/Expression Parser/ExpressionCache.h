@@ -0,0 +1,107 @@
+#pragma once
+
+#include "CompiledExpression.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Remembers the results of the most recently evaluated values, for input where the same few values
+// come up over and over. The cache is direct mapped: a value hashes to a single entry holding the
+// last value to land there and its result, so a repeated value costs a hash and a compare instead
+// of evaluating the expression, and a value missing simply takes the entry over. Values colliding
+// in the same entry keep evicting each other, so size the cache comfortably above the number of
+// values that make up most of the input.
+//
+// The cache refers to the expression rather than copying it, and checks its version before every
+// lookup, so once the parser holding the expression parses another string, or optimises or
+// simplifies it, the stale results are thrown away on the next Evaluate. The expression must
+// outlive the cache. A cache holds its own entries and counters, so give each thread its own cache
+// of the same expression, which is only ever read.
+template <ExpressionValueType T>
+class BasicExpressionCache
+{
+public:
+   using Compiled = BasicCompiledExpression<T>;
+
+   static constexpr size_t DefaultEntryCount = 1024;
+
+   // The number of entries is rounded up to a power of two, and is at least 2.
+   explicit BasicExpressionCache(const Compiled& expression, size_t entryCount = DefaultEntryCount);
+
+   // Evaluate a value, taking the result from the cache if it was the last value to land in its
+   // entry since the expression was compiled.
+   bool Evaluate(T value)
+   {
+      if (m_version != m_pExpression->GetVersion())
+      {
+         Clear();
+      }
+
+      const Key key = std::bit_cast<Key>(value);
+      Entry& entry = m_entries[(size_t)(((uint64_t)key * HashMultiplier) >> m_shift)];
+      if (entry.m_key == key && entry.m_state != Entry::Empty)
+      {
+         ++m_hitCount;
+         return entry.m_state == Entry::Passes;
+      }
+      return Miss(entry, key, value);
+   }
+
+   // Evaluate every value in the span through the cache, writing 1 to the matching result if it
+   // passes and 0 if not. The results span must be at least as large as the values span.
+   void Evaluate(std::span<const T> values, std::span<uint8_t> results);
+
+   // The number of lookups answered from the cache and the number that evaluated the expression,
+   // since the cache was created or its counters were last reset. Clearing keeps the counts.
+   uint64_t GetHitCount() const { return m_hitCount; }
+   uint64_t GetMissCount() const { return m_missCount; }
+   void ResetCounters();
+
+   size_t GetEntryCount() const { return m_entries.size(); }
+
+   // Forget every result, as happens by itself when the expression changes version.
+   void Clear();
+
+private:
+   // Values are compared and hashed by their bits, so a NaN is cached like any other value. Each
+   // NaN only ever gives the one result for a given expression, so that is safe.
+   using Key = std::conditional_t<sizeof(T) == sizeof(uint64_t), uint64_t, uint32_t>;
+
+   struct Entry
+   {
+      enum State : uint8_t
+      {
+         Empty,
+         Fails,
+         Passes,
+      };
+
+      Key m_key;
+      State m_state;
+   };
+
+   // Fibonacci hashing, taking the top bits of the product so every bit of the value counts.
+   static constexpr uint64_t HashMultiplier = 0x9E3779B97F4A7C15ull;
+
+   // Evaluate the value and store its result over whatever the entry held before.
+   bool Miss(Entry& entry, Key key, T value);
+
+private:
+   const Compiled* m_pExpression;
+   uint64_t m_version;
+
+   std::vector<Entry> m_entries;
+   uint32_t m_shift;
+
+   uint64_t m_hitCount;
+   uint64_t m_missCount;
+};
+
+using ExpressionCache = BasicExpressionCache<int32_t>;
+using Int64ExpressionCache = BasicExpressionCache<int64_t>;
+using FloatExpressionCache = BasicExpressionCache<float>;
+using DoubleExpressionCache = BasicExpressionCache<double>;
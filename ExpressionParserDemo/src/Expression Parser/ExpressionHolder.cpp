@@ -0,0 +1,158 @@
+#include "ExpressionHolder.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+/****************************************
+   Expression Holder
+****************************************/
+
+template <ExpressionValueType T>
+BasicExpressionHolder<T>::BasicExpressionHolder(size_t readerCapacity)
+   : m_pLive(new Compiled())
+   , m_epoch(0)
+   , m_slots(readerCapacity)
+{}
+
+template <ExpressionValueType T>
+BasicExpressionHolder<T>::~BasicExpressionHolder()
+{
+   assert(std::none_of(m_slots.begin(), m_slots.end(), [](const ReaderSlot& slot) { return slot.m_isClaimed.load(); }));
+   delete m_pLive.load();
+}
+
+template <ExpressionValueType T>
+std::optional<typename BasicExpressionHolder<T>::Reader> BasicExpressionHolder<T>::CreateReader()
+{
+   for (ReaderSlot& slot : m_slots)
+   {
+      bool isClaimed = false;
+      if (slot.m_isClaimed.compare_exchange_strong(isClaimed, true))
+      {
+         return Reader(this, &slot);
+      }
+   }
+   return std::nullopt;
+}
+
+template <ExpressionValueType T>
+bool BasicExpressionHolder<T>::BindField(std::string_view name, uint16_t column)
+{
+   const std::lock_guard<std::mutex> lock(m_writerLock);
+   return m_parser.BindField(name, column);
+}
+
+template <ExpressionValueType T>
+typename BasicExpressionHolder<T>::ParseResult BasicExpressionHolder<T>::Publish(std::string_view expression)
+{
+   const std::lock_guard<std::mutex> lock(m_writerLock);
+
+   // The parser only ever holds the expression being published, the live one is a copy of its own
+   m_parser.Clear();
+   const ParseResult result = m_parser.Parse(expression);
+   if (result == ParseResult::OK)
+   {
+      PublishLocked(std::make_unique<const Compiled>(m_parser.GetCompiledExpression()));
+   }
+   return result;
+}
+
+template <ExpressionValueType T>
+void BasicExpressionHolder<T>::Publish(const Compiled& expression)
+{
+   const std::lock_guard<std::mutex> lock(m_writerLock);
+   PublishLocked(std::make_unique<const Compiled>(expression));
+}
+
+template <ExpressionValueType T>
+std::string BasicExpressionHolder<T>::GetErrorMessage() const
+{
+   const std::lock_guard<std::mutex> lock(m_writerLock);
+   return m_parser.GetErrorMessage();
+}
+
+template <ExpressionValueType T>
+size_t BasicExpressionHolder<T>::Reclaim()
+{
+   const std::lock_guard<std::mutex> lock(m_writerLock);
+   return ReclaimLocked();
+}
+
+template <ExpressionValueType T>
+size_t BasicExpressionHolder<T>::GetRetiredCount() const
+{
+   const std::lock_guard<std::mutex> lock(m_writerLock);
+   return m_retired.size();
+}
+
+template <ExpressionValueType T>
+void BasicExpressionHolder<T>::PublishLocked(std::unique_ptr<const Compiled> pExpression)
+{
+   // Only readers announcing this epoch or an earlier one can have loaded the old expression, as
+   // anyone announcing the next epoch does so after the swap
+   const Compiled* pOld = m_pLive.exchange(pExpression.release());
+   const uint64_t epoch = m_epoch.fetch_add(1);
+   m_retired.push_back({ std::unique_ptr<const Compiled>(pOld), epoch });
+   ReclaimLocked();
+}
+
+template <ExpressionValueType T>
+size_t BasicExpressionHolder<T>::ReclaimLocked()
+{
+   uint64_t oldestEpoch = Outside;
+   for (const ReaderSlot& slot : m_slots)
+   {
+      oldestEpoch = std::min(oldestEpoch, slot.m_epoch.load());
+   }
+
+   std::erase_if(m_retired, [oldestEpoch](const Retired& retired) { return retired.m_epoch < oldestEpoch; });
+   return m_retired.size();
+}
+
+
+/****************************************
+   Reader
+****************************************/
+
+template <ExpressionValueType T>
+BasicExpressionHolder<T>::Reader::Reader(Reader&& other) noexcept
+   : m_pHolder(other.m_pHolder)
+   , m_pSlot(other.m_pSlot)
+{
+   other.m_pHolder = nullptr;
+   other.m_pSlot = nullptr;
+}
+
+template <ExpressionValueType T>
+typename BasicExpressionHolder<T>::Reader& BasicExpressionHolder<T>::Reader::operator=(Reader&& other) noexcept
+{
+   if (this != &other)
+   {
+      Release();
+      m_pHolder = other.m_pHolder;
+      m_pSlot = other.m_pSlot;
+      other.m_pHolder = nullptr;
+      other.m_pSlot = nullptr;
+   }
+   return *this;
+}
+
+template <ExpressionValueType T>
+BasicExpressionHolder<T>::Reader::~Reader()
+{
+   Release();
+}
+
+template <ExpressionValueType T>
+void BasicExpressionHolder<T>::Reader::Release()
+{
+   if (m_pSlot != nullptr)
+   {
+      m_pSlot->m_isClaimed.store(false, std::memory_order_release);
+   }
+}
+
+#define INSTANTIATE(T) template class BasicExpressionHolder<T>;
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "ExpressionParser.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Holds the live version of a rule so it can be replaced while other threads are evaluating it. A
+// writer parses the new expression off to the side with a parser of the holder's own, then
+// publishes it with a single atomic swap. Readers never wait on the writer or each other: each
+// evaluation announces the current epoch in the reader's own slot, loads the live expression,
+// evaluates it and clears the slot again, a fixed handful of atomic operations with no locks,
+// loops or reference counts.
+//
+// A replaced expression is retired along with the epoch it was replaced in, and is only destroyed
+// once no reader is still announcing that epoch or an earlier one, as only those readers can have
+// loaded it. Destroying happens on the writer's thread, during Publish() or Reclaim(), so a reader
+// never frees anything and a reload never stalls the threads evaluating the rule. A reader that
+// stays inside an evaluation holds back every expression retired since, not just the one it's
+// using, until it leaves.
+template <ExpressionValueType T>
+class BasicExpressionHolder
+{
+   struct ReaderSlot;
+
+public:
+   using Parser = BasicExpressionParser<T>;
+   using Compiled = BasicCompiledExpression<T>;
+   using ParseResult = typename Parser::ParseResult;
+
+   static constexpr size_t DefaultReaderCapacity = 64;
+
+   // A thread's handle for evaluating the held expression, which owns one of the holder's reader
+   // slots until it is destroyed. A reader is used by one thread at a time, and must be destroyed
+   // before the holder.
+   class Reader
+   {
+   public:
+      Reader(Reader&& other) noexcept;
+      Reader& operator=(Reader&& other) noexcept;
+      ~Reader();
+
+      bool Evaluate(T value) { return Read([value](const Compiled& expression) { return expression.Evaluate(value); }); }
+
+      // Evaluate every value in the span against the same version of the expression, writing 1 to
+      // the matching result if it passes and 0 if not. The results span must be at least as large
+      // as the values span.
+      void Evaluate(std::span<const T> values, std::span<uint8_t> results)
+      {
+         Read([values, results](const Compiled& expression) { expression.Evaluate(values, results); });
+      }
+
+      // Call function(const Compiled&) with the live expression, returning whatever it returns. The
+      // expression is only safe to use until the function returns, and keeps every expression
+      // retired in the meantime from being destroyed, so keep the function short.
+      template <typename Function>
+      decltype(auto) Read(Function&& function)
+      {
+         const Announcement announcement(*m_pHolder, *m_pSlot);
+         return function(*m_pHolder->m_pLive.load());
+      }
+
+   private:
+      friend class BasicExpressionHolder;
+
+      Reader(BasicExpressionHolder* pHolder, ReaderSlot* pSlot)
+         : m_pHolder(pHolder)
+         , m_pSlot(pSlot)
+      {}
+
+      void Release();
+
+      BasicExpressionHolder* m_pHolder;
+      ReaderSlot* m_pSlot;
+   };
+
+   // Starts out holding an empty expression, which fails every value. At most readerCapacity
+   // readers can exist at once.
+   explicit BasicExpressionHolder(size_t readerCapacity = DefaultReaderCapacity);
+   ~BasicExpressionHolder();
+
+   // The slots are shared with the readers, so the holder can't be moved or copied.
+   BasicExpressionHolder(const BasicExpressionHolder&) = delete;
+   BasicExpressionHolder& operator=(const BasicExpressionHolder&) = delete;
+
+   // Claim a reader slot, or return nothing if every slot is already claimed. Safe to call from any
+   // thread.
+   std::optional<Reader> CreateReader();
+
+   // Bind a field name for every later Publish of a string. See BasicExpressionParser::BindField.
+   bool BindField(std::string_view name, uint16_t column);
+
+   // Parse the expression and, if it parses, publish it in place of the live one. Anything failing
+   // to parse leaves the live expression as it was, with the error in GetErrorMessage(). Publishing
+   // from several threads is safe, each publish waits for the one before to finish.
+   ParseResult Publish(std::string_view expression);
+
+   // Publish a copy of an expression compiled elsewhere.
+   void Publish(const Compiled& expression);
+
+   // The error from the last Publish of a string, as BasicExpressionParser::GetErrorMessage().
+   std::string GetErrorMessage() const;
+
+   // Destroy every retired expression no reader can still be using, returning the number left
+   // waiting on readers. Publish does this itself, so this is only needed to free the last
+   // retired expressions when no more are coming.
+   size_t Reclaim();
+
+   // The number of expressions retired but not yet destroyed.
+   size_t GetRetiredCount() const;
+
+private:
+   // Slots are claimed by readers and hold the epoch a reader saw on entering an evaluation, or
+   // Outside. Each sits on its own cache line so readers announcing never contend.
+   static constexpr uint64_t Outside = std::numeric_limits<uint64_t>::max();
+
+   struct alignas(64) ReaderSlot
+   {
+      std::atomic<uint64_t> m_epoch = Outside;
+      std::atomic<bool> m_isClaimed = false;
+   };
+
+   // Announces the epoch in the slot for as long as it lives. The announcement and the load of the
+   // live expression after it are sequentially consistent along with the writer's swap and its scan
+   // of the slots, so a writer either sees the announcement or the reader sees the new expression.
+   class Announcement
+   {
+   public:
+      Announcement(const BasicExpressionHolder& holder, ReaderSlot& slot)
+         : m_slot(slot)
+      {
+         m_slot.m_epoch.store(holder.m_epoch.load());
+      }
+
+      ~Announcement() { m_slot.m_epoch.store(Outside, std::memory_order_release); }
+
+      Announcement(const Announcement&) = delete;
+      Announcement& operator=(const Announcement&) = delete;
+
+   private:
+      ReaderSlot& m_slot;
+   };
+
+   struct Retired
+   {
+      std::unique_ptr<const Compiled> m_pExpression;
+      uint64_t m_epoch;
+   };
+
+   // Swap in the new expression and retire the old one, then reclaim what can be. The writer lock
+   // must be held.
+   void PublishLocked(std::unique_ptr<const Compiled> pExpression);
+   size_t ReclaimLocked();
+
+private:
+   std::atomic<const Compiled*> m_pLive;
+   std::atomic<uint64_t> m_epoch;
+   std::vector<ReaderSlot> m_slots;
+
+   // Everything below belongs to the writers.
+   mutable std::mutex m_writerLock;
+   Parser m_parser;
+   std::vector<Retired> m_retired;
+};
+
+using ExpressionHolder = BasicExpressionHolder<int32_t>;
+using Int64ExpressionHolder = BasicExpressionHolder<int64_t>;
+using FloatExpressionHolder = BasicExpressionHolder<float>;
+using DoubleExpressionHolder = BasicExpressionHolder<double>;
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+// Working with the sorted, non overlapping intervals an expression passes. These are shared by the
+// passes that lower or rewrite the node graph, and only ever included from their source files.
+namespace ExpressionIntervals
+{
+   // The full range of values, which for floating point includes both infinities.
+   template <typename T>
+   constexpr T MinValue = std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::min();
+   template <typename T>
+   constexpr T MaxValue = std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+
+   // The values directly before and after the given one, which must not be at that end of the range.
+   template <typename T>
+   T Previous(T value)
+   {
+      if constexpr (std::is_floating_point_v<T>)
+      {
+         return std::nextafter(value, MinValue<T>);
+      }
+      else
+      {
+         return value - 1;
+      }
+   }
+
+   template <typename T>
+   T Next(T value)
+   {
+      if constexpr (std::is_floating_point_v<T>)
+      {
+         return std::nextafter(value, MaxValue<T>);
+      }
+      else
+      {
+         return value + 1;
+      }
+   }
+
+   // The union of intervals in any order, overlapping or not. Sorting them all and merging in one
+   // pass keeps a union of many terms from copying the result so far for every term added.
+   template <typename Interval>
+   std::pmr::vector<Interval> UnionAll(std::pmr::vector<Interval> intervals)
+   {
+      using T = decltype(Interval::m_min);
+      std::sort(intervals.begin(), intervals.end(), [](const Interval& a, const Interval& b) { return a.m_min < b.m_min; });
+
+      size_t count = 0;
+      for (const Interval& next : intervals)
+      {
+         if (count > 0 && (intervals[count - 1].m_max == MaxValue<T> || next.m_min <= Next(intervals[count - 1].m_max)))
+         {
+            intervals[count - 1].m_max = std::max(intervals[count - 1].m_max, next.m_max);
+         }
+         else
+         {
+            intervals[count++] = next;
+         }
+      }
+      intervals.resize(count);
+      return intervals;
+   }
+
+   template <typename Interval>
+   std::pmr::vector<Interval> Intersection(const std::pmr::vector<Interval>& a, const std::pmr::vector<Interval>& b)
+   {
+      std::pmr::vector<Interval> result(a.get_allocator());
+
+      size_t aAt = 0;
+      size_t bAt = 0;
+      while (aAt < a.size() && bAt < b.size())
+      {
+         const auto min = std::max(a[aAt].m_min, b[bAt].m_min);
+         const auto max = std::min(a[aAt].m_max, b[bAt].m_max);
+         if (min <= max)
+         {
+            result.push_back({ min, max });
+         }
+
+         // Whichever ends first can't overlap anything else
+         if (a[aAt].m_max < b[bAt].m_max)
+         {
+            ++aAt;
+         }
+         else
+         {
+            ++bAt;
+         }
+      }
+      return result;
+   }
+
+   // The intersection of every list, of which there must be at least one. Lists are intersected in
+   // pairs, then those results in pairs and so on, so each interval is copied once per level rather
+   // than once per list.
+   template <typename Interval>
+   std::pmr::vector<Interval> IntersectionAll(std::pmr::vector<std::pmr::vector<Interval>> lists)
+   {
+      for (size_t width = 1; width < lists.size(); width *= 2)
+      {
+         for (size_t i = 0; i + width < lists.size(); i += width * 2)
+         {
+            lists[i] = Intersection(lists[i], lists[i + width]);
+         }
+      }
+      return std::move(lists[0]);
+   }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The compare kernels batch evaluation is built on, shared with anything else evaluating blocks
+// of values. Only ever included from source files.
+namespace ExpressionKernels
+{
+   // Compare kernels write 1 to the mask for every value passing the comparison and 0 otherwise.
+   template <typename T>
+   using CompareKernel = void(*)(int operation, T constant, const T* pValues, uint8_t* pMask, size_t count);
+
+   // The widest compare kernel the CPU supports, picked once per value type the first time it is
+   // needed. Instantiated for every value type, see EXPRESSION_VALUE_TYPES.
+   template <typename T>
+   CompareKernel<T> GetCompareKernel();
+}
@@ -0,0 +1,363 @@
+#pragma once
+
+#include "ExpressionParser.h"
+
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+
+// Splits an expression string into tokens in a single pass without allocating. Whitespace is
+// optional between tokens, so "(>1 or <0)and>5" reads the same as "( >1 or <0 ) and >5". Any word
+// other than "and"/"or"/"in"/"notin" is read as a field name, which is left for the parser to look
+// up. Once "in{" or "notin{" has been read the members of the set are read with NextInSet().
+// Everything is constexpr so the same lexer is used when compiling expressions at compile time.
+// Comparison values are read as T.
+template <ExpressionValueType T>
+class ExpressionLexer
+{
+public:
+   struct Token
+   {
+      enum Type : uint8_t
+      {
+         Comparison,
+         Field,
+
+         // "in{" or "notin{", with the operation being EqualTo or NotEqualTo respectively.
+         Set,
+         // An inclusive range of values, eg: "10..20".
+         Range,
+
+         // Only returned by NextInSet(). Members are either a single value or a range.
+         SetMember,
+         Comma,
+         CloseSet,
+
+         OpenBrace,
+         CloseBrace,
+         And,
+         Or,
+         End,
+         Invalid,
+      };
+
+      Type m_type;
+      int m_operation;
+      T m_value;
+
+      // The end of a range or set member, which is the same as m_value for a single value.
+      T m_max;
+
+      // Where the token starts in the string. For invalid tokens this is where the problem is.
+      size_t m_at;
+
+      // Only set for invalid tokens.
+      ExpressionParserBase::ParseResult m_error;
+   };
+
+   constexpr explicit ExpressionLexer(std::string_view input)
+      : m_input(input)
+      , m_at(0)
+   {}
+
+   // Read the next token, returning an End token once the whole string has been read.
+   constexpr Token Next()
+   {
+      while (m_at < m_input.length() && IsWhitespace(m_input[m_at]))
+      {
+         ++m_at;
+      }
+
+      const size_t tokenStart = m_at;
+      if (m_at == m_input.length())
+      {
+         return MakeToken(Token::End, tokenStart);
+      }
+
+      switch (m_input[m_at])
+      {
+         case '(': ++m_at; return MakeToken(Token::OpenBrace, tokenStart);
+         case ')': ++m_at; return MakeToken(Token::CloseBrace, tokenStart);
+         case '<': case '>': case '=': case '!':
+            return ReadComparison();
+         case '&': case '|':
+         {
+            // Programmatic logic is always doubled up, eg: "&&"
+            const char logic = m_input[m_at];
+            if (m_at + 1 == m_input.length() || m_input[m_at + 1] != logic)
+            {
+               return MakeInvalid(ExpressionParserBase::ParseResult::InvalidLogic, tokenStart);
+            }
+            m_at += 2;
+            return MakeToken(logic == '&' ? Token::And : Token::Or, tokenStart);
+         }
+         default:
+            break;
+      }
+
+      if (IsDigit(m_input[m_at]) || m_input[m_at] == '-')
+      {
+         return ReadRange(Token::Range, tokenStart);
+      }
+
+      if (IsWordStart(m_input[m_at]))
+      {
+         while (m_at < m_input.length() && (IsWordStart(m_input[m_at]) || IsDigit(m_input[m_at])))
+         {
+            ++m_at;
+         }
+
+         const std::string_view word = m_input.substr(tokenStart, m_at - tokenStart);
+         if constexpr (std::is_floating_point_v<T>)
+         {
+            // Infinity is read as a value like any number, so it can start a range, eg: "inf..inf"
+            if ((word == "inf" || word == "infinity") && IsRangeNext(m_at))
+            {
+               m_at = tokenStart;
+               return ReadRange(Token::Range, tokenStart);
+            }
+         }
+
+         if (word == "and") { return MakeToken(Token::And, tokenStart); }
+         if (word == "or") { return MakeToken(Token::Or, tokenStart); }
+         if (word == "in" || word == "notin")
+         {
+            // The members of the set have to follow straight on
+            while (m_at < m_input.length() && IsWhitespace(m_input[m_at]))
+            {
+               ++m_at;
+            }
+            if (m_at == m_input.length() || m_input[m_at] != '{')
+            {
+               return MakeInvalid(ExpressionParserBase::ParseResult::InvalidExpression, tokenStart);
+            }
+            ++m_at;
+
+            Token token = MakeToken(Token::Set, tokenStart);
+            token.m_operation = word == "in" ? (int)CompiledExpressionBase::EqualTo : (int)CompiledExpressionBase::NotEqualTo;
+            return token;
+         }
+         return MakeToken(Token::Field, tokenStart);
+      }
+
+      return MakeInvalid(ExpressionParserBase::ParseResult::ParsingInvalidCharacter, tokenStart);
+   }
+
+   // Read the next token inside of a set, being a member, the comma between members or the brace
+   // closing the set. Reaching the end of the string first returns an End token.
+   constexpr Token NextInSet()
+   {
+      while (m_at < m_input.length() && IsWhitespace(m_input[m_at]))
+      {
+         ++m_at;
+      }
+
+      const size_t tokenStart = m_at;
+      if (m_at == m_input.length())
+      {
+         return MakeToken(Token::End, tokenStart);
+      }
+
+      switch (m_input[m_at])
+      {
+         case ',': ++m_at; return MakeToken(Token::Comma, tokenStart);
+         case '}': ++m_at; return MakeToken(Token::CloseSet, tokenStart);
+         default:  return ReadRange(Token::SetMember, tokenStart);
+      }
+   }
+
+   // The offset just past the last token read.
+   constexpr size_t GetPosition() const { return m_at; }
+
+   // Check if the whole string would be read as a single field name.
+   static constexpr bool IsFieldName(std::string_view name)
+   {
+      if (name.empty() || IsWordStart(name[0]) == false || name == "and" || name == "or" || name == "in" || name == "notin")
+      {
+         return false;
+      }
+
+      for (char c : name)
+      {
+         if (IsWordStart(c) == false && IsDigit(c) == false)
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+
+private:
+   static constexpr bool IsWhitespace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+   static constexpr bool IsWordStart(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+   static constexpr bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+   // Reads "<operator><value>", eg: "<5" or ">= -100"
+   constexpr Token ReadComparison()
+   {
+      const size_t tokenStart = m_at;
+      const char first = m_input[m_at++];
+      const bool hasEquals = m_at < m_input.length() && m_input[m_at] == '=';
+
+      int operation;
+      switch (first)
+      {
+         case '<': operation = hasEquals ? (int)CompiledExpressionBase::LessThan | (int)CompiledExpressionBase::EqualTo : (int)CompiledExpressionBase::LessThan; break;
+         case '>': operation = hasEquals ? (int)CompiledExpressionBase::GreaterThan | (int)CompiledExpressionBase::EqualTo : (int)CompiledExpressionBase::GreaterThan; break;
+         case '=': operation = (int)CompiledExpressionBase::EqualTo; break;
+         default:
+            // '!' is only valid as part of "!="
+            if (hasEquals == false)
+            {
+               return MakeInvalid(ExpressionParserBase::ParseResult::InvalidExpression, tokenStart);
+            }
+            operation = (int)CompiledExpressionBase::NotEqualTo;
+            break;
+      }
+
+      // "=" is already complete, anything else with an '=' following it has 2 characters
+      if (hasEquals && first != '=')
+      {
+         ++m_at;
+      }
+
+      while (m_at < m_input.length() && IsWhitespace(m_input[m_at]))
+      {
+         ++m_at;
+      }
+
+      // Either there is no number here, or it doesn't fit in T
+      T value = 0;
+      if (ReadValue(value) == false)
+      {
+         return MakeInvalid(ExpressionParserBase::ParseResult::InvalidExpression, tokenStart);
+      }
+
+      Token token = MakeToken(Token::Comparison, tokenStart);
+      token.m_operation = operation;
+      token.m_value = value;
+      return token;
+   }
+
+   // Reads "<min>..<max>", eg: "-10..10", which has to hold at least one value. Set members may
+   // also be a lone value, anywhere else a number on its own isn't a valid term.
+   constexpr Token ReadRange(Token::Type type, size_t tokenStart)
+   {
+      T min = 0;
+      if (ReadValue(min) == false)
+      {
+         return MakeInvalid(ExpressionParserBase::ParseResult::InvalidExpression, tokenStart);
+      }
+
+      if (IsRangeNext(m_at) == false)
+      {
+         return type == Token::SetMember
+            ? MakeRange(type, min, min, tokenStart)
+            : MakeInvalid(ExpressionParserBase::ParseResult::ParsingInvalidCharacter, tokenStart);
+      }
+
+      while (IsWhitespace(m_input[m_at]))
+      {
+         ++m_at;
+      }
+      m_at += 2;
+      while (m_at < m_input.length() && IsWhitespace(m_input[m_at]))
+      {
+         ++m_at;
+      }
+
+      T max = 0;
+      if (ReadValue(max) == false || max < min)
+      {
+         return MakeInvalid(ExpressionParserBase::ParseResult::InvalidExpression, tokenStart);
+      }
+      return MakeRange(type, min, max, tokenStart);
+   }
+
+   // Check if ".." comes next after any whitespace from the given position.
+   constexpr bool IsRangeNext(size_t at) const
+   {
+      while (at < m_input.length() && IsWhitespace(m_input[at]))
+      {
+         ++at;
+      }
+      return m_input.substr(at, 2) == "..";
+   }
+
+   // Reads an optionally negative number, returning false if there isn't one or it doesn't fit.
+   // Floating point values may also have a fraction and exponent, or be "inf". A number never
+   // runs on into "..", so "1..5" is read as 1 rather than as "1." followed by ".5".
+   constexpr bool ReadValue(T& value)
+   {
+      if (std::is_constant_evaluated() == false || std::is_floating_point_v<T>)
+      {
+         const char* pBegin = m_input.data() + m_at;
+         std::from_chars_result result = std::from_chars(pBegin, m_input.data() + m_input.length(), value);
+
+         // Only a number ending in a '.' that another '.' follows has run on into "..", in which case
+         // it is read again stopping short of that '.'
+         if (result.ptr > pBegin && result.ptr[-1] == '.' && result.ptr < m_input.data() + m_input.length() && result.ptr[0] == '.')
+         {
+            result = std::from_chars(pBegin, result.ptr - 1, value);
+         }
+         // A NaN constant would fail every comparison but "!=", which is never what was meant
+         if (result.ec != std::errc() || value != value)
+         {
+            return false;
+         }
+         m_at += result.ptr - pBegin;
+         return true;
+      }
+
+      // from_chars can't be used in constant expressions, so this does the same job by hand for the
+      // integer types. Accumulating as a negative number lets the minimum value be read without
+      // overflowing.
+      const bool isNegative = m_at < m_input.length() && m_input[m_at] == '-';
+      size_t at = isNegative ? m_at + 1 : m_at;
+      if (at == m_input.length() || IsDigit(m_input[at]) == false)
+      {
+         return false;
+      }
+
+      constexpr T MinValue = std::numeric_limits<T>::min();
+      T negativeValue = 0;
+      for (; at < m_input.length() && IsDigit(m_input[at]); ++at)
+      {
+         const T digit = (T)(m_input[at] - '0');
+         if (negativeValue < (MinValue + digit) / 10)
+         {
+            return false;
+         }
+         negativeValue = negativeValue * 10 - digit;
+      }
+
+      if (isNegative == false && negativeValue == MinValue)
+      {
+         return false;
+      }
+      value = isNegative ? negativeValue : -negativeValue;
+      m_at = at;
+      return true;
+   }
+
+   static constexpr Token MakeToken(Token::Type type, size_t at)
+   {
+      return { type, 0, 0, 0, at, ExpressionParserBase::ParseResult::OK };
+   }
+
+   static constexpr Token MakeRange(Token::Type type, T min, T max, size_t at)
+   {
+      return { type, 0, min, max, at, ExpressionParserBase::ParseResult::OK };
+   }
+
+   static constexpr Token MakeInvalid(ExpressionParserBase::ParseResult error, size_t at)
+   {
+      return { Token::Invalid, 0, 0, 0, at, error };
+   }
+
+private:
+   std::string_view m_input;
+   size_t m_at;
+};
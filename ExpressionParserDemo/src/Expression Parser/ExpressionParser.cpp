@@ -1,36 +1,21 @@
 #include "ExpressionParser.h"
+#include "ExpressionLexer.h"
+#include "ExpressionIntervals.h"
 
+#include <algorithm>
+#include <limits>
 #include <string>
 #include <vector>
 #include <cassert>
 
-
-std::vector<std::string_view> SplitString(std::string_view input, std::string_view delimiter)
-{
-   std::vector<std::string_view> strings;
-   size_t prevPosOfDelimiter = 0;
-   size_t posOfDelimiter = input.find_first_of(delimiter);
-   while (posOfDelimiter != std::string::npos)
-   {
-      strings.push_back(input.substr(prevPosOfDelimiter, posOfDelimiter - prevPosOfDelimiter));
-      prevPosOfDelimiter = posOfDelimiter + delimiter.length();
-      posOfDelimiter = input.find(delimiter, prevPosOfDelimiter);
-   }
-
-   if (prevPosOfDelimiter < input.length())
-   {
-      strings.push_back(input.substr(prevPosOfDelimiter));
-   }
-
-   return strings;
-}
-
+using namespace ExpressionIntervals;
 
 /****************************************
    Expression Parser
 ****************************************/
 
-ExpressionParser::ParseResult ExpressionParser::Parse(std::string_view conditionalDataString)
+template <ExpressionValueType T>
+ExpressionParserBase::ParseResult BasicExpressionParser<T>::Parse(std::string_view conditionalDataString)
 {
    if (m_isValid == true)
    {
@@ -43,107 +28,352 @@ ExpressionParser::ParseResult ExpressionParser::Parse(std::string_view condition
       return SetResult(ParseResult::EmptyStatement, 0);
    }
 
-   std::vector<std::string_view> splitStrings = SplitString(conditionalDataString, " ");
+   const size_t allocationCountBefore = m_allocationCounter.GetAllocationCount();
 
-   size_t currentLocationInString = 0;
-   bool parsingCondition = false;
+   using Lexer = ExpressionLexer<T>;
+   Lexer lexer(conditionalDataString);
+   bool expectingExpression = true;
+   bool foundAnything = false;
 
-   for (std::string_view data : splitStrings)
+   // Read the members of a set following "in{" or "notin{" up to the closing brace, sorting them
+   // and joining any that touch or overlap. Members and commas have to alternate, so a set can't
+   // be empty. Returns the token closing the set, or an invalid token where the set went wrong.
+   std::vector<Interval> members;
+   auto readSet = [&lexer, &members]()
    {
-      parsingCondition = !parsingCondition;
-
-      if (parsingCondition == true)
+      members.clear();
+      bool expectingMember = true;
+      for (typename Lexer::Token token = lexer.NextInSet(); ; token = lexer.NextInSet())
       {
-         const size_t conditionStart = data.find_first_not_of('(');
-         const size_t conditionEnd = data.find_last_not_of(')');
-         std::string_view conditionData = data.substr(conditionStart, conditionEnd - conditionStart + 1);
-
-         for (int charIndex = 0; charIndex < (int)conditionStart; ++charIndex)
+         if (expectingMember && token.m_type == Lexer::Token::SetMember)
+         {
+            members.push_back({ token.m_value, token.m_max });
+            expectingMember = false;
+         }
+         else if (expectingMember == false && token.m_type == Lexer::Token::Comma)
          {
-            if (data[charIndex] != '(')
+            expectingMember = true;
+         }
+         else if (expectingMember == false && token.m_type == Lexer::Token::CloseSet)
+         {
+            std::sort(members.begin(), members.end(), [](const Interval& a, const Interval& b) { return a.m_min < b.m_min; });
+            size_t joined = 0;
+            for (size_t i = 1; i < members.size(); ++i)
             {
-               // error
-               Clear();
-               return SetResult(ParseResult::ParsingInvalidCharacter, currentLocationInString);
+               if (members[joined].m_max == MaxValue<T> || members[i].m_min <= Next(members[joined].m_max))
+               {
+                  members[joined].m_max = std::max(members[joined].m_max, members[i].m_max);
+               }
+               else
+               {
+                  members[++joined] = members[i];
+               }
             }
+            members.resize(joined + 1);
+            return token;
+         }
+         else
+         {
+            token.m_error = token.m_type == Lexer::Token::Invalid ? token.m_error : ParseResult::InvalidExpression;
+            token.m_type = Lexer::Token::Invalid;
+            return token;
+         }
+      }
+   };
 
-            OpenBrace();
-            currentLocationInString++;
+   // Expressions and logic have to alternate, with braces being allowed before an expression
+   // or after one. eg: "(<expression>) <logic> <expression>"
+   for (typename Lexer::Token token = lexer.Next(); ; token = lexer.Next())
+   {
+      if (token.m_type == Lexer::Token::Invalid)
+      {
+         Clear();
+         return SetResult(token.m_error, token.m_at);
+      }
+
+      if (token.m_type == Lexer::Token::End)
+      {
+         if (foundAnything == false)
+         {
+            // Only whitespace was given
+            Clear();
+            return SetResult(ParseResult::EmptyStatement, 0);
          }
 
-         if (AddExpression(conditionData) == false)
+         if (expectingExpression)
          {
+            // Ending on logic or an open brace
             Clear();
-            return SetResult(ParseResult::InvalidExpression, currentLocationInString);
+            return SetResult(ParseResult::InvalidExpression, token.m_at);
          }
-         currentLocationInString += conditionData.length();
+         break;
+      }
 
-         for (size_t charIndex = conditionEnd + 1; charIndex < data.length(); ++charIndex)
+      foundAnything = true;
+      if (expectingExpression)
+      {
+         switch (token.m_type)
          {
-            if (data[charIndex] != ')')
+            case Lexer::Token::OpenBrace:
+               OpenBrace();
+               break;
+
+            case Lexer::Token::Comparison:
+            case Lexer::Token::Set:
+            case Lexer::Token::Range:
+            case Lexer::Token::Field:
             {
-               Clear();
-               return SetResult(ParseResult::ParsingInvalidCharacter, currentLocationInString);
+               // A field is only ever followed by the comparison, set or range checked against it
+               uint16_t field = 0;
+               typename Lexer::Token term = token;
+               if (token.m_type == Lexer::Token::Field)
+               {
+                  const std::string_view name = conditionalDataString.substr(token.m_at, lexer.GetPosition() - token.m_at);
+                  auto it = std::find_if(m_fields.begin(), m_fields.end(), [name](const FieldBinding& binding) { return binding.m_name == name; });
+                  if (it == m_fields.end())
+                  {
+                     Clear();
+                     return SetResult(ParseResult::UnknownField, token.m_at);
+                  }
+
+                  field = it->m_column;
+                  term = lexer.Next();
+               }
+
+               if (term.m_type == Lexer::Token::Set)
+               {
+                  const typename Lexer::Token closing = readSet();
+                  if (closing.m_type == Lexer::Token::Invalid)
+                  {
+                     Clear();
+                     return SetResult(closing.m_error, closing.m_at);
+                  }
+               }
+               else if (term.m_type == Lexer::Token::Range)
+               {
+                  members.assign(1, { term.m_value, term.m_max });
+               }
+               else if (term.m_type != Lexer::Token::Comparison)
+               {
+                  Clear();
+                  return SetResult(term.m_type == Lexer::Token::Invalid ? term.m_error : ParseResult::InvalidExpression, term.m_at);
+               }
+
+               const SourceRange source = { (uint32_t)token.m_at, (uint32_t)(lexer.GetPosition() - token.m_at) };
+               if (term.m_type == Lexer::Token::Comparison)
+               {
+                  AddExpression(term.m_operation, term.m_value, field, source);
+               }
+               else
+               {
+                  AddSet(members, term.m_type == Lexer::Token::Set && term.m_operation == (int)Compiled::NotEqualTo, field, source);
+               }
+               expectingExpression = false;
+               break;
             }
 
+            default:
+               Clear();
+               return SetResult(ParseResult::InvalidExpression, token.m_at);
+         }
+         continue;
+      }
+
+      switch (token.m_type)
+      {
+         case Lexer::Token::CloseBrace:
             if (CloseBrace() == false)
             {
                Clear();
-               return SetResult(ParseResult::ClosingUnopenedBrace, currentLocationInString);
+               return SetResult(ParseResult::ClosingUnopenedBrace, token.m_at);
             }
+            break;
 
-            currentLocationInString++;
-         }
+         case Lexer::Token::And:
+         case Lexer::Token::Or:
+            SetLogic(token.m_type == Lexer::Token::Or);
+            expectingExpression = true;
+            break;
 
-         currentLocationInString++;    // Account for the space delimeter
-         continue;
+         default:
+            Clear();
+            return SetResult(ParseResult::InvalidLogic, token.m_at);
       }
+   }
 
-      bool newLogicIsOr = data == "or" || data == "||";
-      if (newLogicIsOr == false && data != "and" && data != "&&")
-      {
-         Clear();
-         return SetResult(ParseResult::InvalidLogic, currentLocationInString);
-      }
+   Compile();
+   m_isValid = true;
+   m_parseAllocationCount = m_allocationCounter.GetAllocationCount() - allocationCountBefore;
+   return SetResult(ParseResult::OK, 0);
+}
 
-      currentLocationInString += data.length() + 1;    // +1 to account for the space delimeter
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::SetEvaluationMode(EvaluationMode mode)
+{
+   m_evaluationMode = mode;
+   m_compiled.m_evaluationMode = mode;
+}
 
-      if (m_pActiveBranchRoot->IsOrLogic() != newLogicIsOr)
-      {
-         // The logic is different, we need to swap the active roots
-         m_pActiveBranchRoot = m_pActiveBranch->GetLogicPathRoot(!m_pActiveBranchRoot->IsOrLogic());
+template <ExpressionValueType T>
+bool BasicExpressionParser<T>::SetDomain(T min, T max) requires std::integral<T>
+{
+   if (max < min)
+   {
+      return false;
+   }
 
-         if (newLogicIsOr == false)
-         {
-            // When switching from OR -> AND, we need to move the latest expression added to the OR root
-            std::shared_ptr<Node> pNodeToMove = m_pActiveBranch->GetLogicPathRoot(true)->GetNext();
-            m_pActiveBranchRoot->SetNext(pNodeToMove);
-         }
-      }
+   using Unsigned = std::make_unsigned_t<T>;
+   const Unsigned range = (Unsigned)max - (Unsigned)min;
+   if (range > std::numeric_limits<uint32_t>::max())
+   {
+      return false;
    }
 
-   return SetResult(ParseResult::OK, 0);
+   m_hasDomain = true;
+   m_domainMin = min;
+   m_domainRange = (uint32_t)range;
+
+   if (m_isValid)
+   {
+      m_compiled.BuildDomain(m_domainMin, m_domainRange);
+   }
+   return true;
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::ClearDomain()
+{
+   m_hasDomain = false;
+   m_domainMin = 0;
+   m_domainRange = 0;
+   m_compiled.ClearDomain();
 }
 
-bool ExpressionParser::AddExpression(std::string_view expressionString)
+template <ExpressionValueType T>
+bool BasicExpressionParser<T>::BindField(std::string_view name, uint16_t column)
 {
-   std::shared_ptr<ExpressionNode> pExpressionNode = std::make_shared<ExpressionNode>(expressionString);
-   if (pExpressionNode->IsValid() == false)
+   if (ExpressionLexer<T>::IsFieldName(name) == false)
    {
       return false;
    }
 
+   auto it = std::find_if(m_fields.begin(), m_fields.end(), [name](const FieldBinding& field) { return field.m_name == name; });
+   if (it != m_fields.end())
+   {
+      it->m_column = column;
+      return true;
+   }
+
+   m_fields.push_back({ std::string(name), column });
+   return true;
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::ClearFields()
+{
+   m_fields.clear();
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::Compile()
+{
+   // Start from an empty expression so nothing from a previous parse carries over
+   m_compiled = Compiled();
+   m_compiled.m_evaluationMode = m_evaluationMode;
+   m_compiled.m_sets = m_sets;
+
+   CompileProgram();
+   CompileBatch();
+   CompileFilter();
+   CompileIntervals();
+   if constexpr (std::is_integral_v<T>)
+   {
+      if (m_hasDomain)
+      {
+         m_compiled.BuildDomain(m_domainMin, m_domainRange);
+      }
+   }
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::CompileProgram()
+{
+   std::vector<Instruction>& program = m_compiled.m_instructions;
+   std::vector<SourceRange>& sourceRanges = m_compiled.m_sourceRanges;
+   const uint32_t entry = m_pBaseRoot->Compile(program, sourceRanges, Instruction::JumpToTrue, Instruction::JumpToFalse);
+
+   // Nodes are compiled back to front so that every jump target already exists by the time it is
+   // needed. Reverse the program so the entry point comes first and every jump goes forwards.
+   std::reverse(program.begin(), program.end());
+   std::reverse(sourceRanges.begin(), sourceRanges.end());
+   const uint32_t lastIndex = (uint32_t)program.size() - 1;
+   auto remapTarget = [lastIndex](uint32_t target)
+   {
+      return target >= Instruction::JumpToFalse ? target : lastIndex - target;
+   };
+
+   for (Instruction& instruction : program)
+   {
+      instruction.m_onTrue = remapTarget(instruction.m_onTrue);
+      instruction.m_onFalse = remapTarget(instruction.m_onFalse);
+      m_compiled.m_fieldCount = std::max(m_compiled.m_fieldCount, (uint32_t)instruction.m_field + 1);
+   }
+   m_compiled.m_entry = remapTarget(entry);
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::AddExpression(int operation, T value, uint16_t field, SourceRange source)
+{
+   std::shared_ptr<ExpressionNode> pExpressionNode = std::allocate_shared<ExpressionNode>(std::pmr::polymorphic_allocator<ExpressionNode>(&m_nodeArena), operation, value, field, source);
+
    // We should always push expressions to the start of the branch, that way there if they satisfy
    // the requirements of the condition early we avoid doing unneeded calculations in higher branches
    m_pActiveBranchRoot->SetNext(pExpressionNode);
-   return true;
+   m_pLastTerm = pExpressionNode;
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::AddSet(std::span<const Interval> members, bool isNegated, uint16_t field, SourceRange source)
+{
+   const uint32_t set = (uint32_t)m_sets.size();
+   m_sets.emplace_back(members);
+
+   std::pmr::vector<Interval> nodeMembers(members.begin(), members.end(), &m_nodeArena);
+   std::shared_ptr<SetNode> pSetNode = std::allocate_shared<SetNode>(std::pmr::polymorphic_allocator<SetNode>(&m_nodeArena), std::move(nodeMembers), isNegated, field, set, source);
+   m_pActiveBranchRoot->SetNext(pSetNode);
+   m_pLastTerm = pSetNode;
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::SetLogic(bool isOrLogic)
+{
+   if (m_pActiveBranchRoot->IsOrLogic() == isOrLogic)
+   {
+      return;
+   }
+
+   if (isOrLogic)
+   {
+      // AND groups only ever live on an OR branch, so finishing one steps back out to that branch
+      m_pActiveBranchRoot = m_pActiveBranchRoot->GetParentFork()->GetRoot();
+      return;
+   }
+
+   // When switching from OR -> AND, the latest term added to the OR branch becomes the first term
+   // of a new AND group. Like braces, the group is forked from the end of the OR branch.
+   std::shared_ptr<ForkNode> pNewFork = ForkNode::Create(&m_nodeArena, false);
+   m_pActiveBranchRoot->GetLast()->SetNext(pNewFork);
+   m_pActiveBranchRoot = pNewFork->GetLinkedRoot();
+   if (m_pLastTerm != nullptr)
+   {
+      m_pActiveBranchRoot->SetNext(m_pLastTerm);
+   }
 }
 
-void ExpressionParser::OpenBrace()
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::OpenBrace()
 {
-   std::shared_ptr<ForkNode> pNewFork = std::make_shared<ForkNode>();
-   std::shared_ptr<BranchNode> pNewBranch = BranchNode::Create();
-   pNewFork->SetLinkedRoot(pNewBranch->GetLogicPathRoot(true));
+   std::shared_ptr<ForkNode> pNewFork = ForkNode::Create(&m_nodeArena, true);
    m_braceForks.push(pNewFork);
 
    // Fork nodes are always pushed to the end to avoid unneeded extra calculations.
@@ -151,48 +381,64 @@ void ExpressionParser::OpenBrace()
    m_pActiveBranchRoot = pNewFork->GetLinkedRoot();
 }
 
-bool ExpressionParser::CloseBrace()
+template <ExpressionValueType T>
+bool BasicExpressionParser<T>::CloseBrace()
 {
    if (m_braceForks.empty())
    {
       return false;
    }
 
+   // The fork knows which branch it sits on, even if that is an AND group the brace was opened in
    std::shared_ptr<ForkNode> pResultNode = m_braceForks.top();
    m_pActiveBranchRoot = pResultNode->GetRoot();
-   m_pActiveBranch = m_pActiveBranchRoot->GetParentBranch();
+   m_pLastTerm = pResultNode;
    m_braceForks.pop();
    return true;
 }
 
-void ExpressionParser::Clear()
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::Clear()
 {
    SetResult(ParseResult::OK, 0);
    m_isValid = false;
-   m_pBaseBranch = BranchNode::Create();
-   m_pActiveBranch = m_pBaseBranch;
-   m_pActiveBranchRoot = m_pActiveBranch->GetLogicPathRoot(true);
-   m_braceForks = std::stack<std::shared_ptr<ForkNode>>();
+
+   // Destroy every node before releasing the memory they were allocated from in one go
+   m_pLastTerm = nullptr;
+   m_braceForks = BraceStack(&m_nodeArena);
+   m_pBaseRoot = nullptr;
+   m_nodeArena.release();
+   m_sets.clear();
+   m_simplifications.clear();
+
+   m_pBaseRoot = std::allocate_shared<BranchRootNode>(std::pmr::polymorphic_allocator<BranchRootNode>(&m_nodeArena), nullptr, true);
+   m_pActiveBranchRoot = m_pBaseRoot.get();
+
+   m_compiled = Compiled();
+   m_compiled.m_evaluationMode = m_evaluationMode;
 }
 
-ExpressionParser::ParseResult ExpressionParser::SetResult(ParseResult result, size_t at)
+template <ExpressionValueType T>
+ExpressionParserBase::ParseResult BasicExpressionParser<T>::SetResult(ParseResult result, size_t at)
 {
    m_result = result;
    m_errorAt = at;
    return result;
 }
 
-std::string ExpressionParser::GetErrorMessage() const
+template <ExpressionValueType T>
+std::string BasicExpressionParser<T>::GetErrorMessage() const
 {
    const std::string location = std::to_string(GetErrorLocation());
    switch (GetResultCode())
    {
-      case ExpressionParser::ParseResult::EmptyStatement:            return "Cannot parse an empty statement string.";
-      case ExpressionParser::ParseResult::AlreadyConstructed:        return "Logic has already been parsed successfully. Call 'Clear' before trying again.";
-      case ExpressionParser::ParseResult::ClosingUnopenedBrace:      return "Found a closing brace without an open brace at " + location + ".";
-      case ExpressionParser::ParseResult::InvalidExpression:         return "An invalid expression was found at " + location + ".";
-      case ExpressionParser::ParseResult::InvalidLogic:              return "Invalid logic found at " + location + ". Only supports and/&& + or/||.";
-      case ExpressionParser::ParseResult::ParsingInvalidCharacter:   return "An invalid character was found at " + location + ".";
+      case ParseResult::EmptyStatement:            return "Cannot parse an empty statement string.";
+      case ParseResult::AlreadyConstructed:        return "Logic has already been parsed successfully. Call 'Clear' before trying again.";
+      case ParseResult::ClosingUnopenedBrace:      return "Found a closing brace without an open brace at " + location + ".";
+      case ParseResult::InvalidExpression:         return "An invalid expression was found at " + location + ".";
+      case ParseResult::InvalidLogic:              return "Invalid logic found at " + location + ". Only supports and/&& + or/||.";
+      case ParseResult::ParsingInvalidCharacter:   return "An invalid character was found at " + location + ".";
+      case ParseResult::UnknownField:              return "A field that hasn't been bound was found at " + location + ".";
       default:                                                          return "";
    }
 }
@@ -202,410 +448,212 @@ std::string ExpressionParser::GetErrorMessage() const
    Nodes
 ****************************************/
 
-void ExpressionParser::Node::SetNext(std::shared_ptr<Node> pMyNewNextNode)
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::Node::SetNext(std::shared_ptr<Node> pMyNewNextNode)
 {
-   std::shared_ptr<Node> pMyOldNextNode = m_pNext;
-   std::shared_ptr<Node> pTheirOldNextNode = pMyNewNextNode != nullptr ? pMyNewNextNode->m_pNext : nullptr;
-   std::shared_ptr<Node> pTheirOldPrevNode = pMyNewNextNode != nullptr ? pMyNewNextNode->m_pPrev : nullptr;
-
-   // Step 1 - Link the current and new nodes together
-   m_pNext = pMyNewNextNode;
-   if (pMyNewNextNode != nullptr)
-   {
-      pMyNewNextNode->m_pPrev = shared_from_this();
-   }
-
-   // Step 2 - Link the gap made by moving the new next node
-   if (pTheirOldPrevNode != nullptr)
-   {
-      pTheirOldPrevNode->m_pNext = pMyNewNextNode != nullptr ? pMyNewNextNode->m_pNext : nullptr;
-      if (pTheirOldPrevNode->m_pNext != nullptr)
-      {
-         pTheirOldPrevNode->m_pNext->m_pPrev = pTheirOldPrevNode;
-      }
-   }
-
-   // Step 3 - Link the new next node to my old one
-   if (pMyNewNextNode != nullptr)
-   {
-      pMyNewNextNode->m_pNext = pMyOldNextNode;
-   }
-   if (pMyOldNextNode != nullptr)
-   {
-      pMyOldNextNode->m_pPrev = pMyNewNextNode;
-   }
-
-   /*
-   Current : 0 <--> 1 <--> 2 <--> 3 <--> 4
-   I am Node 1
-   Add new node 5 as my next
-   Desired : 0 <--> 1 <--> 5 <--> 2 <--> 3 <--> 4
-
-   my old next         = [2]    (old next 1)
-   new node's old next = [NULL] (old next 2)
-   new node's old prev = [NULL] (old prev 2)
-
-   my (1) next is set to the new node
-   1 ---> 5
-
-   0 ---> 1 ---> 5      2 ---> 3 ---> 4
-
-   0 <--- 1 <---------- 2 <--- 3 <--- 4
-
-
-   the new nodes (5) prev is set to me (1)
-   1 <--- 5
-
-   0 ---> 1 ---> 5      2 ---> 3 ---> 4
-
-   0 <--- 1 <--- 5
-          1 <---------- 2 <--- 3 <--- 4
-
-
-   the new nodes (5) old prev (NULL) next is set to the new nodes (5) next
-   NULL - Not performed
-
-   the new nodes (5) old next (NULL) prev is set to the new nodes (5) old prev (NULL)
-   NULL - Not performed
-
-   the new nodes (5) next is set to the my old next
-   5 ---> 2
-
-   0 ---> 1 ---> 5 ---> 2 ---> 3 ---> 4
-
-   0 <--- 1 <--- 5
-          1 <---------- 2 <--- 3 <--- 4
-
-
-   my old next (2) prev is set to the new node
-   5 <--- 2
-
-   0 ---> 1 ---> 5 ---> 2 ---> 3 ---> 4
-   0 <--- 1 <--- 5 <--- 2 <--- 3 <--- 4
-   */
-
-   /*
-   Current : 0 <--> 1 <--> 2 <--> 3 <--> 4
-   I am Node 1
-   Set 4 as my next
-   Desired : 0 <--> 1 <--> 4 <--> 2 <--> 3
-
-   my old next         = [2]    (old next 1)
-   new node's old next = [NULL] (old next 2)
-   new node's old prev = [3]    (old prev 2)
-
-   my (1) next is set to the new node
-   1 ---> 4
-
-   0 ---> 1 -----------------> 4
-                 2 ---> 3 ---> 4
-
-   0 <--- 1 <--- 2 <--- 3 <--- 4
-
-
-   the new nodes (4) prev is set to me (1)
-   1 <--- 4
-
-   0 ---> 1 -----------------> 4
-                 2 ---> 3 ---> 4
-
-   0 <--- 1 <----------------- 4
-          1 <--- 2 <--- 3
-
-
-   the new nodes (4) old prev (3) next is set to the new nodes (4) next
-   3 ---> 5
-
-   0 ---> 1 -----------------> 4
-                 2 ---> 3
-
-   0 <--- 1 <----------------- 4
-          1 <--- 2 <--- 3
-
-
-   the new nodes (4) old next (NULL) prev is set to the new nodes (4) old prev (3)
-   NULL - Not performed
-
-   the new nodes (4) next is set to the my old next
-   4 ---> 2
-
-   0 ---> 1 ---> 4 ---> 2 ---> 3
-
-   0 <--- 1 <----------------- 4
-          1 <--- 2 <--- 3
-
-
-   my old next (2) prev is set to the new node
-   4 <--- 2
-
-   0 ---> 1 ---> 4 ---> 2 ---> 3
-   0 <--- 1 <--- 4 <--- 2 <--- 3
-   */
-
    /*
    Current : 0 <--> 1 <--> 2 <--> 3 <--> 4 <--> 5
    I am Node 1
    Set 4 as my next
    Desired : 0 <--> 1 <--> 4 <--> 2 <--> 3 <--> 5
 
-   my old next         = [2] (old next 1)
-   new node's old next = [5] (old next 2)
-   new node's old prev = [3] (old prev 2)
-
-   my (1) next is set to the new node
-   1 ---> 4
-
-   0 ---> 1 -----------------> 4 ---> 5
-                 2 ---> 3 ---> 4
-
-   0 <--- 1 <--- 2 <--- 3 <--- 4 <--- 5
-
-
-   the new nodes (4) prev is set to me (1)
-   1 <--- 4
-
-   0 ---> 1 -----------------> 4 ---> 5
-                 2 ---> 3 ---> 4
-
-   0 <--- 1 <----------------- 4 <--- 5
-          1 <--- 2 <--- 3
-
-
-   the new nodes (4) old prev (3) next is set to the new nodes (4) next
-   3 ---> 5
-
-   0 ---> 1 -----------------> 4 ---> 5
-                 2 ---> 3 ----------> 5
-
-   0 <--- 1 <----------------- 4 <--- 5
-          1 <--- 2 <--- 3
-
-
-   the new nodes (4) old next (5) prev is set to the new nodes (4) old prev (3)
-   3 <--- 5
-
-   0 ---> 1 -----------------> 4 ---> 5
-                 2 ---> 3 ----------> 5
-
-   0 <--- 1 <----------------- 4
-          1 <--- 2 <--- 3 <---------- 5
-
-
-   the new nodes (4) next is set to the my old next
-   4 ---> 2
-
-   0 ---> 1 ---> 4 ---> 2 ---> 3 ---> 5
-
-   0 <--- 1 <----------------- 4
-          1 <--- 2 <--- 3 <---------- 5
-
-
-   my old next (2) prev is set to the new node
-   4 <--- 2
-
-   0 ---> 1 ---> 4 ---> 2 ---> 3 ---> 5
-   0 <--- 1 <--- 4 <--- 2 <--- 3 <--- 5
+   Step 1 unlinks 4 from where it currently is, joining 3 and 5 together (this also works when 4
+   is on a different branch, or on no branch at all). Step 2 links 4 in between myself and 2.
+   The root of each branch keeps track of its last node, so that needs updating whenever the
+   last node is moved or something is linked after it.
    */
-}
 
-std::shared_ptr<ExpressionParser::BranchRootNode> ExpressionParser::Node::GetRoot()
-{
-   std::shared_ptr<Node> pNode = m_pPrev;
-   if (pNode == nullptr)
-   {
-      return std::static_pointer_cast<BranchRootNode>(shared_from_this());
-   }
+   BranchRootNode* pMyRoot = GetRoot();
 
-   while (pNode->m_pPrev != nullptr)
+   // Step 1 - Unlink the new next node from wherever it currently is
+   if (pMyNewNextNode != nullptr && pMyNewNextNode->m_pPrev != nullptr)
    {
-      pNode = pNode->m_pPrev;
-   }
-   return std::static_pointer_cast<BranchRootNode>(pNode);
-}
+      Node* pTheirOldPrevNode = pMyNewNextNode->m_pPrev;
+      pTheirOldPrevNode->m_pNext = pMyNewNextNode->m_pNext;
+      if (pTheirOldPrevNode->m_pNext != nullptr)
+      {
+         pTheirOldPrevNode->m_pNext->m_pPrev = pTheirOldPrevNode;
+      }
+      else
+      {
+         pMyNewNextNode->m_pRoot->m_pLast = pTheirOldPrevNode;
+      }
 
-std::shared_ptr<const ExpressionParser::BranchRootNode> ExpressionParser::Node::GetRoot() const
-{
-   std::shared_ptr<Node> pNode = m_pPrev;
-   if (pNode == nullptr)
-   {
-      return std::static_pointer_cast<const BranchRootNode>(shared_from_this());
+      pMyNewNextNode->m_pNext = nullptr;
+      pMyNewNextNode->m_pPrev = nullptr;
    }
 
-   while (pNode->m_pPrev != nullptr)
+   // Step 2 - Link the new next node in between myself and my old next node
+   std::shared_ptr<Node> pMyOldNextNode = m_pNext;
+   m_pNext = pMyNewNextNode;
+   if (pMyNewNextNode == nullptr)
    {
-      pNode = pNode->m_pPrev;
+      // Nothing follows on from me anymore
+      pMyRoot->m_pLast = this;
+      return;
    }
-   return std::static_pointer_cast<const BranchRootNode>(pNode);
-}
 
-std::shared_ptr<ExpressionParser::Node> ExpressionParser::Node::GetLast()
-{
-   std::shared_ptr<Node> pNode = m_pNext;
-   if (pNode == nullptr)
+   pMyNewNextNode->m_pPrev = this;
+   pMyNewNextNode->m_pRoot = pMyRoot;
+   pMyNewNextNode->m_pNext = pMyOldNextNode;
+   if (pMyOldNextNode != nullptr)
    {
-      return std::static_pointer_cast<Node>(shared_from_this());
+      pMyOldNextNode->m_pPrev = pMyNewNextNode.get();
    }
-
-   while (pNode->m_pNext != nullptr)
+   else
    {
-      pNode = pNode->m_pNext;
+      pMyRoot->m_pLast = pMyNewNextNode.get();
    }
-   return pNode;
 }
 
-std::shared_ptr<const ExpressionParser::Node> ExpressionParser::Node::GetLast() const
+template <ExpressionValueType T>
+typename BasicExpressionParser<T>::Node* BasicExpressionParser<T>::Node::GetLast() const
 {
-   std::shared_ptr<Node> pNode = m_pNext;
-   if (pNode == nullptr)
-   {
-      return std::static_pointer_cast<const Node>(shared_from_this());
-   }
-
-   while (pNode->m_pNext != nullptr)
-   {
-      pNode = pNode->m_pNext;
-   }
-   return pNode;
+   return m_pRoot != nullptr ? m_pRoot->m_pLast : nullptr;
 }
 
 
 /****************************************
-   Branch Node
+   Fork Node
 ****************************************/
 
-std::shared_ptr<ExpressionParser::BranchNode> ExpressionParser::BranchNode::Create()
+template <ExpressionValueType T>
+std::shared_ptr<typename BasicExpressionParser<T>::ForkNode> BasicExpressionParser<T>::ForkNode::Create(std::pmr::memory_resource* pResource, bool isOrLogic)
 {
-   std::shared_ptr<BranchNode> pNewBranch = std::make_shared<BranchNode>(ConstructorKey{ 0 });
-   pNewBranch->m_pOrRoot = std::make_shared<BranchRootNode>(pNewBranch, true);
-   pNewBranch->m_pAndRoot = std::make_shared<BranchRootNode>(pNewBranch, false);
-
-   std::shared_ptr<ForkNode> pFork = std::make_shared<ForkNode>();
-   pFork->SetLinkedRoot(pNewBranch->m_pAndRoot);
-   pNewBranch->m_pOrRoot->SetNext(pFork);
-
-   return pNewBranch;
+   std::shared_ptr<ForkNode> pNewFork = std::allocate_shared<ForkNode>(std::pmr::polymorphic_allocator<ForkNode>(pResource), ConstructorKey{ 0 });
+   pNewFork->m_pBranchRoot = std::allocate_shared<BranchRootNode>(std::pmr::polymorphic_allocator<BranchRootNode>(pResource), pNewFork.get(), isOrLogic);
+   return pNewFork;
 }
 
-bool ExpressionParser::BranchNode::Evaluate(int value) const
+template <ExpressionValueType T>
+uint32_t BasicExpressionParser<T>::ForkNode::Compile(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, uint32_t onTrue, uint32_t onFalse) const
 {
-   return m_pOrRoot->Evaluate(value);
+   if (m_pBranchRoot == nullptr)
+   {
+      // This should never happen...
+      assert(false);
+      return onFalse;
+   }
+
+   return m_pBranchRoot->Compile(program, sourceRanges, onTrue, onFalse);
 }
 
+
 /****************************************
    Expression Node
 ****************************************/
 
-ExpressionParser::ExpressionNode::ExpressionNode(std::string_view data)
-   : m_value(0)
-   , m_operation(0)
+template <ExpressionValueType T>
+uint32_t BasicExpressionParser<T>::ExpressionNode::Compile(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, uint32_t onTrue, uint32_t onFalse) const
 {
-   m_isValid = false;
-
-   const size_t numberAt = data.find_first_of("0123456789");
-   // "x0" or "xx0" where x is an operator of 1 or 2 characters wide
-   if (numberAt != 1 && numberAt != 2)
-   {
-      return;
-   }
+   program.push_back({ (uint8_t)m_operation, m_field, m_value, onTrue, onFalse });
+   sourceRanges.push_back(m_source);
+   return (uint32_t)program.size() - 1;
+}
 
-   std::string_view comparisonOperator = data.substr(0, numberAt);
-   if (comparisonOperator == "<") { m_operation = (int)LessThan; }
-   else if (comparisonOperator == "<=") { m_operation = (int)LessThan | (int)EqualTo; }
-   else if (comparisonOperator == "=") { m_operation = (int)EqualTo; }
-   else if (comparisonOperator == "!=") { m_operation = (int)NotEqualTo; }
-   else if (comparisonOperator == ">=") { m_operation = (int)GreaterThan | (int)EqualTo; }
-   else if (comparisonOperator == ">") { m_operation = (int)GreaterThan; }
-   else
-   {
-      return;
-   }
 
-   try
-   {
-      std::string_view valueString = data.substr(numberAt);
-      m_value = std::stoi(valueString.data());
-   }
-   catch (...)
-   {
-      return;
-   }
+/****************************************
+   Set Node
+****************************************/
 
-   m_isValid = true;
+template <ExpressionValueType T>
+uint32_t BasicExpressionParser<T>::SetNode::Compile(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, uint32_t onTrue, uint32_t onFalse) const
+{
+   // Values outside of a negated set are the ones passing it
+   return m_isNegated
+      ? CompileSearch(program, sourceRanges, 0, m_members.size() - 1, false, onFalse, onTrue)
+      : CompileSearch(program, sourceRanges, 0, m_members.size() - 1, false, onTrue, onFalse);
 }
 
-bool ExpressionParser::ExpressionNode::Evaluate(int value) const
+template <ExpressionValueType T>
+uint32_t BasicExpressionParser<T>::SetNode::CompileSearch(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, size_t first, size_t last, bool isAboveMin, uint32_t onIn, uint32_t onOut) const
 {
-   if (IsValid() == false)
-   {
-      return false;
-   }
-
-   bool result;
-   switch (m_operation)
+   // Each step splits the members in two with a single "<" comparison, so finding the member a
+   // value could be in takes as many comparisons as there are halvings, the same as the binary
+   // search a set is checked with in batches. Only plain comparisons are used, so everything
+   // running the program runs sets too.
+   auto emit = [&](int operation, T value, uint32_t onTrue, uint32_t onFalse)
    {
-      case (int)LessThan:                       result = value < m_value; break;
-      case (int)LessThan | (int)EqualTo:        result = value <= m_value; break;
-      case (int)EqualTo:                        result = value == m_value; break;
-      case (int)NotEqualTo:                     result = value != m_value; break;
-      case (int)GreaterThan | (int)EqualTo:     result = value >= m_value; break;
-      case (int)GreaterThan:                    result = value > m_value; break;
-      default: return false;
-   }
+      program.push_back({ (uint8_t)operation, m_field, value, onTrue, onFalse });
+      sourceRanges.push_back(m_source);
+      return (uint32_t)program.size() - 1;
+   };
 
-   // The neat trick here is if result == true and IsOrLogic() == true, we return true as OR requires result == true at any point
-   // On the other hand, if result == false and IsOrLogic() == false, we return false as AND requires result == true at ALL times
-   // We also return the result if there is no next node to check
-   if (GetNext() == nullptr || result == GetRoot()->IsOrLogic())
+   if (first == last)
    {
-      return result;
+      // The value is below the next member's minimum but can still be in the gap before it, so the
+      // maximum is always checked unless nothing is above it. NaN fails every check but "!=", so for
+      // floating point values there is always at least one.
+      const Interval& member = m_members[first];
+      const bool checksMin = isAboveMin == false && member.m_min != MinValue<T>;
+      const bool checksMax = member.m_max != MaxValue<T> || (checksMin == false && std::is_floating_point_v<T>);
+      uint32_t next = onIn;
+      if (checksMax)
+      {
+         next = emit((int)Compiled::LessThan | (int)Compiled::EqualTo, member.m_max, next, onOut);
+      }
+      if (checksMin)
+      {
+         next = emit((int)Compiled::GreaterThan | (int)Compiled::EqualTo, member.m_min, next, onOut);
+      }
+      return next;
    }
 
-   return GetNext()->Evaluate(value);
+   // Nodes are compiled back to front, so both sides exist before the comparison choosing between them
+   const size_t split = first + (last - first + 1) / 2;
+   const uint32_t above = CompileSearch(program, sourceRanges, split, last, true, onIn, onOut);
+   const uint32_t below = CompileSearch(program, sourceRanges, first, split - 1, isAboveMin, onIn, onOut);
+   return emit((int)Compiled::LessThan, m_members[split].m_min, below, above);
 }
 
 
 /****************************************
-   Root Node
+   Constant Node
 ****************************************/
 
-ExpressionParser::BranchRootNode::BranchRootNode(std::weak_ptr<BranchNode> pParent, bool isOrLogic)
-   : m_pParentBranch(pParent)
-   , m_isOrLogic(isOrLogic)
-{}
-
-bool ExpressionParser::BranchRootNode::Evaluate(int value) const
+template <ExpressionValueType T>
+uint32_t BasicExpressionParser<T>::ConstantNode::Compile(std::vector<Instruction>&, std::vector<SourceRange>&, uint32_t onTrue, uint32_t onFalse) const
 {
-   if (GetNext() == nullptr)
-   {
-      // There is nothing on this branch
-      return false;
-   }
-   return GetNext()->Evaluate(value);
+   // Nothing needs comparing, so whatever comes before jumps straight to the result
+   return m_passes ? onTrue : onFalse;
 }
 
 
 /****************************************
-   Fork Node
+   Root Node
 ****************************************/
 
-bool ExpressionParser::ForkNode::Evaluate(int value) const
+template <ExpressionValueType T>
+BasicExpressionParser<T>::BranchRootNode::BranchRootNode(ForkNode* pParentFork, bool isOrLogic)
+   : m_pParentFork(pParentFork)
+   , m_pLast(this)
+   , m_isOrLogic(isOrLogic)
 {
-   if (m_pBranchRoot == nullptr)
+   this->m_pRoot = this;
+}
+
+template <ExpressionValueType T>
+uint32_t BasicExpressionParser<T>::BranchRootNode::Compile(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, uint32_t onTrue, uint32_t onFalse) const
+{
+   // Walk the branch backwards, each node continuing on to the node after it. The neat trick here is
+   // OR logic only needs to continue when a node fails and AND logic only when a node passes, the
+   // other result can jump straight out of the branch. The last node simply returns its own result.
+   // An empty branch is treated the same as a failed one.
+   if (GetNext() == nullptr)
    {
-      // This should never happen...
-      assert(false);
-      return false;
+      return onFalse;
    }
 
-   bool result = m_pBranchRoot->Evaluate(value);
-
-   // The neat trick here is if result == true and IsOrLogic() == true, we return true as OR requires result == true at any point
-   // On the other hand, if result == false and IsOrLogic() == false, we return false as AND requires result == true at ALL times
-   // We also return the result if there is no next node to check
-   if (GetNext() == nullptr || result == GetRoot()->IsOrLogic())
+   uint32_t next = IsOrLogic() ? onFalse : onTrue;
+   for (const Node* pNode = GetLast(); pNode != this; pNode = pNode->GetPrev())
    {
-      return result;
+      next = IsOrLogic()
+         ? pNode->Compile(program, sourceRanges, onTrue, next)
+         : pNode->Compile(program, sourceRanges, next, onFalse);
    }
+   return next;
+}
 
-   return GetNext()->Evaluate(value);
-}
\ No newline at end of file
+#define INSTANTIATE(T) template class BasicExpressionParser<T>;
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
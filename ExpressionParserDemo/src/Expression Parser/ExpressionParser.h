@@ -1,159 +1,420 @@
 #pragma once
 
+#include "CompiledExpression.h"
+
+#include <concepts>
+#include <cstdint>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
 #include <string_view>
 #include <stack>
+#include <vector>
+
+template <ExpressionValueType T, size_t Capacity>
+class StaticExpression;
 
-class ExpressionParser
+// The parts of the parser that are the same whatever type of value it parses.
+class ExpressionParserBase
 {
+public:
+   enum class ParseResult : uint8_t
+   {
+      OK = 0,
+
+      AlreadyConstructed,
+      EmptyStatement,
+      ParsingInvalidCharacter,
+      ClosingUnopenedBrace,
+      InvalidExpression,
+      InvalidLogic,
+      UnknownField
+   };
+
+   // A comparison Simplify() removed from an expression, along with why it could go.
+   struct Simplification
+   {
+      enum class Reason : uint8_t
+      {
+         // Already implied by the rest of its group, eg: the ">3" of ">3 and >5".
+         Redundant,
+         // Replaced, along with the other comparisons of the same field in its group, by a single
+         // comparison, eg: "<5 or =5" becoming "<=5".
+         Merged,
+         // Part of a group passing every value, eg: "<10 or >5".
+         AlwaysTrue,
+         // Part of a group passing no value, eg: "=5 and !=5".
+         AlwaysFalse,
+      };
+
+      Reason m_reason;
+
+      // Where the comparison was read from in the expression string.
+      CompiledExpressionBase::SourceRange m_source;
+   };
+};
+
+// Parses expression strings into a node graph, then compiles that into a BasicCompiledExpression
+// which does the actual evaluating. The parser itself holds mutable parse state and should only be
+// used from one thread at a time, the compiled expression has no such restriction.
+// Values are of type T, and the constants in the string are read as T, so 64 bit ids or floating
+// point measurements are compared as they are rather than being truncated to an int.
+template <ExpressionValueType T>
+class BasicExpressionParser : public ExpressionParserBase
+{
+public:
+   using ValueType = T;
+   using Compiled = BasicCompiledExpression<T>;
+   using OperatorFlags = typename Compiled::OperatorFlags;
+   using Interval = typename Compiled::Interval;
+   using EvaluationMode = typename Compiled::EvaluationMode;
+   using ResultRun = typename Compiled::ResultRun;
+
+private:
+   // Interns the node graph of every rule it parses.
+   friend class RuleGraph;
+
+   using Instruction = typename Compiled::Instruction;
+   using SourceRange = typename Compiled::SourceRange;
+   using BatchOp = typename Compiled::BatchOp;
+   using FilterOp = typename Compiled::FilterOp;
+
+   struct ForkNode;
    struct BranchRootNode;
-   struct Node : public std::enable_shared_from_this<Node>
+   struct Node
    {
       Node()
          : m_pNext(nullptr)
          , m_pPrev(nullptr)
+         , m_pRoot(nullptr)
       {}
 
-      virtual bool Evaluate(int value) const = 0;
+      virtual ~Node() = default;
+
+      // Append the instructions for this node to the program, jumping to onTrue or onFalse
+      // depending on the result, along with where in the string each instruction came from.
+      // Returns the index of the first instruction to run, which may be one of the targets if
+      // the node emitted nothing.
+      virtual uint32_t Compile(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, uint32_t onTrue, uint32_t onFalse) const = 0;
+
+      // Append the postfix batch operations for this node, which leave exactly one mask pushed.
+      virtual void CompileBatch(std::vector<BatchOp>& batchProgram) const = 0;
+
+      // Append the prefix filter operations for this node. Returns how deeply OR groups are nested
+      // within it, as each needs its own scratch selections while filtering.
+      virtual uint32_t CompileFilter(std::vector<FilterOp>& filterProgram) const = 0;
+
+      // Get the sorted, non overlapping intervals of every value passing this node. The working
+      // intervals are allocated from the given resource.
+      virtual std::pmr::vector<Interval> CompileIntervals(std::pmr::memory_resource* pResource) const = 0;
+
+      // Write 1 to passes for every sample value passing this node and 0 otherwise, reordering the
+      // nodes along any branches beneath it so those most likely to short circuit run first.
+      // Returns the average number of comparisons run per sample value. Scratch memory is taken
+      // from the given resource.
+      virtual double Optimize(std::span<const T> sample, std::span<uint8_t> passes, std::pmr::memory_resource* pResource) = 0;
 
       // Set the node following this one. Automatically reorganises the linkage between
       // nodes before and after should it be needed.
       void SetNext(std::shared_ptr<Node> pMyNewNextNode);
 
-      std::shared_ptr<Node> GetNext() const { return m_pNext; }
-      std::shared_ptr<Node> GetPrev() const { return m_pPrev; }
+      const std::shared_ptr<Node>& GetNext() const { return m_pNext; }
+      Node* GetPrev() const { return m_pPrev; }
 
-      std::shared_ptr<const BranchRootNode> GetRoot() const;
-      std::shared_ptr<BranchRootNode> GetRoot();
-      std::shared_ptr<const Node> GetLast() const;
-      std::shared_ptr<Node> GetLast();
+      // The root and last node of the branch are tracked as nodes are linked, so these
+      // never need to walk the branch.
+      BranchRootNode* GetRoot() const { return m_pRoot; }
+      Node* GetLast() const;
 
-   private:
+   protected:
+      // Only the next link owns the node it points to, the links back towards the root are
+      // plain pointers so a branch never keeps itself alive.
       std::shared_ptr<Node> m_pNext;
-      std::shared_ptr<Node> m_pPrev;
+      Node* m_pPrev;
+      BranchRootNode* m_pRoot;
    };
 
-   // Branch nodes are a container for OR and AND logic paths which hold the actual expressions.
-   struct BranchNode : public Node
+   // Root nodes are the first nodes along a branch, they hold the logic information
+   // the following nodes will use when being compiled.
+   struct BranchRootNode : public Node
    {
-   private:
-      // This private struct is only used to keep BranchNode constructor public, meaning we can
-      // use std::make_shared only in the Create() function. Trying to create a BranchNode without
-      // using Create() will fail.
-      struct ConstructorKey { explicit ConstructorKey(int) {}; };
+      BranchRootNode(ForkNode* pParentFork, bool isOrLogic);
 
-   public:
-      BranchNode(const ConstructorKey&)
-         : m_pOrRoot(nullptr)
-         , m_pAndRoot(nullptr)
-      {}
+      // Node depends on T, so its members aren't found by name in here without these
+      using Node::GetNext;
+      using Node::GetLast;
+
+      // Compiles every node along the current branch using this root's logic.
+      virtual uint32_t Compile(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, uint32_t onTrue, uint32_t onFalse) const override;
+      virtual void CompileBatch(std::vector<BatchOp>& batchProgram) const override;
+      virtual uint32_t CompileFilter(std::vector<FilterOp>& filterProgram) const override;
+      virtual std::pmr::vector<Interval> CompileIntervals(std::pmr::memory_resource* pResource) const override;
+      virtual double Optimize(std::span<const T> sample, std::span<uint8_t> passes, std::pmr::memory_resource* pResource) override;
 
-      virtual bool Evaluate(int value) const override;
+      // Simplify every group beneath this branch and then the branch itself, adding every comparison
+      // removed to the report. Braces around a single term, or around a group with the same logic
+      // as this one, are flattened into this branch. Returns the result if the branch always has
+      // the same one, in which case it is left for the caller to replace. New nodes are allocated
+      // from pNodeResource and working memory from pScratch.
+      std::optional<bool> Simplify(std::vector<Simplification>& report, std::pmr::memory_resource* pNodeResource, std::pmr::memory_resource* pScratch);
 
-      static std::shared_ptr<BranchNode> Create();
+      // The fork linking to this branch, or nullptr if this is the base branch.
+      ForkNode* GetParentFork() const { return m_pParentFork; }
 
-      // Get the OR or AND logic path root node.
-      std::shared_ptr<BranchRootNode> GetLogicPathRoot(bool orLogic) { return orLogic ? m_pOrRoot : m_pAndRoot; }
+      bool IsOrLogic() const { return m_isOrLogic; }
 
    private:
-      std::shared_ptr<BranchRootNode> m_pOrRoot;
-      std::shared_ptr<BranchRootNode> m_pAndRoot;
+      friend struct Node;
+
+      ForkNode* m_pParentFork;
+      Node* m_pLast;
+      bool m_isOrLogic;
    };
 
-   // Root nodes are the first nodes along a branch, they hold the logic information
-   // the following nodes will use when calling Evaluate().
-   struct BranchRootNode : public Node
+   // Fork nodes indicate where a branch has been created, either by a brace or by a group
+   // of AND logic. When a forked branch has been evaluated, the result will be returned here.
+   struct ForkNode : public Node
    {
-      BranchRootNode(std::weak_ptr<BranchNode> pParent, bool isOrLogic);
+   private:
+      // This private struct is only used to keep ForkNode constructor public, meaning we can
+      // use std::allocate_shared only in the Create() function. Trying to create a ForkNode without
+      // using Create() will fail.
+      struct ConstructorKey { explicit ConstructorKey(int) {}; };
+
+   public:
+      ForkNode(const ConstructorKey&)
+         : m_pBranchRoot(nullptr)
+      {}
 
-      // Starts the evaluation of the current branch.
-      virtual bool Evaluate(int value) const override;
+      virtual uint32_t Compile(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, uint32_t onTrue, uint32_t onFalse) const override;
+      virtual void CompileBatch(std::vector<BatchOp>& batchProgram) const override;
+      virtual uint32_t CompileFilter(std::vector<FilterOp>& filterProgram) const override;
+      virtual std::pmr::vector<Interval> CompileIntervals(std::pmr::memory_resource* pResource) const override;
+      virtual double Optimize(std::span<const T> sample, std::span<uint8_t> passes, std::pmr::memory_resource* pResource) override;
 
-      std::shared_ptr<BranchNode> GetParentBranch() const { return m_pParentBranch.lock(); }
+      // Create a fork along with the new branch it links to, allocating both from the resource.
+      static std::shared_ptr<ForkNode> Create(std::pmr::memory_resource* pResource, bool isOrLogic);
 
-      bool IsOrLogic() const { return m_isOrLogic; }
+      BranchRootNode* GetLinkedRoot() const { return m_pBranchRoot.get(); }
 
    private:
-      std::weak_ptr<BranchNode> m_pParentBranch;
-      bool m_isOrLogic;
+      std::shared_ptr<BranchRootNode> m_pBranchRoot;
    };
 
-   // Fork nodes indicate where a branch has been created. When a forked branch has
-   // been evaluated, the result will be returned here.
-   struct ForkNode : public Node
+   // Expression nodes are where the actual comparisons occur. These nodes hold a condition
+   // read from the string in the form <operator><value> (eg: "<5" or ">=100") and will
+   // compile into an instruction checking if the given value fits the requirements.
+   struct ExpressionNode : public Node
    {
-      ForkNode()
-         : m_pBranchRoot(std::shared_ptr<BranchRootNode>(nullptr))
+      ExpressionNode(int operation, T value, uint16_t field, SourceRange source)
+         : m_operation(operation)
+         , m_value(value)
+         , m_field(field)
+         , m_source(source)
       {}
 
-      virtual bool Evaluate(int value) const override;
+      virtual uint32_t Compile(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, uint32_t onTrue, uint32_t onFalse) const override;
+      virtual void CompileBatch(std::vector<BatchOp>& batchProgram) const override;
+      virtual uint32_t CompileFilter(std::vector<FilterOp>& filterProgram) const override;
+      virtual std::pmr::vector<Interval> CompileIntervals(std::pmr::memory_resource* pResource) const override;
+      virtual double Optimize(std::span<const T> sample, std::span<uint8_t> passes, std::pmr::memory_resource* pResource) override;
 
-      // Set/get the branch root this fork links to.
-      void SetLinkedRoot(std::shared_ptr<BranchRootNode> pBranchRoot) { m_pBranchRoot = pBranchRoot; }
-      std::shared_ptr<BranchRootNode> GetLinkedRoot() const { return m_pBranchRoot; }
+      int GetOperation() const { return m_operation; }
+      T GetValue() const { return m_value; }
+      uint16_t GetField() const { return m_field; }
+      SourceRange GetSource() const { return m_source; }
 
    private:
-      std::shared_ptr<BranchRootNode> m_pBranchRoot;
+      int m_operation;
+      T m_value;
+      uint16_t m_field;
+      SourceRange m_source;
    };
 
-   // Expression nodes are where the actual comparisons occur. These nodes convert
-   // a string condition in the form <operator><value> (eg: "<5" or ">=100") and will
-   // evaluate if the given value fits the requirements.
-   struct ExpressionNode : public Node
+   // Set nodes check a value against every member of an "in{...}" or "notin{...}" set at once,
+   // where each member is a lone value or an inclusive range. Ranges written on their own, eg:
+   // "10..20", are a set of one. The members are kept sorted and joined wherever they touch, with
+   // the lookup form used to evaluate batches built alongside them.
+   struct SetNode : public Node
    {
-      enum OperatorFlags
-      {
-         LessThan = 1 << 0,
-         GreaterThan = 1 << 1,
-         EqualTo = 1 << 2,
-         NotEqualTo = 1 << 3,
-      };
+      SetNode(std::pmr::vector<Interval> members, bool isNegated, uint16_t field, uint32_t set, SourceRange source)
+         : m_members(std::move(members))
+         , m_isNegated(isNegated)
+         , m_field(field)
+         , m_set(set)
+         , m_source(source)
+      {}
 
-      ExpressionNode(std::string_view expressionString);
+      virtual uint32_t Compile(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, uint32_t onTrue, uint32_t onFalse) const override;
+      virtual void CompileBatch(std::vector<BatchOp>& batchProgram) const override;
+      virtual uint32_t CompileFilter(std::vector<FilterOp>& filterProgram) const override;
+      virtual std::pmr::vector<Interval> CompileIntervals(std::pmr::memory_resource* pResource) const override;
+      virtual double Optimize(std::span<const T> sample, std::span<uint8_t> passes, std::pmr::memory_resource* pResource) override;
 
-      virtual bool Evaluate(int value) const override;
+      std::span<const Interval> GetMembers() const { return m_members; }
+      bool IsNegated() const { return m_isNegated; }
+      uint16_t GetField() const { return m_field; }
+      SourceRange GetSource() const { return m_source; }
 
-      // Check to see if the expression was created without errors.
-      bool IsValid() const { return m_isValid; }
+   private:
+      // Compile the search tree beneath the members from first up to last, jumping to onIn or
+      // onOut. Values reaching it are known to be at least the first member's minimum if
+      // isAboveMin is set.
+      uint32_t CompileSearch(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, size_t first, size_t last, bool isAboveMin, uint32_t onIn, uint32_t onOut) const;
 
    private:
-      bool m_isValid;
-      int m_operation;
-      int m_value;
+      std::pmr::vector<Interval> m_members;
+      bool m_isNegated;
+      uint16_t m_field;
+      uint32_t m_set;
+      SourceRange m_source;
    };
 
-public:
-   enum class ParseResult : uint8_t
+   // Constant nodes are left behind by Simplify() in place of an expression that always passes
+   // or always fails, compiling to no comparisons at all.
+   struct ConstantNode : public Node
    {
-      OK = 0,
+      explicit ConstantNode(bool passes)
+         : m_passes(passes)
+      {}
 
-      AlreadyConstructed,
-      EmptyStatement,
-      ParsingInvalidCharacter,
-      ClosingUnopenedBrace,
-      InvalidExpression,
-      InvalidLogic
+      virtual uint32_t Compile(std::vector<Instruction>& program, std::vector<SourceRange>& sourceRanges, uint32_t onTrue, uint32_t onFalse) const override;
+      virtual void CompileBatch(std::vector<BatchOp>& batchProgram) const override;
+      virtual uint32_t CompileFilter(std::vector<FilterOp>& filterProgram) const override;
+      virtual std::pmr::vector<Interval> CompileIntervals(std::pmr::memory_resource* pResource) const override;
+      virtual double Optimize(std::span<const T> sample, std::span<uint8_t> passes, std::pmr::memory_resource* pResource) override;
+
+      bool Passes() const { return m_passes; }
+
+   private:
+      bool m_passes;
    };
 
-   ExpressionParser()
+public:
+   // Every node of a parsed expression is allocated from an arena which is released in one go
+   // when the parser is cleared. The arena takes its memory in large blocks from the given
+   // upstream resource.
+   explicit BasicExpressionParser(std::pmr::memory_resource* pUpstream = std::pmr::get_default_resource())
+      : m_allocationCounter(pUpstream)
+      , m_nodeArena(NodeArenaBlockSize, &m_allocationCounter)
+      , m_braceForks(BraceStack(&m_nodeArena))
+      , m_evaluationMode(EvaluationMode::Program)
+      , m_hasDomain(false)
+      , m_domainMin(0)
+      , m_domainRange(0)
+      , m_parseAllocationCount(0)
    {
       Clear();
    }
 
-   bool Evaluate(const int& value) const { return m_pBaseBranch->Evaluate(value); }
+   // The arena can't be moved or shared, so neither can the parser.
+   BasicExpressionParser(const BasicExpressionParser&) = delete;
+   BasicExpressionParser& operator=(const BasicExpressionParser&) = delete;
+
+   // Evaluate a value against the parsed expression. Returns false if nothing has been parsed.
+   bool Evaluate(T value) const { return m_compiled.Evaluate(value); }
+
+   // Evaluate every value in the span, writing 1 to the matching result if it passes and 0 if not.
+   // The results span must be at least as large as the values span.
+   void Evaluate(std::span<const T> values, std::span<uint8_t> results) const { m_compiled.Evaluate(values, results); }
+
+   // Evaluate a row with a column per field, or a block of rows stored as a column per field. See
+   // BasicCompiledExpression for how the selection is laid out.
+   bool EvaluateRow(std::span<const T> row) const { return m_compiled.EvaluateRow(row); }
+   void Evaluate(std::span<const std::span<const T>> columns, std::span<uint64_t> selection) const { m_compiled.Evaluate(columns, selection); }
+
+   // Evaluate sorted values into runs of the same result, or unsorted values by sorting them first.
+   // See BasicCompiledExpression for what order the values must be in.
+   size_t EvaluateSorted(std::span<const T> values, std::vector<ResultRun>& runs) const { return m_compiled.EvaluateSorted(values, runs); }
+   void EvaluateBySorting(std::span<const T> values, std::span<uint8_t> results) const { m_compiled.EvaluateBySorting(values, results); }
+
+   // The expression compiled by the last successful Parse, or one failing everything if there
+   // hasn't been one. Evaluating it is safe from any number of threads while the parser is left
+   // alone, copy it to keep it past the next Clear or Parse.
+   const Compiled& GetCompiledExpression() const { return m_compiled; }
+
+   // Set how Evaluate() checks single values. This is kept when the parser is cleared.
+   void SetEvaluationMode(EvaluationMode mode);
+   EvaluationMode GetEvaluationMode() const { return m_evaluationMode; }
+
+   std::span<const Interval> GetIntervals() const { return m_compiled.GetIntervals(); }
+   bool PassesAll(T min, T max) const { return m_compiled.PassesAll(min, max); }
+   bool PassesAny(T min, T max) const { return m_compiled.PassesAny(min, max); }
+
+   // Declare the inclusive range most values are expected to fall in. The expression is then
+   // materialised as a bitmap over that range, one bit per value, so evaluating a value inside
+   // it is a single load and bit test. Values outside it fall back to the current evaluation mode.
+   // The domain is kept when the parser is cleared and the bitmap is rebuilt on every Parse.
+   // Returns false if max is less than min, or the range holds more than 2^32 values. Only
+   // integer values can have a domain.
+   bool SetDomain(T min, T max) requires std::integral<T>;
+   void ClearDomain();
+   bool HasDomain() const { return m_hasDomain; }
+
+   // The number of bytes used by the domain bitmap, or 0 if there is no domain.
+   size_t GetDomainMemoryCost() const { return m_compiled.GetDomainMemoryCost(); }
+
+   // Bind a field name to the column it reads, so comparisons such as "hp<50" can be parsed.
+   // Comparisons without a field read column 0. Names start with a letter or underscore followed by
+   // any letters, digits or underscores, and can't be "and", "or", "in" or "notin". Binding a name
+   // again moves it to the new column. Bindings are kept when the parser is cleared and are used by
+   // every later Parse. Returns false if the name isn't valid.
+   bool BindField(std::string_view name, uint16_t column);
+   void ClearFields();
 
    // Parse a logical expression. The string must be in the following format:
    // <expression> (<logic> <expression>)...
    // At least 1 expression is required, however you can also add logic (and/or) as well
    // to make a more complex condition. You can also add brackets to group certain
-   // expressions together.
-   // eg: "(>3 or <10) and !=5"
+   // expressions together. Whitespace between any of these is optional, and values may
+   // be negative. Floating point parsers also accept fractions and exponents, eg: "<1.5e-3".
+   // Each expression may start with the name of a bound field to compare, eg: "level>=10".
+   // An expression may also be a set of values and inclusive ranges, passing any value in the set
+   // with "in" or any value outside of it with "notin", or a range on its own.
+   // eg: "(>3 or <10) and !=5" or "(>3||<10)&&!=-5" or "hp<50 and (level>=10 or class=2)"
+   // or "in{1, 4, 10..20}" or "class notin{2, 7} and level 10..20"
    // Returns a ParseResult code, with ParseResult::OK being a success and anything else
    // being a failure.
    ParseResult Parse(std::string_view conditionalDataString);
 
+   // Parse and compile a string literal at compile time, eg:
+   // constexpr auto expression = ExpressionParser::Compile(">10 and (<50 or >100)");
+   // or ExpressionParser::Compile("in{1, 4, 10..20} and !=15")
+   // The result evaluates the same as a parsed expression without any allocation. An invalid
+   // expression fails to compile, with the ParseResult code named in the error. Requires
+   // StaticExpression.h to be included, and is only available for integer values.
+   template <size_t N>
+      requires std::integral<T>
+   static consteval StaticExpression<T, N> Compile(const char (&conditionalDataString)[N]);
+
+   // Reorder the terms within every AND/OR group so the ones most likely to settle the result run
+   // first, based on how the given sample of values is distributed. Terms are chosen one at a time,
+   // each time picking the term that short circuits the most sample values still being evaluated
+   // for the fewest comparisons. Only the evaluation order changes, every value gets the same
+   // result as before. Returns false if nothing has been parsed or the sample is empty.
+   bool Optimize(std::span<const T> sample);
+
+   // Rewrite the expression into a simpler one passing exactly the same values. Comparisons on the
+   // same field within an AND/OR group are merged together where a single comparison covers them,
+   // and any made redundant by the rest of their group are removed, eg: ">3 and >5" becomes ">5"
+   // and "<5 or =5" becomes "<=5". Braces around a single term or a group of the same logic are
+   // flattened away, and an expression always passing or always failing, eg: "=5 and !=5",
+   // becomes a constant running no comparisons. Every comparison removed is reported by
+   // GetSimplifications(). Returns false if nothing has been parsed.
+   bool Simplify();
+
+   // The comparisons removed by the last Simplify, in the order they appear in the string.
+   std::span<const Simplification> GetSimplifications() const { return m_simplifications; }
+
    void Clear();
 
+   // The number of blocks the node arena took from the upstream resource during the last Parse,
+   // and in total since the parser was created.
+   size_t GetParseAllocationCount() const { return m_parseAllocationCount; }
+   size_t GetTotalAllocationCount() const { return m_allocationCounter.GetAllocationCount(); }
+
    size_t GetErrorLocation() const { return m_errorAt; }
    ParseResult GetResultCode() const { return m_result; }
    std::string GetErrorMessage() const;
@@ -162,17 +423,96 @@ private:
    void OpenBrace();
    bool CloseBrace();
 
-   bool AddExpression(std::string_view condition);
+   void AddExpression(int operation, T value, uint16_t field, SourceRange source);
+   void AddSet(std::span<const Interval> members, bool isNegated, uint16_t field, SourceRange source);
+   void SetLogic(bool isOrLogic);
+
+   // Lower the node graph into each of the forms the compiled expression evaluates with.
+   void Compile();
+   void CompileProgram();
+   void CompileBatch();
+   void CompileFilter();
+   void CompileIntervals();
 
    ParseResult SetResult(ParseResult result, size_t at);
 
+   // Passes allocations straight through to the upstream resource, counting them on the way.
+   class AllocationCounter : public std::pmr::memory_resource
+   {
+   public:
+      explicit AllocationCounter(std::pmr::memory_resource* pUpstream)
+         : m_pUpstream(pUpstream)
+         , m_allocationCount(0)
+      {}
+
+      size_t GetAllocationCount() const { return m_allocationCount; }
+
+   private:
+      virtual void* do_allocate(size_t bytes, size_t alignment) override
+      {
+         ++m_allocationCount;
+         return m_pUpstream->allocate(bytes, alignment);
+      }
+
+      virtual void do_deallocate(void* p, size_t bytes, size_t alignment) override
+      {
+         m_pUpstream->deallocate(p, bytes, alignment);
+      }
+
+      virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+      {
+         return this == &other;
+      }
+
+      std::pmr::memory_resource* m_pUpstream;
+      size_t m_allocationCount;
+   };
+
+   struct FieldBinding
+   {
+      std::string m_name;
+      uint16_t m_column;
+   };
+
+   // Big enough for the nodes of a typical expression, so most only ever need one block.
+   static constexpr size_t NodeArenaBlockSize = 4096;
+
+   using BraceStack = std::stack<std::shared_ptr<ForkNode>, std::pmr::vector<std::shared_ptr<ForkNode>>>;
+
 private:
+   // The arena has to outlive every node allocated from it, so it is declared before them.
+   AllocationCounter m_allocationCounter;
+   std::pmr::monotonic_buffer_resource m_nodeArena;
+
    bool m_isValid;
-   std::shared_ptr<BranchNode> m_pBaseBranch;
-   std::shared_ptr<BranchNode> m_pActiveBranch;
-   std::shared_ptr<BranchRootNode> m_pActiveBranchRoot;
-   std::stack<std::shared_ptr<ForkNode>> m_braceForks;
+   std::shared_ptr<BranchRootNode> m_pBaseRoot;
+   BranchRootNode* m_pActiveBranchRoot;
+   BraceStack m_braceForks;
+
+   // The most recent expression or closed brace, which is moved into a new AND group should
+   // the logic following it switch from OR to AND.
+   std::shared_ptr<Node> m_pLastTerm;
+
+   // The lookup form of every set parsed, indexed by the set nodes.
+   std::vector<typename Compiled::Set> m_sets;
+
+   Compiled m_compiled;
+   EvaluationMode m_evaluationMode;
+
+   bool m_hasDomain;
+   T m_domainMin;
+   uint32_t m_domainRange;
+
+   std::vector<FieldBinding> m_fields;
+   std::vector<Simplification> m_simplifications;
+
+   size_t m_parseAllocationCount;
 
    ParseResult m_result;
    size_t m_errorAt;
-};
\ No newline at end of file
+};
+
+using ExpressionParser = BasicExpressionParser<int32_t>;
+using Int64ExpressionParser = BasicExpressionParser<int64_t>;
+using FloatExpressionParser = BasicExpressionParser<float>;
+using DoubleExpressionParser = BasicExpressionParser<double>;
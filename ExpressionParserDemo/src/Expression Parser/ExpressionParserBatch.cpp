@@ -0,0 +1,154 @@
+#include "ExpressionParser.h"
+
+#include <algorithm>
+
+
+/****************************************
+   Expression Parser
+****************************************/
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::CompileBatch()
+{
+   std::vector<BatchOp>& batchProgram = m_compiled.m_batchProgram;
+   m_pBaseRoot->CompileBatch(batchProgram);
+
+   // Work out how many masks are needed at once
+   uint32_t depth = 0;
+   uint32_t& maxDepth = m_compiled.m_batchStackDepth;
+   for (const BatchOp& op : batchProgram)
+   {
+      depth += (op.m_type == BatchOp::And || op.m_type == BatchOp::Or) ? -1 : 1;
+      maxDepth = std::max(maxDepth, depth);
+   }
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::CompileFilter()
+{
+   m_compiled.m_filterDepth = m_pBaseRoot->CompileFilter(m_compiled.m_filterProgram);
+}
+
+
+/****************************************
+   Nodes
+****************************************/
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::BranchRootNode::CompileBatch(std::vector<BatchOp>& batchProgram) const
+{
+   // An empty branch is treated the same as a failed one
+   if (GetNext() == nullptr)
+   {
+      batchProgram.push_back({ BatchOp::False, 0, 0, 0 });
+      return;
+   }
+
+   // Combining after every node rather than once at the end keeps at most two masks per branch
+   const typename BatchOp::Type combine = IsOrLogic() ? BatchOp::Or : BatchOp::And;
+   for (const Node* pNode = GetNext().get(); pNode != nullptr; pNode = pNode->GetNext().get())
+   {
+      pNode->CompileBatch(batchProgram);
+      if (pNode != GetNext().get())
+      {
+         batchProgram.push_back({ (uint8_t)combine, 0, 0, 0 });
+      }
+   }
+}
+
+template <ExpressionValueType T>
+uint32_t BasicExpressionParser<T>::BranchRootNode::CompileFilter(std::vector<FilterOp>& filterProgram) const
+{
+   // An empty branch is treated the same as a failed one
+   if (GetNext() == nullptr)
+   {
+      filterProgram.push_back({ FilterOp::False, 0, 0, 0, T(), 0 });
+      return 0;
+   }
+
+   // A group of one is just that one node
+   if (GetNext()->GetNext() == nullptr)
+   {
+      return GetNext()->CompileFilter(filterProgram);
+   }
+
+   const size_t groupAt = filterProgram.size();
+   filterProgram.push_back({ (uint8_t)(IsOrLogic() ? FilterOp::Or : FilterOp::And), 0, 0, 0, T(), 0 });
+
+   uint32_t depth = 0;
+   for (const Node* pNode = GetNext().get(); pNode != nullptr; pNode = pNode->GetNext().get())
+   {
+      depth = std::max(depth, pNode->CompileFilter(filterProgram));
+   }
+   filterProgram[groupAt].m_end = (uint32_t)filterProgram.size();
+   return IsOrLogic() ? depth + 1 : depth;
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::ForkNode::CompileBatch(std::vector<BatchOp>& batchProgram) const
+{
+   m_pBranchRoot->CompileBatch(batchProgram);
+}
+
+template <ExpressionValueType T>
+uint32_t BasicExpressionParser<T>::ForkNode::CompileFilter(std::vector<FilterOp>& filterProgram) const
+{
+   return m_pBranchRoot->CompileFilter(filterProgram);
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::ConstantNode::CompileBatch(std::vector<BatchOp>& batchProgram) const
+{
+   batchProgram.push_back({ (uint8_t)(m_passes ? BatchOp::True : BatchOp::False), 0, 0, 0 });
+}
+
+template <ExpressionValueType T>
+uint32_t BasicExpressionParser<T>::ConstantNode::CompileFilter(std::vector<FilterOp>& filterProgram) const
+{
+   filterProgram.push_back({ (uint8_t)(m_passes ? FilterOp::True : FilterOp::False), 0, 0, 0, T(), 0 });
+   return 0;
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::ExpressionNode::CompileBatch(std::vector<BatchOp>& batchProgram) const
+{
+   batchProgram.push_back({ BatchOp::Compare, (uint8_t)m_operation, m_value, 0 });
+}
+
+template <ExpressionValueType T>
+uint32_t BasicExpressionParser<T>::ExpressionNode::CompileFilter(std::vector<FilterOp>& filterProgram) const
+{
+   filterProgram.push_back({ FilterOp::Compare, (uint8_t)m_operation, m_field, 0, m_value, 0 });
+   return 0;
+}
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::SetNode::CompileBatch(std::vector<BatchOp>& batchProgram) const
+{
+   const int operation = m_isNegated ? (int)Compiled::NotEqualTo : (int)Compiled::EqualTo;
+   batchProgram.push_back({ BatchOp::Set, (uint8_t)operation, T(), m_set });
+}
+
+template <ExpressionValueType T>
+uint32_t BasicExpressionParser<T>::SetNode::CompileFilter(std::vector<FilterOp>& filterProgram) const
+{
+   const int operation = m_isNegated ? (int)Compiled::NotEqualTo : (int)Compiled::EqualTo;
+   filterProgram.push_back({ FilterOp::Set, (uint8_t)operation, m_field, 0, T(), m_set });
+   return 0;
+}
+
+#define INSTANTIATE(T) \
+   template void BasicExpressionParser<T>::CompileBatch(); \
+   template void BasicExpressionParser<T>::BranchRootNode::CompileBatch(std::vector<BatchOp>&) const; \
+   template void BasicExpressionParser<T>::ForkNode::CompileBatch(std::vector<BatchOp>&) const; \
+   template void BasicExpressionParser<T>::ConstantNode::CompileBatch(std::vector<BatchOp>&) const; \
+   template void BasicExpressionParser<T>::ExpressionNode::CompileBatch(std::vector<BatchOp>&) const; \
+   template void BasicExpressionParser<T>::SetNode::CompileBatch(std::vector<BatchOp>&) const; \
+   template void BasicExpressionParser<T>::CompileFilter(); \
+   template uint32_t BasicExpressionParser<T>::BranchRootNode::CompileFilter(std::vector<FilterOp>&) const; \
+   template uint32_t BasicExpressionParser<T>::ForkNode::CompileFilter(std::vector<FilterOp>&) const; \
+   template uint32_t BasicExpressionParser<T>::ConstantNode::CompileFilter(std::vector<FilterOp>&) const; \
+   template uint32_t BasicExpressionParser<T>::ExpressionNode::CompileFilter(std::vector<FilterOp>&) const; \
+   template uint32_t BasicExpressionParser<T>::SetNode::CompileFilter(std::vector<FilterOp>&) const;
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,141 @@
+#include "ExpressionParser.h"
+#include "ExpressionIntervals.h"
+
+#include <array>
+#include <cstddef>
+
+using namespace ExpressionIntervals;
+
+
+namespace
+{
+   // Enough for the working intervals of a typical expression.
+   constexpr size_t ScratchBufferSize = 1024;
+}
+
+
+/****************************************
+   Expression Parser
+****************************************/
+
+template <ExpressionValueType T>
+void BasicExpressionParser<T>::CompileIntervals()
+{
+   // The working intervals are only needed until the final list is built, so they come from a
+   // scratch arena rather than the node arena, which keeps everything until the parser is cleared.
+   // Most expressions fit in the buffer on the stack and never touch the heap.
+   std::array<std::byte, ScratchBufferSize> buffer;
+   std::pmr::monotonic_buffer_resource scratch(buffer.data(), buffer.size(), &m_allocationCounter);
+   const std::pmr::vector<Interval> intervals = m_pBaseRoot->CompileIntervals(&scratch);
+   m_compiled.m_intervals.assign(intervals.begin(), intervals.end());
+}
+
+
+/****************************************
+   Nodes
+****************************************/
+
+template <ExpressionValueType T>
+std::pmr::vector<typename BasicExpressionParser<T>::Interval> BasicExpressionParser<T>::BranchRootNode::CompileIntervals(std::pmr::memory_resource* pResource) const
+{
+   // An empty branch is treated the same as a failed one
+   if (GetNext() == nullptr)
+   {
+      return std::pmr::vector<Interval>(pResource);
+   }
+
+   // Every term is worked out before combining them all at once, as folding them in one at a time
+   // would copy the result so far for every term
+   if (IsOrLogic())
+   {
+      std::pmr::vector<Interval> intervals(pResource);
+      for (const Node* pNode = GetNext().get(); pNode != nullptr; pNode = pNode->GetNext().get())
+      {
+         const std::pmr::vector<Interval> term = pNode->CompileIntervals(pResource);
+         intervals.insert(intervals.end(), term.begin(), term.end());
+      }
+      return UnionAll(std::move(intervals));
+   }
+
+   std::pmr::vector<std::pmr::vector<Interval>> terms(pResource);
+   for (const Node* pNode = GetNext().get(); pNode != nullptr; pNode = pNode->GetNext().get())
+   {
+      terms.push_back(pNode->CompileIntervals(pResource));
+   }
+   return IntersectionAll(std::move(terms));
+}
+
+template <ExpressionValueType T>
+std::pmr::vector<typename BasicExpressionParser<T>::Interval> BasicExpressionParser<T>::ForkNode::CompileIntervals(std::pmr::memory_resource* pResource) const
+{
+   return m_pBranchRoot->CompileIntervals(pResource);
+}
+
+template <ExpressionValueType T>
+std::pmr::vector<typename BasicExpressionParser<T>::Interval> BasicExpressionParser<T>::ConstantNode::CompileIntervals(std::pmr::memory_resource* pResource) const
+{
+   std::pmr::vector<Interval> intervals(pResource);
+   if (m_passes)
+   {
+      intervals.push_back({ MinValue<T>, MaxValue<T> });
+   }
+   return intervals;
+}
+
+template <ExpressionValueType T>
+std::pmr::vector<typename BasicExpressionParser<T>::Interval> BasicExpressionParser<T>::ExpressionNode::CompileIntervals(std::pmr::memory_resource* pResource) const
+{
+   std::pmr::vector<Interval> intervals(pResource);
+
+   // Strict comparisons against the very ends of the range pass nothing
+   constexpr T Min = MinValue<T>;
+   constexpr T Max = MaxValue<T>;
+   switch (m_operation)
+   {
+      case (int)Compiled::LessThan:                              if (m_value != Min) { intervals.push_back({ Min, Previous(m_value) }); } break;
+      case (int)Compiled::LessThan | (int)Compiled::EqualTo:     intervals.push_back({ Min, m_value }); break;
+      case (int)Compiled::EqualTo:                               intervals.push_back({ m_value, m_value }); break;
+      case (int)Compiled::GreaterThan | (int)Compiled::EqualTo:  intervals.push_back({ m_value, Max }); break;
+      case (int)Compiled::GreaterThan:                           if (m_value != Max) { intervals.push_back({ Next(m_value), Max }); } break;
+      case (int)Compiled::NotEqualTo:
+         if (m_value != Min) { intervals.push_back({ Min, Previous(m_value) }); }
+         if (m_value != Max) { intervals.push_back({ Next(m_value), Max }); }
+         break;
+   }
+   return intervals;
+}
+
+template <ExpressionValueType T>
+std::pmr::vector<typename BasicExpressionParser<T>::Interval> BasicExpressionParser<T>::SetNode::CompileIntervals(std::pmr::memory_resource* pResource) const
+{
+   if (m_isNegated == false)
+   {
+      return std::pmr::vector<Interval>(m_members.begin(), m_members.end(), pResource);
+   }
+
+   // A negated set passes the gaps between its members, along with anything either side of them
+   std::pmr::vector<Interval> intervals(pResource);
+   if (m_members.front().m_min != MinValue<T>)
+   {
+      intervals.push_back({ MinValue<T>, Previous(m_members.front().m_min) });
+   }
+   for (size_t i = 1; i < m_members.size(); ++i)
+   {
+      intervals.push_back({ Next(m_members[i - 1].m_max), Previous(m_members[i].m_min) });
+   }
+   if (m_members.back().m_max != MaxValue<T>)
+   {
+      intervals.push_back({ Next(m_members.back().m_max), MaxValue<T> });
+   }
+   return intervals;
+}
+
+#define INSTANTIATE(T) \
+   template void BasicExpressionParser<T>::CompileIntervals(); \
+   template std::pmr::vector<typename BasicExpressionParser<T>::Interval> BasicExpressionParser<T>::BranchRootNode::CompileIntervals(std::pmr::memory_resource*) const; \
+   template std::pmr::vector<typename BasicExpressionParser<T>::Interval> BasicExpressionParser<T>::ForkNode::CompileIntervals(std::pmr::memory_resource*) const; \
+   template std::pmr::vector<typename BasicExpressionParser<T>::Interval> BasicExpressionParser<T>::ConstantNode::CompileIntervals(std::pmr::memory_resource*) const; \
+   template std::pmr::vector<typename BasicExpressionParser<T>::Interval> BasicExpressionParser<T>::ExpressionNode::CompileIntervals(std::pmr::memory_resource*) const; \
+   template std::pmr::vector<typename BasicExpressionParser<T>::Interval> BasicExpressionParser<T>::SetNode::CompileIntervals(std::pmr::memory_resource*) const;
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
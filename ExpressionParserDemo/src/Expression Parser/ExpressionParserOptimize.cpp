@@ -0,0 +1,166 @@
+#include "ExpressionParser.h"
+
+#include <algorithm>
+#include <bit>
+
+
+/****************************************
+   Expression Parser
+****************************************/
+
+template <ExpressionValueType T>
+bool BasicExpressionParser<T>::Optimize(std::span<const T> sample)
+{
+   if (m_isValid == false || sample.empty())
+   {
+      return false;
+   }
+
+   // The masks are only needed while reordering, so they come from a scratch arena rather than
+   // growing the node arena every time this is called.
+   std::pmr::monotonic_buffer_resource scratch(&m_allocationCounter);
+   std::pmr::vector<uint8_t> passes(sample.size(), &scratch);
+   m_pBaseRoot->Optimize(sample, passes, &scratch);
+
+   // The domain bitmap and intervals don't depend on the order, but rebuilding everything keeps
+   // the compiled expression in one consistent state.
+   Compile();
+   return true;
+}
+
+
+/****************************************
+   Nodes
+****************************************/
+
+template <ExpressionValueType T>
+double BasicExpressionParser<T>::BranchRootNode::Optimize(std::span<const T> sample, std::span<uint8_t> passes, std::pmr::memory_resource* pResource)
+{
+   // An empty branch is treated the same as a failed one
+   if (GetNext() == nullptr)
+   {
+      std::fill(passes.begin(), passes.end(), (uint8_t)0);
+      return 0.0;
+   }
+
+   std::pmr::vector<std::shared_ptr<Node>> children(pResource);
+   for (const Node* pNode = this; pNode->GetNext() != nullptr; pNode = pNode->GetNext().get())
+   {
+      children.push_back(pNode->GetNext());
+   }
+
+   // Optimise each child first, keeping what it passes and what it costs on its own
+   const size_t sampleSize = sample.size();
+   std::pmr::vector<uint8_t> childPasses(children.size() * sampleSize, pResource);
+   std::pmr::vector<double> childCosts(children.size(), pResource);
+   for (size_t i = 0; i < children.size(); ++i)
+   {
+      childCosts[i] = children[i]->Optimize(sample, std::span<uint8_t>(childPasses).subspan(i * sampleSize, sampleSize), pResource);
+   }
+
+   // OR logic stops on the first pass and AND logic on the first fail. Values still being
+   // evaluated are active, and each pick is the child stopping the most active values for its cost.
+   const uint8_t stopsOn = IsOrLogic() ? 1 : 0;
+   std::pmr::vector<uint8_t> active(sampleSize, 1, pResource);
+   size_t activeCount = sampleSize;
+   double cost = 0.0;
+
+   Node* pPrev = this;
+   for (size_t placed = 0; placed < children.size(); ++placed)
+   {
+      size_t best = placed;
+      double bestScore = -1.0;
+      for (size_t i = placed; i < children.size(); ++i)
+      {
+         const uint8_t* pPasses = childPasses.data() + i * sampleSize;
+         size_t stopped = 0;
+         for (size_t v = 0; v < sampleSize; ++v)
+         {
+            stopped += active[v] & (pPasses[v] == stopsOn);
+         }
+
+         // A child running no comparisons at all is free, so always goes first
+         const double score = childCosts[i] > 0.0 ? (double)stopped / childCosts[i] : (double)sampleSize + 1.0;
+         if (score > bestScore)
+         {
+            best = i;
+            bestScore = score;
+         }
+      }
+
+      // Keep the unplaced children after the placed ones by swapping the pick into place
+      if (best != placed)
+      {
+         std::swap(children[best], children[placed]);
+         std::swap(childCosts[best], childCosts[placed]);
+         std::swap_ranges(childPasses.begin() + best * sampleSize, childPasses.begin() + (best + 1) * sampleSize, childPasses.begin() + placed * sampleSize);
+      }
+
+      pPrev->SetNext(children[placed]);
+      pPrev = children[placed].get();
+
+      cost += childCosts[placed] * (double)activeCount / (double)sampleSize;
+      const uint8_t* pPasses = childPasses.data() + placed * sampleSize;
+      activeCount = 0;
+      for (size_t v = 0; v < sampleSize; ++v)
+      {
+         active[v] &= pPasses[v] != stopsOn;
+         activeCount += active[v];
+      }
+   }
+
+   // Values still active never hit the stopping result, so they take the opposite one
+   for (size_t v = 0; v < sampleSize; ++v)
+   {
+      passes[v] = active[v] ? (uint8_t)(1 - stopsOn) : stopsOn;
+   }
+   return cost;
+}
+
+template <ExpressionValueType T>
+double BasicExpressionParser<T>::ForkNode::Optimize(std::span<const T> sample, std::span<uint8_t> passes, std::pmr::memory_resource* pResource)
+{
+   return m_pBranchRoot->Optimize(sample, passes, pResource);
+}
+
+template <ExpressionValueType T>
+double BasicExpressionParser<T>::ConstantNode::Optimize(std::span<const T>, std::span<uint8_t> passes, std::pmr::memory_resource*)
+{
+   std::fill(passes.begin(), passes.end(), (uint8_t)(m_passes ? 1 : 0));
+   return 0.0;
+}
+
+template <ExpressionValueType T>
+double BasicExpressionParser<T>::ExpressionNode::Optimize(std::span<const T> sample, std::span<uint8_t> passes, std::pmr::memory_resource*)
+{
+   for (size_t i = 0; i < sample.size(); ++i)
+   {
+      passes[i] = Compiled::Compare(m_operation, m_value, sample[i]) ? 1 : 0;
+   }
+   return 1.0;
+}
+
+template <ExpressionValueType T>
+double BasicExpressionParser<T>::SetNode::Optimize(std::span<const T> sample, std::span<uint8_t> passes, std::pmr::memory_resource*)
+{
+   // NaN is below no member's minimum so lands on the last member, where it fails the check
+   for (size_t i = 0; i < sample.size(); ++i)
+   {
+      auto it = std::upper_bound(m_members.begin(), m_members.end(), sample[i], [](T value, const Interval& member) { return value < member.m_min; });
+      const bool isMember = it != m_members.begin() && (it - 1)->m_min <= sample[i] && sample[i] <= (it - 1)->m_max;
+      passes[i] = isMember != m_isNegated ? 1 : 0;
+   }
+
+   // Compiled as a search tree, with a comparison for each halving and up to two on the member reached
+   return 1.0 + (double)std::bit_width(m_members.size() - 1);
+}
+
+#define INSTANTIATE(T) \
+   template bool BasicExpressionParser<T>::Optimize(std::span<const T>); \
+   template double BasicExpressionParser<T>::BranchRootNode::Optimize(std::span<const T>, std::span<uint8_t>, std::pmr::memory_resource*); \
+   template double BasicExpressionParser<T>::ForkNode::Optimize(std::span<const T>, std::span<uint8_t>, std::pmr::memory_resource*); \
+   template double BasicExpressionParser<T>::ConstantNode::Optimize(std::span<const T>, std::span<uint8_t>, std::pmr::memory_resource*); \
+   template double BasicExpressionParser<T>::ExpressionNode::Optimize(std::span<const T>, std::span<uint8_t>, std::pmr::memory_resource*); \
+   template double BasicExpressionParser<T>::SetNode::Optimize(std::span<const T>, std::span<uint8_t>, std::pmr::memory_resource*);
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
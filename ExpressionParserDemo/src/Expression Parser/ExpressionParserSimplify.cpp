@@ -0,0 +1,582 @@
+#include "ExpressionParser.h"
+#include "ExpressionIntervals.h"
+
+#include <algorithm>
+#include <climits>
+#include <span>
+#include <utility>
+
+using namespace ExpressionIntervals;
+
+
+namespace
+{
+   // Every value a comparison passes, or a group of comparisons on the same field. NaN isn't in any
+   // interval but still passes "!=", so it is tracked on its own for floating point values.
+   template <typename Interval>
+   struct ValueSet
+   {
+      std::pmr::vector<Interval> m_intervals;
+      bool m_hasNaN;
+   };
+
+   // The set passing every value, which AND logic starts from as OR logic does from an empty set.
+   // Integers can't be NaN, so never include it.
+   template <typename Interval>
+   ValueSet<Interval> Everything(std::pmr::memory_resource* pResource)
+   {
+      using T = decltype(Interval::m_min);
+      return { std::pmr::vector<Interval>({ { MinValue<T>, MaxValue<T> } }, pResource), std::is_floating_point_v<T> };
+   }
+
+   // The values every set passes together, all combined at once rather than one after another.
+   template <typename Interval>
+   ValueSet<Interval> CombineAll(std::span<const ValueSet<Interval>> sets, bool isOrLogic, std::pmr::memory_resource* pResource)
+   {
+      if (isOrLogic)
+      {
+         std::pmr::vector<Interval> intervals(pResource);
+         bool hasNaN = false;
+         for (const ValueSet<Interval>& set : sets)
+         {
+            intervals.insert(intervals.end(), set.m_intervals.begin(), set.m_intervals.end());
+            hasNaN = hasNaN || set.m_hasNaN;
+         }
+         return { UnionAll(std::move(intervals)), hasNaN };
+      }
+
+      if (sets.empty())
+      {
+         return Everything<Interval>(pResource);
+      }
+
+      std::pmr::vector<std::pmr::vector<Interval>> lists(pResource);
+      bool hasNaN = true;
+      for (const ValueSet<Interval>& set : sets)
+      {
+         lists.push_back(set.m_intervals);
+         hasNaN = hasNaN && set.m_hasNaN;
+      }
+      return { IntersectionAll(std::move(lists)), hasNaN };
+   }
+
+   // Every value the set doesn't pass. Integers can't be NaN, so never include it.
+   template <typename Interval>
+   ValueSet<Interval> Complement(const ValueSet<Interval>& set, std::pmr::memory_resource* pResource)
+   {
+      using T = decltype(Interval::m_min);
+      const std::pmr::vector<Interval>& intervals = set.m_intervals;
+      ValueSet<Interval> complement{ std::pmr::vector<Interval>(pResource), std::is_floating_point_v<T> && set.m_hasNaN == false };
+      if (intervals.empty())
+      {
+         complement.m_intervals.push_back({ MinValue<T>, MaxValue<T> });
+         return complement;
+      }
+
+      if (intervals.front().m_min != MinValue<T>)
+      {
+         complement.m_intervals.push_back({ MinValue<T>, Previous(intervals.front().m_min) });
+      }
+      for (size_t i = 1; i < intervals.size(); ++i)
+      {
+         complement.m_intervals.push_back({ Next(intervals[i - 1].m_max), Previous(intervals[i].m_min) });
+      }
+      if (intervals.back().m_max != MaxValue<T>)
+      {
+         complement.m_intervals.push_back({ Next(intervals.back().m_max), MaxValue<T> });
+      }
+      return complement;
+   }
+
+   // Counts how many sets cover each of a number of consecutive segments, adding to or finding the
+   // lowest count over a range of segments in logarithmic time. Each node holds the lowest count
+   // beneath it including what was added to the node as a whole, so nothing is pushed down.
+   class CoverageTree
+   {
+   public:
+      CoverageTree(size_t segmentCount, std::pmr::memory_resource* pResource)
+         : m_segmentCount(std::max<size_t>(segmentCount, 1))
+         , m_lowest(m_segmentCount * 4, 0, pResource)
+         , m_added(m_segmentCount * 4, 0, pResource)
+      {}
+
+      // Both take the half open range of segments [first, last).
+      void Add(size_t first, size_t last, int amount) { Add(1, 0, m_segmentCount, first, last, amount); }
+      int GetLowest(size_t first, size_t last) const { return GetLowest(1, 0, m_segmentCount, first, last); }
+
+   private:
+      void Add(size_t node, size_t nodeFirst, size_t nodeLast, size_t first, size_t last, int amount)
+      {
+         if (last <= nodeFirst || nodeLast <= first)
+         {
+            return;
+         }
+         if (first <= nodeFirst && nodeLast <= last)
+         {
+            m_lowest[node] += amount;
+            m_added[node] += amount;
+            return;
+         }
+
+         const size_t middle = (nodeFirst + nodeLast) / 2;
+         Add(node * 2, nodeFirst, middle, first, last, amount);
+         Add(node * 2 + 1, middle, nodeLast, first, last, amount);
+         m_lowest[node] = std::min(m_lowest[node * 2], m_lowest[node * 2 + 1]) + m_added[node];
+      }
+
+      int GetLowest(size_t node, size_t nodeFirst, size_t nodeLast, size_t first, size_t last) const
+      {
+         if (last <= nodeFirst || nodeLast <= first)
+         {
+            return INT_MAX;
+         }
+         if (first <= nodeFirst && nodeLast <= last)
+         {
+            return m_lowest[node];
+         }
+
+         // The range overlaps at least one side, so the sum never starts from INT_MAX
+         const size_t middle = (nodeFirst + nodeLast) / 2;
+         return std::min(GetLowest(node * 2, nodeFirst, middle, first, last), GetLowest(node * 2 + 1, middle, nodeLast, first, last)) + m_added[node];
+      }
+
+      size_t m_segmentCount;
+      std::pmr::vector<int> m_lowest;
+      std::pmr::vector<int> m_added;
+   };
+
+   template <typename Interval>
+   bool IsSame(const ValueSet<Interval>& a, const ValueSet<Interval>& b)
+   {
+      return a.m_hasNaN == b.m_hasNaN && std::equal(a.m_intervals.begin(), a.m_intervals.end(), b.m_intervals.begin(), b.m_intervals.end(),
+         [](const Interval& x, const Interval& y) { return x.m_min == y.m_min && x.m_max == y.m_max; });
+   }
+
+   template <typename Interval>
+   bool IsEmpty(const ValueSet<Interval>& set)
+   {
+      return set.m_intervals.empty() && set.m_hasNaN == false;
+   }
+
+   template <typename Interval>
+   bool IsEverything(const ValueSet<Interval>& set)
+   {
+      using T = decltype(Interval::m_min);
+      return set.m_intervals.size() == 1 && set.m_intervals[0].m_min == MinValue<T> && set.m_intervals[0].m_max == MaxValue<T>
+         && set.m_hasNaN == std::is_floating_point_v<T>;
+   }
+}
+
+
+/****************************************
+   Expression Parser
+****************************************/
+
+template <ExpressionValueType T>
+bool BasicExpressionParser<T>::Simplify()
+{
+   if (m_isValid == false)
+   {
+      return false;
+   }
+
+   // The value sets are only needed while simplifying, so they come from a scratch arena. Any
+   // nodes replacing others live as long as the rest of the graph.
+   std::pmr::monotonic_buffer_resource scratch(&m_allocationCounter);
+   m_simplifications.clear();
+   const std::optional<bool> result = m_pBaseRoot->Simplify(m_simplifications, &m_nodeArena, &scratch);
+   if (result.has_value())
+   {
+      m_pBaseRoot->SetNext(nullptr);
+      m_pBaseRoot->SetNext(std::allocate_shared<ConstantNode>(std::pmr::polymorphic_allocator<ConstantNode>(&m_nodeArena), *result));
+   }
+
+   std::stable_sort(m_simplifications.begin(), m_simplifications.end(), [](const Simplification& a, const Simplification& b)
+   {
+      return a.m_source.m_at < b.m_source.m_at;
+   });
+
+   Compile();
+   return true;
+}
+
+
+/****************************************
+   Nodes
+****************************************/
+
+template <ExpressionValueType T>
+std::optional<bool> BasicExpressionParser<T>::BranchRootNode::Simplify(std::vector<Simplification>& report, std::pmr::memory_resource* pNodeResource, std::pmr::memory_resource* pScratch)
+{
+   using Reason = Simplification::Reason;
+
+   // An empty branch is treated the same as a failed one
+   if (GetNext() == nullptr)
+   {
+      return false;
+   }
+
+   // OR logic is settled by any term passing everything and AND logic by any failing everything.
+   // The opposite result is what the group would have without a term, so those terms can go.
+   const bool isOrLogic = IsOrLogic();
+   const bool settlingResult = isOrLogic;
+
+   // Add every comparison beneath a term to the report
+   auto reportTerm = [&report, pScratch](const Node* pTerm, Reason reason)
+   {
+      std::pmr::vector<const Node*> pending({ pTerm }, pScratch);
+      while (pending.empty() == false)
+      {
+         const Node* pNode = pending.back();
+         pending.pop_back();
+         if (const ExpressionNode* pExpression = dynamic_cast<const ExpressionNode*>(pNode))
+         {
+            report.push_back({ reason, pExpression->GetSource() });
+         }
+         else if (const SetNode* pSet = dynamic_cast<const SetNode*>(pNode))
+         {
+            report.push_back({ reason, pSet->GetSource() });
+         }
+         else if (const ForkNode* pFork = dynamic_cast<const ForkNode*>(pNode))
+         {
+            for (const Node* pChild = pFork->GetLinkedRoot()->GetNext().get(); pChild != nullptr; pChild = pChild->GetNext().get())
+            {
+               pending.push_back(pChild);
+            }
+         }
+      }
+   };
+
+   std::pmr::vector<std::shared_ptr<Node>> children(pScratch);
+   for (const Node* pNode = this; pNode->GetNext() != nullptr; pNode = pNode->GetNext().get())
+   {
+      children.push_back(pNode->GetNext());
+   }
+
+   // Simplify the groups beneath this one first, then flatten any of them whose braces do nothing
+   // into this branch
+   std::pmr::vector<std::shared_ptr<Node>> terms(pScratch);
+   bool isSettled = false;
+   for (const std::shared_ptr<Node>& pChild : children)
+   {
+      std::optional<bool> constant;
+      if (const ConstantNode* pConstant = dynamic_cast<const ConstantNode*>(pChild.get()))
+      {
+         constant = pConstant->Passes();
+      }
+      else if (ForkNode* pFork = dynamic_cast<ForkNode*>(pChild.get()))
+      {
+         BranchRootNode* pGroup = pFork->GetLinkedRoot();
+         constant = pGroup->Simplify(report, pNodeResource, pScratch);
+         if (constant.has_value() == false)
+         {
+            // A group of one is just that one term, which may be a group itself
+            std::shared_ptr<Node> pTerm = pChild;
+            if (pGroup->GetNext()->GetNext() == nullptr)
+            {
+               pTerm = pGroup->GetNext();
+               ForkNode* pInnerFork = dynamic_cast<ForkNode*>(pTerm.get());
+               pGroup = pInnerFork != nullptr ? pInnerFork->GetLinkedRoot() : nullptr;
+            }
+
+            if (pGroup != nullptr && pGroup->IsOrLogic() == isOrLogic)
+            {
+               for (const Node* pNode = pGroup; pNode->GetNext() != nullptr; pNode = pNode->GetNext().get())
+               {
+                  terms.push_back(pNode->GetNext());
+               }
+            }
+            else
+            {
+               terms.push_back(pTerm);
+            }
+         }
+      }
+      else
+      {
+         terms.push_back(pChild);
+      }
+
+      // Groups always having the other result simply drop out, having reported their own comparisons
+      isSettled = isSettled || constant == settlingResult;
+   }
+
+   if (isSettled)
+   {
+      for (const std::shared_ptr<Node>& pTerm : terms)
+      {
+         reportTerm(pTerm.get(), Reason::Redundant);
+      }
+      return settlingResult;
+   }
+
+   // Comparisons and sets on the same field are worked out from the values they pass together.
+   // NaN only ever passes "!=" and "notin", and integers can't be NaN at all.
+   auto getField = [](const Node* pTerm) -> std::optional<uint16_t>
+   {
+      if (const ExpressionNode* pExpression = dynamic_cast<const ExpressionNode*>(pTerm))
+      {
+         return pExpression->GetField();
+      }
+      if (const SetNode* pSet = dynamic_cast<const SetNode*>(pTerm))
+      {
+         return pSet->GetField();
+      }
+      return std::nullopt;
+   };
+
+   auto getSet = [pScratch](const Node& term)
+   {
+      const SetNode* pSet = dynamic_cast<const SetNode*>(&term);
+      const bool isNegated = pSet != nullptr
+         ? pSet->IsNegated()
+         : static_cast<const ExpressionNode&>(term).GetOperation() == (int)Compiled::NotEqualTo;
+      return ValueSet<Interval>{ term.CompileIntervals(pScratch), std::is_floating_point_v<T> && isNegated };
+   };
+
+   const ValueSet<Interval> identity = isOrLogic ? ValueSet<Interval>{ std::pmr::vector<Interval>(pScratch), false } : Everything<Interval>(pScratch);
+   std::pmr::vector<uint16_t> fields(pScratch);
+   for (const std::shared_ptr<Node>& pTerm : terms)
+   {
+      const std::optional<uint16_t> field = getField(pTerm.get());
+      if (field.has_value() && std::find(fields.begin(), fields.end(), *field) == fields.end())
+      {
+         fields.push_back(*field);
+      }
+   }
+
+   // The terms comparing each field along with the values each of them passes, and all of them together
+   std::pmr::vector<size_t> fieldTerms(pScratch);
+   std::pmr::vector<ValueSet<Interval>> sets(pScratch);
+   auto gatherField = [&](uint16_t field)
+   {
+      fieldTerms.clear();
+      sets.clear();
+      for (size_t i = 0; i < terms.size(); ++i)
+      {
+         if (getField(terms[i].get()) == field)
+         {
+            fieldTerms.push_back(i);
+            sets.push_back(getSet(*terms[i]));
+         }
+      }
+      return CombineAll<Interval>(sets, isOrLogic, pScratch);
+   };
+
+   // Check every field for one settling the whole group before changing anything
+   const Reason constantReason = isOrLogic ? Reason::AlwaysTrue : Reason::AlwaysFalse;
+   for (uint16_t field : fields)
+   {
+      const ValueSet<Interval> combined = gatherField(field);
+      if (isOrLogic ? IsEverything(combined) : IsEmpty(combined))
+      {
+         for (size_t i = 0; i < terms.size(); ++i)
+         {
+            const bool isFieldTerm = std::find(fieldTerms.begin(), fieldTerms.end(), i) != fieldTerms.end();
+            reportTerm(terms[i].get(), isFieldTerm ? constantReason : Reason::Redundant);
+         }
+         return settlingResult;
+      }
+   }
+
+   std::pmr::vector<uint8_t> isRemoved(terms.size(), 0, pScratch);
+   for (uint16_t field : fields)
+   {
+      const ValueSet<Interval> combined = gatherField(field);
+
+      // Comparisons that together never change the result of the group can all go
+      if (IsSame(combined, identity))
+      {
+         for (size_t i : fieldTerms)
+         {
+            reportTerm(terms[i].get(), isOrLogic ? Reason::AlwaysFalse : Reason::AlwaysTrue);
+            isRemoved[i] = 1;
+         }
+         continue;
+      }
+
+      // Remove any comparison the rest already cover, from the first, reporting those never changing
+      // the result on their own as constant. Under OR logic a term is covered when every value it
+      // passes is passed by another term still kept, and under AND logic when every value it fails
+      // is failed by another. The values are split into segments at the ends of every term's
+      // intervals, counting how many kept terms cover each, so a term is covered when none of its
+      // segments is down to being covered by it alone.
+      const size_t count = fieldTerms.size();
+      std::pmr::vector<ValueSet<Interval>> covers(pScratch);
+      std::pmr::vector<T> boundaries(pScratch);
+      for (const ValueSet<Interval>& set : sets)
+      {
+         covers.push_back(isOrLogic ? set : Complement(set, pScratch));
+         for (const Interval& interval : covers.back().m_intervals)
+         {
+            boundaries.push_back(interval.m_min);
+            if (interval.m_max != MaxValue<T>)
+            {
+               boundaries.push_back(Next(interval.m_max));
+            }
+         }
+      }
+      std::sort(boundaries.begin(), boundaries.end());
+      boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+      auto getSegments = [&boundaries](const Interval& interval)
+      {
+         const size_t first = std::lower_bound(boundaries.begin(), boundaries.end(), interval.m_min) - boundaries.begin();
+         const size_t last = interval.m_max == MaxValue<T>
+            ? boundaries.size()
+            : std::lower_bound(boundaries.begin(), boundaries.end(), Next(interval.m_max)) - boundaries.begin();
+         return std::pair<size_t, size_t>(first, last);
+      };
+
+      CoverageTree coverage(boundaries.size(), pScratch);
+      int coveringNaN = 0;
+      for (const ValueSet<Interval>& cover : covers)
+      {
+         for (const Interval& interval : cover.m_intervals)
+         {
+            const auto [first, last] = getSegments(interval);
+            coverage.Add(first, last, 1);
+         }
+         coveringNaN += cover.m_hasNaN ? 1 : 0;
+      }
+
+      size_t keptCount = count;
+      for (size_t i = 0; i < count && keptCount > 1; ++i)
+      {
+         const ValueSet<Interval>& cover = covers[i];
+         bool isCovered = cover.m_hasNaN == false || coveringNaN > 1;
+         for (size_t j = 0; j < cover.m_intervals.size() && isCovered; ++j)
+         {
+            const auto [first, last] = getSegments(cover.m_intervals[j]);
+            isCovered = coverage.GetLowest(first, last) > 1;
+         }
+
+         if (isCovered)
+         {
+            const bool isConstant = IsSame(sets[i], identity);
+            reportTerm(terms[fieldTerms[i]].get(), isConstant ? (isOrLogic ? Reason::AlwaysFalse : Reason::AlwaysTrue) : Reason::Redundant);
+            isRemoved[fieldTerms[i]] = 1;
+            --keptCount;
+            for (const Interval& interval : cover.m_intervals)
+            {
+               const auto [first, last] = getSegments(interval);
+               coverage.Add(first, last, -1);
+            }
+            coveringNaN -= cover.m_hasNaN ? 1 : 0;
+         }
+      }
+
+      if (keptCount < 2)
+      {
+         continue;
+      }
+
+      // Look for a single comparison against one of the values already there passing the same
+      // values, eg: "<5 or =5" is "<=5". Sets offer the ends of their members, eg: "<1 or in{1..5}"
+      // is "<=5".
+      static constexpr int Operations[] =
+      {
+         (int)Compiled::LessThan,
+         (int)Compiled::LessThan | (int)Compiled::EqualTo,
+         (int)Compiled::EqualTo,
+         (int)Compiled::NotEqualTo,
+         (int)Compiled::GreaterThan | (int)Compiled::EqualTo,
+         (int)Compiled::GreaterThan,
+      };
+
+      bool isMergeable = false;
+      int mergedOperation = 0;
+      T mergedValue = T();
+      SourceRange mergedSource = {};
+      for (size_t i : fieldTerms)
+      {
+         if (isRemoved[i])
+         {
+            continue;
+         }
+
+         T candidates[2];
+         size_t candidateCount = 0;
+         SourceRange source;
+         if (const ExpressionNode* pExpression = dynamic_cast<const ExpressionNode*>(terms[i].get()))
+         {
+            candidates[candidateCount++] = pExpression->GetValue();
+            source = pExpression->GetSource();
+         }
+         else
+         {
+            const SetNode& set = static_cast<const SetNode&>(*terms[i]);
+            candidates[candidateCount++] = set.GetMembers().front().m_min;
+            candidates[candidateCount++] = set.GetMembers().back().m_max;
+            source = set.GetSource();
+         }
+
+         for (size_t c = 0; c < candidateCount; ++c)
+         {
+            for (int operation : Operations)
+            {
+               if (isMergeable == false && IsSame(getSet(ExpressionNode(operation, candidates[c], field, source)), combined))
+               {
+                  isMergeable = true;
+                  mergedOperation = operation;
+                  mergedValue = candidates[c];
+                  mergedSource = source;
+               }
+            }
+         }
+      }
+
+      if (isMergeable == false)
+      {
+         continue;
+      }
+
+      // The merged comparison takes the place of the first one it replaces, and is read from the
+      // term its value came from, eg: ">5" in "=5 or >7 or >5" rather than the whole of it
+      bool isPlaced = false;
+      for (size_t i : fieldTerms)
+      {
+         if (isRemoved[i])
+         {
+            continue;
+         }
+
+         reportTerm(terms[i].get(), Reason::Merged);
+         if (isPlaced == false)
+         {
+            terms[i] = std::allocate_shared<ExpressionNode>(std::pmr::polymorphic_allocator<ExpressionNode>(pNodeResource),
+               mergedOperation, mergedValue, field, mergedSource);
+            isPlaced = true;
+         }
+         else
+         {
+            isRemoved[i] = 1;
+         }
+      }
+   }
+
+   // Relink whatever is left in order. Nodes come along from any flattened groups, and anything
+   // removed is left after the last node kept to be cut off.
+   Node* pPrev = this;
+   for (size_t i = 0; i < terms.size(); ++i)
+   {
+      if (isRemoved[i] == 0)
+      {
+         pPrev->SetNext(terms[i]);
+         pPrev = terms[i].get();
+      }
+   }
+
+   if (pPrev == this)
+   {
+      return settlingResult == false;
+   }
+   pPrev->SetNext(nullptr);
+   return std::nullopt;
+}
+
+#define INSTANTIATE(T) \
+   template bool BasicExpressionParser<T>::Simplify(); \
+   template std::optional<bool> BasicExpressionParser<T>::BranchRootNode::Simplify(std::vector<Simplification>&, std::pmr::memory_resource*, std::pmr::memory_resource*);
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
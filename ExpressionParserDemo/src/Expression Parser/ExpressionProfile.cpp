@@ -0,0 +1,97 @@
+#include "ExpressionProfile.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+/****************************************
+   Expression Profile
+****************************************/
+
+ExpressionProfile::ExpressionProfile(std::span<const CompiledExpressionBase::SourceRange> sourceRanges)
+   : m_evaluationCount(0)
+{
+   for (const CompiledExpressionBase::SourceRange& source : sourceRanges)
+   {
+      m_terms.push_back({ source, 0, 0, 0 });
+   }
+}
+
+bool ExpressionProfile::Merge(const ExpressionProfile& other)
+{
+   const bool isSameExpression = std::equal(m_terms.begin(), m_terms.end(), other.m_terms.begin(), other.m_terms.end(),
+      [](const TermCounters& a, const TermCounters& b) { return a.m_source.m_at == b.m_source.m_at && a.m_source.m_length == b.m_source.m_length; });
+   if (isSameExpression == false)
+   {
+      return false;
+   }
+
+   for (size_t i = 0; i < m_terms.size(); ++i)
+   {
+      m_terms[i].m_evaluated += other.m_terms[i].m_evaluated;
+      m_terms[i].m_passed += other.m_terms[i].m_passed;
+      m_terms[i].m_shortCircuits += other.m_terms[i].m_shortCircuits;
+   }
+   m_evaluationCount += other.m_evaluationCount;
+   return true;
+}
+
+void ExpressionProfile::Reset()
+{
+   for (TermCounters& term : m_terms)
+   {
+      term.m_evaluated = 0;
+      term.m_passed = 0;
+      term.m_shortCircuits = 0;
+   }
+   m_evaluationCount = 0;
+}
+
+std::string ExpressionProfile::ToString(std::string_view expression) const
+{
+   std::string result = "Evaluated " + std::to_string(m_evaluationCount) + " values\n";
+   for (const TermCounters& term : m_terms)
+   {
+      const std::string_view text = term.m_source.m_at < expression.length() ? expression.substr(term.m_source.m_at, term.m_source.m_length) : std::string_view();
+      result += "  \"" + std::string(text) + "\" at " + std::to_string(term.m_source.m_at)
+         + ": evaluated " + std::to_string(term.m_evaluated)
+         + ", passed " + std::to_string(term.m_passed)
+         + ", short circuited " + std::to_string(term.m_shortCircuits) + "\n";
+   }
+   return result;
+}
+
+
+/****************************************
+   Compiled Expression
+****************************************/
+
+template <ExpressionValueType T>
+bool BasicCompiledExpression<T>::Evaluate(T value, ExpressionProfile& profile) const
+{
+   assert(profile.m_terms.size() == m_instructions.size());
+   ++profile.m_evaluationCount;
+
+   // Every jump goes forwards, so a jump past the next instruction has skipped the ones in between.
+   // Ending the evaluation counts as jumping to the end of the program.
+   const uint32_t programEnd = (uint32_t)m_instructions.size();
+   uint32_t at = m_entry;
+   while (at < Instruction::JumpToFalse)
+   {
+      const Instruction& instruction = m_instructions[at];
+      const bool passed = Compare(instruction.m_operation, instruction.m_value, value);
+      const uint32_t next = passed ? instruction.m_onTrue : instruction.m_onFalse;
+
+      ExpressionProfile::TermCounters& term = profile.m_terms[at];
+      ++term.m_evaluated;
+      term.m_passed += passed ? 1 : 0;
+      term.m_shortCircuits += std::min(next, programEnd) > at + 1 ? 1 : 0;
+      at = next;
+   }
+
+   return at == Instruction::JumpToTrue;
+}
+
+#define INSTANTIATE(T) template bool BasicCompiledExpression<T>::Evaluate(T, ExpressionProfile&) const;
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
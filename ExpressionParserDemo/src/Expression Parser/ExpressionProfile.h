@@ -0,0 +1,59 @@
+#pragma once
+
+#include "CompiledExpression.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Counts how each comparison of a compiled expression behaves as values are evaluated through
+// BasicCompiledExpression::Evaluate(value, profile). A profile is never shared, so counting needs no
+// synchronisation: give each thread its own profile of the same expression and Merge them once done.
+class ExpressionProfile
+{
+public:
+   // The counts for a single comparison, along with where it was read from in the expression string.
+   struct TermCounters
+   {
+      CompiledExpressionBase::SourceRange m_source;
+
+      // How many times the comparison ran, and how many of those it passed.
+      uint64_t m_evaluated;
+      uint64_t m_passed;
+
+      // How many times its result skipped over comparisons that would otherwise have run next,
+      // eg: the first comparison passing in "<5 or >10" never needs to check ">10".
+      uint64_t m_shortCircuits;
+   };
+
+   template <ExpressionValueType T>
+   explicit ExpressionProfile(const BasicCompiledExpression<T>& expression)
+      : ExpressionProfile(expression.GetSourceRanges())
+   {}
+
+   // Add the counts from a profile of the same expression. Returns false, merging nothing, if the
+   // profile is for a different expression.
+   bool Merge(const ExpressionProfile& other);
+   void Reset();
+
+   // The number of values evaluated.
+   uint64_t GetEvaluationCount() const { return m_evaluationCount; }
+
+   // The counters for every comparison, in the order they were compiled.
+   std::span<const TermCounters> GetTerms() const { return m_terms; }
+
+   // Write a line per comparison showing its counts alongside the comparison taken from the
+   // expression string the profiled expression was parsed from.
+   std::string ToString(std::string_view expression) const;
+
+private:
+   template <ExpressionValueType>
+   friend class BasicCompiledExpression;
+
+   explicit ExpressionProfile(std::span<const CompiledExpressionBase::SourceRange> sourceRanges);
+
+   std::vector<TermCounters> m_terms;
+   uint64_t m_evaluationCount;
+};
@@ -0,0 +1,79 @@
+#include "ExpressionStream.h"
+#include "ExpressionIntervals.h"
+
+#include <algorithm>
+
+using namespace ExpressionIntervals;
+
+
+/****************************************
+   Expression Stream
+****************************************/
+
+template <ExpressionValueType T>
+BasicExpressionStream<T>::BasicExpressionStream(const Compiled& expression)
+   : m_expression(expression)
+{
+   Reset();
+}
+
+template <ExpressionValueType T>
+size_t BasicExpressionStream<T>::Update(std::span<const T> values, std::vector<Transition>& transitions)
+{
+   const size_t initialCount = transitions.size();
+   Update(values, [&transitions](const Transition& transition) { transitions.push_back(transition); });
+   return transitions.size() - initialCount;
+}
+
+template <ExpressionValueType T>
+void BasicExpressionStream<T>::Reset()
+{
+   m_min = MaxValue<T>;
+   m_max = MinValue<T>;
+   m_passes = false;
+   m_hasResult = false;
+   m_sampleCount = 0;
+   m_lookupCount = 0;
+}
+
+template <ExpressionValueType T>
+bool BasicExpressionStream<T>::Enter(T value)
+{
+   ++m_lookupCount;
+
+   bool passes;
+   if (value != value)
+   {
+      passes = m_expression.Evaluate(value);
+      m_min = MaxValue<T>;
+      m_max = MinValue<T>;
+   }
+   else
+   {
+      // The first interval not entirely below the value either holds it or comes after the gap it's in
+      const std::span<const typename Compiled::Interval> intervals = m_expression.GetIntervals();
+      auto it = std::lower_bound(intervals.begin(), intervals.end(), value,
+         [](const typename Compiled::Interval& interval, T target) { return interval.m_max < target; });
+
+      passes = it != intervals.end() && it->m_min <= value;
+      if (passes)
+      {
+         m_min = it->m_min;
+         m_max = it->m_max;
+      }
+      else
+      {
+         m_min = it == intervals.begin() ? MinValue<T> : Next((it - 1)->m_max);
+         m_max = it == intervals.end() ? MaxValue<T> : Previous(it->m_min);
+      }
+   }
+
+   const bool isChanged = m_hasResult == false || passes != m_passes;
+   m_passes = passes;
+   m_hasResult = true;
+   return isChanged;
+}
+
+#define INSTANTIATE(T) template class BasicExpressionStream<T>;
+EXPRESSION_VALUE_TYPES(INSTANTIATE)
+#undef INSTANTIATE
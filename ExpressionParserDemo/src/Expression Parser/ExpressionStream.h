@@ -0,0 +1,102 @@
+#pragma once
+
+#include "CompiledExpression.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Evaluates a stream of values against an expression, reporting only when the result changes.
+// Alongside the current result it keeps the run of values either side of the current value that
+// give the same result, taken from the expression's intervals: the interval the value is in if it
+// passes, otherwise the gap between the intervals either side of it. While values stay inside that
+// run, as they mostly do for slowly changing signals, each update is a single bounds check and the
+// expression isn't evaluated at all. Only a value leaving the run looks up the new one, with a
+// binary search over the intervals.
+//
+// NaN is in no interval but can still pass "!=", so it always evaluates the expression and leaves
+// an empty run, sending the next value back through the lookup. A stream holds its own state, so
+// give each thread its own stream of the same expression.
+template <ExpressionValueType T>
+class BasicExpressionStream
+{
+public:
+   using Compiled = BasicCompiledExpression<T>;
+
+   // A change of result, at the index of the sample causing it counting from the first sample
+   // since the stream was created or last reset.
+   struct Transition
+   {
+      uint64_t m_sample;
+      T m_value;
+      bool m_passes;
+   };
+
+   explicit BasicExpressionStream(const Compiled& expression);
+
+   // Feed the next sample, returning true if the result changed. The first sample after creating
+   // or resetting the stream always counts as a change, as there is no earlier result to compare.
+   bool Update(T value)
+   {
+      ++m_sampleCount;
+      if (value >= m_min && value <= m_max)
+      {
+         return false;
+      }
+      return Enter(value);
+   }
+
+   // Feed every sample in the span, appending a transition for each change. Returns the number of
+   // transitions appended.
+   size_t Update(std::span<const T> values, std::vector<Transition>& transitions);
+
+   // Feed every sample in the span, calling onTransition(const Transition&) for each change.
+   template <typename Callback>
+   void Update(std::span<const T> values, Callback&& onTransition)
+   {
+      for (const T value : values)
+      {
+         if (Update(value))
+         {
+            onTransition(Transition{ m_sampleCount - 1, value, m_passes });
+         }
+      }
+   }
+
+   // The result for the latest sample, false if there hasn't been one yet.
+   bool GetResult() const { return m_passes; }
+
+   // The inclusive run of values giving the current result. Empty, with the minimum above the
+   // maximum, before the first sample or after a NaN.
+   T GetRunMin() const { return m_min; }
+   T GetRunMax() const { return m_max; }
+
+   // The number of samples fed in, and how many of those fell outside the current run and had to
+   // look up a new one.
+   uint64_t GetSampleCount() const { return m_sampleCount; }
+   uint64_t GetLookupCount() const { return m_lookupCount; }
+
+   // Forget the current result and start counting samples again from 0.
+   void Reset();
+
+private:
+   // Look up the run holding the value and take on its result, returning true if that changed.
+   bool Enter(T value);
+
+private:
+   Compiled m_expression;
+
+   T m_min;
+   T m_max;
+   bool m_passes;
+   bool m_hasResult;
+
+   uint64_t m_sampleCount;
+   uint64_t m_lookupCount;
+};
+
+using ExpressionStream = BasicExpressionStream<int32_t>;
+using Int64ExpressionStream = BasicExpressionStream<int64_t>;
+using FloatExpressionStream = BasicExpressionStream<float>;
+using DoubleExpressionStream = BasicExpressionStream<double>;
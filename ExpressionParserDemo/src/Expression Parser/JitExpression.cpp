@@ -0,0 +1,400 @@
+#include "JitExpression.h"
+
+#include <cassert>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define EXPRESSION_PARSER_JIT
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+
+#ifdef EXPRESSION_PARSER_JIT
+namespace
+{
+   using Instruction = CompiledExpression::Instruction;
+
+#if defined(_WIN32)
+   // Windows passes the first arguments in rcx, rdx and r8.
+   constexpr uint8_t s_loadValue[] = { 0x89, 0xC8 };                                                 // mov eax, ecx
+   constexpr uint8_t s_loadBatchArguments[] = { 0x4D, 0x89, 0xC2, 0x49, 0x89, 0xD1, 0x49, 0x89, 0xC8 }; // mov r10, r8; mov r9, rdx; mov r8, rcx
+#else
+   // System V passes the first arguments in rdi, rsi and rdx.
+   constexpr uint8_t s_loadValue[] = { 0x89, 0xF8 };                                                 // mov eax, edi
+   constexpr uint8_t s_loadBatchArguments[] = { 0x49, 0x89, 0xD2, 0x49, 0x89, 0xF1, 0x49, 0x89, 0xF8 }; // mov r10, rdx; mov r9, rsi; mov r8, rdi
+#endif
+
+   // The x86 condition codes for comparing signed integers, as used by jcc and setcc. Flipping the
+   // lowest bit of a condition code inverts it.
+   enum ConditionCode : uint8_t
+   {
+      Below = 0x2,
+      Equal = 0x4,
+      NotEqual = 0x5,
+      Less = 0xC,
+      GreaterOrEqual = 0xD,
+      LessOrEqual = 0xE,
+      Greater = 0xF,
+   };
+
+   // Get the condition passing a value compared against the constant, returning false for an
+   // operation that never passes.
+   bool GetConditionCode(int operation, uint8_t& condition)
+   {
+      switch (operation)
+      {
+         case (int)CompiledExpression::LessThan:                                       condition = Less; return true;
+         case (int)CompiledExpression::LessThan | (int)CompiledExpression::EqualTo:    condition = LessOrEqual; return true;
+         case (int)CompiledExpression::EqualTo:                                        condition = Equal; return true;
+         case (int)CompiledExpression::NotEqualTo:                                     condition = NotEqual; return true;
+         case (int)CompiledExpression::GreaterThan | (int)CompiledExpression::EqualTo: condition = GreaterOrEqual; return true;
+         case (int)CompiledExpression::GreaterThan:                                    condition = Greater; return true;
+         default:                                                                      return false;
+      }
+   }
+
+   // Writes machine code, with jumps made to labels that may only be bound later on. Every jump
+   // uses a 32 bit offset, which is filled in once all of the labels are bound.
+   class Assembler
+   {
+   public:
+      Assembler(std::vector<uint8_t>& code, uint32_t labelCount)
+         : m_code(code)
+         , m_labels(labelCount, Unbound)
+      {}
+
+      uint32_t AddLabel()
+      {
+         m_labels.push_back(Unbound);
+         return (uint32_t)m_labels.size() - 1;
+      }
+
+      void Bind(uint32_t label) { m_labels[label] = m_code.size(); }
+
+      void Emit(std::initializer_list<uint8_t> bytes) { m_code.insert(m_code.end(), bytes); }
+      void Emit(std::span<const uint8_t> bytes) { m_code.insert(m_code.end(), bytes.begin(), bytes.end()); }
+
+      void Emit32(uint32_t value)
+      {
+         for (int i = 0; i < 4; ++i)
+         {
+            m_code.push_back((uint8_t)(value >> (i * 8)));
+         }
+      }
+
+      // cmp eax, constant
+      void Compare(int constant)
+      {
+         if (constant >= -128 && constant <= 127)
+         {
+            Emit({ 0x83, 0xF8, (uint8_t)constant });
+            return;
+         }
+         Emit({ 0x3D });
+         Emit32((uint32_t)constant);
+      }
+
+      // jmp label
+      void Jump(uint32_t label)
+      {
+         Emit({ 0xE9 });
+         AddFixup(label);
+      }
+
+      // jcc label
+      void JumpIf(uint8_t condition, uint32_t label)
+      {
+         Emit({ 0x0F, (uint8_t)(0x80 | condition) });
+         AddFixup(label);
+      }
+
+      // Fill in the offset of every jump.
+      void Finish()
+      {
+         for (const Fixup& fixup : m_fixups)
+         {
+            assert(m_labels[fixup.m_label] != Unbound);
+            const uint32_t offset = (uint32_t)(m_labels[fixup.m_label] - (fixup.m_at + 4));
+            for (int i = 0; i < 4; ++i)
+            {
+               m_code[fixup.m_at + i] = (uint8_t)(offset >> (i * 8));
+            }
+         }
+      }
+
+   private:
+      static constexpr size_t Unbound = ~(size_t)0;
+
+      struct Fixup
+      {
+         size_t m_at;
+         uint32_t m_label;
+      };
+
+      void AddFixup(uint32_t label)
+      {
+         m_fixups.push_back({ m_code.size(), label });
+         Emit32(0);
+      }
+
+   private:
+      std::vector<uint8_t>& m_code;
+      std::vector<size_t> m_labels;
+      std::vector<Fixup> m_fixups;
+   };
+
+   enum class FunctionType
+   {
+      // bool(int value), returning the result in eax.
+      Single,
+      // Part of the batch loop, storing the result to [r9 + r11].
+      Batch,
+   };
+
+   // Emit the instructions of the program, with the value to compare in eax. Instruction i is bound
+   // to label i, and the code following on from the last instruction must be bound to failLabel.
+   // Ending the program jumps to passLabel or failLabel, except for comparisons that end it either
+   // way, which write the result from the flags and then return or jump to nextLabel.
+   void EmitProgram(Assembler& assembler, const CompiledExpression& expression, FunctionType type, uint32_t passLabel, uint32_t failLabel, uint32_t nextLabel)
+   {
+      const std::span<const Instruction> instructions = expression.GetInstructions();
+      const uint32_t instructionCount = (uint32_t)instructions.size();
+      auto toLabel = [&](uint32_t target)
+      {
+         return target == Instruction::JumpToTrue ? passLabel : target == Instruction::JumpToFalse ? failLabel : target;
+      };
+      auto following = [&](uint32_t at) { return at + 1 < instructionCount ? at + 1 : failLabel; };
+
+      const uint32_t entry = toLabel(expression.GetEntry());
+      if (entry != (instructionCount > 0 ? 0 : failLabel))
+      {
+         assembler.Jump(entry);
+      }
+
+      for (uint32_t at = 0; at < instructionCount; ++at)
+      {
+         const Instruction& instruction = instructions[at];
+         const uint32_t onTrue = toLabel(instruction.m_onTrue);
+         const uint32_t onFalse = toLabel(instruction.m_onFalse);
+         const uint32_t next = following(at);
+         assembler.Bind(at);
+
+         uint8_t condition = 0;
+         if (GetConditionCode(instruction.m_operation, condition) == false)
+         {
+            if (onFalse != next)
+            {
+               assembler.Jump(onFalse);
+            }
+            continue;
+         }
+
+         assembler.Compare(instruction.m_value);
+         if (onTrue != onFalse && (onTrue == passLabel || onTrue == failLabel) && (onFalse == passLabel || onFalse == failLabel))
+         {
+            // The comparison decides the result on its own, so set it without branching
+            const uint8_t resultCondition = onTrue == passLabel ? condition : (uint8_t)(condition ^ 1);
+            if (type == FunctionType::Single)
+            {
+               assembler.Emit({ 0x0F, (uint8_t)(0x90 | resultCondition), 0xC0 }); // setcc al
+               assembler.Emit({ 0x0F, 0xB6, 0xC0 });                                // movzx eax, al
+               assembler.Emit({ 0xC3 });                                            // ret
+            }
+            else
+            {
+               assembler.Emit({ 0x43, 0x0F, (uint8_t)(0x90 | resultCondition), 0x04, 0x19 }); // setcc byte [r9 + r11]
+               assembler.Jump(nextLabel);
+            }
+         }
+         else if (onTrue == onFalse)
+         {
+            if (onTrue != next)
+            {
+               assembler.Jump(onTrue);
+            }
+         }
+         else if (onFalse == next)
+         {
+            assembler.JumpIf(condition, onTrue);
+         }
+         else if (onTrue == next)
+         {
+            assembler.JumpIf(condition ^ 1, onFalse);
+         }
+         else
+         {
+            assembler.JumpIf(condition, onTrue);
+            assembler.Jump(onFalse);
+         }
+      }
+   }
+
+   // bool Evaluate(int value)
+   void EmitEvaluate(std::vector<uint8_t>& code, const CompiledExpression& expression)
+   {
+      Assembler assembler(code, (uint32_t)expression.GetInstructions().size());
+      const uint32_t passLabel = assembler.AddLabel();
+      const uint32_t failLabel = assembler.AddLabel();
+
+      assembler.Emit(s_loadValue);
+      EmitProgram(assembler, expression, FunctionType::Single, passLabel, failLabel, failLabel);
+
+      assembler.Bind(failLabel);
+      assembler.Emit({ 0x31, 0xC0 });                         // xor eax, eax
+      assembler.Emit({ 0xC3 });                               // ret
+      assembler.Bind(passLabel);
+      assembler.Emit({ 0xB8, 0x01, 0x00, 0x00, 0x00 });       // mov eax, 1
+      assembler.Emit({ 0xC3 });                               // ret
+      assembler.Finish();
+   }
+
+   // void EvaluateBatch(const int* pValues, uint8_t* pResults, size_t count), with the values in r8,
+   // the results in r9, the count in r10 and the index in r11. These are all scratch registers in
+   // both calling conventions, so nothing needs saving.
+   void EmitEvaluateBatch(std::vector<uint8_t>& code, const CompiledExpression& expression)
+   {
+      Assembler assembler(code, (uint32_t)expression.GetInstructions().size());
+      const uint32_t passLabel = assembler.AddLabel();
+      const uint32_t failLabel = assembler.AddLabel();
+      const uint32_t loopLabel = assembler.AddLabel();
+      const uint32_t nextLabel = assembler.AddLabel();
+      const uint32_t doneLabel = assembler.AddLabel();
+
+      assembler.Emit(s_loadBatchArguments);
+      assembler.Emit({ 0x4D, 0x85, 0xD2 });                   // test r10, r10
+      assembler.JumpIf(Equal, doneLabel);
+      assembler.Emit({ 0x45, 0x31, 0xDB });                   // xor r11d, r11d
+
+      assembler.Bind(loopLabel);
+      assembler.Emit({ 0x43, 0x8B, 0x04, 0x98 });             // mov eax, [r8 + r11 * 4]
+      EmitProgram(assembler, expression, FunctionType::Batch, passLabel, failLabel, nextLabel);
+
+      assembler.Bind(failLabel);
+      assembler.Emit({ 0x43, 0xC6, 0x04, 0x19, 0x00 });       // mov byte [r9 + r11], 0
+      assembler.Jump(nextLabel);
+      assembler.Bind(passLabel);
+      assembler.Emit({ 0x43, 0xC6, 0x04, 0x19, 0x01 });       // mov byte [r9 + r11], 1
+
+      assembler.Bind(nextLabel);
+      assembler.Emit({ 0x49, 0xFF, 0xC3 });                   // inc r11
+      assembler.Emit({ 0x4D, 0x39, 0xD3 });                   // cmp r11, r10
+      assembler.JumpIf(Below, loopLabel);
+
+      assembler.Bind(doneLabel);
+      assembler.Emit({ 0xC3 });                               // ret
+      assembler.Finish();
+   }
+}
+#endif
+
+
+/****************************************
+   Jit Expression
+****************************************/
+
+JitExpression::JitExpression(const CompiledExpression& expression)
+   : m_expression(expression)
+   , m_pCode(nullptr)
+   , m_codeSize(0)
+   , m_allocatedSize(0)
+   , m_pEvaluate(nullptr)
+   , m_pEvaluateBatch(nullptr)
+{
+#ifdef EXPRESSION_PARSER_JIT
+   std::vector<uint8_t> code;
+   EmitEvaluate(code, expression);
+
+   // Start the batch function on a fresh cache line, padding with int3
+   code.resize((code.size() + 63) & ~(size_t)63, 0xCC);
+   const size_t batchOffset = code.size();
+   EmitEvaluateBatch(code, expression);
+
+   m_pCode = AllocateCode(code, m_allocatedSize);
+   if (m_pCode != nullptr)
+   {
+      m_codeSize = code.size();
+      m_pEvaluate = reinterpret_cast<EvaluateFunction>(m_pCode);
+      m_pEvaluateBatch = reinterpret_cast<EvaluateBatchFunction>(static_cast<uint8_t*>(m_pCode) + batchOffset);
+   }
+#endif
+}
+
+JitExpression::~JitExpression()
+{
+   if (m_pCode != nullptr)
+   {
+      FreeCode(m_pCode, m_allocatedSize);
+   }
+}
+
+void JitExpression::Evaluate(std::span<const int> values, std::span<uint8_t> results) const
+{
+   assert(results.size() >= values.size());
+
+   if (m_pEvaluateBatch != nullptr)
+   {
+      m_pEvaluateBatch(values.data(), results.data(), values.size());
+   }
+   else
+   {
+      m_expression.Evaluate(values, results);
+   }
+}
+
+void* JitExpression::AllocateCode(const std::vector<uint8_t>& code, size_t& allocatedSize)
+{
+   allocatedSize = code.size();
+
+#if defined(EXPRESSION_PARSER_JIT) && defined(_WIN32)
+   void* pCode = VirtualAlloc(nullptr, allocatedSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+   if (pCode == nullptr)
+   {
+      return nullptr;
+   }
+
+   std::memcpy(pCode, code.data(), code.size());
+   DWORD oldProtection = 0;
+   if (VirtualProtect(pCode, allocatedSize, PAGE_EXECUTE_READ, &oldProtection) == FALSE)
+   {
+      VirtualFree(pCode, 0, MEM_RELEASE);
+      return nullptr;
+   }
+   FlushInstructionCache(GetCurrentProcess(), pCode, allocatedSize);
+   return pCode;
+#elif defined(EXPRESSION_PARSER_JIT)
+   void* pCode = mmap(nullptr, allocatedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (pCode == MAP_FAILED)
+   {
+      return nullptr;
+   }
+
+   std::memcpy(pCode, code.data(), code.size());
+   if (mprotect(pCode, allocatedSize, PROT_READ | PROT_EXEC) != 0)
+   {
+      munmap(pCode, allocatedSize);
+      return nullptr;
+   }
+   return pCode;
+#else
+   return nullptr;
+#endif
+}
+
+void JitExpression::FreeCode(void* pCode, size_t allocatedSize)
+{
+#if defined(EXPRESSION_PARSER_JIT) && defined(_WIN32)
+   (void)allocatedSize;
+   VirtualFree(pCode, 0, MEM_RELEASE);
+#elif defined(EXPRESSION_PARSER_JIT)
+   munmap(pCode, allocatedSize);
+#else
+   (void)pCode;
+   (void)allocatedSize;
+#endif
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "CompiledExpression.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Compiles the instruction program of an expression into native x86-64 code. Each instruction
+// becomes a compare against its constant followed by conditional jumps to its targets, so the
+// short circuiting works exactly as it does in the program, just without the interpreter loop.
+// Comparisons jumping straight to the result set it from the flags rather than branching.
+//
+// The code lives in memory that is never writable and executable at the same time. Where there
+// is no JIT support, or the memory can't be allocated, everything falls back to evaluating a copy
+// of the compiled expression, so the results are always the same either way.
+class JitExpression
+{
+public:
+   using EvaluateFunction = bool(*)(int value);
+   using EvaluateBatchFunction = void(*)(const int* pValues, uint8_t* pResults, size_t count);
+
+   explicit JitExpression(const CompiledExpression& expression);
+   ~JitExpression();
+
+   // The generated code is owned by the instance and freed along with it.
+   JitExpression(const JitExpression&) = delete;
+   JitExpression& operator=(const JitExpression&) = delete;
+
+   bool Evaluate(int value) const
+   {
+      return m_pEvaluate != nullptr ? m_pEvaluate(value) : m_expression.Evaluate(value);
+   }
+
+   // Evaluate every value in the span, writing 1 to the matching result if it passes and 0 if
+   // not. The results span must be at least as large as the values span.
+   void Evaluate(std::span<const int> values, std::span<uint8_t> results) const;
+
+   // Check if the expression was compiled to native code rather than falling back.
+   bool IsNative() const { return m_pEvaluate != nullptr; }
+
+   // The native functions, or nullptr if the expression isn't native. They stay valid for as long
+   // as the instance does.
+   EvaluateFunction GetFunction() const { return m_pEvaluate; }
+   EvaluateBatchFunction GetBatchFunction() const { return m_pEvaluateBatch; }
+
+   // The number of bytes of native code generated, or 0 if the expression isn't native.
+   size_t GetCodeSize() const { return m_codeSize; }
+
+private:
+   // Copy the code into newly allocated memory and make it executable, returning nullptr if that fails.
+   static void* AllocateCode(const std::vector<uint8_t>& code, size_t& allocatedSize);
+   static void FreeCode(void* pCode, size_t allocatedSize);
+
+private:
+   CompiledExpression m_expression;
+
+   void* m_pCode;
+   size_t m_codeSize;
+   size_t m_allocatedSize;
+   EvaluateFunction m_pEvaluate;
+   EvaluateBatchFunction m_pEvaluateBatch;
+};
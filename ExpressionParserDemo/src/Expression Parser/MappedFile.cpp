@@ -0,0 +1,111 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/****************************************
+   Mapped File
+****************************************/
+
+MappedFile::MappedFile()
+   : m_pData(nullptr)
+   , m_size(0)
+   , m_isOpen(false)
+{}
+
+MappedFile::~MappedFile()
+{
+   Close();
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+   Close();
+
+#if defined(_WIN32)
+   HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+   if (file == INVALID_HANDLE_VALUE)
+   {
+      return false;
+   }
+
+   LARGE_INTEGER fileSize = {};
+   const bool hasSize = GetFileSizeEx(file, &fileSize) != FALSE;
+   if (hasSize == false || fileSize.QuadPart == 0)
+   {
+      CloseHandle(file);
+      m_isOpen = hasSize;
+      return m_isOpen;
+   }
+
+   // The view keeps the file and the mapping alive by itself
+   HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+   CloseHandle(file);
+   if (mapping == nullptr)
+   {
+      return false;
+   }
+
+   void* pData = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+   CloseHandle(mapping);
+   if (pData == nullptr)
+   {
+      return false;
+   }
+   const size_t size = (size_t)fileSize.QuadPart;
+#else
+   const int file = open(path.c_str(), O_RDONLY);
+   if (file < 0)
+   {
+      return false;
+   }
+
+   struct stat status = {};
+   const bool hasStatus = fstat(file, &status) == 0;
+   if (hasStatus == false || status.st_size == 0)
+   {
+      close(file);
+      m_isOpen = hasStatus;
+      return m_isOpen;
+   }
+
+   // The mapping keeps the file open by itself
+   const size_t size = (size_t)status.st_size;
+   void* pData = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+   close(file);
+   if (pData == MAP_FAILED)
+   {
+      return false;
+   }
+#endif
+
+   m_pData = pData;
+   m_size = size;
+   m_isOpen = true;
+   return true;
+}
+
+void MappedFile::Close()
+{
+   if (m_pData != nullptr)
+   {
+#if defined(_WIN32)
+      UnmapViewOfFile(m_pData);
+#else
+      munmap(m_pData, m_size);
+#endif
+   }
+
+   m_pData = nullptr;
+   m_size = 0;
+   m_isOpen = false;
+}
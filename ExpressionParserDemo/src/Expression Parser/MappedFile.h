@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// A whole file mapped into memory read only, with mmap or MapViewOfFile. Pages are only read in
+// from the file as they are touched, and the mapping is released along with the instance.
+class MappedFile
+{
+public:
+   MappedFile();
+   ~MappedFile();
+
+   MappedFile(const MappedFile&) = delete;
+   MappedFile& operator=(const MappedFile&) = delete;
+
+   // Map the file, closing any file already mapped. Returns false if it couldn't be opened or
+   // mapped. An empty file can't be mapped, so it opens successfully with no data.
+   bool Open(const std::string& path);
+   void Close();
+
+   bool IsOpen() const { return m_isOpen; }
+   std::span<const uint8_t> GetData() const { return std::span<const uint8_t>(static_cast<const uint8_t*>(m_pData), m_size); }
+
+private:
+   void* m_pData;
+   size_t m_size;
+   bool m_isOpen;
+};
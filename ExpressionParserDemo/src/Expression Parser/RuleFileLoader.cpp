@@ -0,0 +1,401 @@
+#include "RuleFileLoader.h"
+
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+
+namespace
+{
+   using ParseResult = ExpressionParser::ParseResult;
+
+   // Chunks are split at the first line break after at least this many bytes, so the work of
+   // handing out a chunk is nothing next to parsing it.
+   constexpr size_t MinimumChunkSize = 64 * 1024;
+
+   // Aim for this many chunks per thread, so a thread given a slow chunk doesn't leave the rest
+   // of them waiting at the end.
+   constexpr size_t ChunksPerThread = 4;
+
+   // A string found in the JSON array, which is checked to be valid JSON before it is parsed.
+   struct JsonString
+   {
+      // The string between its quotes, still escaped.
+      std::string_view m_escaped;
+
+      // The line the string is on, counting from 0.
+      size_t m_line;
+      bool m_hasEscapes;
+   };
+
+   // The rules from one chunk of the file, which is a run of whole lines or whole JSON strings.
+   // Rule indices and lines are counted from the start of the chunk until the chunks are merged
+   // back together.
+   struct Chunk
+   {
+      std::string_view m_text;
+      std::span<const JsonString> m_strings;
+
+      // The line the chunk starts on, counting from 0. This is known up front for JSON, and found
+      // while merging for lines.
+      size_t m_firstLine = 0;
+
+      RuleSet m_ruleSet;
+      std::vector<RuleFileLoader::RuleError> m_errors;
+      size_t m_ruleCount = 0;
+      size_t m_lineCount = 0;
+   };
+
+   bool IsWhitespace(char c)
+   {
+      return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+   }
+
+   void ParseRule(Chunk& chunk, std::string_view rule, ExpressionParser& parser)
+   {
+      parser.Clear();
+      const ParseResult result = parser.Parse(rule);
+      if (result == ParseResult::OK)
+      {
+         chunk.m_ruleSet.Add((RuleSet::RuleId)chunk.m_ruleCount, parser.GetCompiledExpression());
+      }
+      else
+      {
+         chunk.m_errors.push_back({ chunk.m_ruleCount, chunk.m_lineCount, result, parser.GetErrorLocation(), parser.GetErrorMessage() });
+      }
+      ++chunk.m_ruleCount;
+   }
+
+   void LoadLines(Chunk& chunk, ExpressionParser& parser)
+   {
+      std::string_view text = chunk.m_text;
+      while (text.empty() == false)
+      {
+         const size_t end = text.find('\n');
+         std::string_view line = text.substr(0, end);
+         text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+         if (line.ends_with('\r'))
+         {
+            line.remove_suffix(1);
+         }
+
+         if (std::all_of(line.begin(), line.end(), IsWhitespace) == false)
+         {
+            ParseRule(chunk, line, parser);
+         }
+         chunk.m_lineCount += end == std::string_view::npos ? 0 : 1;
+      }
+   }
+
+   // Append a code point to the string as UTF-8. Nothing outside of ASCII ever parses, but it
+   // should still be reported as an invalid character rather than as invalid JSON.
+   void AppendCodePoint(std::string& text, uint32_t codePoint)
+   {
+      if (codePoint < 0x80)
+      {
+         text += (char)codePoint;
+      }
+      else if (codePoint < 0x800)
+      {
+         text += (char)(0xC0 | (codePoint >> 6));
+         text += (char)(0x80 | (codePoint & 0x3F));
+      }
+      else
+      {
+         text += (char)(0xE0 | (codePoint >> 12));
+         text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+         text += (char)(0x80 | (codePoint & 0x3F));
+      }
+   }
+
+   int HexDigit(char c)
+   {
+      return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+   }
+
+   // Unescape the contents of a JSON string, which ScanJson() has already checked is valid.
+   void UnescapeJson(std::string_view escaped, std::string& text)
+   {
+      text.clear();
+      for (size_t at = 0; at < escaped.size(); ++at)
+      {
+         if (escaped[at] != '\\')
+         {
+            text += escaped[at];
+            continue;
+         }
+
+         switch (escaped[++at])
+         {
+            case 'b':   text += '\b'; break;
+            case 'f':   text += '\f'; break;
+            case 'n':   text += '\n'; break;
+            case 'r':   text += '\r'; break;
+            case 't':   text += '\t'; break;
+            case 'u':
+            {
+               uint32_t codePoint = 0;
+               for (size_t i = 0; i < 4; ++i)
+               {
+                  codePoint = codePoint * 16 + (uint32_t)HexDigit(escaped[++at]);
+               }
+               AppendCodePoint(text, codePoint);
+               break;
+            }
+            // '"', '\\' and '/' stand for themselves
+            default:    text += escaped[at]; break;
+         }
+      }
+   }
+
+   // Check the text is a single JSON array of strings, finding every string in it. This is a
+   // single pass over the bytes with none of the work of parsing a rule, so it's done serially
+   // up front, leaving the strings to be parsed in parallel. Returns the line the JSON stopped
+   // being valid on, counting from 1, or 0 if it is all valid. The strings before that point are
+   // still found.
+   size_t ScanJson(std::string_view text, std::vector<JsonString>& strings)
+   {
+      size_t at = 0;
+      size_t line = 0;
+      auto skipWhitespace = [&]()
+      {
+         for (; at < text.size() && IsWhitespace(text[at]); ++at)
+         {
+            line += text[at] == '\n' ? 1 : 0;
+         }
+      };
+
+      // Find the end of the string starting at the opening quote, checking every escape in it.
+      // Control characters, line breaks included, have to be escaped.
+      auto scanString = [&]()
+      {
+         const size_t begin = ++at;
+         bool hasEscapes = false;
+         for (; at < text.size() && text[at] != '"'; ++at)
+         {
+            if ((unsigned char)text[at] < 0x20)
+            {
+               return false;
+            }
+            if (text[at] != '\\')
+            {
+               continue;
+            }
+
+            hasEscapes = true;
+            const char escape = ++at < text.size() ? text[at] : '\0';
+            if (escape == 'u')
+            {
+               for (size_t i = 0; i < 4; ++i)
+               {
+                  if (++at >= text.size() || HexDigit(text[at]) < 0)
+                  {
+                     return false;
+                  }
+               }
+            }
+            else if (std::string_view("\"\\/bfnrt").find(escape) == std::string_view::npos)
+            {
+               return false;
+            }
+         }
+         if (at >= text.size())
+         {
+            return false;
+         }
+
+         strings.push_back({ text.substr(begin, at - begin), line, hasEscapes });
+         ++at;
+         return true;
+      };
+
+      skipWhitespace();
+      if (at >= text.size() || text[at++] != '[')
+      {
+         return line + 1;
+      }
+
+      skipWhitespace();
+      if (at < text.size() && text[at] == ']')
+      {
+         ++at;
+      }
+      else
+      {
+         // Expecting a string, then either a comma and another string or the closing bracket
+         while (true)
+         {
+            if (at >= text.size() || text[at] != '"' || scanString() == false)
+            {
+               return line + 1;
+            }
+
+            skipWhitespace();
+            const char next = at < text.size() ? text[at++] : '\0';
+            if (next == ']')
+            {
+               break;
+            }
+            if (next != ',')
+            {
+               return line + 1;
+            }
+            skipWhitespace();
+         }
+      }
+
+      // Nothing but whitespace can follow the array
+      skipWhitespace();
+      return at < text.size() ? line + 1 : 0;
+   }
+
+   void LoadJson(Chunk& chunk, ExpressionParser& parser)
+   {
+      std::string unescaped;
+      for (const JsonString& string : chunk.m_strings)
+      {
+         chunk.m_lineCount = string.m_line - chunk.m_firstLine;
+         if (string.m_hasEscapes)
+         {
+            UnescapeJson(string.m_escaped, unescaped);
+            ParseRule(chunk, unescaped, parser);
+         }
+         else
+         {
+            ParseRule(chunk, string.m_escaped, parser);
+         }
+      }
+   }
+}
+
+
+/****************************************
+   Rule File Loader
+****************************************/
+
+RuleFileLoader::RuleFileLoader(unsigned threadCount)
+   : m_threadCount(threadCount != 0 ? threadCount : std::max(std::thread::hardware_concurrency(), 1u))
+   , m_ruleCount(0)
+   , m_invalidJsonLine(0)
+{}
+
+RuleFileLoader::LoadResult RuleFileLoader::LoadFile(const std::string& path, Format format)
+{
+   MappedFile file;
+   if (file.Open(path) == false)
+   {
+      Clear();
+      return LoadResult::FileError;
+   }
+
+   const std::span<const uint8_t> data = file.GetData();
+   return Load(std::string_view(reinterpret_cast<const char*>(data.data()), data.size()), format);
+}
+
+RuleFileLoader::LoadResult RuleFileLoader::Load(std::string_view text, Format format)
+{
+   Clear();
+
+   if (format == Format::Auto)
+   {
+      const auto first = std::find_if_not(text.begin(), text.end(), IsWhitespace);
+      format = first != text.end() && *first == '[' ? Format::Json : Format::Lines;
+   }
+
+   // Split the text into chunks of whole lines, or of whole strings for JSON. JSON is often
+   // written as a single line, so its chunks are split between strings instead, which are found
+   // and checked up front.
+   const size_t chunkSize = std::max(MinimumChunkSize, text.size() / (m_threadCount * ChunksPerThread) + 1);
+   std::vector<Chunk> chunks;
+   std::vector<JsonString> strings;
+   if (format == Format::Json)
+   {
+      m_invalidJsonLine = ScanJson(text, strings);
+      for (size_t first = 0; first < strings.size();)
+      {
+         const char* pStart = strings[first].m_escaped.data();
+         size_t end = first + 1;
+         while (end < strings.size() && (size_t)(strings[end].m_escaped.data() - pStart) < chunkSize)
+         {
+            ++end;
+         }
+
+         Chunk& chunk = chunks.emplace_back();
+         chunk.m_strings = std::span<const JsonString>(strings).subspan(first, end - first);
+         chunk.m_firstLine = strings[first].m_line;
+         first = end;
+      }
+   }
+   else
+   {
+      for (size_t at = 0; at < text.size();)
+      {
+         const size_t lineEnd = at + chunkSize < text.size() ? text.find('\n', at + chunkSize) : std::string_view::npos;
+         const size_t end = lineEnd == std::string_view::npos ? text.size() : lineEnd + 1;
+         chunks.emplace_back().m_text = text.substr(at, end - at);
+         at = end;
+      }
+   }
+
+   // Every thread takes the next chunk until there are none left, with this thread taking part
+   std::atomic<size_t> nextChunk = 0;
+   auto loadChunks = [&chunks, &nextChunk, format]()
+   {
+      ExpressionParser parser;
+      for (size_t i = nextChunk++; i < chunks.size(); i = nextChunk++)
+      {
+         if (format == Format::Json)
+         {
+            LoadJson(chunks[i], parser);
+         }
+         else
+         {
+            LoadLines(chunks[i], parser);
+         }
+      }
+   };
+
+   std::vector<std::thread> threads;
+   for (size_t i = 1; i < std::min((size_t)m_threadCount, chunks.size()); ++i)
+   {
+      threads.emplace_back(loadChunks);
+   }
+   loadChunks();
+   for (std::thread& thread : threads)
+   {
+      thread.join();
+   }
+
+   // Merge the chunks in order, now the rule and line each of them starts at is known
+   size_t lineOffset = 0;
+   for (Chunk& chunk : chunks)
+   {
+      if (format == Format::Lines)
+      {
+         chunk.m_firstLine = lineOffset;
+         lineOffset += chunk.m_lineCount;
+      }
+
+      m_ruleSet.Merge(chunk.m_ruleSet, (RuleSet::RuleId)m_ruleCount);
+      for (RuleError& error : chunk.m_errors)
+      {
+         error.m_ruleIndex += m_ruleCount;
+         error.m_line += chunk.m_firstLine + 1;
+         m_errors.push_back(std::move(error));
+      }
+      m_ruleCount += chunk.m_ruleCount;
+   }
+   m_ruleSet.Build();
+
+   return m_invalidJsonLine != 0 ? LoadResult::InvalidJson : LoadResult::OK;
+}
+
+void RuleFileLoader::Clear()
+{
+   m_ruleSet.Clear();
+   m_ruleCount = 0;
+   m_errors.clear();
+   m_invalidJsonLine = 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ExpressionParser.h"
+#include "RuleSet.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Loads a file of rule strings into a RuleSet, parsing the rules in parallel. The file is mapped
+// into memory and split into chunks of whole lines, or whole strings for JSON, which a pool of
+// threads then parses with a parser each. Every rule's id is its index in the file, counting from 0, whether or not it parsed.
+class RuleFileLoader
+{
+public:
+   enum class Format : uint8_t
+   {
+      // JSON if the first character other than whitespace is '[', otherwise lines.
+      Auto,
+      // One rule per line, skipping blank lines.
+      Lines,
+      // A JSON array of strings, one rule per string. The array is checked in full before any
+      // rule is parsed, and anything else in the file is invalid JSON.
+      Json,
+   };
+
+   enum class LoadResult : uint8_t
+   {
+      OK = 0,
+
+      FileError,
+      InvalidJson
+   };
+
+   // A rule that failed to parse, which is left out of the rule set.
+   struct RuleError
+   {
+      size_t m_ruleIndex;
+
+      // The line the rule is on, counting from 1.
+      size_t m_line;
+
+      // The result, error location and error message from the parser, with the location being
+      // relative to the start of the rule.
+      ExpressionParser::ParseResult m_result;
+      size_t m_location;
+      std::string m_message;
+   };
+
+   // A thread count of 0 uses every hardware thread.
+   explicit RuleFileLoader(unsigned threadCount = 0);
+
+   // Load every rule from the file, replacing anything loaded before. The rule set is built and
+   // ready to match even if some of the rules failed to parse.
+   LoadResult LoadFile(const std::string& path, Format format = Format::Auto);
+
+   // Load every rule from text already in memory, the same as LoadFile().
+   LoadResult Load(std::string_view text, Format format = Format::Auto);
+
+   const RuleSet& GetRuleSet() const { return m_ruleSet; }
+
+   // The number of rules found, including any that failed to parse.
+   size_t GetRuleCount() const { return m_ruleCount; }
+
+   // Every rule that failed to parse, in the order they are in the file.
+   std::span<const RuleError> GetErrors() const { return m_errors; }
+
+   // The line the JSON stopped being valid on when loading returned InvalidJson. The rules before
+   // it are still loaded.
+   size_t GetInvalidJsonLine() const { return m_invalidJsonLine; }
+
+   void Clear();
+
+private:
+   unsigned m_threadCount;
+
+   RuleSet m_ruleSet;
+   size_t m_ruleCount;
+   std::vector<RuleError> m_errors;
+   size_t m_invalidJsonLine;
+};
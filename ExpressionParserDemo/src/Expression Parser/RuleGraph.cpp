@@ -0,0 +1,298 @@
+#include "RuleGraph.h"
+
+#include "ExpressionKernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+
+namespace
+{
+   // Values are evaluated a block at a time, so the result of every node for the block stays in
+   // cache while the nodes depending on it are evaluated.
+   constexpr size_t BlockSize = 256;
+
+   uint64_t HashCombine(uint64_t hash, uint64_t value)
+   {
+      constexpr uint64_t Prime = 0x100000001B3ull;
+      return (hash ^ value) * Prime;
+   }
+}
+
+
+/****************************************
+   Rule Graph
+****************************************/
+
+RuleGraph::ParseResult RuleGraph::Add(RuleId id, std::string_view expression)
+{
+   m_parser.Clear();
+   const ParseResult result = m_parser.Parse(expression);
+   if (result == ParseResult::OK)
+   {
+      m_ruleIds.push_back(id);
+      m_ruleNodes.push_back(AddBranch(*m_parser.m_pBaseRoot));
+   }
+   return result;
+}
+
+void RuleGraph::Evaluate(std::span<const int> values, std::span<uint8_t> results) const
+{
+   assert(results.size() >= values.size() * m_ruleNodes.size());
+
+   std::vector<uint8_t> nodeResults(m_nodes.size() * BlockSize);
+   for (size_t blockStart = 0; blockStart < values.size(); blockStart += BlockSize)
+   {
+      const size_t count = std::min(BlockSize, values.size() - blockStart);
+      EvaluateBlock(values.data() + blockStart, count, nodeResults.data());
+
+      for (size_t rule = 0; rule < m_ruleNodes.size(); ++rule)
+      {
+         std::memcpy(results.data() + rule * values.size() + blockStart, nodeResults.data() + (size_t)m_ruleNodes[rule] * BlockSize, count);
+      }
+   }
+}
+
+size_t RuleGraph::Match(int value, std::vector<RuleId>& matches) const
+{
+   matches.clear();
+
+   // Every node is needed by some rule, so they are all evaluated in order the same as a block.
+   // The results are kept per thread, so matching a value doesn't allocate once they are big enough.
+   thread_local std::vector<uint8_t> threadNodeResults;
+   threadNodeResults.resize(std::max(threadNodeResults.size(), m_nodes.size()));
+   uint8_t* pNodeResults = threadNodeResults.data();
+
+   const ExpressionKernels::CompareKernel<int> compareKernel = ExpressionKernels::GetCompareKernel<int>();
+   for (size_t i = 0; i < m_nodes.size(); ++i)
+   {
+      const Node& node = m_nodes[i];
+      const uint32_t* pChildren = m_children.data() + node.m_firstChild;
+      switch (node.m_type)
+      {
+         case Node::Compare:
+            compareKernel(node.m_operation, node.m_value, &value, &pNodeResults[i], 1);
+            break;
+
+         case Node::Set:
+            pNodeResults[i] = m_sets[node.m_value].Contains(value) != (node.m_operation == (int)CompiledExpression::NotEqualTo);
+            break;
+
+         case Node::And:
+            pNodeResults[i] = std::all_of(pChildren, pChildren + node.m_childCount, [pNodeResults](uint32_t child) { return pNodeResults[child] != 0; });
+            break;
+
+         case Node::Or:
+            pNodeResults[i] = std::any_of(pChildren, pChildren + node.m_childCount, [pNodeResults](uint32_t child) { return pNodeResults[child] != 0; });
+            break;
+
+         case Node::False:
+            pNodeResults[i] = 0;
+            break;
+      }
+   }
+
+   for (size_t rule = 0; rule < m_ruleNodes.size(); ++rule)
+   {
+      if (pNodeResults[m_ruleNodes[rule]] != 0)
+      {
+         matches.push_back(m_ruleIds[rule]);
+      }
+   }
+   return matches.size();
+}
+
+void RuleGraph::Clear()
+{
+   m_parser.Clear();
+   m_nodes.clear();
+   m_children.clear();
+   m_sets.clear();
+   m_nodesByHash.clear();
+   m_ruleIds.clear();
+   m_ruleNodes.clear();
+   m_unsharedNodeCount = 0;
+}
+
+uint32_t RuleGraph::AddBranch(const ExpressionParser::BranchRootNode& root)
+{
+   // An empty branch is treated the same as a failed one
+   if (root.GetNext() == nullptr)
+   {
+      ++m_unsharedNodeCount;
+      return Intern({ Node::False, 0, 0, 0, 0 });
+   }
+
+   // A group of one is just that one term
+   if (root.GetNext()->GetNext() == nullptr)
+   {
+      return AddTerm(*root.GetNext());
+   }
+
+   // The terms are interned first, which may add children of their own, so they are gathered
+   // separately before going on the end of m_children
+   std::vector<uint32_t> children;
+   for (const ExpressionParser::Node* pNode = root.GetNext().get(); pNode != nullptr; pNode = pNode->GetNext().get())
+   {
+      children.push_back(AddTerm(*pNode));
+   }
+
+   // The order of the terms doesn't change the result, and nor does a term repeated
+   std::sort(children.begin(), children.end());
+   children.erase(std::unique(children.begin(), children.end()), children.end());
+   if (children.size() == 1)
+   {
+      return children[0];
+   }
+   ++m_unsharedNodeCount;
+
+   const Node group = { (uint8_t)(root.IsOrLogic() ? Node::Or : Node::And), 0, 0, (uint32_t)m_children.size(), (uint32_t)children.size() };
+   m_children.insert(m_children.end(), children.begin(), children.end());
+   return Intern(group);
+}
+
+uint32_t RuleGraph::AddTerm(const ExpressionParser::Node& term)
+{
+   if (const ExpressionParser::ForkNode* pFork = dynamic_cast<const ExpressionParser::ForkNode*>(&term))
+   {
+      return AddBranch(*pFork->GetLinkedRoot());
+   }
+
+   // Sets are stored ahead of interning, and dropped again if an identical one is already there
+   if (const ExpressionParser::SetNode* pSet = dynamic_cast<const ExpressionParser::SetNode*>(&term))
+   {
+      const int operation = pSet->IsNegated() ? (int)CompiledExpression::NotEqualTo : (int)CompiledExpression::EqualTo;
+      const int set = (int)m_sets.size();
+      m_sets.emplace_back(pSet->GetMembers());
+      ++m_unsharedNodeCount;
+
+      const uint32_t id = Intern({ Node::Set, (uint8_t)operation, set, 0, 0 });
+      if (m_nodes[id].m_value != set)
+      {
+         m_sets.pop_back();
+      }
+      return id;
+   }
+
+   // Strict comparisons become inclusive ones wherever there is a value to step to
+   const ExpressionParser::ExpressionNode& comparison = static_cast<const ExpressionParser::ExpressionNode&>(term);
+   int operation = comparison.GetOperation();
+   int value = comparison.GetValue();
+   if (operation == (int)CompiledExpression::LessThan && value != std::numeric_limits<int>::min())
+   {
+      operation = (int)CompiledExpression::LessThan | (int)CompiledExpression::EqualTo;
+      --value;
+   }
+   else if (operation == (int)CompiledExpression::GreaterThan && value != std::numeric_limits<int>::max())
+   {
+      operation = (int)CompiledExpression::GreaterThan | (int)CompiledExpression::EqualTo;
+      ++value;
+   }
+   ++m_unsharedNodeCount;
+   return Intern({ Node::Compare, (uint8_t)operation, value, 0, 0 });
+}
+
+uint32_t RuleGraph::Intern(Node node)
+{
+   const uint64_t hash = HashNode(node);
+   auto [first, last] = m_nodesByHash.equal_range(hash);
+   for (auto it = first; it != last; ++it)
+   {
+      if (IsSameNode(m_nodes[it->second], node))
+      {
+         m_children.resize(m_children.size() - node.m_childCount);
+         return it->second;
+      }
+   }
+
+   const uint32_t id = (uint32_t)m_nodes.size();
+   m_nodes.push_back(node);
+   m_nodesByHash.emplace(hash, id);
+   return id;
+}
+
+bool RuleGraph::IsSameNode(const Node& a, const Node& b) const
+{
+   if (a.m_type == Node::Set && b.m_type == Node::Set)
+   {
+      const std::span<const CompiledExpression::Interval> membersA = m_sets[a.m_value].GetMembers();
+      const std::span<const CompiledExpression::Interval> membersB = m_sets[b.m_value].GetMembers();
+      return a.m_operation == b.m_operation && std::equal(membersA.begin(), membersA.end(), membersB.begin(), membersB.end(),
+         [](const CompiledExpression::Interval& x, const CompiledExpression::Interval& y) { return x.m_min == y.m_min && x.m_max == y.m_max; });
+   }
+
+   return a.m_type == b.m_type && a.m_operation == b.m_operation && a.m_value == b.m_value
+      && std::equal(m_children.begin() + a.m_firstChild, m_children.begin() + a.m_firstChild + a.m_childCount,
+         m_children.begin() + b.m_firstChild, m_children.begin() + b.m_firstChild + b.m_childCount);
+}
+
+uint64_t RuleGraph::HashNode(const Node& node) const
+{
+   uint64_t hash = 0xCBF29CE484222325ull;
+   hash = HashCombine(hash, node.m_type);
+   hash = HashCombine(hash, node.m_operation);
+   if (node.m_type == Node::Set)
+   {
+      // Sets are hashed by their members, as identical sets are stored at different indices
+      for (const CompiledExpression::Interval& member : m_sets[node.m_value].GetMembers())
+      {
+         hash = HashCombine(hash, (uint32_t)member.m_min);
+         hash = HashCombine(hash, (uint32_t)member.m_max);
+      }
+      return hash;
+   }
+
+   hash = HashCombine(hash, (uint32_t)node.m_value);
+   for (uint32_t i = 0; i < node.m_childCount; ++i)
+   {
+      hash = HashCombine(hash, m_children[node.m_firstChild + i]);
+   }
+   return hash;
+}
+
+void RuleGraph::EvaluateBlock(const int* pValues, size_t count, uint8_t* pNodeResults) const
+{
+   const ExpressionKernels::CompareKernel<int> compareKernel = ExpressionKernels::GetCompareKernel<int>();
+   for (size_t i = 0; i < m_nodes.size(); ++i)
+   {
+      const Node& node = m_nodes[i];
+      uint8_t* pResults = pNodeResults + i * BlockSize;
+      const uint32_t* pChildren = m_children.data() + node.m_firstChild;
+      switch (node.m_type)
+      {
+         case Node::Compare:
+            compareKernel(node.m_operation, node.m_value, pValues, pResults, count);
+            break;
+
+         case Node::Set:
+            m_sets[node.m_value].Evaluate(pValues, pResults, count, node.m_operation == (int)CompiledExpression::NotEqualTo);
+            break;
+
+         case Node::And:
+         case Node::Or:
+         {
+            // Results are always 0 or 1, so combining them bitwise gives the same
+            std::memcpy(pResults, pNodeResults + (size_t)pChildren[0] * BlockSize, count);
+            for (uint32_t child = 1; child < node.m_childCount; ++child)
+            {
+               const uint8_t* pChildResults = pNodeResults + (size_t)pChildren[child] * BlockSize;
+               if (node.m_type == Node::And)
+               {
+                  for (size_t v = 0; v < count; ++v) { pResults[v] &= pChildResults[v]; }
+               }
+               else
+               {
+                  for (size_t v = 0; v < count; ++v) { pResults[v] |= pChildResults[v]; }
+               }
+            }
+            break;
+         }
+
+         case Node::False:
+            std::memset(pResults, 0, count);
+            break;
+      }
+   }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "ExpressionParser.h"
+#include "RuleSet.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Evaluates many rules at once with every sub-expression they have in common stored and evaluated
+// only once. Each rule is parsed and its node graph interned bottom up, so identical comparisons
+// and identical braced or AND/OR groups, wherever they turn up, become the same node. Groups are
+// canonicalised before interning by sorting their terms and dropping duplicates, so "(>=0 and
+// <=100)" and "(<=100 and >=0)" share a node. For integers "<v" is read as "<=v-1" and ">v" as
+// ">=v+1", so those share too. Sets with the same members share a node however they were
+// written. Braces are kept as written, so a guard braced in every rule using it is shared even
+// when the rest of the rule uses the same logic.
+//
+// Nodes are only ever added after the nodes they depend on, so evaluating them in order computes
+// each one exactly once per value, with every rule reading the result of its top node. Memory
+// and evaluation work both grow with the number of unique sub-expressions rather than the number
+// of rules.
+class RuleGraph
+{
+public:
+   using ParseResult = ExpressionParser::ParseResult;
+   using RuleId = RuleSet::RuleId;
+
+   // Parse the expression and add it as a rule. Nothing is added unless it parses, with the reason
+   // it failed being available from GetErrorMessage(). Rules compare a single value, so can't name
+   // fields. Ids aren't checked for uniqueness.
+   ParseResult Add(RuleId id, std::string_view expression);
+
+   std::string GetErrorMessage() const { return m_parser.GetErrorMessage(); }
+
+   // Evaluate every rule against every value in the span, computing each unique sub-expression
+   // once per value. The results of rule i, in the order the rules were added, are written to
+   // results[i * values.size()] onwards, 1 for each value passing and 0 otherwise. The results span
+   // must hold at least GetRuleCount() * values.size() results.
+   void Evaluate(std::span<const int> values, std::span<uint8_t> results) const;
+
+   // Replace matches with the ids of every rule passing the value, in the order they were added.
+   // Returns the number of matching rules.
+   size_t Match(int value, std::vector<RuleId>& matches) const;
+
+   size_t GetRuleCount() const { return m_ruleIds.size(); }
+   RuleId GetRuleId(size_t rule) const { return m_ruleIds[rule]; }
+
+   // The number of unique sub-expressions stored, and the number there would be if nothing was
+   // shared between or within rules.
+   size_t GetNodeCount() const { return m_nodes.size(); }
+   size_t GetUnsharedNodeCount() const { return m_unsharedNodeCount; }
+
+   void Clear();
+
+private:
+   struct Node
+   {
+      enum Type : uint8_t
+      {
+         Compare,
+         // Checks the set in m_sets at m_value, with the operation being EqualTo for "in" or
+         // NotEqualTo for "notin".
+         Set,
+         And,
+         Or,
+         // Only ever an empty branch, which fails the same as in a compiled expression.
+         False,
+      };
+
+      uint8_t m_type;
+      uint8_t m_operation;
+      int m_value;
+
+      // For groups, the ids of their terms are m_children[m_firstChild] onwards, sorted by id.
+      uint32_t m_firstChild;
+      uint32_t m_childCount;
+   };
+
+   // Intern the nodes of a parsed expression, returning the id of the node for it.
+   uint32_t AddBranch(const ExpressionParser::BranchRootNode& root);
+   uint32_t AddTerm(const ExpressionParser::Node& term);
+
+   // Intern a node, whose children must already be on the end of m_children. Returns the id of
+   // the node already stored if there is an identical one, dropping the new node's children.
+   uint32_t Intern(Node node);
+
+   bool IsSameNode(const Node& a, const Node& b) const;
+   uint64_t HashNode(const Node& node) const;
+
+   // Evaluate every node against a block of values, with node i writing to
+   // nodeResults[i * BlockSize] onwards.
+   void EvaluateBlock(const int* pValues, size_t count, uint8_t* pNodeResults) const;
+
+private:
+   ExpressionParser m_parser;
+
+   std::vector<Node> m_nodes;
+   std::vector<uint32_t> m_children;
+   std::vector<CompiledExpression::Set> m_sets;
+
+   // Every node by its hash, to find an identical node when interning.
+   std::unordered_multimap<uint64_t, uint32_t> m_nodesByHash;
+
+   std::vector<RuleId> m_ruleIds;
+   std::vector<uint32_t> m_ruleNodes;
+   size_t m_unsharedNodeCount = 0;
+};
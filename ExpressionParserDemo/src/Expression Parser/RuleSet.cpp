@@ -0,0 +1,124 @@
+#include "RuleSet.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+
+/****************************************
+   Rule Set
+****************************************/
+
+RuleSet::RuleSet()
+{
+   Clear();
+}
+
+void RuleSet::Add(RuleId id, const CompiledExpression& expression)
+{
+   for (const CompiledExpression::Interval& interval : expression.GetIntervals())
+   {
+      m_ruleIntervals.push_back({ id, interval });
+   }
+   ++m_ruleCount;
+   m_isBuilt = false;
+}
+
+void RuleSet::Merge(const RuleSet& other, RuleId idOffset)
+{
+   m_ruleIntervals.reserve(m_ruleIntervals.size() + other.m_ruleIntervals.size());
+   for (const RuleInterval& ruleInterval : other.m_ruleIntervals)
+   {
+      m_ruleIntervals.push_back({ ruleInterval.m_id + idOffset, ruleInterval.m_interval });
+   }
+   m_ruleCount += other.m_ruleCount;
+   m_isBuilt = false;
+}
+
+void RuleSet::Build()
+{
+   // Every interval starts a segment at its minimum and ends it just after its maximum. Starting
+   // at the minimum int means every value falls in some segment.
+   m_segmentStarts.clear();
+   m_segmentStarts.push_back(std::numeric_limits<int>::min());
+   for (const RuleInterval& ruleInterval : m_ruleIntervals)
+   {
+      m_segmentStarts.push_back(ruleInterval.m_interval.m_min);
+      if (ruleInterval.m_interval.m_max != std::numeric_limits<int>::max())
+      {
+         m_segmentStarts.push_back(ruleInterval.m_interval.m_max + 1);
+      }
+   }
+   std::sort(m_segmentStarts.begin(), m_segmentStarts.end());
+   m_segmentStarts.erase(std::unique(m_segmentStarts.begin(), m_segmentStarts.end()), m_segmentStarts.end());
+
+   // Calls back with each tree node exactly covering the interval's segments
+   const uint32_t leafCount = (uint32_t)m_segmentStarts.size();
+   auto forEachNode = [&](const CompiledExpression::Interval& interval, auto&& callback)
+   {
+      uint32_t from = FindSegment(m_segmentStarts, interval.m_min) + leafCount;
+      uint32_t to = FindSegment(m_segmentStarts, interval.m_max) + leafCount + 1;
+      for (; from < to; from /= 2, to /= 2)
+      {
+         if (from & 1) { callback(from++); }
+         if (to & 1) { callback(--to); }
+      }
+   };
+
+   // Count the rules in each node first so they can all be packed into one array
+   m_nodeOffsets.assign((size_t)leafCount * 2 + 1, 0);
+   for (const RuleInterval& ruleInterval : m_ruleIntervals)
+   {
+      forEachNode(ruleInterval.m_interval, [&](uint32_t node) { ++m_nodeOffsets[node + 1]; });
+   }
+   for (size_t i = 1; i < m_nodeOffsets.size(); ++i)
+   {
+      m_nodeOffsets[i] += m_nodeOffsets[i - 1];
+   }
+
+   m_nodeRules.resize(m_nodeOffsets.back());
+   std::vector<uint32_t> nodeFill(m_nodeOffsets.begin(), m_nodeOffsets.end() - 1);
+   for (const RuleInterval& ruleInterval : m_ruleIntervals)
+   {
+      forEachNode(ruleInterval.m_interval, [&](uint32_t node) { m_nodeRules[nodeFill[node]++] = ruleInterval.m_id; });
+   }
+
+   m_isBuilt = true;
+}
+
+size_t RuleSet::Match(int value, std::vector<RuleId>& matches) const
+{
+   assert(m_isBuilt);
+   return Match(m_segmentStarts, m_nodeOffsets, m_nodeRules, value, matches);
+}
+
+void RuleSet::Clear()
+{
+   m_ruleIntervals.clear();
+   m_ruleCount = 0;
+
+   // An empty set still has the one segment covering every value, so it can be matched against
+   // without building
+   m_segmentStarts.assign(1, std::numeric_limits<int>::min());
+   m_nodeOffsets.assign(3, 0);
+   m_nodeRules.clear();
+   m_isBuilt = true;
+}
+
+uint32_t RuleSet::FindSegment(std::span<const int> segmentStarts, int value)
+{
+   // The last segment starting at or before the value, there always is one as the first starts at the minimum int
+   return (uint32_t)(std::upper_bound(segmentStarts.begin(), segmentStarts.end(), value) - segmentStarts.begin()) - 1;
+}
+
+size_t RuleSet::Match(std::span<const int> segmentStarts, std::span<const uint32_t> nodeOffsets, std::span<const RuleId> nodeRules, int value, std::vector<RuleId>& matches)
+{
+   matches.clear();
+
+   // The intervals of a single rule never overlap, so each rule turns up at most once on the way up
+   for (uint32_t node = FindSegment(segmentStarts, value) + (uint32_t)segmentStarts.size(); node > 0; node /= 2)
+   {
+      matches.insert(matches.end(), nodeRules.begin() + nodeOffsets[node], nodeRules.begin() + nodeOffsets[node + 1]);
+   }
+   return matches.size();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "CompiledExpression.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Matches a value against many expressions at once. Each rule is added as the intervals of values
+// its expression passes, then Build() indexes them by the boundaries between those intervals, so a
+// query only ever looks at the rules that actually match rather than evaluating every rule.
+class RuleSet
+{
+public:
+   using RuleId = uint32_t;
+
+   RuleSet();
+
+   // Add a rule, which is matched using the intervals of the given expression. Ids aren't checked
+   // for uniqueness, a rule added twice will be matched twice. Build() has to be called again
+   // before the new rule can be matched.
+   void Add(RuleId id, const CompiledExpression& expression);
+
+   // Add every rule from another set, offsetting their ids. Rule sets can be filled separately, eg:
+   // one per thread, then merged into one before building it.
+   void Merge(const RuleSet& other, RuleId idOffset);
+
+   // Index every added rule. Queries take O(log n + matches) time, where n is the number of
+   // distinct interval boundaries across all of the rules.
+   void Build();
+
+   // Replace matches with the ids of every rule passing the value, in no particular order.
+   // Returns the number of matching rules.
+   size_t Match(int value, std::vector<RuleId>& matches) const;
+
+   size_t GetRuleCount() const { return m_ruleCount; }
+   bool IsBuilt() const { return m_isBuilt; }
+
+   void Clear();
+
+private:
+   friend class ExpressionArchive;
+   friend class ExpressionArchiveWriter;
+
+   struct RuleInterval
+   {
+      RuleId m_id;
+      CompiledExpression::Interval m_interval;
+   };
+
+   // Get the segment the value falls in, segments being the runs of values between boundaries.
+   static uint32_t FindSegment(std::span<const int> segmentStarts, int value);
+
+   // Match against an index laid out the way Build() leaves it, wherever it is stored.
+   static size_t Match(std::span<const int> segmentStarts, std::span<const uint32_t> nodeOffsets, std::span<const RuleId> nodeRules, int value, std::vector<RuleId>& matches);
+
+private:
+   std::vector<RuleInterval> m_ruleIntervals;
+   size_t m_ruleCount;
+   bool m_isBuilt;
+
+   // The first value of every segment in ascending order, the first always being the minimum int.
+   std::vector<int> m_segmentStarts;
+
+   // A bottom up segment tree over the segments, with the leaf for segment i at m_segmentStarts.size() + i
+   // and the parent of node i at i / 2. Every interval is stored in the O(log n) nodes exactly
+   // covering its segments, so the rules passing a value are those stored along the path from its
+   // leaf up to the root. The rule ids for node i are m_nodeRules[m_nodeOffsets[i]] up to
+   // m_nodeRules[m_nodeOffsets[i + 1]].
+   std::vector<uint32_t> m_nodeOffsets;
+   std::vector<RuleId> m_nodeRules;
+};
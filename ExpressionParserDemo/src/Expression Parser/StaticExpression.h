@@ -0,0 +1,411 @@
+#pragma once
+
+#include "CompiledExpression.h"
+#include "ExpressionLexer.h"
+#include "ExpressionParser.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// None of these are constexpr, so reaching one while compiling an expression at compile time stops
+// the build with the name of the ParseResult code, and where it was found, in the error message.
+namespace StaticExpressionError
+{
+   void EmptyStatement(size_t at);
+   void ParsingInvalidCharacter(size_t at);
+   void ClosingUnopenedBrace(size_t at);
+   void InvalidExpression(size_t at);
+   void InvalidLogic(size_t at);
+   void UnknownField(size_t at);
+}
+
+// An expression compiled at compile time by BasicExpressionParser::Compile. The instructions are the
+// same as a BasicCompiledExpression runs, but are held in a fixed size array so nothing is ever
+// allocated and a constexpr expression can be evaluated in constant expressions or inlined by the
+// optimiser.
+template <ExpressionValueType T, size_t Capacity>
+class StaticExpression
+{
+public:
+   using Instruction = typename BasicCompiledExpression<T>::Instruction;
+   using Interval = typename BasicCompiledExpression<T>::Interval;
+
+   constexpr bool Evaluate(T value) const
+   {
+      uint32_t at = m_entry;
+      while (at < Instruction::JumpToFalse)
+      {
+         const Instruction& instruction = m_instructions[at];
+
+         bool result;
+         switch (instruction.m_operation)
+         {
+            case (int)CompiledExpressionBase::LessThan:                                            result = value < instruction.m_value; break;
+            case (int)CompiledExpressionBase::LessThan | (int)CompiledExpressionBase::EqualTo:     result = value <= instruction.m_value; break;
+            case (int)CompiledExpressionBase::EqualTo:                                             result = value == instruction.m_value; break;
+            case (int)CompiledExpressionBase::NotEqualTo:                                          result = value != instruction.m_value; break;
+            case (int)CompiledExpressionBase::GreaterThan | (int)CompiledExpressionBase::EqualTo:  result = value >= instruction.m_value; break;
+            case (int)CompiledExpressionBase::GreaterThan:                                         result = value > instruction.m_value; break;
+            default: return false;
+         }
+
+         at = result ? instruction.m_onTrue : instruction.m_onFalse;
+      }
+
+      return at == Instruction::JumpToTrue;
+   }
+
+   constexpr size_t GetInstructionCount() const { return m_instructionCount; }
+
+private:
+   friend class BasicExpressionParser<T>;
+
+   // The expression is parsed into a binary tree first, with AND/OR nodes combining the results
+   // of their two children. Sets and ranges keep the index of their first member in m_left and the
+   // number of members in m_right, with an m_operation of NotEqualTo for "notin".
+   struct TreeNode
+   {
+      enum Type : uint8_t
+      {
+         Comparison,
+         And,
+         Or,
+         Set,
+      };
+
+      Type m_type;
+      int m_operation;
+      T m_value;
+      uint32_t m_left;
+      uint32_t m_right;
+   };
+
+   // Works the same as the node graph's Compile, appending the instructions for the node back to
+   // front and returning the index of the first one to run.
+   template <size_t NodeCapacity>
+   constexpr uint32_t CompileNode(const std::array<TreeNode, NodeCapacity>& tree, const std::array<Interval, NodeCapacity>& members, uint32_t node, uint32_t onTrue, uint32_t onFalse)
+   {
+      const TreeNode& treeNode = tree[node];
+      switch (treeNode.m_type)
+      {
+         case TreeNode::And:
+            return CompileNode(tree, members, treeNode.m_left, CompileNode(tree, members, treeNode.m_right, onTrue, onFalse), onFalse);
+
+         case TreeNode::Or:
+            return CompileNode(tree, members, treeNode.m_left, onTrue, CompileNode(tree, members, treeNode.m_right, onTrue, onFalse));
+
+         case TreeNode::Set:
+         {
+            // Values outside of a negated set are the ones passing it
+            const uint32_t last = treeNode.m_left + treeNode.m_right - 1;
+            return treeNode.m_operation == (int)CompiledExpressionBase::NotEqualTo
+               ? CompileSearch(members, treeNode.m_left, last, false, onFalse, onTrue)
+               : CompileSearch(members, treeNode.m_left, last, false, onTrue, onFalse);
+         }
+
+         default:
+            return Emit(treeNode.m_operation, treeNode.m_value, onTrue, onFalse);
+      }
+   }
+
+   // The same search as the node graph's SetNode::CompileSearch, splitting the members in two with
+   // a single "<" comparison at each step.
+   template <size_t NodeCapacity>
+   constexpr uint32_t CompileSearch(const std::array<Interval, NodeCapacity>& members, uint32_t first, uint32_t last, bool isAboveMin, uint32_t onIn, uint32_t onOut)
+   {
+      if (first == last)
+      {
+         const Interval& member = members[first];
+         const bool checksMin = isAboveMin == false && member.m_min != std::numeric_limits<T>::min();
+         const bool checksMax = member.m_max != std::numeric_limits<T>::max();
+         uint32_t next = onIn;
+         if (checksMax)
+         {
+            next = Emit((int)CompiledExpressionBase::LessThan | (int)CompiledExpressionBase::EqualTo, member.m_max, next, onOut);
+         }
+         if (checksMin)
+         {
+            next = Emit((int)CompiledExpressionBase::GreaterThan | (int)CompiledExpressionBase::EqualTo, member.m_min, next, onOut);
+         }
+         return next;
+      }
+
+      const uint32_t split = first + (last - first + 1) / 2;
+      const uint32_t above = CompileSearch(members, split, last, true, onIn, onOut);
+      const uint32_t below = CompileSearch(members, first, split - 1, isAboveMin, onIn, onOut);
+      return Emit((int)CompiledExpressionBase::LessThan, members[split].m_min, below, above);
+   }
+
+   constexpr uint32_t Emit(int operation, T value, uint32_t onTrue, uint32_t onFalse)
+   {
+      m_instructions[m_instructionCount] = { (uint8_t)operation, 0, value, onTrue, onFalse };
+      return m_instructionCount++;
+   }
+
+   // Reverse the program so the entry point comes first and every jump goes forwards.
+   constexpr void Finish(uint32_t entry)
+   {
+      const uint32_t lastIndex = m_instructionCount - 1;
+      auto remapTarget = [lastIndex](uint32_t target)
+      {
+         return target >= Instruction::JumpToFalse ? target : lastIndex - target;
+      };
+
+      for (uint32_t i = 0; i < m_instructionCount / 2; ++i)
+      {
+         const Instruction swap = m_instructions[i];
+         m_instructions[i] = m_instructions[lastIndex - i];
+         m_instructions[lastIndex - i] = swap;
+      }
+
+      for (uint32_t i = 0; i < m_instructionCount; ++i)
+      {
+         m_instructions[i].m_onTrue = remapTarget(m_instructions[i].m_onTrue);
+         m_instructions[i].m_onFalse = remapTarget(m_instructions[i].m_onFalse);
+      }
+      m_entry = remapTarget(entry);
+   }
+
+   static constexpr void ReportError(ExpressionParserBase::ParseResult result, size_t at)
+   {
+      switch (result)
+      {
+         case ExpressionParserBase::ParseResult::EmptyStatement:            StaticExpressionError::EmptyStatement(at); break;
+         case ExpressionParserBase::ParseResult::ParsingInvalidCharacter:   StaticExpressionError::ParsingInvalidCharacter(at); break;
+         case ExpressionParserBase::ParseResult::ClosingUnopenedBrace:      StaticExpressionError::ClosingUnopenedBrace(at); break;
+         case ExpressionParserBase::ParseResult::InvalidExpression:         StaticExpressionError::InvalidExpression(at); break;
+         case ExpressionParserBase::ParseResult::InvalidLogic:              StaticExpressionError::InvalidLogic(at); break;
+         case ExpressionParserBase::ParseResult::UnknownField:              StaticExpressionError::UnknownField(at); break;
+         default: break;
+      }
+   }
+
+private:
+   std::array<Instruction, Capacity> m_instructions{};
+   uint32_t m_instructionCount = 0;
+   uint32_t m_entry = Instruction::JumpToFalse;
+};
+
+
+template <ExpressionValueType T>
+template <size_t N>
+   requires std::integral<T>
+consteval StaticExpression<T, N> BasicExpressionParser<T>::Compile(const char (&conditionalDataString)[N])
+{
+   using Expression = StaticExpression<T, N>;
+   using Lexer = ExpressionLexer<T>;
+   using TreeNode = typename Expression::TreeNode;
+
+   Expression expression;
+   const std::string_view input(conditionalDataString, N - 1);
+
+   // Every comparison, range and set member takes at least 1 character and there is one fewer
+   // logic token than there are terms, so these can never fill up. Open braces sit on the operator
+   // stack too. A set compiles to at most 2 instructions per member, and every member takes at
+   // least 2 characters along with the comma or brace after it, so the program can't fill up either.
+   std::array<TreeNode, N> tree{};
+   std::array<Interval, N> members{};
+   std::array<uint32_t, N> operands{};
+   std::array<uint8_t, N> operators{};
+   uint32_t nodeCount = 0;
+   uint32_t memberCount = 0;
+   uint32_t operandCount = 0;
+   uint32_t operatorCount = 0;
+   uint32_t openBraces = 0;
+   constexpr uint8_t BraceOperator = 0xFF;
+
+   // Combine the top two operands with the top operator
+   auto reduce = [&]()
+   {
+      const uint32_t right = operands[--operandCount];
+      const uint32_t left = operands[--operandCount];
+      tree[nodeCount] = { (typename TreeNode::Type)operators[--operatorCount], 0, 0, left, right };
+      operands[operandCount++] = nodeCount++;
+   };
+
+   // Read the members of a set following "in{" or "notin{", sorting them with an insertion sort
+   // and joining any that touch or overlap as Parse does. Returns the token closing the set, or an
+   // invalid token where the set went wrong.
+   auto readSet = [&](Lexer& lexer)
+   {
+      const uint32_t firstMember = memberCount;
+      bool expectingMember = true;
+      for (typename Lexer::Token token = lexer.NextInSet(); ; token = lexer.NextInSet())
+      {
+         if (expectingMember && token.m_type == Lexer::Token::SetMember)
+         {
+            uint32_t at = memberCount++;
+            for (; at > firstMember && members[at - 1].m_min > token.m_value; --at)
+            {
+               members[at] = members[at - 1];
+            }
+            members[at] = { token.m_value, token.m_max };
+            expectingMember = false;
+         }
+         else if (expectingMember == false && token.m_type == Lexer::Token::Comma)
+         {
+            expectingMember = true;
+         }
+         else if (expectingMember == false && token.m_type == Lexer::Token::CloseSet)
+         {
+            uint32_t joined = firstMember;
+            for (uint32_t i = firstMember + 1; i < memberCount; ++i)
+            {
+               if (members[joined].m_max == std::numeric_limits<T>::max() || members[i].m_min <= members[joined].m_max + 1)
+               {
+                  members[joined].m_max = std::max(members[joined].m_max, members[i].m_max);
+               }
+               else
+               {
+                  members[++joined] = members[i];
+               }
+            }
+            memberCount = joined + 1;
+            return token;
+         }
+         else
+         {
+            token.m_error = token.m_type == Lexer::Token::Invalid ? token.m_error : ParseResult::InvalidExpression;
+            token.m_type = Lexer::Token::Invalid;
+            return token;
+         }
+      }
+   };
+
+   // The same rules as Parse, with AND binding tighter than OR and unclosed braces being closed
+   // at the end of the string.
+   Lexer lexer(input);
+   bool expectingExpression = true;
+   bool foundAnything = false;
+   for (typename Lexer::Token token = lexer.Next(); ; token = lexer.Next())
+   {
+      if (token.m_type == Lexer::Token::Invalid)
+      {
+         Expression::ReportError(token.m_error, token.m_at);
+         return expression;
+      }
+
+      if (token.m_type == Lexer::Token::End)
+      {
+         if (foundAnything == false)
+         {
+            Expression::ReportError(ParseResult::EmptyStatement, 0);
+            return expression;
+         }
+
+         if (expectingExpression)
+         {
+            Expression::ReportError(ParseResult::InvalidExpression, token.m_at);
+            return expression;
+         }
+         break;
+      }
+
+      foundAnything = true;
+      if (expectingExpression)
+      {
+         switch (token.m_type)
+         {
+            case Lexer::Token::OpenBrace:
+               operators[operatorCount++] = BraceOperator;
+               ++openBraces;
+               break;
+
+            case Lexer::Token::Comparison:
+               tree[nodeCount] = { TreeNode::Comparison, token.m_operation, token.m_value, 0, 0 };
+               operands[operandCount++] = nodeCount++;
+               expectingExpression = false;
+               break;
+
+            case Lexer::Token::Field:
+               // Fields are bound to a parser at runtime, so there are none to compare at compile time
+               Expression::ReportError(ParseResult::UnknownField, token.m_at);
+               return expression;
+
+            case Lexer::Token::Set:
+            case Lexer::Token::Range:
+            {
+               // A range is a set of a single member
+               const uint32_t firstMember = memberCount;
+               if (token.m_type == Lexer::Token::Set)
+               {
+                  const typename Lexer::Token closing = readSet(lexer);
+                  if (closing.m_type == Lexer::Token::Invalid)
+                  {
+                     Expression::ReportError(closing.m_error, closing.m_at);
+                     return expression;
+                  }
+               }
+               else
+               {
+                  members[memberCount++] = { token.m_value, token.m_max };
+               }
+
+               const int operation = token.m_type == Lexer::Token::Set ? token.m_operation : (int)Compiled::EqualTo;
+               tree[nodeCount] = { TreeNode::Set, operation, 0, firstMember, memberCount - firstMember };
+               operands[operandCount++] = nodeCount++;
+               expectingExpression = false;
+               break;
+            }
+
+            default:
+               Expression::ReportError(ParseResult::InvalidExpression, token.m_at);
+               return expression;
+         }
+         continue;
+      }
+
+      switch (token.m_type)
+      {
+         case Lexer::Token::CloseBrace:
+            if (openBraces == 0)
+            {
+               Expression::ReportError(ParseResult::ClosingUnopenedBrace, token.m_at);
+               return expression;
+            }
+
+            while (operators[operatorCount - 1] != BraceOperator)
+            {
+               reduce();
+            }
+            --operatorCount;
+            --openBraces;
+            break;
+
+         case Lexer::Token::And:
+         case Lexer::Token::Or:
+         {
+            // Anything at least as tight as the new logic can be combined now
+            const uint8_t logic = token.m_type == Lexer::Token::And ? TreeNode::And : TreeNode::Or;
+            while (operatorCount > 0 && operators[operatorCount - 1] != BraceOperator && (logic == TreeNode::Or || operators[operatorCount - 1] == TreeNode::And))
+            {
+               reduce();
+            }
+            operators[operatorCount++] = logic;
+            expectingExpression = true;
+            break;
+         }
+
+         default:
+            Expression::ReportError(ParseResult::InvalidLogic, token.m_at);
+            return expression;
+      }
+   }
+
+   while (operatorCount > 0)
+   {
+      if (operators[operatorCount - 1] == BraceOperator)
+      {
+         --operatorCount;
+         continue;
+      }
+      reduce();
+   }
+
+   const uint32_t entry = expression.CompileNode(tree, members, operands[0], Instruction::JumpToTrue, Instruction::JumpToFalse);
+   expression.Finish(entry);
+   return expression;
+}
@@ -1,7 +1,12 @@
 #include "Expression Parser/ExpressionParser.h"
+#include "Expression Parser/RuleFileLoader.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <vector>
 
 const std::string ReadFromStream()
 {
@@ -10,22 +15,150 @@ const std::string ReadFromStream()
    return valIn;
 };
 
-int main()
+const char* DescribeSimplification(ExpressionParser::Simplification::Reason reason)
 {
+   switch (reason)
+   {
+      case ExpressionParser::Simplification::Reason::Redundant:   return "is already covered by the rest of its group";
+      case ExpressionParser::Simplification::Reason::Merged:      return "was merged with another comparison";
+      case ExpressionParser::Simplification::Reason::AlwaysTrue:  return "is part of a group that always passes";
+      case ExpressionParser::Simplification::Reason::AlwaysFalse: return "is part of a group that never passes";
+      default:                                                    return "";
+   }
+}
+
+// Load a file of rules, report any that failed, then match values typed in against them.
+int RunLoad(int argc, char** argv)
+{
+   std::string path;
+   RuleFileLoader::Format format = RuleFileLoader::Format::Auto;
+   unsigned threadCount = 0;
+   for (int i = 1; i < argc; ++i)
+   {
+      if (std::strcmp(argv[i], "--load") == 0 && i + 1 < argc)
+      {
+         path = argv[++i];
+      }
+      else if (std::strcmp(argv[i], "--json") == 0)
+      {
+         format = RuleFileLoader::Format::Json;
+      }
+      else if (std::strcmp(argv[i], "--lines") == 0)
+      {
+         format = RuleFileLoader::Format::Lines;
+      }
+      else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+      {
+         try
+         {
+            threadCount = (unsigned)std::stoul(argv[++i]);
+         }
+         catch (...)
+         {
+            path.clear();
+            break;
+         }
+      }
+      else
+      {
+         path.clear();
+         break;
+      }
+   }
+
+   if (path.empty())
+   {
+      std::cerr << "Usage: " << argv[0] << " [--load <file> [--json | --lines] [--threads <n>]]" << std::endl;
+      return 1;
+   }
+
+   RuleFileLoader loader(threadCount);
+   const auto start = std::chrono::steady_clock::now();
+   const RuleFileLoader::LoadResult result = loader.LoadFile(path, format);
+   const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+
+   if (result == RuleFileLoader::LoadResult::FileError)
+   {
+      std::cerr << "Failed to open " << path << std::endl;
+      return 1;
+   }
+   if (result == RuleFileLoader::LoadResult::InvalidJson)
+   {
+      std::cerr << "Invalid JSON on line " << loader.GetInvalidJsonLine() << ", only the rules before it were loaded." << std::endl;
+   }
+
+   // Only show the first few errors and matches, there could easily be millions of either
+   constexpr size_t ShownCount = 20;
+   for (size_t i = 0; i < std::min(loader.GetErrors().size(), ShownCount); ++i)
+   {
+      const RuleFileLoader::RuleError& error = loader.GetErrors()[i];
+      std::cout << "Rule " << error.m_ruleIndex << " on line " << error.m_line << ", offset " << error.m_location << ": " << error.m_message << std::endl;
+   }
+   if (loader.GetErrors().size() > ShownCount)
+   {
+      std::cout << "... and " << loader.GetErrors().size() - ShownCount << " more errors" << std::endl;
+   }
+
+   std::cout << "Loaded " << loader.GetRuleSet().GetRuleCount() << " of " << loader.GetRuleCount() << " rules in " << duration.count() << "ms" << std::endl;
+
+   std::vector<RuleSet::RuleId> matches;
+   while (true)
+   {
+      std::cout << std::endl << "Type a value to match (or 'end' to quit): ";
+
+      const std::string valueIn = ReadFromStream();
+      if (valueIn == "end" || std::cin.eof())
+      {
+         break;
+      }
+
+      int value;
+      try
+      {
+         value = std::stoi(valueIn);
+      }
+      catch (...)
+      {
+         std::cout << "Invalid input.";
+         continue;
+      }
+
+      loader.GetRuleSet().Match(value, matches);
+      std::sort(matches.begin(), matches.end());
+      std::cout << matches.size() << " rules matched:";
+      for (size_t i = 0; i < std::min(matches.size(), ShownCount); ++i)
+      {
+         std::cout << " " << matches[i];
+      }
+      std::cout << (matches.size() > ShownCount ? " ..." : "") << std::endl;
+   }
+   return 0;
+}
+
+int main(int argc, char** argv)
+{
+   if (argc > 1)
+   {
+      return RunLoad(argc, argv);
+   }
+
    std::cout << "=======================================================================================================================" << std::endl;
    std::cout << "This is a demo to showcase how the ExpressionParser class can parse a string expression then evaluate an integer value." << std::endl;
    std::cout << std::endl;
    std::cout << "Expressions must be in the following format: \"COMP <LOGIC COMP>...\" where:" << std::endl;
-   std::cout << " - 'COMP' is a comparison operation (<, <=, >, >=, =, !=) and a value with no space between them" << std::endl;
+   std::cout << " - 'COMP' is a comparison operation (<, <=, >, >=, =, !=) and a value, which may be negative" << std::endl;
+   std::cout << " - a 'COMP' may instead be a set, \"in{1, 5, 10..20}\" or \"notin{...}\", or a range on its own, eg: \"10..20\"" << std::endl;
    std::cout << " - 'LOGIC' is either \"and\" or \"or\" (interchangable with the progammatic operators \"&&\" or \"||\")" << std::endl;
    std::cout << " - additional logic is optional, however if used a comparison must proceed it" << std::endl;
    std::cout << " - braces may be used to change the order of operations" << std::endl;
+   std::cout << " - whitespace between comparisons, logic and braces is optional" << std::endl;
    std::cout << std::endl;
    std::cout << "Examples:" << std::endl;
    std::cout << " - \"<=100\"" << std::endl;
    std::cout << " - \">=0 && <=100 && !=50\"" << std::endl;
    std::cout << " - \">10 and <50 or >100\" ('and' only passes if >10 and <50)" << std::endl;
    std::cout << " - \">10 and (<50 or >100)\" ('and' passes if <50 OR >100 due to braces)" << std::endl;
+   std::cout << " - \"in{2, 3, 5, 7, 11} or 100..200\" (passes the primes listed or anything from 100 to 200)" << std::endl;
    std::cout << "=======================================================================================================================" << std::endl;
    std::cout << std::endl;
 
@@ -47,6 +180,14 @@ int main()
          continue;
       }
 
+      // Point out anything that can be taken out without changing the result
+      parser.Simplify();
+      for (const ExpressionParser::Simplification& simplification : parser.GetSimplifications())
+      {
+         const std::string comparison = expressionIn.substr(simplification.m_source.m_at, simplification.m_source.m_length);
+         std::cout << "Simplified: '" << comparison << "' " << DescribeSimplification(simplification.m_reason) << std::endl;
+      }
+
       // Test different inputs on the generated logic tree
       while (true)
       {
@@ -0,0 +1,286 @@
+#include "RandomExpression.h"
+#include "Tests.h"
+
+#include "ExpressionArchive.h"
+#include "ExpressionParser.h"
+#include "RuleSet.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+   using LoadResult = ExpressionArchive::LoadResult;
+   using Instruction = CompiledExpression::Instruction;
+
+   constexpr int ExpressionCount = 500;
+   constexpr size_t RandomValueCount = 32;
+
+   // Where everything is in an archive, which is the format itself so can't move.
+   constexpr size_t VersionAt = 4;
+   constexpr size_t SizeAt = 16;
+   constexpr size_t RecordsAt = 24;
+   constexpr size_t InstructionsAt = 32;
+   constexpr size_t IntervalsAt = 40;
+   constexpr size_t SegmentStartsAt = 48;
+   constexpr size_t NodeOffsetsAt = 56;
+   constexpr size_t NodeRulesAt = 64;
+
+   constexpr size_t RecordSize = 32;
+   constexpr size_t EntryAt = 4;
+   constexpr size_t FirstInstructionAt = 8;
+   constexpr size_t InstructionCountAt = 12;
+   constexpr size_t FirstIntervalAt = 16;
+   constexpr size_t IntervalCountAt = 20;
+   constexpr size_t FieldCountAt = 24;
+   constexpr size_t EvaluationModeAt = 28;
+
+   constexpr size_t InstructionSize = 16;
+   constexpr size_t FieldAt = 2;
+   constexpr size_t OnTrueAt = 8;
+   constexpr size_t OnFalseAt = 12;
+
+   constexpr size_t IntervalSize = 8;
+
+   uint32_t Read32(const std::vector<uint8_t>& data, size_t at)
+   {
+      uint32_t value;
+      std::memcpy(&value, data.data() + at, sizeof(value));
+      return value;
+   }
+
+   void Write32(std::vector<uint8_t>& data, size_t at, uint32_t value)
+   {
+      std::memcpy(data.data() + at, &value, sizeof(value));
+   }
+
+   // Every random expression, some evaluated as intervals, is written to an archive along with
+   // a few reading fields. Each has to give the same results from the archive as it did compiled,
+   // and the archive has to match the same rules as a rule set built from them.
+   void CheckRoundTrip(TestReport& report)
+   {
+      std::vector<CompiledExpression> expressions;
+      std::vector<std::string> sources;
+      ExpressionArchiveWriter writer;
+      RuleSet ruleSet;
+      std::vector<int> values;
+
+      auto add = [&](ExpressionParser& parser, const std::string& expression)
+      {
+         parser.Clear();
+         const bool isParsed = parser.Parse(expression) == ExpressionParser::ParseResult::OK;
+         report.Check(isParsed, "Failed to parse \"" + expression + "\": " + parser.GetErrorMessage());
+         if (isParsed == false)
+         {
+            return;
+         }
+
+         // Ids are spread out so they can't be mistaken for indices
+         const RuleSet::RuleId id = (RuleSet::RuleId)expressions.size() * 3 + 1;
+         writer.Add(id, parser.GetCompiledExpression());
+         ruleSet.Add(id, parser.GetCompiledExpression());
+         expressions.push_back(parser.GetCompiledExpression());
+         sources.push_back(expression);
+      };
+
+      RandomExpression<int32_t> tree(6);
+      ExpressionParser parser;
+      for (int i = 0; i < ExpressionCount; ++i)
+      {
+         tree.Generate(6, 2);
+         const std::vector<int> treeValues = tree.GenerateValues(RandomValueCount);
+         values.insert(values.end(), treeValues.begin(), treeValues.end());
+         parser.SetEvaluationMode(i % 2 == 0 ? ExpressionParser::EvaluationMode::Program : ExpressionParser::EvaluationMode::Intervals);
+         add(parser, tree.ToString());
+      }
+
+      ExpressionParser fieldParser;
+      fieldParser.BindField("price", 1);
+      fieldParser.BindField("qty", 2);
+      add(fieldParser, "price>=10 and (qty<5 or <0)");
+      add(fieldParser, "qty in{1, 2, 3} or price=7");
+      ruleSet.Build();
+
+      ExpressionArchive archive;
+      const std::vector<uint8_t> data = writer.Write();
+      const LoadResult result = archive.Attach(data);
+      report.Check(result == LoadResult::OK, "Failed to load the written archive: " + std::string(ExpressionArchive::GetLoadResultMessage(result)));
+      if (result != LoadResult::OK)
+      {
+         return;
+      }
+      report.Check(archive.GetExpressionCount() == expressions.size() && archive.GetRuleCount() == ruleSet.GetRuleCount(), "The archive holds the wrong number of expressions");
+
+      const std::vector<int> rowValues = { -1, 0, 1, 2, 4, 5, 7, 10, 11 };
+      for (size_t i = 0; i < std::min(archive.GetExpressionCount(), expressions.size()); ++i)
+      {
+         const CompiledExpression& expression = expressions[i];
+         report.Check(archive.GetId(i) == (RuleSet::RuleId)i * 3 + 1, "The id of \"" + sources[i] + "\" differs");
+         report.Check(archive.GetFieldCount(i) == expression.GetFieldCount(), "The field count of \"" + sources[i] + "\" differs");
+
+         const std::span<const CompiledExpression::Interval> intervals = archive.GetIntervals(i);
+         report.Check(std::equal(intervals.begin(), intervals.end(), expression.GetIntervals().begin(), expression.GetIntervals().end(),
+            [](const auto& a, const auto& b) { return a.m_min == b.m_min && a.m_max == b.m_max; }), "The intervals of \"" + sources[i] + "\" differ");
+
+         for (size_t v = (i % ExpressionCount) * RandomValueCount; v < (i % ExpressionCount + 1) * RandomValueCount; ++v)
+         {
+            std::ostringstream description;
+            description << "\"" << sources[i] << "\" evaluates differently from the archive with " << values[v];
+            report.Check(archive.Evaluate(i, values[v]) == expression.Evaluate(values[v]), description.str());
+         }
+
+         // Rows vary every column, the value every comparison without a field reads included
+         std::vector<int> row(std::max<uint32_t>(expression.GetFieldCount(), 1));
+         for (int a : rowValues)
+         {
+            for (int b : rowValues)
+            {
+               for (size_t column = 0; column < row.size(); ++column)
+               {
+                  row[column] = column % 2 == 0 ? a : b;
+               }
+               std::ostringstream description;
+               description << "\"" << sources[i] << "\" evaluates a row differently from the archive with " << a << " and " << b;
+               report.Check(archive.EvaluateRow(i, row) == expression.EvaluateRow(row), description.str());
+            }
+         }
+      }
+
+      std::vector<RuleSet::RuleId> matches;
+      std::vector<RuleSet::RuleId> expectedMatches;
+      for (size_t v = 0; v < values.size(); v += 7)
+      {
+         archive.Match(values[v], matches);
+         ruleSet.Match(values[v], expectedMatches);
+         std::sort(matches.begin(), matches.end());
+         std::sort(expectedMatches.begin(), expectedMatches.end());
+         report.Check(matches == expectedMatches, "The archive matches different rules for " + std::to_string(values[v]));
+      }
+   }
+
+   // Loading from a file goes through the mapping rather than memory already there.
+   void CheckFile(TestReport& report)
+   {
+      ExpressionArchiveWriter writer;
+      writer.Add(5, "<5 or >10");
+      const std::string path = (std::filesystem::temp_directory_path() / "ExpressionParserTests.expa").string();
+      report.Check(writer.WriteToFile(path), "Failed to write the archive to " + path);
+
+      ExpressionArchive archive;
+      report.Check(archive.Load(path) == LoadResult::OK && archive.GetExpressionCount() == 1 && archive.Evaluate(0, 11) && archive.Evaluate(0, 7) == false,
+         "The archive loaded from a file differs from the one written");
+      archive.Close();
+      std::filesystem::remove(path);
+
+      report.Check(archive.Load(path) == LoadResult::FileError, "Loaded an archive from a file that doesn't exist");
+   }
+
+   void CheckEmpty(TestReport& report)
+   {
+      ExpressionArchiveWriter writer;
+      const std::vector<uint8_t> data = writer.Write();
+      report.Check(data.empty() == false, "Wrote nothing for an empty archive");
+
+      ExpressionArchive archive;
+      const LoadResult result = archive.Attach(data);
+      report.Check(result == LoadResult::OK, "Failed to load an empty archive: " + std::string(ExpressionArchive::GetLoadResultMessage(result)));
+
+      std::vector<RuleSet::RuleId> matches = { 1 };
+      report.Check(archive.GetExpressionCount() == 0 && archive.GetRuleCount() == 0 && archive.Match(0, matches) == 0 && matches.empty(), "An empty archive holds rules");
+      report.Check(archive.Match(std::numeric_limits<int>::min(), matches) == 0 && archive.Match(std::numeric_limits<int>::max(), matches) == 0, "An empty archive matches rules");
+   }
+
+   // Every way an archive can be rejected, each reached by changing a valid archive. The checksum
+   // is checked before the layout, so the layout is checked with the checksum skipped.
+   void CheckRejected(TestReport& report)
+   {
+      ExpressionArchiveWriter writer;
+      writer.Add(0, "<5 or >10");
+      writer.Add(1, ">=0 and <=100");
+      const std::vector<uint8_t> valid = writer.Write();
+
+      const size_t records = Read32(valid, RecordsAt);
+      const size_t instructions = Read32(valid, InstructionsAt) + Read32(valid, records + FirstInstructionAt) * InstructionSize;
+      const size_t intervals = Read32(valid, IntervalsAt) + Read32(valid, records + FirstIntervalAt) * IntervalSize;
+      const uint32_t instructionCount = Read32(valid, records + InstructionCountAt);
+      const size_t segmentStarts = Read32(valid, SegmentStartsAt);
+      const size_t nodeOffsets = Read32(valid, NodeOffsetsAt);
+      report.Check(instructionCount == 2 && Read32(valid, records + IntervalCountAt) == 2, "\"<5 or >10\" no longer compiles to 2 instructions and 2 intervals");
+
+      ExpressionArchive archive;
+      auto check = [&](const char* pDescription, LoadResult expected, bool verifyChecksum, const std::function<void(std::vector<uint8_t>&)>& change)
+      {
+         std::vector<uint8_t> data = valid;
+         change(data);
+         const LoadResult result = archive.Attach(data, verifyChecksum);
+         report.Check(result == expected && archive.IsLoaded() == false, std::string(pDescription) + " gave " + std::string(ExpressionArchive::GetLoadResultMessage(result)));
+      };
+
+      report.Check(archive.Attach(valid) == LoadResult::OK, "Failed to load the archive before changing it");
+
+      check("A flipped byte", LoadResult::ChecksumMismatch, true, [&](std::vector<uint8_t>& data) { data[records + FirstInstructionAt + 3] ^= 1; });
+      check("A flipped byte without the checksum", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { data[records + FirstInstructionAt + 3] ^= 1; });
+      check("A flipped padding byte", LoadResult::ChecksumMismatch, true, [&](std::vector<uint8_t>& data) { data.back() ^= 0x80; });
+
+      check("Data shorter than a header", LoadResult::InvalidHeader, false, [](std::vector<uint8_t>& data) { data.resize(40); });
+      check("No data", LoadResult::InvalidHeader, false, [](std::vector<uint8_t>& data) { data.clear(); });
+      check("Truncated data", LoadResult::InvalidHeader, false, [](std::vector<uint8_t>& data) { data.resize(data.size() - 8); });
+      check("Data with more after it", LoadResult::InvalidHeader, false, [](std::vector<uint8_t>& data) { data.resize(data.size() + 8); });
+      check("A different magic number", LoadResult::InvalidHeader, false, [](std::vector<uint8_t>& data) { data[0] ^= 1; });
+      check("A different version", LoadResult::UnsupportedVersion, false, [](std::vector<uint8_t>& data) { Write32(data, VersionAt, ExpressionArchive::Version + 1); });
+      check("A different size", LoadResult::InvalidHeader, false, [](std::vector<uint8_t>& data) { Write32(data, SizeAt, Read32(data, SizeAt) - 8); });
+
+      check("A misaligned section", LoadResult::InvalidData, false, [](std::vector<uint8_t>& data) { Write32(data, InstructionsAt, Read32(data, InstructionsAt) + 4); });
+      check("A section starting past the end", LoadResult::InvalidData, false, [](std::vector<uint8_t>& data) { Write32(data, IntervalsAt, (uint32_t)data.size() + 8); });
+      check("A section running past the end", LoadResult::InvalidData, false, [](std::vector<uint8_t>& data) { Write32(data, NodeRulesAt + 4, Read32(data, NodeRulesAt + 4) + 1000); });
+      check("A section with a wrapping count", LoadResult::InvalidData, false, [](std::vector<uint8_t>& data) { Write32(data, RecordsAt + 4, 0xFFFFFFFF); });
+
+      check("Instructions past the section", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, records + FirstInstructionAt, 0xFFFFFFFF); });
+      check("An instruction count past the section", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, records + InstructionCountAt, 100); });
+      check("Intervals past the section", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, records + FirstIntervalAt, 100); });
+      check("An interval count past the section", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, records + IntervalCountAt, 0xFFFFFFFF); });
+      check("An unknown evaluation mode", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, records + EvaluationModeAt, 2); });
+      check("An entry past the instructions", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, records + EntryAt, instructionCount); });
+
+      check("A jump past the instructions", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, instructions + OnFalseAt, instructionCount); });
+      check("A jump backwards", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, instructions + InstructionSize + OnTrueAt, 0); });
+      check("A jump to itself", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, instructions + InstructionSize + OnTrueAt, 1); });
+      check("A field past the field count", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { data[instructions + FieldAt] = 1; });
+      check("No fields", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, records + FieldCountAt, 0); });
+
+      check("An empty interval", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, intervals, 100); });
+      check("Unsorted intervals", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, intervals + IntervalSize, (uint32_t)-50); });
+      check("Touching intervals", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, intervals + IntervalSize, 4); });
+
+      check("No segments", LoadResult::InvalidData, false, [](std::vector<uint8_t>& data) { Write32(data, SegmentStartsAt + 4, 0); });
+      check("A first segment after the minimum", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, segmentStarts, 0); });
+      check("Unsorted segments", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, segmentStarts + 8, Read32(data, segmentStarts + 4)); });
+      check("Too few node offsets", LoadResult::InvalidData, false, [](std::vector<uint8_t>& data) { Write32(data, NodeOffsetsAt + 4, Read32(data, NodeOffsetsAt + 4) - 1); });
+      check("A first node offset after 0", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, nodeOffsets, 1); });
+      check("A last node offset before the end", LoadResult::InvalidData, false, [](std::vector<uint8_t>& data) { Write32(data, NodeRulesAt + 4, Read32(data, NodeRulesAt + 4) + 1); });
+      check("Decreasing node offsets", LoadResult::InvalidData, false, [&](std::vector<uint8_t>& data) { Write32(data, nodeOffsets + 4, 0xFFFF); });
+
+      // Attached data has to be aligned for the records to be read in place
+      std::vector<uint8_t> misaligned(valid.size() + 1);
+      std::memcpy(misaligned.data() + 1, valid.data(), valid.size());
+      report.Check(archive.Attach(std::span<const uint8_t>(misaligned).subspan(1)) == LoadResult::InvalidHeader, "Attached misaligned data");
+   }
+}
+
+bool RunArchiveTests()
+{
+   TestReport report("archive");
+
+   CheckRoundTrip(report);
+   CheckFile(report);
+   CheckEmpty(report);
+   CheckRejected(report);
+   return report.Finish();
+}
@@ -0,0 +1,188 @@
+#include "RandomExpression.h"
+#include "Tests.h"
+
+#include "ExpressionCache.h"
+#include "ExpressionParser.h"
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+   constexpr int ExpressionCount = 300;
+   constexpr int MaxTerms = 8;
+   constexpr int MaxDepth = 3;
+   constexpr size_t RandomValueCount = 16;
+   constexpr size_t LookupCount = 500;
+
+   // Entry counts small enough that the values keep colliding, and large enough that they mostly don't.
+   constexpr size_t EntryCounts[] = { 2, 1024 };
+
+   // Look up values picked from those worth checking, with every other lookup repeating the one
+   // before so hits are guaranteed. Every result has to be the tree's, and every lookup counted
+   // once as either a hit or a miss.
+   template <typename T>
+   void CheckLookups(TestReport& report, const BasicExpressionParser<T>& parser, const RandomExpression<T>& tree, const std::string& expression, const std::vector<T>& values, std::mt19937& random)
+   {
+      std::uniform_int_distribution<size_t> pick(0, values.size() - 1);
+      for (const size_t entryCount : EntryCounts)
+      {
+         BasicExpressionCache<T> cache(parser.GetCompiledExpression(), entryCount);
+         report.Check(cache.GetEntryCount() == entryCount, "A cache asked for " + std::to_string(entryCount) + " entries has " + std::to_string(cache.GetEntryCount()));
+
+         T value = values[0];
+         for (size_t i = 0; i < LookupCount; ++i)
+         {
+            value = i % 2 == 0 ? values[pick(random)] : value;
+            const uint64_t hitCount = cache.GetHitCount();
+            const bool passes = cache.Evaluate(value);
+            if (passes != tree.Evaluate(value))
+            {
+               std::ostringstream description;
+               description.precision(17);
+               description << "Cached result differs for \"" << expression << "\" with " << value << " in " << entryCount << " entries";
+               report.Check(false, description.str());
+            }
+            report.Check(i % 2 == 0 || cache.GetHitCount() == hitCount + 1, "A repeated value missed for \"" + expression + "\" in " + std::to_string(entryCount) + " entries");
+         }
+         report.Check(cache.GetHitCount() + cache.GetMissCount() == LookupCount, "\"" + expression + "\" counted " + std::to_string(cache.GetHitCount() + cache.GetMissCount())
+            + " lookups rather than " + std::to_string(LookupCount));
+      }
+   }
+
+   template <typename T>
+   void CheckValueType(TestReport& report, uint32_t seed)
+   {
+      RandomExpression<T> tree(seed);
+      std::mt19937 random(seed);
+      for (int i = 0; i < ExpressionCount; ++i)
+      {
+         tree.Generate(MaxTerms, MaxDepth);
+         const std::string expression = tree.ToString();
+
+         BasicExpressionParser<T> parser;
+         const bool isParsed = parser.Parse(expression) == BasicExpressionParser<T>::ParseResult::OK;
+         report.Check(isParsed, "Failed to parse \"" + expression + "\": " + parser.GetErrorMessage());
+         if (isParsed)
+         {
+            CheckLookups(report, parser, tree, expression, tree.GenerateValues(RandomValueCount), random);
+         }
+      }
+   }
+
+   // With two entries, three values alternating can't all stay cached, so they keep evicting each
+   // other with every result still right.
+   void CheckCollisions(TestReport& report)
+   {
+      ExpressionParser parser;
+      parser.Parse("<5 or =10");
+      ExpressionCache cache(parser.GetCompiledExpression(), 2);
+      const int values[] = { 4, 10, 7 };
+      for (int i = 0; i < 30; ++i)
+      {
+         const int value = values[i % 3];
+         report.Check(cache.Evaluate(value) == (value != 7), "Colliding values gave the wrong result for " + std::to_string(value));
+      }
+      report.Check(cache.GetMissCount() > 3 && cache.GetHitCount() + cache.GetMissCount() == 30,
+         "Three values in two entries missed " + std::to_string(cache.GetMissCount()) + " times and hit " + std::to_string(cache.GetHitCount()));
+
+      cache.ResetCounters();
+      report.Check(cache.GetHitCount() == 0 && cache.GetMissCount() == 0, "Resetting the counters left them counting");
+      cache.Evaluate(4);
+      cache.Clear();
+      cache.Evaluate(4);
+      report.Check(cache.GetMissCount() == 2 && cache.GetHitCount() == 0, "Clearing kept a result or lost the counts");
+   }
+
+   // Parsing another string, optimising or simplifying all change the expression's version, so the
+   // next lookup evaluates it afresh even where the result stays the same.
+   void CheckVersions(TestReport& report)
+   {
+      ExpressionParser parser;
+      parser.Parse("<5 or =5");
+      ExpressionCache cache(parser.GetCompiledExpression(), 16);
+      cache.Evaluate(4);
+      report.Check(cache.Evaluate(4) && cache.GetHitCount() == 1 && cache.GetMissCount() == 1, "A repeated value wasn't cached");
+
+      auto checkCleared = [&report, &cache](bool expected, const char* pChange)
+      {
+         const uint64_t missCount = cache.GetMissCount();
+         report.Check(cache.Evaluate(4) == expected && cache.GetMissCount() == missCount + 1, std::string("The cache kept its results once the expression was ") + pChange);
+         report.Check(cache.Evaluate(4) == expected && cache.GetMissCount() == missCount + 1, std::string("The cache didn't cache again once the expression was ") + pChange);
+      };
+
+      const std::vector<int> sample = { 1, 5, 9, 4, 6 };
+      report.Check(parser.Optimize(sample), "Failed to optimise \"<5 or =5\"");
+      checkCleared(true, "optimised");
+
+      report.Check(parser.Simplify() && parser.GetSimplifications().empty() == false, "Failed to simplify \"<5 or =5\"");
+      checkCleared(true, "simplified");
+
+      parser.Clear();
+      parser.Parse(">5");
+      checkCleared(false, "parsed again");
+   }
+
+   // A NaN is cached by its bits, so every NaN gets an entry of its own, as do -0.0 and 0.0. Each
+   // has to give the same result as evaluating the expression directly, whichever is looked up first.
+   template <typename T>
+   void CheckFloatKeys(TestReport& report)
+   {
+      using Bits = std::conditional_t<sizeof(T) == sizeof(uint64_t), uint64_t, uint32_t>;
+      const T quietNaN = std::numeric_limits<T>::quiet_NaN();
+      const T values[] =
+      {
+         quietNaN,
+         -quietNaN,
+         std::bit_cast<T>((Bits)(std::bit_cast<Bits>(quietNaN) | 1)),
+         std::numeric_limits<T>::signaling_NaN(),
+         (T)0.0,
+         (T)-0.0,
+      };
+
+      for (const char* pExpression : { "<0", "<=0", "=0", "!=0", ">=0", ">0", "in{0, 5}", "notin{0}", "=5" })
+      {
+         BasicExpressionParser<T> parser;
+         parser.Parse(pExpression);
+         const BasicCompiledExpression<T>& compiled = parser.GetCompiledExpression();
+         for (const bool isReversed : { false, true })
+         {
+            BasicExpressionCache<T> cache(compiled, 1024);
+            for (int pass = 0; pass < 2; ++pass)
+            {
+               for (size_t i = 0; i < std::size(values); ++i)
+               {
+                  const T value = values[isReversed ? std::size(values) - 1 - i : i];
+                  std::ostringstream description;
+                  description << "\"" << pExpression << "\" gave a different cached result for " << (std::signbit(value) ? "-" : "") << std::abs(value) << " with bits " << std::hex << std::bit_cast<Bits>(value);
+                  report.Check(cache.Evaluate(value) == compiled.Evaluate(value), description.str());
+               }
+            }
+            report.Check(cache.GetHitCount() == std::size(values) && cache.GetMissCount() == std::size(values),
+               "\"" + std::string(pExpression) + "\" hit " + std::to_string(cache.GetHitCount()) + " times with every NaN and zero a key of its own");
+         }
+      }
+   }
+}
+
+bool RunCacheTests()
+{
+   TestReport report("cache");
+
+   CheckValueType<int32_t>(report, 51);
+   CheckValueType<int64_t>(report, 52);
+   CheckValueType<float>(report, 53);
+   CheckValueType<double>(report, 54);
+   CheckCollisions(report);
+   CheckVersions(report);
+   CheckFloatKeys<float>(report);
+   CheckFloatKeys<double>(report);
+   return report.Finish();
+}
@@ -0,0 +1,108 @@
+#include "RandomExpression.h"
+#include "Tests.h"
+
+#include "ExpressionParser.h"
+
+#include <cstdint>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+   constexpr int ExpressionCount = 300;
+   constexpr int MaxTerms = 8;
+   constexpr int MaxDepth = 3;
+   constexpr int FieldCount = 3;
+   constexpr size_t RandomValueCount = 16;
+
+   // Row counts around a word of the selection and around a block of rows, none of them but 64
+   // and 1024 filling their last word.
+   constexpr size_t RowCounts[] = { 1, 63, 64, 65, 1000, 1024, 1025, 2113 };
+
+   // Filter columns of values picked from those worth checking the expression with, and check
+   // every row's bit in the selection against both the tree and EvaluateRow on the same row. The
+   // selection starts out full so every failing row has to be cleared.
+   template <typename T>
+   void CheckColumns(TestReport& report, const BasicExpressionParser<T>& parser, const RandomExpression<T>& tree, const std::string& expression, const std::vector<T>& values, std::mt19937& random)
+   {
+      std::uniform_int_distribution<size_t> pick(0, values.size() - 1);
+      for (const size_t rowCount : RowCounts)
+      {
+         std::vector<std::vector<T>> columns(FieldCount, std::vector<T>(rowCount));
+         for (std::vector<T>& column : columns)
+         {
+            for (T& value : column)
+            {
+               value = values[pick(random)];
+            }
+         }
+         const std::vector<std::span<const T>> columnSpans(columns.begin(), columns.end());
+
+         std::vector<uint64_t> selection((rowCount + 63) / 64, ~0ull);
+         parser.Evaluate(columnSpans, selection);
+
+         std::vector<T> row(FieldCount);
+         for (size_t i = 0; i < rowCount; ++i)
+         {
+            for (size_t field = 0; field < FieldCount; ++field)
+            {
+               row[field] = columns[field][i];
+            }
+
+            const bool isSelected = ((selection[i / 64] >> (i % 64)) & 1) != 0;
+            const bool isPassing = isSelected == tree.EvaluateRow(row) && isSelected == parser.EvaluateRow(row);
+            std::ostringstream description;
+            if (isPassing == false)
+            {
+               description.precision(17);
+               description << "Row " << i << " of " << rowCount << " for \"" << expression << "\" is " << (isSelected ? "selected" : "not selected") << " with";
+               for (const T value : row)
+               {
+                  description << " " << value;
+               }
+            }
+            report.Check(isPassing, description.str());
+         }
+      }
+   }
+
+   template <typename T>
+   void CheckValueType(TestReport& report, uint32_t seed)
+   {
+      RandomExpression<T> tree(seed);
+      std::mt19937 random(seed);
+      for (int i = 0; i < ExpressionCount; ++i)
+      {
+         tree.Generate(MaxTerms, MaxDepth, FieldCount);
+         const std::string expression = tree.ToString();
+         const std::vector<T> values = tree.GenerateValues(RandomValueCount);
+
+         BasicExpressionParser<T> parser;
+         for (int field = 0; field < FieldCount; ++field)
+         {
+            parser.BindField("f" + std::to_string(field), (uint16_t)field);
+         }
+
+         const bool isParsed = parser.Parse(expression) == BasicExpressionParser<T>::ParseResult::OK;
+         report.Check(isParsed, "Failed to parse \"" + expression + "\": " + parser.GetErrorMessage());
+         if (isParsed)
+         {
+            CheckColumns(report, parser, tree, expression, values, random);
+         }
+      }
+   }
+}
+
+bool RunColumnTests()
+{
+   TestReport report("columns");
+
+   CheckValueType<int32_t>(report, 11);
+   CheckValueType<int64_t>(report, 12);
+   CheckValueType<float>(report, 13);
+   CheckValueType<double>(report, 14);
+   return report.Finish();
+}
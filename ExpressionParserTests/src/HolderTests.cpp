@@ -0,0 +1,202 @@
+#include "Tests.h"
+
+#include "ExpressionHolder.h"
+#include "ExpressionParser.h"
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+   constexpr int VersionCount = 2000;
+   constexpr int ReaderThreadCount = 4;
+   constexpr size_t BatchRepeats = 4;
+
+   // Version k passes only k, with every other version adding enough members below 0 that it is
+   // evaluated as a program rather than by its intervals.
+   std::string WriteVersion(int version)
+   {
+      return "=" + std::to_string(version) + (version % 2 == 1 ? " or in{-9, -7, -5, -3, -1}" : "");
+   }
+
+   // The version a batch of i % VersionCount for each i was evaluated against, or -1 if the results
+   // are anything but the ones a single version gives.
+   int FindVersion(const std::vector<uint8_t>& results)
+   {
+      int version = -1;
+      size_t passedCount = 0;
+      for (size_t i = 0; i < results.size(); ++i)
+      {
+         if (results[i] != 0)
+         {
+            const int value = (int)(i % VersionCount);
+            if (version != -1 && version != value)
+            {
+               return -1;
+            }
+            version = value;
+            ++passedCount;
+         }
+      }
+      return passedCount == BatchRepeats ? version : -1;
+   }
+
+   // Readers evaluate batches while versions are published one after another, alternating between
+   // parsing a string and copying an expression compiled elsewhere. Every batch has to match exactly
+   // one version, and no reader can see a version older than one it has already seen.
+   void CheckConcurrentReaders(TestReport& report)
+   {
+      ExpressionHolder holder;
+      report.Check(holder.Publish(WriteVersion(0)) == ExpressionHolder::ParseResult::OK, "Failed to publish the first version");
+
+      std::vector<int> values(VersionCount * BatchRepeats);
+      for (size_t i = 0; i < values.size(); ++i)
+      {
+         values[i] = (int)(i % VersionCount);
+      }
+
+      std::atomic<bool> isPublishing = true;
+      std::atomic<int> mismatchCount = 0;
+      std::atomic<int> backwardsCount = 0;
+      std::atomic<int> batchCount = 0;
+      std::vector<std::thread> readers;
+      for (int i = 0; i < ReaderThreadCount; ++i)
+      {
+         std::optional<ExpressionHolder::Reader> reader = holder.CreateReader();
+         report.Check(reader.has_value(), "Failed to create reader " + std::to_string(i));
+         if (reader.has_value() == false)
+         {
+            continue;
+         }
+
+         readers.emplace_back([&, reader = std::move(*reader)]() mutable
+         {
+            std::vector<uint8_t> results(values.size());
+            int lastVersion = 0;
+            do
+            {
+               reader.Evaluate(values, results);
+               const int version = FindVersion(results);
+               mismatchCount += version == -1 ? 1 : 0;
+               backwardsCount += version != -1 && version < lastVersion ? 1 : 0;
+               lastVersion = version == -1 ? lastVersion : version;
+               ++batchCount;
+            } while (isPublishing.load());
+         });
+      }
+
+      ExpressionParser parser;
+      for (int version = 1; version < VersionCount; ++version)
+      {
+         // Wait for a batch per version so far, keeping the readers busy for the whole run
+         while (readers.empty() == false && batchCount.load() < version)
+         {
+            std::this_thread::yield();
+         }
+
+         if (version % 2 == 0)
+         {
+            report.Check(holder.Publish(WriteVersion(version)) == ExpressionHolder::ParseResult::OK, "Failed to publish version " + std::to_string(version));
+         }
+         else
+         {
+            parser.Clear();
+            parser.Parse(WriteVersion(version));
+            holder.Publish(parser.GetCompiledExpression());
+         }
+      }
+      isPublishing = false;
+      for (std::thread& thread : readers)
+      {
+         thread.join();
+      }
+
+      report.Check(mismatchCount == 0, std::to_string(mismatchCount.load()) + " of " + std::to_string(batchCount.load()) + " batches matched no single published version");
+      report.Check(backwardsCount == 0, std::to_string(backwardsCount.load()) + " batches went back to an older version");
+
+      // Every reader has left, so nothing retired can still be in use
+      report.Check(holder.Reclaim() == 0 && holder.GetRetiredCount() == 0, "Expressions were left retired once every reader had finished");
+      std::optional<ExpressionHolder::Reader> reader = holder.CreateReader();
+      report.Check(reader.has_value() && reader->Evaluate(VersionCount - 1) && reader->Evaluate(VersionCount - 2) == false, "The last version published isn't live");
+   }
+
+   // A reader inside an evaluation holds back everything retired while it's there, and only that
+   // long.
+   void CheckReclaim(TestReport& report)
+   {
+      ExpressionHolder holder;
+      std::optional<ExpressionHolder::Reader> reader = holder.CreateReader();
+      report.Check(reader.has_value() && reader->Evaluate(0) == false, "An empty holder passed a value");
+
+      holder.Publish("<5");
+      report.Check(holder.Reclaim() == 0, "The empty expression was kept with no reader inside");
+
+      const size_t heldCount = reader->Read([&holder](const ExpressionHolder::Compiled& expression)
+      {
+         holder.Publish(">10");
+         holder.Publish("=7");
+         return expression.Evaluate(4) ? holder.Reclaim() : 0;
+      });
+      report.Check(heldCount == 2, "A reader inside an evaluation held back " + std::to_string(heldCount) + " retired expressions rather than 2");
+      report.Check(holder.Reclaim() == 0 && holder.GetRetiredCount() == 0, "Retired expressions were kept after the reader left");
+      report.Check(reader->Evaluate(7) && reader->Evaluate(4) == false, "The last expression published isn't live");
+   }
+
+   // Readers are limited to the capacity, with a slot freed when the reader holding it is destroyed
+   // and not when one is moved from.
+   void CheckCapacity(TestReport& report)
+   {
+      constexpr size_t Capacity = 3;
+      ExpressionHolder holder(Capacity);
+      std::vector<std::optional<ExpressionHolder::Reader>> readers;
+      for (size_t i = 0; i < Capacity; ++i)
+      {
+         readers.push_back(holder.CreateReader());
+         report.Check(readers.back().has_value(), "Failed to create reader " + std::to_string(i) + " of " + std::to_string(Capacity));
+      }
+      report.Check(holder.CreateReader().has_value() == false, "Created a reader past the capacity");
+
+      std::optional<ExpressionHolder::Reader> moved = std::move(*readers[0]);
+      readers[0].reset();
+      report.Check(holder.CreateReader().has_value() == false, "Destroying a moved from reader freed its slot");
+
+      moved.reset();
+      std::optional<ExpressionHolder::Reader> reader = holder.CreateReader();
+      report.Check(reader.has_value(), "Destroying a reader didn't free its slot");
+      report.Check(holder.CreateReader().has_value() == false, "Created a reader past the capacity once a slot was reused");
+   }
+
+   // Anything failing to parse reports the error and leaves the rule that was live in place.
+   void CheckFailedPublish(TestReport& report)
+   {
+      ExpressionHolder holder;
+      std::optional<ExpressionHolder::Reader> reader = holder.CreateReader();
+      holder.Publish("<5");
+      const size_t retiredCount = holder.GetRetiredCount();
+
+      for (const char* pInvalid : { "<5 and $", ">", "<5)", "" })
+      {
+         const ExpressionHolder::ParseResult result = holder.Publish(pInvalid);
+         report.Check(result != ExpressionHolder::ParseResult::OK && holder.GetErrorMessage().empty() == false, "Published \"" + std::string(pInvalid) + "\" without an error");
+         report.Check(reader->Evaluate(4) && reader->Evaluate(5) == false, "Failing to publish \"" + std::string(pInvalid) + "\" replaced the live rule");
+         report.Check(holder.GetRetiredCount() == retiredCount, "Failing to publish \"" + std::string(pInvalid) + "\" retired the live rule");
+      }
+
+      report.Check(holder.Publish(">5") == ExpressionHolder::ParseResult::OK && reader->Evaluate(6) && reader->Evaluate(4) == false, "Failed to publish after an error");
+   }
+}
+
+bool RunHolderTests()
+{
+   TestReport report("holder");
+
+   CheckConcurrentReaders(report);
+   CheckReclaim(report);
+   CheckCapacity(report);
+   CheckFailedPublish(report);
+   return report.Finish();
+}
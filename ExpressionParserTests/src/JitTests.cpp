@@ -0,0 +1,116 @@
+#include "RandomExpression.h"
+#include "Tests.h"
+
+#include "ExpressionParser.h"
+#include "JitExpression.h"
+
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+   constexpr int ExpressionCount = 2000;
+   constexpr int MaxTerms = 8;
+   constexpr int MaxDepth = 3;
+   constexpr size_t RandomValueCount = 32;
+
+   template <typename T>
+   std::string Describe(const char* pWhat, const char* pStage, const std::string& expression, T value)
+   {
+      std::ostringstream description;
+      description.precision(17);
+      description << pWhat << " " << pStage << " for \"" << expression << "\" with " << value;
+      return description.str();
+   }
+
+   // Check every way of evaluating a single value against the tree the expression was written
+   // from, as the program and the intervals, one at a time and as a batch. 32 bit integer
+   // expressions are also compiled to native code, which has to agree one at a time and as a batch.
+   template <typename T>
+   void CheckExpression(TestReport& report, BasicExpressionParser<T>& parser, const RandomExpression<T>& tree, const std::string& expression, const std::vector<T>& values, const char* pStage)
+   {
+      using EvaluationMode = typename BasicExpressionParser<T>::EvaluationMode;
+
+      std::vector<uint8_t> batch(values.size());
+      parser.SetEvaluationMode(EvaluationMode::Program);
+      parser.Evaluate(values, batch);
+      for (size_t i = 0; i < values.size(); ++i)
+      {
+         const bool expected = tree.Evaluate(values[i]);
+         report.Check(parser.Evaluate(values[i]) == expected, Describe("Program result differs", pStage, expression, values[i]));
+         report.Check((batch[i] != 0) == expected, Describe("Batch result differs", pStage, expression, values[i]));
+      }
+
+      parser.SetEvaluationMode(EvaluationMode::Intervals);
+      for (size_t i = 0; i < values.size(); ++i)
+      {
+         report.Check(parser.Evaluate(values[i]) == tree.Evaluate(values[i]), Describe("Intervals result differs", pStage, expression, values[i]));
+      }
+      parser.SetEvaluationMode(EvaluationMode::Program);
+
+      if constexpr (std::is_same_v<T, int32_t>)
+      {
+         const CompiledExpression& compiled = parser.GetCompiledExpression();
+         const JitExpression jit(compiled);
+         std::vector<uint8_t> jitBatch(values.size());
+         jit.Evaluate(values, jitBatch);
+         for (size_t i = 0; i < values.size(); ++i)
+         {
+            const bool expected = compiled.Evaluate(values[i]);
+            report.Check(jit.Evaluate(values[i]) == expected, Describe("JIT result differs from Evaluate", pStage, expression, values[i]));
+            report.Check((jitBatch[i] != 0) == expected, Describe("JIT batch result differs from Evaluate", pStage, expression, values[i]));
+         }
+      }
+   }
+
+   // Every expression is checked as parsed, then again once optimized for its own values and once
+   // simplified, each of which compiles a different program for the same results.
+   template <typename T>
+   void CheckValueType(TestReport& report, uint32_t seed)
+   {
+      RandomExpression<T> tree(seed);
+      for (int i = 0; i < ExpressionCount; ++i)
+      {
+         tree.Generate(MaxTerms, MaxDepth);
+         const std::string expression = tree.ToString();
+         const std::vector<T> values = tree.GenerateValues(RandomValueCount);
+
+         BasicExpressionParser<T> parser;
+         const bool isParsed = parser.Parse(expression) == BasicExpressionParser<T>::ParseResult::OK;
+         report.Check(isParsed, "Failed to parse \"" + expression + "\": " + parser.GetErrorMessage());
+         if (isParsed == false)
+         {
+            continue;
+         }
+
+         CheckExpression(report, parser, tree, expression, values, "as parsed");
+         report.Check(parser.Optimize(values), "Failed to optimize \"" + expression + "\"");
+         CheckExpression(report, parser, tree, expression, values, "once optimized");
+         parser.Simplify();
+         CheckExpression(report, parser, tree, expression, values, "once simplified");
+      }
+   }
+}
+
+bool RunJitTests()
+{
+   TestReport report("jit");
+
+   // Without native code the JIT falls back on the compiled expression, which would agree with
+   // itself whatever happened, so say so rather than passing quietly
+   const JitExpression probe(CompiledExpression{});
+   if (probe.IsNative() == false)
+   {
+      std::cout << "jit: native code isn't supported here, only the fallback is checked" << std::endl;
+   }
+
+   CheckValueType<int32_t>(report, 1);
+   CheckValueType<int64_t>(report, 2);
+   CheckValueType<float>(report, 3);
+   CheckValueType<double>(report, 4);
+   return report.Finish();
+}
@@ -0,0 +1,248 @@
+#include "RandomExpression.h"
+#include "Tests.h"
+
+#include "ExpressionParser.h"
+#include "RuleFileLoader.h"
+#include "RuleSet.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+   using Format = RuleFileLoader::Format;
+   using LoadResult = RuleFileLoader::LoadResult;
+
+   // Enough rules that the text is split into several chunks of at least 64 KiB each.
+   constexpr int RuleCount = 40000;
+   constexpr unsigned ThreadCount = 4;
+
+   // A rule as it is written in the file, and the line it ends up on.
+   struct SourceRule
+   {
+      std::string m_text;
+      size_t m_line;
+   };
+
+   // Random rules, with every 97th one broken so the errors are spread across every chunk.
+   std::vector<SourceRule> GenerateRules()
+   {
+      RandomExpression<int32_t> tree(5);
+      std::vector<SourceRule> rules(RuleCount);
+      for (int i = 0; i < RuleCount; ++i)
+      {
+         tree.Generate(4, 2);
+         rules[i].m_text = tree.ToString() + (i % 97 == 0 ? " and $" : "");
+      }
+      return rules;
+   }
+
+   // One rule per line, with CRLF line endings and a blank line, or one of whitespace, after
+   // every few rules. The last line has no line break.
+   std::string WriteLines(std::vector<SourceRule>& rules)
+   {
+      std::string text;
+      size_t line = 1;
+      for (size_t i = 0; i < rules.size(); ++i)
+      {
+         rules[i].m_line = line++;
+         text += rules[i].m_text;
+         if (i + 1 < rules.size())
+         {
+            text += "\r\n";
+         }
+         if (i % 5 == 0)
+         {
+            text += i % 2 == 0 ? "\r\n" : " \t \n";
+            ++line;
+         }
+      }
+      return text;
+   }
+
+   // A JSON array, either all on one line as it usually is when generated, or one string per line.
+   std::string WriteJson(std::vector<SourceRule>& rules, bool isMinified)
+   {
+      std::string text = isMinified ? "[" : "[\r\n";
+      size_t line = isMinified ? 1 : 2;
+      for (size_t i = 0; i < rules.size(); ++i)
+      {
+         rules[i].m_line = line;
+         text += (isMinified ? "\"" : "   \"") + rules[i].m_text + "\"";
+         if (i + 1 < rules.size())
+         {
+            text += ",";
+         }
+         if (isMinified == false)
+         {
+            text += "\r\n";
+            ++line;
+         }
+      }
+      return text + "]";
+   }
+
+   // Check every rule was loaded with its index as its id, with the errors reported being those
+   // from parsing each rule on its own, and that the rule set matches the same rules as one built
+   // a rule at a time.
+   void CheckLoaded(TestReport& report, const RuleFileLoader& loader, const std::vector<SourceRule>& rules, const char* pFormat)
+   {
+      const std::string format = pFormat;
+      report.Check(loader.GetRuleCount() == rules.size(), format + ": found " + std::to_string(loader.GetRuleCount()) + " rules rather than " + std::to_string(rules.size()));
+
+      RuleSet expected;
+      std::vector<RuleFileLoader::RuleError> expectedErrors;
+      ExpressionParser parser;
+      for (size_t i = 0; i < rules.size(); ++i)
+      {
+         parser.Clear();
+         if (parser.Parse(rules[i].m_text) == ExpressionParser::ParseResult::OK)
+         {
+            expected.Add((RuleSet::RuleId)i, parser.GetCompiledExpression());
+         }
+         else
+         {
+            expectedErrors.push_back({ i, rules[i].m_line, parser.GetResultCode(), parser.GetErrorLocation(), parser.GetErrorMessage() });
+         }
+      }
+      expected.Build();
+
+      report.Check(loader.GetErrors().size() == expectedErrors.size(), format + ": reported " + std::to_string(loader.GetErrors().size()) + " errors rather than " + std::to_string(expectedErrors.size()));
+      for (size_t i = 0; i < std::min(loader.GetErrors().size(), expectedErrors.size()); ++i)
+      {
+         const RuleFileLoader::RuleError& error = loader.GetErrors()[i];
+         const RuleFileLoader::RuleError& expectedError = expectedErrors[i];
+         std::ostringstream description;
+         description << format << ": error " << i << " is rule " << error.m_ruleIndex << " on line " << error.m_line << " at " << error.m_location
+            << " rather than rule " << expectedError.m_ruleIndex << " on line " << expectedError.m_line << " at " << expectedError.m_location;
+         report.Check(error.m_ruleIndex == expectedError.m_ruleIndex && error.m_line == expectedError.m_line && error.m_result == expectedError.m_result
+            && error.m_location == expectedError.m_location && error.m_message == expectedError.m_message, description.str());
+      }
+
+      report.Check(loader.GetRuleSet().GetRuleCount() == expected.GetRuleCount(), format + ": rule set holds " + std::to_string(loader.GetRuleSet().GetRuleCount()) + " rules rather than " + std::to_string(expected.GetRuleCount()));
+      std::vector<RuleSet::RuleId> matches;
+      std::vector<RuleSet::RuleId> expectedMatches;
+      for (int value = -1100; value <= 1100; value += 7)
+      {
+         loader.GetRuleSet().Match(value, matches);
+         expected.Match(value, expectedMatches);
+         std::sort(matches.begin(), matches.end());
+         std::sort(expectedMatches.begin(), expectedMatches.end());
+         report.Check(matches == expectedMatches, format + ": matches differ for " + std::to_string(value));
+      }
+   }
+
+   void CheckLoad(TestReport& report, std::vector<SourceRule>& rules, const std::string& text, Format format, const char* pFormat)
+   {
+      RuleFileLoader loader(ThreadCount);
+      const LoadResult result = loader.Load(text, format);
+      report.Check(result == LoadResult::OK, std::string(pFormat) + ": failed to load, with the JSON invalid on line " + std::to_string(loader.GetInvalidJsonLine()));
+      CheckLoaded(report, loader, rules, pFormat);
+   }
+
+   // JSON escapes are undone before parsing, so these are the same as the rules written plainly.
+   void CheckEscapes(TestReport& report)
+   {
+      RuleFileLoader loader(ThreadCount);
+      const LoadResult result = loader.Load(R"(["\u003c5", "\u003E10 and \u003c=20", "\t>=\u0030", "<5 \/", "\"<5\"", "<5 \u00e9"])", Format::Json);
+      report.Check(result == LoadResult::OK, "Failed to load escaped JSON strings");
+      report.Check(loader.GetRuleCount() == 6, "Found " + std::to_string(loader.GetRuleCount()) + " escaped JSON strings rather than 6");
+
+      std::vector<RuleSet::RuleId> matches;
+      const std::pair<int, std::vector<RuleSet::RuleId>> expected[] = { { 4, { 0, 2 } }, { 15, { 1, 2 } }, { -1, { 0 } } };
+      for (const auto& [value, expectedMatches] : expected)
+      {
+         loader.GetRuleSet().Match(value, matches);
+         std::sort(matches.begin(), matches.end());
+         report.Check(matches == expectedMatches, "Escaped JSON strings match the wrong rules for " + std::to_string(value));
+      }
+
+      // A '/', quotes and anything outside of ASCII are all invalid characters once unescaped
+      report.Check(loader.GetErrors().size() == 3, "Escaped JSON strings reported " + std::to_string(loader.GetErrors().size()) + " errors rather than 3");
+      for (size_t i = 0; i < std::min<size_t>(loader.GetErrors().size(), 3); ++i)
+      {
+         const RuleFileLoader::RuleError& error = loader.GetErrors()[i];
+         report.Check(error.m_ruleIndex == i + 3 && error.m_result == ExpressionParser::ParseResult::ParsingInvalidCharacter,
+            "Escaped JSON string error " + std::to_string(i) + " is for rule " + std::to_string(error.m_ruleIndex) + " with result " + std::to_string((int)error.m_result));
+      }
+   }
+
+   // Anything other than one array of strings is invalid, with the rules before the point it
+   // stopped being valid still loaded.
+   void CheckInvalidJson(TestReport& report)
+   {
+      struct Case
+      {
+         std::string_view m_text;
+         size_t m_line;
+         size_t m_ruleCount;
+      };
+
+      const Case cases[] =
+      {
+         { "", 1, 0 },
+         { "  \n ", 2, 0 },
+         { "\"<5\"", 1, 0 },
+         { "[", 1, 0 },
+         { "[\n\"<5\"", 2, 1 },
+         { "[\"<5\" \">10\"]", 1, 1 },
+         { "[\"<5\" \">10\"]]]] [[", 1, 1 },
+         { "[\"<5\",]", 1, 1 },
+         { "[,\"<5\"]", 1, 0 },
+         { "[\"<5\"],", 1, 1 },
+         { "[\"<5\"]\n\nx", 3, 1 },
+         { "[\"<5\"][]", 1, 1 },
+         { "[5]", 1, 0 },
+         { "[\"<5\",\n\">10\",\n>20]", 3, 2 },
+         { "[\"<5\",\n\"<10\n\"]", 2, 1 },
+         { "[\"<5\", \"<5\t\"]", 1, 1 },
+         { "[\"<5\", \"\\x\"]", 1, 1 },
+         { "[\"<5\", \"\\u12g4\"]", 1, 1 },
+         { "[\"<5\", \"\\u12\"]", 1, 1 },
+         { "[\"<5\", \"\\", 1, 1 },
+         { "[\"<5\", \"<10", 1, 1 },
+      };
+
+      RuleFileLoader loader(ThreadCount);
+      for (const Case& invalid : cases)
+      {
+         const std::string text(invalid.m_text);
+         const LoadResult result = loader.Load(text, Format::Json);
+         report.Check(result == LoadResult::InvalidJson, "Loaded invalid JSON: " + text);
+         report.Check(loader.GetInvalidJsonLine() == invalid.m_line, "Invalid JSON reported on line " + std::to_string(loader.GetInvalidJsonLine()) + " rather than " + std::to_string(invalid.m_line) + ": " + text);
+         report.Check(loader.GetRuleCount() == invalid.m_ruleCount && loader.GetRuleSet().GetRuleCount() == invalid.m_ruleCount,
+            "Loaded " + std::to_string(loader.GetRuleCount()) + " rules rather than " + std::to_string(invalid.m_ruleCount) + " before invalid JSON: " + text);
+      }
+
+      const std::string_view valid[] = { "[]", " [ ] \r\n", "[\"<5\"]", "\r\n[\r\n\"<5\" ,\r\n \">10\"\r\n]\r\n" };
+      for (const std::string_view text : valid)
+      {
+         report.Check(loader.Load(text, Format::Json) == LoadResult::OK, "Failed to load valid JSON: " + std::string(text));
+      }
+      report.Check(loader.GetRuleCount() == 2 && loader.GetRuleSet().GetRuleCount() == 2, "Failed to load both rules from valid JSON");
+   }
+}
+
+bool RunLoaderTests()
+{
+   TestReport report("loader");
+
+   std::vector<SourceRule> rules = GenerateRules();
+   const std::string lines = WriteLines(rules);
+   CheckLoad(report, rules, lines, Format::Lines, "lines");
+   CheckLoad(report, rules, lines, Format::Auto, "lines detected");
+
+   const std::string minified = WriteJson(rules, true);
+   CheckLoad(report, rules, minified, Format::Json, "minified JSON");
+   CheckLoad(report, rules, minified, Format::Auto, "minified JSON detected");
+   const std::string json = WriteJson(rules, false);
+   CheckLoad(report, rules, json, Format::Json, "JSON");
+
+   CheckEscapes(report);
+   CheckInvalidJson(report);
+   return report.Finish();
+}
@@ -0,0 +1,105 @@
+#include "Tests.h"
+
+#include "ExpressionParser.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace
+{
+   template <typename T>
+   void CheckParse(TestReport& report, std::string_view expression, typename BasicExpressionParser<T>::ParseResult expected)
+   {
+      BasicExpressionParser<T> parser;
+      std::ostringstream description;
+      description << "\"" << expression << "\" parsed as " << (int)parser.Parse(expression) << " rather than " << (int)expected;
+      report.Check(parser.Parse(expression) == expected, description.str());
+   }
+
+   // Check the expression parses, and that it passes exactly the values expected of those given.
+   template <typename T>
+   void CheckValues(TestReport& report, std::string_view expression, std::initializer_list<T> passing, std::initializer_list<T> failing)
+   {
+      BasicExpressionParser<T> parser;
+      const bool isParsed = parser.Parse(expression) == BasicExpressionParser<T>::ParseResult::OK;
+      report.Check(isParsed, "Failed to parse \"" + std::string(expression) + "\": " + parser.GetErrorMessage());
+      if (isParsed == false)
+      {
+         return;
+      }
+
+      for (const T value : passing)
+      {
+         std::ostringstream description;
+         description << "\"" << expression << "\" fails " << value;
+         report.Check(parser.Evaluate(value), description.str());
+      }
+      for (const T value : failing)
+      {
+         std::ostringstream description;
+         description << "\"" << expression << "\" passes " << value;
+         report.Check(parser.Evaluate(value) == false, description.str());
+      }
+   }
+
+   // Infinity is a value like any other for floating point, so it can start a range as well as end
+   // one. Anywhere else a word is a field name, as is "inf" for integers.
+   template <typename T>
+   void CheckInfinityRanges(TestReport& report)
+   {
+      using ParseResult = typename BasicExpressionParser<T>::ParseResult;
+
+      constexpr T inf = std::numeric_limits<T>::infinity();
+      constexpr T max = std::numeric_limits<T>::max();
+      CheckValues<T>(report, "inf..inf", { inf }, { max, 0, -inf });
+      CheckValues<T>(report, "infinity .. inf", { inf }, { max, 0, -inf });
+      CheckValues<T>(report, "-inf..5", { -inf, 0, 5 }, { 6, inf });
+      CheckValues<T>(report, "inf..inf or <0", { inf, -1 }, { 0, max });
+      CheckValues<T>(report, "(inf..inf)", { inf }, { max });
+      CheckValues<T>(report, "in{inf..inf, 1}", { inf, 1 }, { max, 0 });
+      CheckParse<T>(report, "inf..5", ParseResult::InvalidExpression);
+      CheckParse<T>(report, "inf", ParseResult::UnknownField);
+   }
+
+   // Once simplified, every comparison compiled has to be read from a single term of the
+   // expression, a merged one from the term its value came from rather than all it replaced.
+   void CheckSimplifiedSources(TestReport& report, std::string_view expression, std::initializer_list<std::string_view> expected)
+   {
+      ExpressionParser parser;
+      parser.Parse(expression);
+      parser.Simplify();
+
+      std::ostringstream description;
+      description << "\"" << expression << "\" simplified is read from";
+      bool isPassing = parser.GetCompiledExpression().GetSourceRanges().size() == expected.size();
+      for (const CompiledExpression::SourceRange& source : parser.GetCompiledExpression().GetSourceRanges())
+      {
+         const std::string_view text = expression.substr(source.m_at, source.m_length);
+         isPassing = isPassing && std::find(expected.begin(), expected.end(), text) != expected.end();
+         description << " \"" << text << "\"";
+      }
+      report.Check(isPassing, description.str());
+   }
+}
+
+bool RunParserTests()
+{
+   TestReport report("parser");
+
+   CheckInfinityRanges<float>(report);
+   CheckInfinityRanges<double>(report);
+   CheckParse<int32_t>(report, "inf..5", ExpressionParser::ParseResult::UnknownField);
+   CheckParse<int64_t>(report, "inf..5", Int64ExpressionParser::ParseResult::UnknownField);
+
+   CheckSimplifiedSources(report, "=5 or >7 or >5", { ">5" });
+   CheckSimplifiedSources(report, ">=5 and !=5", { "!=5" });
+   CheckSimplifiedSources(report, "in{1..5} or <1 or =6", { "=6" });
+   CheckSimplifiedSources(report, "(=1 or =2) or <1", { "=2" });
+   CheckSimplifiedSources(report, ">=5 and <9 and !=5", { ">=5", "<9", "!=5" });
+   return report.Finish();
+}
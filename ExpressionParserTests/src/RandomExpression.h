@@ -0,0 +1,357 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Random expressions built as a tree, which is both written out as an expression string and
+// evaluated directly with the language's own comparisons. Checking the parser against the tree
+// never relies on any of the parser's code being right.
+template <typename T>
+class RandomExpression
+{
+public:
+   // A chain of terms joined by "and" or "or", with AND binding tighter just as when parsing.
+   struct Group;
+
+   struct Term
+   {
+      enum Type : uint8_t
+      {
+         Comparison,
+         Set,
+         Range,
+         Braced,
+      };
+
+      Type m_type;
+
+      // The column compared, named "f<column>" when the expression has more than one field, or -1
+      // for the single value of an expression without named fields.
+      int m_field;
+
+      // Comparisons use the operator and value, ranges the first member and sets all of them.
+      const char* m_pOperator;
+      T m_value;
+      bool m_isNegated;
+      std::vector<std::pair<T, T>> m_members;
+      std::unique_ptr<Group> m_pGroup;
+   };
+
+   struct Group
+   {
+      std::vector<Term> m_terms;
+
+      // Whether each term after the first is joined to the one before by "or".
+      std::vector<bool> m_isOr;
+   };
+
+   explicit RandomExpression(uint32_t seed)
+      : m_random(seed)
+   {}
+
+   // Generate a new expression of up to the given number of terms and depth of braces. With more
+   // than one field every comparison names one of them, to be bound to its column as "f<column>".
+   void Generate(int maxTerms, int maxDepth, int fieldCount = 1)
+   {
+      m_constants.clear();
+      m_fieldCount = fieldCount;
+      m_root = GenerateGroup(maxTerms, maxDepth);
+   }
+
+   std::string ToString() const { return ToString(m_root); }
+
+   bool Evaluate(T value) const { return Evaluate(m_root, std::span<const T>(&value, 1)); }
+
+   // Evaluate a row with a column per field.
+   bool EvaluateRow(std::span<const T> row) const { return Evaluate(m_root, row); }
+
+   // Values worth checking the expression with: the ends of the range, infinities and NaN for
+   // floating point, every constant in the expression along with its neighbours, and a few more
+   // picked at random.
+   std::vector<T> GenerateValues(size_t randomCount)
+   {
+      std::vector<T> values = { std::numeric_limits<T>::lowest(), std::numeric_limits<T>::max(), T(0), T(1), T(-1) };
+      if constexpr (std::is_floating_point_v<T>)
+      {
+         values.insert(values.end(), { std::numeric_limits<T>::infinity(), -std::numeric_limits<T>::infinity(),
+            std::numeric_limits<T>::quiet_NaN(), std::numeric_limits<T>::denorm_min(), -T(0) });
+      }
+      else
+      {
+         values.insert(values.end(), { std::numeric_limits<T>::lowest() + 1, std::numeric_limits<T>::max() - 1 });
+      }
+
+      for (const T constant : m_constants)
+      {
+         values.push_back(constant);
+         values.push_back(Previous(constant));
+         values.push_back(Next(constant));
+      }
+      for (size_t i = 0; i < randomCount; ++i)
+      {
+         values.push_back(RandomConstant());
+      }
+      return values;
+   }
+
+private:
+   Group GenerateGroup(int maxTerms, int maxDepth)
+   {
+      Group group;
+      const int termCount = std::uniform_int_distribution<int>(1, maxTerms)(m_random);
+      for (int i = 0; i < termCount; ++i)
+      {
+         if (i > 0)
+         {
+            group.m_isOr.push_back(std::bernoulli_distribution(0.5)(m_random));
+         }
+         group.m_terms.push_back(GenerateTerm(maxTerms, maxDepth));
+      }
+      return group;
+   }
+
+   Term GenerateTerm(int maxTerms, int maxDepth)
+   {
+      static const char* const s_operators[] = { "<", "<=", "=", "!=", ">=", ">" };
+
+      Term term{ Term::Comparison, -1, nullptr, T(0), false, {}, nullptr };
+      if (m_fieldCount > 1)
+      {
+         term.m_field = std::uniform_int_distribution<int>(0, m_fieldCount - 1)(m_random);
+      }
+
+      const int kind = std::uniform_int_distribution<int>(0, 9)(m_random);
+      if (kind == 0 && maxDepth > 0)
+      {
+         term.m_type = Term::Braced;
+         term.m_pGroup = std::make_unique<Group>(GenerateGroup(maxTerms, maxDepth - 1));
+      }
+      else if (kind <= 2)
+      {
+         term.m_type = Term::Set;
+         term.m_isNegated = std::bernoulli_distribution(0.5)(m_random);
+         const int memberCount = std::uniform_int_distribution<int>(1, 6)(m_random);
+         for (int i = 0; i < memberCount; ++i)
+         {
+            term.m_members.push_back(RandomMember());
+         }
+      }
+      else if (kind == 3)
+      {
+         term.m_type = Term::Range;
+         term.m_members.push_back(RandomMember());
+      }
+      else
+      {
+         term.m_pOperator = s_operators[std::uniform_int_distribution<int>(0, 5)(m_random)];
+         term.m_value = RandomConstant();
+      }
+
+      for (const auto& [min, max] : term.m_members)
+      {
+         m_constants.push_back(min);
+         m_constants.push_back(max);
+      }
+      if (term.m_type == Term::Comparison)
+      {
+         m_constants.push_back(term.m_value);
+      }
+      return term;
+   }
+
+   // Mostly small numbers, so terms overlap, with the ends of the range now and then.
+   T RandomConstant()
+   {
+      const int kind = std::uniform_int_distribution<int>(0, 19)(m_random);
+      if (kind == 0)
+      {
+         return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+      }
+      if (kind == 1)
+      {
+         return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+      }
+      if (kind == 2)
+      {
+         return std::numeric_limits<T>::lowest();
+      }
+      if (kind == 3)
+      {
+         return std::numeric_limits<T>::max();
+      }
+
+      const T value = (T)std::uniform_int_distribution<int>(-50, 50)(m_random);
+      if constexpr (std::is_floating_point_v<T>)
+      {
+         if (kind == 4)
+         {
+            return value + T(0.5);
+         }
+      }
+      return value;
+   }
+
+   std::pair<T, T> RandomMember()
+   {
+      const T min = RandomConstant();
+      if (std::bernoulli_distribution(0.5)(m_random))
+      {
+         return { min, min };
+      }
+
+      // Members reaching past the largest value stop there, bar infinity which has nowhere to go
+      const T length = (T)std::uniform_int_distribution<int>(0, 10)(m_random);
+      return { min, min > std::numeric_limits<T>::max() - length ? std::max(min, std::numeric_limits<T>::max()) : (T)(min + length) };
+   }
+
+   static T Previous(T value)
+   {
+      if constexpr (std::is_floating_point_v<T>)
+      {
+         return std::nextafter(value, -std::numeric_limits<T>::infinity());
+      }
+      else
+      {
+         return value == std::numeric_limits<T>::lowest() ? value : value - 1;
+      }
+   }
+
+   static T Next(T value)
+   {
+      if constexpr (std::is_floating_point_v<T>)
+      {
+         return std::nextafter(value, std::numeric_limits<T>::infinity());
+      }
+      else
+      {
+         return value == std::numeric_limits<T>::max() ? value : value + 1;
+      }
+   }
+
+   // The shortest string reading back as exactly the same value.
+   static std::string ToString(T value)
+   {
+      if constexpr (std::is_floating_point_v<T>)
+      {
+         if (std::isinf(value))
+         {
+            return value > 0 ? "inf" : "-inf";
+         }
+      }
+
+      char buffer[64];
+      const std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+      return std::string(buffer, result.ptr);
+   }
+
+   static std::string ToString(const Group& group)
+   {
+      std::string expression;
+      for (size_t i = 0; i < group.m_terms.size(); ++i)
+      {
+         if (i > 0)
+         {
+            expression += group.m_isOr[i - 1] ? " or " : " and ";
+         }
+         expression += ToString(group.m_terms[i]);
+      }
+      return expression;
+   }
+
+   static std::string ToString(const Term& term)
+   {
+      const std::string field = term.m_field >= 0 ? "f" + std::to_string(term.m_field) : std::string();
+      switch (term.m_type)
+      {
+         case Term::Comparison:
+            return field + term.m_pOperator + ToString(term.m_value);
+
+         case Term::Range:
+            return field + (field.empty() ? "" : " ") + ToString(term.m_members[0].first) + ".." + ToString(term.m_members[0].second);
+
+         case Term::Braced:
+            return "(" + ToString(*term.m_pGroup) + ")";
+
+         case Term::Set:
+         {
+            std::string set = field + (field.empty() ? "" : " ") + (term.m_isNegated ? "notin{" : "in{");
+            for (size_t i = 0; i < term.m_members.size(); ++i)
+            {
+               const auto& [min, max] = term.m_members[i];
+               set += (i > 0 ? ", " : "") + ToString(min);
+               if (max != min)
+               {
+                  set += ".." + ToString(max);
+               }
+            }
+            return set + "}";
+         }
+      }
+      return std::string();
+   }
+
+   static bool Evaluate(const Group& group, std::span<const T> row)
+   {
+      // An OR of runs of ANDed terms
+      bool passes = false;
+      bool runPasses = Evaluate(group.m_terms[0], row);
+      for (size_t i = 1; i < group.m_terms.size(); ++i)
+      {
+         if (group.m_isOr[i - 1])
+         {
+            passes = passes || runPasses;
+            runPasses = Evaluate(group.m_terms[i], row);
+         }
+         else
+         {
+            runPasses = runPasses && Evaluate(group.m_terms[i], row);
+         }
+      }
+      return passes || runPasses;
+   }
+
+   static bool Evaluate(const Term& term, std::span<const T> row)
+   {
+      const T value = row[term.m_field >= 0 ? term.m_field : 0];
+      switch (term.m_type)
+      {
+         case Term::Comparison:
+         {
+            const std::string op = term.m_pOperator;
+            if (op == "<")  { return value < term.m_value; }
+            if (op == "<=") { return value <= term.m_value; }
+            if (op == "=")  { return value == term.m_value; }
+            if (op == "!=") { return value != term.m_value; }
+            if (op == ">=") { return value >= term.m_value; }
+            return value > term.m_value;
+         }
+
+         case Term::Braced:
+            return Evaluate(*term.m_pGroup, row);
+
+         case Term::Range:
+         case Term::Set:
+         {
+            const bool isMember = std::any_of(term.m_members.begin(), term.m_members.end(),
+               [value](const std::pair<T, T>& member) { return member.first <= value && value <= member.second; });
+            return isMember != term.m_isNegated;
+         }
+      }
+      return false;
+   }
+
+private:
+   std::mt19937 m_random;
+   Group m_root;
+   std::vector<T> m_constants;
+   int m_fieldCount = 1;
+};
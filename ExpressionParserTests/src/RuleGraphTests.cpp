@@ -0,0 +1,151 @@
+#include "RandomExpression.h"
+#include "Tests.h"
+
+#include "ExpressionParser.h"
+#include "RuleGraph.h"
+
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+   constexpr int RuleCount = 500;
+   constexpr int MaxTerms = 6;
+   constexpr int MaxDepth = 2;
+   constexpr size_t RandomValueCount = 4;
+
+   // Values around a few blocks of the graph's evaluation, the last block only partly filled.
+   constexpr size_t ValueCount = 1000;
+
+   // Every rule's results from the graph, as a batch and by matching one value at a time, have to
+   // be those of the rule's own compiled expression. Rules are given ids out of order so matches
+   // can't be mistaken for rule indices.
+   void CheckRandomRules(TestReport& report)
+   {
+      RandomExpression<int32_t> tree(41);
+      std::mt19937 random(41);
+      RuleGraph graph;
+      std::vector<std::string> expressions;
+      std::vector<ExpressionParser> parsers(RuleCount);
+      std::vector<int> pool = { std::numeric_limits<int>::min(), std::numeric_limits<int>::max() };
+      for (int i = 0; i < RuleCount; ++i)
+      {
+         tree.Generate(MaxTerms, MaxDepth);
+         expressions.push_back(tree.ToString());
+         const std::vector<int> values = tree.GenerateValues(RandomValueCount);
+         pool.insert(pool.end(), values.begin(), values.end());
+
+         const bool isParsed = parsers[i].Parse(expressions.back()) == ExpressionParser::ParseResult::OK;
+         report.Check(isParsed && graph.Add((RuleGraph::RuleId)(RuleCount - i), expressions.back()) == RuleGraph::ParseResult::OK,
+            "Failed to add \"" + expressions.back() + "\": " + graph.GetErrorMessage());
+      }
+      report.Check(graph.GetRuleCount() == RuleCount, "The graph holds " + std::to_string(graph.GetRuleCount()) + " rules rather than " + std::to_string(RuleCount));
+      report.Check(graph.GetNodeCount() < graph.GetUnsharedNodeCount(), "Random rules shared no nodes");
+
+      std::uniform_int_distribution<size_t> pick(0, pool.size() - 1);
+      std::vector<int> values(ValueCount);
+      for (int& value : values)
+      {
+         value = pool[pick(random)];
+      }
+
+      std::vector<uint8_t> results(graph.GetRuleCount() * values.size());
+      graph.Evaluate(values, results);
+      std::vector<RuleGraph::RuleId> matches;
+      for (size_t j = 0; j < values.size(); ++j)
+      {
+         std::vector<RuleGraph::RuleId> expectedMatches;
+         for (size_t i = 0; i < graph.GetRuleCount(); ++i)
+         {
+            const bool expected = parsers[i].Evaluate(values[j]);
+            report.Check((results[i * values.size() + j] != 0) == expected, "\"" + expressions[i] + "\" differs in the graph for " + std::to_string(values[j]));
+            if (expected)
+            {
+               expectedMatches.push_back(graph.GetRuleId(i));
+            }
+         }
+
+         const size_t count = graph.Match(values[j], matches);
+         report.Check(count == matches.size() && matches == expectedMatches, "Matches differ for " + std::to_string(values[j]));
+      }
+   }
+
+   // Rules written differently that mean the same have to share every node, so adding the second
+   // adds no nodes at all, while a rule that differs by a single value can't share its top node.
+   void CheckSharing(TestReport& report)
+   {
+      struct Case
+      {
+         const char* m_pFirst;
+         const char* m_pSame;
+         const char* m_pDifferent;
+      };
+
+      const Case cases[] =
+      {
+         { "(>=0 and <=100)", "(<=100 and >=0)", "(>=0 and <=101)" },
+         { "<5", "<=4", "<=5" },
+         { ">5", ">=6", ">=5" },
+         { "in{1,2}", "in{2,1}", "in{1,3}" },
+         { "notin{1..3, 7}", "notin{7, 1..3}", "in{1..3, 7}" },
+         { "<-2147483647", "<=-2147483648", "<-2147483646" },
+         { ">2147483646", ">=2147483647", ">2147483645" },
+      };
+
+      for (const Case& shared : cases)
+      {
+         RuleGraph graph;
+         graph.Add(0, shared.m_pFirst);
+         const size_t nodeCount = graph.GetNodeCount();
+         graph.Add(1, shared.m_pSame);
+         report.Check(graph.GetNodeCount() == nodeCount, "\"" + std::string(shared.m_pSame) + "\" added " + std::to_string(graph.GetNodeCount() - nodeCount) + " nodes to \"" + shared.m_pFirst + "\"");
+         graph.Add(2, shared.m_pDifferent);
+         report.Check(graph.GetNodeCount() > nodeCount, "\"" + std::string(shared.m_pDifferent) + "\" shared every node with \"" + shared.m_pFirst + "\"");
+      }
+   }
+
+   // "<v" can't be read as "<=v-1" at the lowest value, nor ">v" as ">=v+1" at the highest, as
+   // both would wrap around and pass everything rather than nothing.
+   void CheckLimits(TestReport& report)
+   {
+      const std::pair<const char*, const char*> cases[] =
+      {
+         { "<-2147483648", "<=2147483647" },
+         { ">2147483647", ">=-2147483648" },
+      };
+
+      const std::vector<int> values = { std::numeric_limits<int>::min(), std::numeric_limits<int>::min() + 1, -1, 0, 1, std::numeric_limits<int>::max() - 1, std::numeric_limits<int>::max() };
+      for (const auto& [pLimit, pWrapped] : cases)
+      {
+         RuleGraph graph;
+         report.Check(graph.Add(0, pWrapped) == RuleGraph::ParseResult::OK, "Failed to add \"" + std::string(pWrapped) + "\"");
+         const size_t nodeCount = graph.GetNodeCount();
+         report.Check(graph.Add(1, pLimit) == RuleGraph::ParseResult::OK, "Failed to add \"" + std::string(pLimit) + "\"");
+         report.Check(graph.GetNodeCount() == nodeCount + 1, "\"" + std::string(pLimit) + "\" was rewritten to share with \"" + pWrapped + "\"");
+
+         std::vector<uint8_t> results(graph.GetRuleCount() * values.size());
+         graph.Evaluate(values, results);
+         std::vector<RuleGraph::RuleId> matches;
+         for (size_t j = 0; j < values.size(); ++j)
+         {
+            const std::string value = std::to_string(values[j]);
+            report.Check(results[j] == 1 && results[values.size() + j] == 0, "\"" + std::string(pLimit) + "\" or \"" + pWrapped + "\" gave the wrong result for " + value);
+            report.Check(graph.Match(values[j], matches) == 1 && matches[0] == 0, "\"" + std::string(pLimit) + "\" matched " + value);
+         }
+      }
+   }
+}
+
+bool RunRuleGraphTests()
+{
+   TestReport report("graph");
+
+   CheckRandomRules(report);
+   CheckSharing(report);
+   CheckLimits(report);
+   return report.Finish();
+}
@@ -0,0 +1,235 @@
+#include "Tests.h"
+
+#include "ExpressionParser.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+   constexpr int RandomSetCount = 300;
+   constexpr int MaxRandomMembers = 300;
+
+   template <typename T>
+   using Interval = typename BasicCompiledExpression<T>::Interval;
+   template <typename T>
+   using Set = typename BasicCompiledExpression<T>::Set;
+   template <typename T>
+   using Kind = typename Set<T>::Kind;
+
+   const char* GetKindName(uint8_t kind)
+   {
+      const char* names[] = { "sorted", "bitmap", "hash" };
+      return kind < std::size(names) ? names[kind] : "unknown";
+   }
+
+   template <typename T>
+   std::string Describe(const std::vector<Interval<T>>& members)
+   {
+      std::ostringstream description;
+      description.precision(17);
+      description << "in{";
+      for (size_t i = 0; i < members.size(); ++i)
+      {
+         description << (i > 0 ? ", " : "") << members[i].m_min;
+         if (members[i].m_max != members[i].m_min)
+         {
+            description << ".." << members[i].m_max;
+         }
+      }
+      description << "}";
+      return description.str();
+   }
+
+   // The values either side of each member and at both of its ends, clamped to the range of T, and
+   // the ends of the range itself.
+   template <typename T>
+   std::vector<T> GenerateValues(const std::vector<Interval<T>>& members)
+   {
+      std::vector<T> values = { std::numeric_limits<T>::lowest(), (T)0, std::numeric_limits<T>::max() };
+      for (const Interval<T>& member : members)
+      {
+         values.push_back(member.m_min);
+         values.push_back(member.m_max);
+         if (member.m_min != std::numeric_limits<T>::lowest())
+         {
+            values.push_back(member.m_min - 1);
+         }
+         if (member.m_max != std::numeric_limits<T>::max())
+         {
+            values.push_back(member.m_max + 1);
+         }
+         if (member.m_max - member.m_min >= 2)
+         {
+            values.push_back(member.m_min + 1);
+         }
+      }
+      return values;
+   }
+
+   // Contains() and Evaluate(), both as it is and negated, have to agree with searching the members
+   // one at a time, as does a parsed "in{...}" evaluated as a batch.
+   template <typename T>
+   void CheckMembership(TestReport& report, const std::vector<Interval<T>>& members, const Set<T>& set)
+   {
+      const std::string description = Describe<T>(members);
+      const std::vector<T> values = GenerateValues<T>(members);
+      std::vector<uint8_t> mask(values.size());
+      std::vector<uint8_t> negatedMask(values.size());
+      set.Evaluate(values.data(), mask.data(), values.size(), false);
+      set.Evaluate(values.data(), negatedMask.data(), values.size(), true);
+
+      // An empty set can't be written
+      BasicExpressionParser<T> parser;
+      const bool isParsed = members.empty() == false && parser.Parse(description) == BasicExpressionParser<T>::ParseResult::OK;
+      report.Check(isParsed || members.empty(), "Failed to parse \"" + description + "\": " + parser.GetErrorMessage());
+      std::vector<uint8_t> results(values.size());
+      parser.Evaluate(values, results);
+
+      for (size_t i = 0; i < values.size(); ++i)
+      {
+         const T value = values[i];
+         const bool expected = std::any_of(members.begin(), members.end(), [value](const Interval<T>& member) { return member.m_min <= value && value <= member.m_max; });
+         const bool isPassing = set.Contains(value) == expected && mask[i] == (expected ? 1 : 0) && negatedMask[i] == (expected ? 0 : 1) && (isParsed == false || results[i] == (expected ? 1 : 0));
+         std::ostringstream failure;
+         if (isPassing == false)
+         {
+            failure << "The " << GetKindName((uint8_t)set.GetKind()) << " set " << description << " gave the wrong result for " << value;
+         }
+         report.Check(isPassing, failure.str());
+      }
+   }
+
+   template <typename T>
+   void CheckSet(TestReport& report, const std::vector<Interval<T>>& members, Kind<T> expectedKind)
+   {
+      const Set<T> set(members);
+      report.Check(set.GetKind() == expectedKind, "The set " + Describe<T>(members) + " is " + GetKindName((uint8_t)set.GetKind()) + " rather than " + GetKindName((uint8_t)expectedKind));
+      CheckMembership<T>(report, members, set);
+   }
+
+   // Lone values count apart from first, sorted as a set needs them.
+   template <typename T>
+   std::vector<Interval<T>> MakeLoneValues(T first, T step, size_t count)
+   {
+      std::vector<Interval<T>> members;
+      for (size_t i = 0; i < count; ++i)
+      {
+         const T value = (T)(first + step * (T)i);
+         members.push_back({ value, value });
+      }
+      return members;
+   }
+
+   // Sets built to land on each kind, near zero, negative and at both ends of the range. Closely
+   // packed members make a bitmap, lone values spread too widely for one make a hash table once
+   // there are enough of them, and anything else stays sorted.
+   template <typename T>
+   void CheckKinds(TestReport& report)
+   {
+      constexpr T lowest = std::numeric_limits<T>::lowest();
+      constexpr T highest = std::numeric_limits<T>::max();
+      constexpr T spread = highest / 64;
+
+      CheckSet<T>(report, { { 1, 1 }, { 3, 5 }, { 9, 9 }, { 60, 70 } }, Kind<T>::Bitmap);
+      CheckSet<T>(report, { { -100, -90 }, { -3, -3 }, { 0, 0 } }, Kind<T>::Bitmap);
+      CheckSet<T>(report, { { lowest, lowest + 2 }, { lowest + 100, lowest + 100 } }, Kind<T>::Bitmap);
+      CheckSet<T>(report, { { highest - 200, highest - 150 }, { highest, highest } }, Kind<T>::Bitmap);
+      CheckSet<T>(report, MakeLoneValues<T>(-1000, 7, 400), Kind<T>::Bitmap);
+
+      CheckSet<T>(report, MakeLoneValues<T>(-spread * 4, spread, 8), Kind<T>::Hash);
+      CheckSet<T>(report, MakeLoneValues<T>(lowest, spread, 64), Kind<T>::Hash);
+      CheckSet<T>(report, MakeLoneValues<T>(-100003 * 500, 100003, 1000), Kind<T>::Hash);
+      std::vector<Interval<T>> limits = MakeLoneValues<T>(-spread * 3, spread, 7);
+      limits.insert(limits.begin(), { lowest, lowest });
+      limits.push_back({ highest, highest });
+      CheckSet<T>(report, limits, Kind<T>::Hash);
+
+      CheckSet<T>(report, MakeLoneValues<T>(-spread * 3, spread, 7), Kind<T>::Sorted);
+      CheckSet<T>(report, { { lowest, lowest }, { highest, highest } }, Kind<T>::Sorted);
+      std::vector<Interval<T>> ranges;
+      for (const Interval<T>& member : MakeLoneValues<T>(lowest + 10, spread, 20))
+      {
+         ranges.push_back({ member.m_min, member.m_min + 5 });
+      }
+      CheckSet<T>(report, ranges, Kind<T>::Sorted);
+      ranges.back().m_max = ranges.back().m_min;
+      ranges.front() = { lowest, lowest + 1 };
+      CheckSet<T>(report, ranges, Kind<T>::Sorted);
+
+      CheckSet<T>(report, {}, Kind<T>::Sorted);
+   }
+
+   // Random sets of every size and spread, lone values and ranges mixed, only checked for membership
+   // as whichever kind they end up.
+   template <typename T>
+   void CheckRandomSets(TestReport& report, uint32_t seed)
+   {
+      const T spreads[] = { 100, 100000, std::numeric_limits<T>::max() / 2 };
+      const int rangeLengths[] = { 0, 0, 3 };
+      std::mt19937 random(seed);
+      for (int i = 0; i < RandomSetCount; ++i)
+      {
+         const int memberCount = std::uniform_int_distribution<int>(1, MaxRandomMembers)(random);
+         const T spread = spreads[i % 3];
+         const int rangeLength = rangeLengths[(i / 3) % 3];
+         std::uniform_int_distribution<T> distribution(-spread, spread);
+
+         std::vector<T> starts(memberCount);
+         for (T& start : starts)
+         {
+            start = distribution(random);
+         }
+         std::sort(starts.begin(), starts.end());
+
+         // Members keep a gap between them, as a set is built with
+         std::vector<Interval<T>> members;
+         for (const T start : starts)
+         {
+            if (members.empty() || start > members.back().m_max + 1)
+            {
+               members.push_back({ start, (T)(start + std::uniform_int_distribution<int>(0, rangeLength)(random)) });
+            }
+         }
+
+         const Set<T> set(members);
+         CheckMembership<T>(report, members, set);
+      }
+   }
+
+   // Floats only ever keep their members sorted.
+   template <typename T>
+   void CheckFloats(TestReport& report)
+   {
+      const std::vector<Interval<T>> members = { { (T)-2.5, (T)-2.5 }, { 0, 1 }, { 3, 3 }, { 5, 5 }, { 7, 7 }, { 9, 9 }, { 11, 11 }, { 13, 13 }, { 15, 15 } };
+      const Set<T> set(members);
+      report.Check(set.GetKind() == Kind<T>::Sorted, std::string("A floating point set is ") + GetKindName((uint8_t)set.GetKind()));
+
+      const T values[] = { (T)-2.5, (T)-2.4, (T)0.5, (T)1.0, (T)1.01, (T)15, std::numeric_limits<T>::quiet_NaN(), std::numeric_limits<T>::infinity() };
+      uint8_t mask[std::size(values)];
+      set.Evaluate(values, mask, std::size(values), false);
+      for (size_t i = 0; i < std::size(values); ++i)
+      {
+         const bool expected = i == 0 || i == 2 || i == 3 || i == 5;
+         report.Check(set.Contains(values[i]) == expected && mask[i] == (expected ? 1 : 0), "A floating point set gave the wrong result for " + std::to_string(values[i]));
+      }
+   }
+}
+
+bool RunSetTests()
+{
+   TestReport report("sets");
+
+   CheckKinds<int32_t>(report);
+   CheckKinds<int64_t>(report);
+   CheckRandomSets<int32_t>(report, 61);
+   CheckRandomSets<int64_t>(report, 62);
+   CheckFloats<float>(report);
+   CheckFloats<double>(report);
+   return report.Finish();
+}
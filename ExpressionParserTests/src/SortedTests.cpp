@@ -0,0 +1,146 @@
+#include "RandomExpression.h"
+#include "Tests.h"
+
+#include "ExpressionParser.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+   constexpr int ExpressionCount = 1000;
+   constexpr int MaxTerms = 8;
+   constexpr int MaxDepth = 3;
+   constexpr size_t RandomValueCount = 16;
+   constexpr size_t ValueCount = 300;
+
+   template <typename T>
+   bool IsNaN(T value)
+   {
+      return value != value;
+   }
+
+   template <typename T>
+   std::string Describe(const char* pWhat, const std::string& expression, size_t index, T value)
+   {
+      std::ostringstream description;
+      description.precision(17);
+      description << pWhat << " for \"" << expression << "\" at " << index << " with " << value;
+      return description.str();
+   }
+
+   // Values picked from those worth checking, with repeats so runs hold more than one value and
+   // every NaN among them several times over.
+   template <typename T>
+   std::vector<T> PickValues(const std::vector<T>& values, std::mt19937& random)
+   {
+      std::uniform_int_distribution<size_t> pick(0, values.size() - 1);
+      std::vector<T> picked(ValueCount);
+      for (T& value : picked)
+      {
+         value = values[pick(random)];
+      }
+      return picked;
+   }
+
+   // Sort with NaN placed last, as EvaluateSorted() needs.
+   template <typename T>
+   std::vector<T> SortValues(std::vector<T> values)
+   {
+      const auto nan = std::stable_partition(values.begin(), values.end(), [](T value) { return IsNaN(value) == false; });
+      std::sort(values.begin(), nan);
+      return values;
+   }
+
+   // The runs appended after those already there have to cover the values from the first to the
+   // last without gaps, each give every value in it the tree's result, and never share a result
+   // with the run before.
+   template <typename T>
+   void CheckRuns(TestReport& report, const BasicExpressionParser<T>& parser, const RandomExpression<T>& tree, const std::string& expression, const std::vector<T>& sorted)
+   {
+      using ResultRun = typename BasicExpressionParser<T>::ResultRun;
+
+      const ResultRun existing = { 7, 3, true };
+      std::vector<ResultRun> runs = { existing };
+      const size_t count = parser.EvaluateSorted(sorted, runs);
+      report.Check(count + 1 == runs.size() && runs[0].m_first == existing.m_first && runs[0].m_count == existing.m_count,
+         "\"" + expression + "\" returned " + std::to_string(count) + " runs but appended " + std::to_string(runs.size() - 1) + ", or changed the run already there");
+
+      size_t next = 0;
+      for (size_t i = 1; i < runs.size(); ++i)
+      {
+         const ResultRun& run = runs[i];
+         report.Check(run.m_first == next && run.m_count > 0, "\"" + expression + "\" has run " + std::to_string(i) + " from " + std::to_string(run.m_first)
+            + " of " + std::to_string(run.m_count) + " values rather than following on from " + std::to_string(next));
+         report.Check(i == 1 || run.m_passes != runs[i - 1].m_passes, "\"" + expression + "\" has runs " + std::to_string(i - 1) + " and " + std::to_string(i) + " with the same result");
+
+         for (size_t at = run.m_first; at < std::min(run.m_first + run.m_count, sorted.size()); ++at)
+         {
+            report.Check(run.m_passes == tree.Evaluate(sorted[at]), Describe("Run result differs", expression, at, sorted[at]));
+         }
+         next = run.m_first + run.m_count;
+      }
+      report.Check(next == sorted.size(), "\"" + expression + "\" has runs covering " + std::to_string(next) + " of " + std::to_string(sorted.size()) + " values");
+   }
+
+   // The same values in their original order, with every result scattered back to where its value
+   // came from. The results start out the opposite of the tree's, so none can be left untouched.
+   template <typename T>
+   void CheckBySorting(TestReport& report, const BasicExpressionParser<T>& parser, const RandomExpression<T>& tree, const std::string& expression, const std::vector<T>& values)
+   {
+      std::vector<uint8_t> results(values.size());
+      for (size_t i = 0; i < values.size(); ++i)
+      {
+         results[i] = tree.Evaluate(values[i]) ? 0 : 1;
+      }
+
+      parser.EvaluateBySorting(values, results);
+      for (size_t i = 0; i < values.size(); ++i)
+      {
+         report.Check((results[i] != 0) == tree.Evaluate(values[i]), Describe("Scattered result differs", expression, i, values[i]));
+      }
+   }
+
+   template <typename T>
+   void CheckValueType(TestReport& report, uint32_t seed)
+   {
+      RandomExpression<T> tree(seed);
+      std::mt19937 random(seed);
+      for (int i = 0; i < ExpressionCount; ++i)
+      {
+         tree.Generate(MaxTerms, MaxDepth);
+         const std::string expression = tree.ToString();
+         const std::vector<T> values = PickValues(tree.GenerateValues(RandomValueCount), random);
+
+         BasicExpressionParser<T> parser;
+         const bool isParsed = parser.Parse(expression) == BasicExpressionParser<T>::ParseResult::OK;
+         report.Check(isParsed, "Failed to parse \"" + expression + "\": " + parser.GetErrorMessage());
+         if (isParsed == false)
+         {
+            continue;
+         }
+
+         CheckRuns(report, parser, tree, expression, SortValues(values));
+         CheckBySorting(report, parser, tree, expression, values);
+
+         std::vector<typename BasicExpressionParser<T>::ResultRun> runs;
+         report.Check(parser.EvaluateSorted(std::span<const T>(), runs) == 0 && runs.empty(), "\"" + expression + "\" found runs in no values");
+      }
+   }
+}
+
+bool RunSortedTests()
+{
+   TestReport report("sorted");
+
+   CheckValueType<int32_t>(report, 31);
+   CheckValueType<int64_t>(report, 32);
+   CheckValueType<float>(report, 33);
+   CheckValueType<double>(report, 34);
+   return report.Finish();
+}
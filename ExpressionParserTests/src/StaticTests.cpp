@@ -0,0 +1,72 @@
+#include "Tests.h"
+
+#include "ExpressionParser.h"
+#include "StaticExpression.h"
+
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+   // Sets and ranges are lowered at compile time too, so these have to hold without ever parsing
+   static_assert(ExpressionParser::Compile("in{1, 4, 10..20}").Evaluate(15));
+   static_assert(ExpressionParser::Compile("in{1, 4, 10..20}").Evaluate(5) == false);
+   static_assert(ExpressionParser::Compile("notin{2, 7} and -5..10").Evaluate(3));
+   static_assert(ExpressionParser::Compile("notin{2, 7} and -5..10").Evaluate(7) == false);
+
+   // Check a compiled literal gives the same result as the literal parsed at runtime, around every
+   // constant in the expressions and at the ends of the range.
+   template <typename T, typename Expression>
+   void CheckStatic(TestReport& report, const Expression& expression, std::string_view source)
+   {
+      BasicExpressionParser<T> parser;
+      const bool isParsed = parser.Parse(source) == BasicExpressionParser<T>::ParseResult::OK;
+      report.Check(isParsed, "Failed to parse \"" + std::string(source) + "\": " + parser.GetErrorMessage());
+      if (isParsed == false)
+      {
+         return;
+      }
+
+      std::vector<T> values = { std::numeric_limits<T>::min(), std::numeric_limits<T>::min() + 1, std::numeric_limits<T>::max() - 1, std::numeric_limits<T>::max() };
+      for (T value = -25; value <= 25; ++value)
+      {
+         values.push_back(value);
+      }
+
+      for (const T value : values)
+      {
+         std::ostringstream description;
+         description << "Compiled \"" << source << "\" differs from parsing it with " << value;
+         report.Check(expression.Evaluate(value) == parser.Evaluate(value), description.str());
+      }
+   }
+
+#define CHECK_STATIC(T, literal) CheckStatic<T>(report, BasicExpressionParser<T>::Compile(literal), literal)
+
+   template <typename T>
+   void CheckValueType(TestReport& report)
+   {
+      CHECK_STATIC(T, ">10 and (<50 or >100) and !=75 or =-5");
+      CHECK_STATIC(T, "in{1, 4, 10..20}");
+      CHECK_STATIC(T, "notin{1, 4, 10..20}");
+      CHECK_STATIC(T, "in{20, 3..5, -10..-8, 4..12, 13, 0}");
+      CHECK_STATIC(T, "notin{0} and (in{-20..-10, 10..20} or =5)");
+      CHECK_STATIC(T, "in{-2147483648..-5, 2147483000..2147483647}");
+      CHECK_STATIC(T, "-3..3 or 10..10 and !=10");
+      CHECK_STATIC(T, "in{7} and in{7, 8}");
+   }
+
+#undef CHECK_STATIC
+}
+
+bool RunStaticTests()
+{
+   TestReport report("static");
+
+   CheckValueType<int32_t>(report);
+   CheckValueType<int64_t>(report);
+   return report.Finish();
+}
@@ -0,0 +1,213 @@
+#include "RandomExpression.h"
+#include "Tests.h"
+
+#include "ExpressionParser.h"
+#include "ExpressionStream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+   constexpr int ExpressionCount = 1000;
+   constexpr int MaxTerms = 8;
+   constexpr int MaxDepth = 3;
+   constexpr size_t RandomValueCount = 16;
+   constexpr size_t SampleCount = 256;
+
+   template <typename T>
+   bool IsNaN(T value)
+   {
+      return value != value;
+   }
+
+   // The same value, telling NaN apart from everything else and -0.0 from 0.0 wouldn't matter.
+   template <typename T>
+   bool IsSameSample(T a, T b)
+   {
+      return a == b || (IsNaN(a) && IsNaN(b));
+   }
+
+   template <typename T>
+   T Previous(T value)
+   {
+      if constexpr (std::is_floating_point_v<T>)
+      {
+         return std::nextafter(value, -std::numeric_limits<T>::infinity());
+      }
+      else
+      {
+         return value - 1;
+      }
+   }
+
+   template <typename T>
+   T Next(T value)
+   {
+      if constexpr (std::is_floating_point_v<T>)
+      {
+         return std::nextafter(value, std::numeric_limits<T>::infinity());
+      }
+      else
+      {
+         return value + 1;
+      }
+   }
+
+   template <typename T>
+   std::string Describe(const char* pWhat, const std::string& expression, size_t sample, T value)
+   {
+      std::ostringstream description;
+      description.precision(17);
+      description << pWhat << " for \"" << expression << "\" at sample " << sample << " with " << value;
+      return description.str();
+   }
+
+   // A slowly changing signal: a walk back and forth over the values worth checking in order, so
+   // most samples stay within a run, with a jump to anywhere or a NaN now and then.
+   template <typename T>
+   std::vector<T> GenerateSamples(const std::vector<T>& values, std::mt19937& random)
+   {
+      std::vector<T> ordered;
+      std::copy_if(values.begin(), values.end(), std::back_inserter(ordered), [](T value) { return IsNaN(value) == false; });
+      std::sort(ordered.begin(), ordered.end());
+
+      std::vector<T> samples;
+      std::uniform_int_distribution<size_t> pick(0, ordered.size() - 1);
+      std::uniform_int_distribution<int> step(0, 19);
+      size_t at = pick(random);
+      for (size_t i = 0; i < SampleCount; ++i)
+      {
+         const int kind = step(random);
+         if (kind == 0 && std::is_floating_point_v<T>)
+         {
+            samples.push_back(std::numeric_limits<T>::quiet_NaN());
+            continue;
+         }
+
+         if (kind == 1)
+         {
+            at = pick(random);
+         }
+         else if (kind < 8)
+         {
+            at = at + 1 < ordered.size() ? at + 1 : at;
+         }
+         else if (kind < 15)
+         {
+            at = at > 0 ? at - 1 : at;
+         }
+         samples.push_back(ordered[at]);
+      }
+      return samples;
+   }
+
+   // Feed the samples one at a time, checking every change reported and every result against the
+   // tree. The run has to hold the sample, give the same result at both ends, and stop where the
+   // result changes, bar at the ends of the range. A NaN leaves an empty run.
+   template <typename T>
+   void CheckUpdates(TestReport& report, BasicExpressionStream<T>& stream, const RandomExpression<T>& tree, const std::string& expression, const std::vector<T>& samples)
+   {
+      constexpr T lowest = std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+      constexpr T highest = std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+
+      bool previous = false;
+      for (size_t i = 0; i < samples.size(); ++i)
+      {
+         const T value = samples[i];
+         const bool expected = tree.Evaluate(value);
+         const bool isChanged = stream.Update(value);
+         report.Check(isChanged == (i == 0 || expected != previous), Describe(isChanged ? "Reported a change that didn't happen" : "Missed a change", expression, i, value));
+         report.Check(stream.GetResult() == expected, Describe("Result differs", expression, i, value));
+         report.Check(stream.GetSampleCount() == i + 1, Describe("Sample count differs", expression, i, value));
+         previous = expected;
+
+         const T min = stream.GetRunMin();
+         const T max = stream.GetRunMax();
+         if (IsNaN(value))
+         {
+            report.Check(min > max, Describe("A NaN left a run that isn't empty", expression, i, value));
+            continue;
+         }
+
+         report.Check(min <= value && value <= max, Describe("The run doesn't hold the value", expression, i, value));
+         report.Check(tree.Evaluate(min) == expected && tree.Evaluate(max) == expected, Describe("The run's ends give a different result", expression, i, value));
+         report.Check(min == lowest || tree.Evaluate(Previous(min)) != expected, Describe("The run stops short below", expression, i, value));
+         report.Check(max == highest || tree.Evaluate(Next(max)) != expected, Describe("The run stops short above", expression, i, value));
+      }
+   }
+
+   // Feed the same samples as a span after resetting, which has to report the same transitions
+   // with the sample indices counting from 0 again.
+   template <typename T>
+   void CheckTransitions(TestReport& report, BasicExpressionStream<T>& stream, const RandomExpression<T>& tree, const std::string& expression, const std::vector<T>& samples)
+   {
+      std::vector<typename BasicExpressionStream<T>::Transition> expected;
+      for (size_t i = 0; i < samples.size(); ++i)
+      {
+         const bool passes = tree.Evaluate(samples[i]);
+         if (expected.empty() || expected.back().m_passes != passes)
+         {
+            expected.push_back({ i, samples[i], passes });
+         }
+      }
+
+      stream.Reset();
+      report.Check(stream.GetSampleCount() == 0 && stream.GetResult() == false && stream.GetRunMin() > stream.GetRunMax(), "\"" + expression + "\" kept its state when reset");
+
+      std::vector<typename BasicExpressionStream<T>::Transition> transitions;
+      const size_t count = stream.Update(samples, transitions);
+      report.Check(count == transitions.size() && transitions.size() == expected.size(),
+         "\"" + expression + "\" had " + std::to_string(transitions.size()) + " transitions rather than " + std::to_string(expected.size()));
+      for (size_t i = 0; i < std::min(transitions.size(), expected.size()); ++i)
+      {
+         const auto& transition = transitions[i];
+         report.Check(transition.m_sample == expected[i].m_sample && IsSameSample(transition.m_value, expected[i].m_value) && transition.m_passes == expected[i].m_passes,
+            Describe("Transition differs", expression, (size_t)transition.m_sample, transition.m_value));
+      }
+      report.Check(stream.GetResult() == tree.Evaluate(samples.back()), "\"" + expression + "\" ended on the wrong result");
+   }
+
+   template <typename T>
+   void CheckValueType(TestReport& report, uint32_t seed)
+   {
+      RandomExpression<T> tree(seed);
+      std::mt19937 random(seed);
+      for (int i = 0; i < ExpressionCount; ++i)
+      {
+         tree.Generate(MaxTerms, MaxDepth);
+         const std::string expression = tree.ToString();
+         const std::vector<T> samples = GenerateSamples(tree.GenerateValues(RandomValueCount), random);
+
+         BasicExpressionParser<T> parser;
+         const bool isParsed = parser.Parse(expression) == BasicExpressionParser<T>::ParseResult::OK;
+         report.Check(isParsed, "Failed to parse \"" + expression + "\": " + parser.GetErrorMessage());
+         if (isParsed == false)
+         {
+            continue;
+         }
+
+         BasicExpressionStream<T> stream(parser.GetCompiledExpression());
+         CheckUpdates(report, stream, tree, expression, samples);
+         CheckTransitions(report, stream, tree, expression, samples);
+      }
+   }
+}
+
+bool RunStreamTests()
+{
+   TestReport report("stream");
+
+   CheckValueType<int32_t>(report, 21);
+   CheckValueType<int64_t>(report, 22);
+   CheckValueType<float>(report, 23);
+   CheckValueType<double>(report, 24);
+   return report.Finish();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// Counts failed checks, printing the first few of them so a broken build doesn't flood the log.
+class TestReport
+{
+public:
+   explicit TestReport(const char* pSuite)
+      : m_pSuite(pSuite)
+      , m_checkCount(0)
+      , m_failureCount(0)
+   {}
+
+   void Check(bool isPassing, const std::string& description)
+   {
+      ++m_checkCount;
+      if (isPassing == false && m_failureCount++ < MaxPrintedFailures)
+      {
+         std::cerr << m_pSuite << ": " << description << std::endl;
+      }
+   }
+
+   // Print a summary, returning true if every check passed.
+   bool Finish() const
+   {
+      std::cout << m_pSuite << ": " << m_checkCount - m_failureCount << " of " << m_checkCount << " checks passed" << std::endl;
+      return m_failureCount == 0;
+   }
+
+private:
+   static constexpr size_t MaxPrintedFailures = 20;
+
+   const char* m_pSuite;
+   size_t m_checkCount;
+   size_t m_failureCount;
+};
+
+// Each suite returns true if every check in it passed.
+bool RunParserTests();
+bool RunStaticTests();
+bool RunJitTests();
+bool RunLoaderTests();
+bool RunArchiveTests();
+bool RunColumnTests();
+bool RunStreamTests();
+bool RunSortedTests();
+bool RunHolderTests();
+bool RunRuleGraphTests();
+bool RunCacheTests();
+bool RunSetTests();
@@ -0,0 +1,65 @@
+#include "Tests.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <iostream>
+
+/*
+   Runs the named test suites, or every suite if none are named, exiting with 1 if any check failed.
+
+   Usage: ExpressionParserTests [suite...]
+*/
+
+namespace
+{
+   struct Suite
+   {
+      const char* m_pName;
+      bool (*m_pRun)();
+   };
+
+   const Suite s_suites[] =
+   {
+      { "parser", RunParserTests },
+      { "static", RunStaticTests },
+      { "jit", RunJitTests },
+      { "loader", RunLoaderTests },
+      { "archive", RunArchiveTests },
+      { "columns", RunColumnTests },
+      { "stream", RunStreamTests },
+      { "sorted", RunSortedTests },
+      { "holder", RunHolderTests },
+      { "graph", RunRuleGraphTests },
+      { "cache", RunCacheTests },
+      { "sets", RunSetTests },
+   };
+}
+
+int main(int argc, char** argv)
+{
+   for (int i = 1; i < argc; ++i)
+   {
+      if (std::none_of(std::begin(s_suites), std::end(s_suites), [argv, i](const Suite& suite) { return std::strcmp(argv[i], suite.m_pName) == 0; }))
+      {
+         std::cerr << "Unknown test suite: " << argv[i] << std::endl;
+         return 1;
+      }
+   }
+
+   bool isPassing = true;
+   for (const Suite& suite : s_suites)
+   {
+      bool isNamed = argc == 1;
+      for (int i = 1; i < argc; ++i)
+      {
+         isNamed = isNamed || std::strcmp(argv[i], suite.m_pName) == 0;
+      }
+
+      if (isNamed)
+      {
+         isPassing = suite.m_pRun() && isPassing;
+      }
+   }
+   return isPassing ? 0 : 1;
+}